@@ -44,6 +44,15 @@ static __thread struct local_info local_info = {
 	.last_port = 0,
 };
 
+/* callback on every trace record */
+static trace_hook_t trace_hook = NULL;
+
+void
+trace_set_hook(trace_hook_t hook)
+{
+	trace_hook = hook;
+}
+
 static int __local_init(void)
 {
 	char buf[16] = {0};
@@ -117,6 +126,9 @@ __record_to_cache(uint8_t loc, uint64_t idx, uint32_t sender,
 	else if (type == TIMESTAMP_TIMESPEC)
 		record->timestamp.u.timespec = *ts;
 
+	if (trace_hook != NULL)
+		trace_hook(loc, sender, idx, &record->timestamp);
+
 //	LOG_DEBUG("RECORD loc %u, port %u, idx %lu, time sec %lu nsec %lu",
 //					loc, sender, idx, ts->tv_sec, ts->tv_nsec);
 
@@ -220,36 +232,47 @@ void
 trace_hw_tx_record(uint8_t portid, struct rte_mbuf *pkt)
 {
 	struct pkt_fmt *fmt = NULL;
-	int wait_us = 0, ret = 0;
-	struct timespec ts = {
-		.tv_sec = 0,
-		.tv_nsec = 0,
-	};
+	uint32_t sender = local_info.last_port;
+	uint64_t idx = local_info.last_idx;
+	int wait_us = 0;
 
 	if (local_info.tid < 0)
 		return;
 
+	if (pkt != NULL) {
+		fmt = rte_pktmbuf_mtod(pkt, struct pkt_fmt *);
+		sender = fmt->probe_sender;
+		idx = fmt->probe_idx;
+	}
+
 	/* Wait at least 1 us to read TX timestamp. */
-	while (((ret = rte_eth_timesync_read_tx_timestamp(portid, &ts)) < 0)
-					&& (wait_us < 1000)) {
+	while (trace_hw_tx_poll(portid, sender, idx) < 0) {
+		if (++wait_us == 1000) {
+			LOG_ERROR("Failed to read HW TX timestamp");
+			return;
+		}
 		rte_delay_us(1);
-		wait_us++;
 	}
+}
 
-	if (wait_us == 1000) {
-		LOG_ERROR("Failed to read HW TX timestamp, ret %d", ret);
-		return;
-	}
+/* try once to read hardware TX timestamp and record it. */
+int
+trace_hw_tx_poll(uint8_t portid, uint32_t sender, uint64_t idx)
+{
+	struct timespec ts = {
+		.tv_sec = 0,
+		.tv_nsec = 0,
+	};
 
-	if (pkt == NULL) {
-		__record_to_cache(LOC_HARDWARE_TX, local_info.last_idx,
-						local_info.last_port, TIMESTAMP_TIMESPEC, &ts);	
-	} else {
-		fmt = rte_pktmbuf_mtod(pkt, struct pkt_fmt *);
-		__record_to_cache(LOC_HARDWARE_TX, fmt->probe_idx,
-						fmt->probe_sender, TIMESTAMP_TIMESPEC, &ts);
-	}
+	if (local_info.tid < 0)
+		return 0;
+
+	if (rte_eth_timesync_read_tx_timestamp(portid, &ts) < 0)
+		return -1;
+
+	__record_to_cache(LOC_HARDWARE_TX, idx, sender, TIMESTAMP_TIMESPEC, &ts);
 	trace_flush();
+	return 0;
 }
 
 /* record hardware RX */
@@ -85,6 +85,22 @@ struct record_fmt {
 
 struct rte_mbuf;
 
+/**
+ * Callback on every trace record, s.t. to match probes on the fly
+ *
+ * Called on the lcore which records the trace.
+ */
+typedef void (*trace_hook_t)(uint8_t loc, uint32_t probe_sender,
+				uint64_t probe_idx, const struct record_ts *ts);
+
+/**
+ * Set the callback on every trace record
+ *
+ * @param hook
+ *	The callback, NULL to remove it
+ */
+void trace_set_hook(trace_hook_t hook);
+
 /**
  * Flush cache: dump all records in the cache to file
  */
@@ -129,6 +145,24 @@ int trace_hw_tx_prepare(uint8_t portid, struct rte_mbuf *buf[], int cnt);
  */
 void trace_hw_tx_record(uint8_t portid, struct rte_mbuf *pkt);
 
+/**
+ * Try once to read hardware TX timestamp and record it, without waiting
+ *
+ * The probe may already be freed. Until the timestamp is read, the NIC
+ * does not latch the one of another probe.
+ *
+ * @param portid
+ *	port which sent the packet
+ * @param sender
+ *	Sender ID of the probe
+ * @param idx
+ *	Probe ID
+ * @return
+ *	- 0 if the timestamp was recorded
+ *	- -1 if the NIC has not latched it yet
+ */
+int trace_hw_tx_poll(uint8_t portid, uint32_t sender, uint64_t idx);
+
 /**
  * Record the receiving of a probe packet
  *
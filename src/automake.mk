@@ -6,9 +6,19 @@ pktsender_CFLAGS = $(AM_CFLAGS)
 pktsender_CPPFLAGS = $(AM_CPPFLAGS) -I pkttracer/
 pktsender_SOURCES = src/main.c \
 					src/pktsender.c \
+					src/capture.c \
+					src/flow.c \
+					src/latency.c \
+					src/pcap.c \
+					src/pcap_stream.c \
 					src/pkt_seq.c \
+					src/pkt_tmpl.c \
 					src/port.c \
 					src/probe.c \
+					src/profile.c \
+					src/rfc2544.c \
+					src/rss.c \
+					src/seqnum.c \
 					src/stat.c \
 					src/transmitter.c
 pktsender_LDADD = libpkttracer.a
@@ -0,0 +1,443 @@
+#include "util.h"
+#include "capture.h"
+#include "pktsender.h"
+#include "port.h"
+
+#include <rte_common.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_cycles.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+/** pcapng block types */
+#define PCAPNG_SHB	0x0A0D0D0A
+#define PCAPNG_IDB	0x00000001
+#define PCAPNG_EPB	0x00000006
+/** Byte-order magic of the section header */
+#define PCAPNG_BOM	0x1A2B3C4D
+/** Interface options */
+#define PCAPNG_OPT_END	0
+#define PCAPNG_OPT_IF_NAME	2
+#define PCAPNG_OPT_IF_TSRESOL	9
+/** Ethernet link type */
+#define PCAPNG_LINKTYPE_ETHERNET	1
+
+/** Section Header Block, without options */
+struct pcapng_shb {
+	uint32_t type;
+	uint32_t len;
+	uint32_t bom;
+	uint16_t major;
+	uint16_t minor;
+	uint64_t section_len;
+	uint32_t len_trailer;
+} __attribute__((__packed__));
+
+/** Fixed part of an Interface Description Block, before the options */
+struct pcapng_idb {
+	uint32_t type;
+	uint32_t len;
+	uint16_t linktype;
+	uint16_t reserved;
+	uint32_t snaplen;
+};
+
+/** Fixed part of an Enhanced Packet Block, before the packet data */
+struct pcapng_epb {
+	uint32_t type;
+	uint32_t len;
+	uint32_t if_id;
+	uint32_t ts_high;
+	uint32_t ts_low;
+	uint32_t caplen;
+	uint32_t origlen;
+};
+
+/** Length of a block carrying len bytes of data, with its trailing length */
+#define PCAPNG_BLOCK_LEN(hdr, len)	\
+	(sizeof(hdr) + RTE_ALIGN_CEIL((len), 4) + sizeof(uint32_t))
+
+/** An RX queue of a captured port */
+struct capture_rxq {
+	/** mbufs from the RX lcore to the writer lcore */
+	struct rte_ring *ring;
+	/** Packets dropped on a full ring, written by the RX lcore */
+	uint64_t nb_drops;
+} __rte_cache_aligned;
+
+/** A captured port */
+struct capture_port {
+	/** Number of RX queues, 0 if the port is not captured */
+	uint8_t nb_rxq;
+	struct capture_rxq rxq[MAX_RXQ_PER_PORT];
+	/** Interface id of the port in the file */
+	uint32_t if_id;
+	/** Packets written, by the writer lcore */
+	uint64_t nb_written;
+	/** Packets discarded after a failed write, by the writer lcore */
+	uint64_t nb_discarded;
+};
+
+/** The capture file, only used by the writer lcore */
+struct capture_file {
+	int fd;
+	/** Write buffer, CAPTURE_ALIGN aligned */
+	uint8_t *buf;
+	/** Number of bytes in buf */
+	size_t len;
+	/** Max number of bytes kept of each packet */
+	uint32_t snaplen;
+	/** Wall clock time in ns at base_tsc */
+	uint64_t base_ns;
+	uint64_t base_tsc;
+	double ns_per_cycle;
+	/** Whether a write failed, the following packets are discarded */
+	uint8_t is_failed;
+};
+
+static struct capture_port *ports = NULL;
+static uint8_t nb_capture_ports = 0;
+static struct capture_file cap = {
+	.fd = -1,
+};
+
+/* append bytes to the buffer, padded with zeros to 4 bytes */
+static inline void
+__capture_put(const void *data, uint32_t len)
+{
+	memcpy(cap.buf + cap.len, data, len);
+	cap.len += len;
+	while (cap.len & 3)
+		cap.buf[cap.len++] = 0;
+}
+
+/* append an interface option */
+static void
+__capture_put_opt(uint16_t code, const void *data, uint16_t len)
+{
+	uint16_t hdr[2] = {code, len};
+
+	__capture_put(hdr, sizeof(hdr));
+	if (len > 0)
+		__capture_put(data, len);
+}
+
+/**
+ * Write the aligned part of the buffer, or all of it
+ *
+ * The unaligned tail is moved to the start of the buffer, so that every
+ * write but the last one starts and ends on a CAPTURE_ALIGN boundary.
+ */
+static int
+__capture_flush(bool all)
+{
+	size_t len = all ? cap.len : RTE_ALIGN_FLOOR(cap.len, CAPTURE_ALIGN);
+	size_t off = 0;
+	ssize_t ret = 0;
+
+	while (off < len) {
+		ret = write(cap.fd, cap.buf + off, len - off);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			LOG_ERROR("Failed to write the capture: %s", strerror(errno));
+			cap.is_failed = 1;
+			return ERR_FILE;
+		}
+		off += ret;
+	}
+
+	memmove(cap.buf, cap.buf + len, cap.len - len);
+	cap.len -= len;
+	return 0;
+}
+
+/* section header and one interface per captured port */
+static void
+__capture_put_header(void)
+{
+	struct pcapng_shb shb = {
+		.type = PCAPNG_SHB,
+		.len = sizeof(shb),
+		.bom = PCAPNG_BOM,
+		.major = 1,
+		.minor = 0,
+		.section_len = UINT64_MAX,
+		.len_trailer = sizeof(shb),
+	};
+	struct pcapng_idb idb = {
+		.type = PCAPNG_IDB,
+		.linktype = PCAPNG_LINKTYPE_ETHERNET,
+		.snaplen = cap.snaplen,
+	};
+	uint8_t tsresol = 9;
+	size_t start = 0;
+	uint32_t len = 0;
+	uint8_t portid = 0;
+	char name[16];
+
+	/* the section length is unknown */
+	__capture_put(&shb, sizeof(shb));
+
+	for (portid = 0; portid < nb_capture_ports; portid++) {
+		if (ports[portid].nb_rxq == 0)
+			continue;
+
+		start = cap.len;
+		__capture_put(&idb, sizeof(idb));
+		snprintf(name, sizeof(name), "port%u", portid);
+		__capture_put_opt(PCAPNG_OPT_IF_NAME, name, strlen(name));
+		__capture_put_opt(PCAPNG_OPT_IF_TSRESOL, &tsresol, 1);
+		__capture_put_opt(PCAPNG_OPT_END, NULL, 0);
+
+		len = cap.len - start + sizeof(len);
+		__capture_put(&len, sizeof(len));
+		memcpy(cap.buf + start + sizeof(uint32_t), &len, sizeof(len));
+	}
+}
+
+/* init the rings and the file */
+int
+capture_init(uint8_t nb_ports, const char *path, uint32_t snaplen)
+{
+	struct timespec ts;
+	char name[32];
+	struct capture_port *cp = NULL;
+	uint8_t portid = 0, lcoreid = 0, q = 0;
+	uint32_t if_id = 0;
+	int socketid = 0;
+
+	ports = (struct capture_port *)rte_zmalloc("capture",
+					nb_ports * sizeof(struct capture_port),
+					RTE_CACHE_LINE_SIZE);
+	if (ports == NULL) {
+		LOG_ERROR("Failed to allocate memory for the capture");
+		return ERR_MEMORY;
+	}
+	nb_capture_ports = nb_ports;
+
+	/* single producer (RX lcore) and single consumer (writer lcore) */
+	for (portid = 0; portid < nb_ports; portid++) {
+		if (!port_is_enabled(portid))
+			continue;
+		lcoreid = port_get_writer_lcore(portid);
+		if (lcoreid == RTE_MAX_LCORE)
+			continue;
+
+		cp = &ports[portid];
+		socketid = rte_lcore_to_socket_id(lcoreid);
+		for (q = 0; q < port_get_nb_rxq(portid); q++) {
+			snprintf(name, sizeof(name), "capture_ring_%u_%u", portid, q);
+			cp->rxq[q].ring = rte_ring_create(name, CAPTURE_RING_SIZE,
+							socketid, RING_F_SP_ENQ | RING_F_SC_DEQ);
+			if (cp->rxq[q].ring == NULL) {
+				LOG_ERROR("Failed to create capture ring %s", name);
+				return ERR_MEMORY;
+			}
+			cp->nb_rxq++;
+		}
+		if (cp->nb_rxq > 0)
+			cp->if_id = if_id++;
+	}
+
+	if (if_id == 0) {
+		LOG_ERROR("--capture needs a (port,W,lcore) mapping");
+		return ERR_PARAM;
+	}
+
+	cap.buf = (uint8_t *)rte_malloc_socket("capture_buf", CAPTURE_BUF_SIZE,
+					CAPTURE_ALIGN, socketid);
+	if (cap.buf == NULL) {
+		LOG_ERROR("Failed to allocate the capture buffer");
+		return ERR_MEMORY;
+	}
+	cap.len = 0;
+	cap.snaplen = snaplen;
+	cap.is_failed = 0;
+
+	cap.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (cap.fd < 0) {
+		LOG_ERROR("Failed to open %s: %s", path, strerror(errno));
+		return ERR_FILE;
+	}
+
+	/* RX TSCs are converted to the wall clock time of the start */
+	clock_gettime(CLOCK_REALTIME, &ts);
+	cap.base_tsc = rte_rdtsc();
+	cap.base_ns = (uint64_t)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+	cap.ns_per_cycle = 1e9 / pktsender.cpu_hz;
+
+	__capture_put_header();
+
+	LOG_INFO("Capture %u port(s) to %s, snaplen %u", if_id, path, snaplen);
+	return 0;
+}
+
+/* hand a burst to the writer lcore */
+uint16_t
+capture_receive(uint8_t portid, uint8_t queueid,
+				struct rte_mbuf **pkts, uint16_t n, uint64_t rx_tsc)
+{
+	struct capture_rxq *rxq = &ports[portid].rxq[queueid];
+	uint16_t i = 0;
+	unsigned nb_enq = 0;
+
+	if (rxq->ring == NULL)
+		return 0;
+
+	for (i = 0; i < n; i++)
+		pkts[i]->udata64 = rx_tsc;
+
+	nb_enq = rte_ring_sp_enqueue_burst(rxq->ring, (void **)pkts, n);
+	rxq->nb_drops += n - nb_enq;
+	return nb_enq;
+}
+
+/* append a packet, copying its segments up to the snaplen */
+static inline void
+__capture_put_pkt(const struct capture_port *cp, const struct rte_mbuf *m)
+{
+	struct pcapng_epb epb;
+	uint64_t ns = 0;
+	uint32_t caplen = RTE_MIN(m->pkt_len, cap.snaplen);
+	uint32_t left = caplen, len = 0;
+
+	if (cap.len + PCAPNG_BLOCK_LEN(epb, caplen) > CAPTURE_BUF_SIZE &&
+			__capture_flush(false) < 0)
+		return;
+
+	ns = cap.base_ns + (uint64_t)((double)(m->udata64 - cap.base_tsc) *
+					cap.ns_per_cycle);
+	epb.type = PCAPNG_EPB;
+	epb.len = PCAPNG_BLOCK_LEN(epb, caplen);
+	epb.if_id = cp->if_id;
+	epb.ts_high = (uint32_t)(ns >> 32);
+	epb.ts_low = (uint32_t)ns;
+	epb.caplen = caplen;
+	epb.origlen = m->pkt_len;
+	memcpy(cap.buf + cap.len, &epb, sizeof(epb));
+	cap.len += sizeof(epb);
+
+	for (; m != NULL && left > 0; m = m->next) {
+		len = RTE_MIN(left, (uint32_t)m->data_len);
+		memcpy(cap.buf + cap.len, rte_pktmbuf_mtod(m, void *), len);
+		cap.len += len;
+		left -= len;
+	}
+	while (cap.len & 3)
+		cap.buf[cap.len++] = 0;
+
+	memcpy(cap.buf + cap.len, &epb.len, sizeof(epb.len));
+	cap.len += sizeof(epb.len);
+}
+
+/* append a burst of a ring, return the number of packets dequeued */
+static unsigned
+__capture_write_ring(struct capture_port *cp, struct rte_ring *ring)
+{
+	struct rte_mbuf *pkts[MAX_PKT_BURST];
+	unsigned n = 0, i = 0;
+
+	n = rte_ring_sc_dequeue_burst(ring, (void **)pkts, MAX_PKT_BURST);
+	if (n == 0)
+		return 0;
+
+	if (unlikely(cap.is_failed)) {
+		cp->nb_discarded += n;
+	} else {
+		/* stop at the first failed write, it is not retried */
+		for (i = 0; i < n && !cap.is_failed; i++)
+			__capture_put_pkt(cp, pkts[i]);
+		/* a failed write loses the packets of the buffer too */
+		if (cap.is_failed)
+			cp->nb_discarded += n;
+		else
+			cp->nb_written += n;
+	}
+	rte_pktmbuf_free_bulk(pkts, n);
+	return n;
+}
+
+/* append a burst of each RX queue of a port */
+void
+capture_write(uint8_t portid)
+{
+	struct capture_port *cp = &ports[portid];
+	uint8_t q = 0;
+
+	for (q = 0; q < cp->nb_rxq; q++)
+		__capture_write_ring(cp, cp->rxq[q].ring);
+}
+
+/* get the counters of a captured port */
+bool
+capture_get_stats(uint8_t portid, uint64_t *written, uint64_t *drops)
+{
+	struct capture_port *cp = NULL;
+	uint8_t q = 0;
+
+	if (ports == NULL || portid >= nb_capture_ports ||
+			ports[portid].nb_rxq == 0)
+		return false;
+
+	cp = &ports[portid];
+	*written = cp->nb_written;
+	*drops = cp->nb_discarded;
+	for (q = 0; q < cp->nb_rxq; q++)
+		*drops += cp->rxq[q].nb_drops;
+	return true;
+}
+
+/* write what the writer lcore left and close the file */
+void
+capture_stop(void)
+{
+	struct capture_port *cp = NULL;
+	uint8_t portid = 0, q = 0;
+
+	if (cap.fd < 0)
+		return;
+
+	for (portid = 0; portid < nb_capture_ports; portid++) {
+		cp = &ports[portid];
+		for (q = 0; q < cp->nb_rxq; q++) {
+			while (__capture_write_ring(cp, cp->rxq[q].ring) > 0)
+				;
+		}
+	}
+
+	if (!cap.is_failed)
+		__capture_flush(true);
+	close(cap.fd);
+	cap.fd = -1;
+}
+
+/* free the rings and the buffer */
+void
+capture_free(void)
+{
+	uint8_t portid = 0, q = 0;
+
+	capture_stop();
+
+	for (portid = 0; portid < nb_capture_ports && ports != NULL; portid++) {
+		for (q = 0; q < MAX_RXQ_PER_PORT; q++) {
+			if (ports[portid].rxq[q].ring != NULL)
+				rte_ring_free(ports[portid].rxq[q].ring);
+		}
+	}
+	if (ports != NULL) {
+		rte_free(ports);
+		ports = NULL;
+	}
+	nb_capture_ports = 0;
+
+	if (cap.buf != NULL) {
+		rte_free(cap.buf);
+		cap.buf = NULL;
+	}
+}
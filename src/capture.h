@@ -0,0 +1,115 @@
+#ifndef _PKTSENDER_CAPTURE_H_
+#define _PKTSENDER_CAPTURE_H_
+
+/**
+ * @file
+ * Capture of received packets to a pcapng file
+ *
+ * With --capture, the RX lcores of every port with a writer mapping
+ * (port,W,lcore) hand the mbufs they receive to the writer lcore through
+ * one single producer/single consumer ring per RX queue, instead of
+ * freeing them. The RX TSC of each packet travels in its udata64 field. A
+ * full ring never blocks the RX lcore: the packets which do not fit are
+ * freed and counted as drops.
+ *
+ * The writer lcore copies up to --capture-snaplen bytes of each packet
+ * into an Enhanced Packet Block of a large buffer, frees the mbufs and
+ * writes the buffer in multiples of CAPTURE_ALIGN once it is full. The
+ * file has one Interface Description Block per captured port, with
+ * nanosecond timestamps derived from the RX TSC. The packets of the RX
+ * queues of a port are interleaved by bursts, not sorted by time.
+ *
+ * All writer mappings share one lcore, the only one touching the file.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <rte_mbuf.h>
+
+/** Number of mbufs in the ring of each RX queue of a captured port */
+#define CAPTURE_RING_SIZE	4096
+/** Size of the write buffer */
+#define CAPTURE_BUF_SIZE	(4ul << 20)
+/** Alignment of the write buffer, and granularity of the writes */
+#define CAPTURE_ALIGN	4096
+/** Max number of bytes kept of a packet, and the default */
+#define CAPTURE_SNAPLEN_MAX	65535
+
+/**
+ * Create the rings of the captured ports and write the file header
+ *
+ * @param nb_ports
+ *	Number of all ports in DPDK
+ * @param path
+ *	Path of the pcapng file, truncated if it exists
+ * @param snaplen
+ *	Max number of bytes kept of each packet, at most CAPTURE_SNAPLEN_MAX
+ * @return
+ *	- 0 on success
+ *	- ERR_PARAM if no port has a writer lcore
+ *	- ERR_MEMORY or ERR_FILE on failure
+ */
+int capture_init(uint8_t nb_ports, const char *path, uint32_t snaplen);
+
+/**
+ * Hand the packets of a burst to the writer lcore
+ *
+ * Only the RX lcore of the queue may call it. The packets which do not fit
+ * in the ring are counted as drops and left to the caller, like those of
+ * ports not captured.
+ *
+ * @param portid
+ *	The port which received the packets
+ * @param queueid
+ *	The RX queue
+ * @param pkts
+ *	The packets
+ * @param n
+ *	Number of packets
+ * @param rx_tsc
+ *	TSC the burst was received at
+ * @return
+ *	Number of packets taken, from the start of pkts
+ */
+uint16_t capture_receive(uint8_t portid, uint8_t queueid,
+				struct rte_mbuf **pkts, uint16_t n, uint64_t rx_tsc);
+
+/**
+ * Append a burst of each ring of a port to the file
+ *
+ * Only the writer lcore may call it.
+ *
+ * @param portid
+ *	DPDK port id
+ */
+void capture_write(uint8_t portid);
+
+/**
+ * Get the counters of a captured port
+ *
+ * @param portid
+ *	DPDK port id
+ * @param written
+ *	Number of packets written to the file
+ * @param drops
+ *	Number of packets dropped on a full ring or a failed write
+ * @return
+ *	- True if the port is captured
+ *	- False otherwise
+ */
+bool capture_get_stats(uint8_t portid, uint64_t *written, uint64_t *drops);
+
+/**
+ * Write the packets left in the rings and the buffer, and close the file
+ *
+ * To be called once all lcores stopped.
+ */
+void capture_stop(void);
+
+/**
+ * Free the rings and the buffer
+ */
+void capture_free(void);
+
+#endif /* _PKTSENDER_CAPTURE_H_ */
@@ -0,0 +1,239 @@
+#ifndef _PKTSENDER_CKSUM_H_
+#define _PKTSENDER_CKSUM_H_
+
+/**
+ * @file
+ * Internet checksum helpers
+ *
+ * All values are passed exactly as they are stored in the packet, the
+ * ones' complement sum does not depend on byte order.
+ *
+ * Full checksums (RFC 1071) sum 32-bit words into 64-bit lanes and fold
+ * the carries once at the end. Field changes are applied incrementally
+ * (RFC 1624) without touching the rest of the packet.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <emmintrin.h>
+
+#include <rte_byteorder.h>
+
+/** Fold a 32-bit partial sum into 16 bits */
+static inline uint16_t
+cksum_fold(uint32_t sum)
+{
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return (uint16_t)sum;
+}
+
+/** Fold a 64-bit partial sum into 16 bits */
+static inline uint16_t
+cksum_fold64(uint64_t sum)
+{
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	return cksum_fold((uint32_t)sum);
+}
+
+/**
+ * Add the ones' complement sum of a buffer to a partial sum
+ *
+ * 64 bytes are summed per round in the two 64-bit lanes of SSE2
+ * registers, the tail one word at a time.
+ *
+ * @param buf
+ *	Start of the buffer, no alignment is required
+ * @param len
+ *	Length in bytes, an odd last byte is padded with zero
+ * @param sum
+ *	Partial sum to add to
+ * @return
+ *	The partial sum, to be folded by cksum_fold64() or cksum_finish()
+ */
+static inline uint64_t
+cksum_sum(const void *buf, uint32_t len, uint64_t sum)
+{
+	const uint8_t *p = (const uint8_t *)buf;
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = _mm_setzero_si128(), v = zero;
+	uint64_t lanes[2];
+	uint32_t w32 = 0;
+	uint16_t w16 = 0;
+	int i = 0;
+
+	/* 32-bit words widened to 64 bits cannot overflow a lane */
+	while (len >= 64) {
+		for (i = 0; i < 4; i++) {
+			v = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+			acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+			acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+		}
+		p += 64;
+		len -= 64;
+	}
+	_mm_storeu_si128((__m128i *)lanes, acc);
+	sum += lanes[0] + lanes[1];
+
+	while (len >= 4) {
+		memcpy(&w32, p, sizeof(w32));
+		sum += w32;
+		p += 4;
+		len -= 4;
+	}
+	if (len >= 2) {
+		memcpy(&w16, p, sizeof(w16));
+		sum += w16;
+		p += 2;
+		len -= 2;
+	}
+	if (len > 0) {
+		w16 = 0;
+		memcpy(&w16, p, 1);
+		sum += w16;
+	}
+	return sum;
+}
+
+/** Fold and complement a partial sum into the checksum to store */
+static inline uint16_t
+cksum_finish(uint64_t sum)
+{
+	return (uint16_t)~cksum_fold64(sum);
+}
+
+/**
+ * Partial sum of the IPv4 pseudo header of an L4 checksum
+ *
+ * @param src_ip
+ *	Source address, in network byte order
+ * @param dst_ip
+ *	Destination address, in network byte order
+ * @param proto
+ *	L4 protocol
+ * @param l4_len
+ *	Length of the L4 header and payload
+ */
+static inline uint64_t
+cksum_ipv4_phdr(uint32_t src_ip, uint32_t dst_ip, uint8_t proto,
+				uint16_t l4_len)
+{
+	return (uint64_t)src_ip + dst_ip + rte_cpu_to_be_16((uint16_t)proto) +
+			rte_cpu_to_be_16(l4_len);
+}
+
+/**
+ * Partial sum of the IPv6 pseudo header of an L4 checksum
+ *
+ * @param src_ip
+ *	Source address, 16 bytes
+ * @param dst_ip
+ *	Destination address, 16 bytes
+ * @param proto
+ *	L4 protocol (next header)
+ * @param l4_len
+ *	Length of the L4 header and payload
+ */
+static inline uint64_t
+cksum_ipv6_phdr(const uint8_t *src_ip, const uint8_t *dst_ip, uint8_t proto,
+				uint32_t l4_len)
+{
+	uint64_t sum = cksum_sum(src_ip, 16, 0);
+
+	sum = cksum_sum(dst_ip, 16, sum);
+	return sum + rte_cpu_to_be_32((uint32_t)proto) +
+			rte_cpu_to_be_32(l4_len);
+}
+
+/**
+ * Update a checksum after a 16-bit field changed (RFC 1624, eqn. 3)
+ *
+ * @param cksum
+ *	The old checksum
+ * @param old_val
+ *	The old value of the field
+ * @param new_val
+ *	The new value of the field
+ * @return
+ *	The new checksum
+ */
+static inline uint16_t
+cksum_update16(uint16_t cksum, uint16_t old_val, uint16_t new_val)
+{
+	uint32_t sum = 0;
+
+	sum = (uint16_t)~cksum + (uint16_t)~old_val + new_val;
+	return ~cksum_fold(sum);
+}
+
+/**
+ * Update a checksum after a 32-bit field changed (RFC 1624, eqn. 3)
+ */
+static inline uint16_t
+cksum_update32(uint16_t cksum, uint32_t old_val, uint32_t new_val)
+{
+	uint32_t sum = 0;
+
+	sum = (uint16_t)~cksum;
+	sum += (uint16_t)~(old_val >> 16) + (uint16_t)~(old_val & 0xffff);
+	sum += (new_val >> 16) + (new_val & 0xffff);
+	return ~cksum_fold(sum);
+}
+
+/**
+ * Partial sum of a 32-bit field change, to be added to a checksum later
+ * with cksum_adjust()
+ */
+static inline uint32_t
+cksum_delta32(uint32_t old_val, uint32_t new_val)
+{
+	return (uint16_t)~(old_val >> 16) + (uint16_t)~(old_val & 0xffff) +
+			(new_val >> 16) + (new_val & 0xffff);
+}
+
+/**
+ * Partial sum of a 16-bit field change
+ */
+static inline uint32_t
+cksum_delta16(uint16_t old_val, uint16_t new_val)
+{
+	return (uint16_t)~old_val + new_val;
+}
+
+/**
+ * Apply a folded partial sum of field changes to a checksum
+ *
+ * @param cksum
+ *	The old checksum
+ * @param delta
+ *	cksum_fold() of the sum of cksum_delta16()/cksum_delta32() values
+ * @return
+ *	The new checksum
+ */
+static inline uint16_t
+cksum_adjust(uint16_t cksum, uint16_t delta)
+{
+	return ~cksum_fold((uint32_t)(uint16_t)~cksum + delta);
+}
+
+/**
+ * Apply a folded partial sum of field changes to a pseudo header sum
+ *
+ * NICs computing the L4 checksum expect the folded pseudo header sum in
+ * the checksum field, not complemented.
+ *
+ * @param phdr
+ *	The old folded pseudo header sum
+ * @param delta
+ *	cksum_fold() of the sum of cksum_delta16()/cksum_delta32() values
+ * @return
+ *	The new folded pseudo header sum
+ */
+static inline uint16_t
+cksum_adjust_phdr(uint16_t phdr, uint16_t delta)
+{
+	return cksum_fold((uint32_t)phdr + delta);
+}
+
+#endif /* _PKTSENDER_CKSUM_H_ */
@@ -0,0 +1,346 @@
+#include "util.h"
+#include "pktsender.h"
+#include "flow.h"
+#include "cksum.h"
+#include "rand.h"
+
+#include <math.h>
+
+#include <rte_malloc.h>
+#include <rte_memory.h>
+
+/* flow tables shared by all TX queues of a socket, built on first use */
+static struct flow_table *flow_tables[RTE_MAX_NUMA_NODES];
+
+/* parse a flow selection */
+int
+flow_parse_dist(const char *str, uint8_t *dist, double *skew)
+{
+	char *end = NULL;
+
+	if (strcmp(str, "rr") == 0) {
+		*dist = FLOW_DIST_RR;
+	} else if (strcmp(str, "uniform") == 0) {
+		*dist = FLOW_DIST_UNIFORM;
+	} else if (strncmp(str, "zipf", 4) == 0) {
+		*dist = FLOW_DIST_ZIPF;
+		*skew = FLOW_ZIPF_SKEW_DEFAULT;
+		if (str[4] == ':') {
+			errno = 0;
+			*skew = strtod(str + 5, &end);
+			if (errno != 0 || end == str + 5 || *end != '\0' || *skew <= 0)
+				goto fail;
+		} else if (str[4] != '\0') {
+			goto fail;
+		}
+	} else {
+		goto fail;
+	}
+	return 0;
+
+fail:
+	LOG_ERROR("Unknown flow selection %s", str);
+	return ERR_PARAM;
+}
+
+/* set a flow to the idx-th tuple of the ranges, source port first */
+static void
+__flow_entry_set(struct flow_entry *e, const struct flow_entry *old,
+				const struct pkt_seq_range *range, const uint64_t *span,
+				uint64_t idx)
+{
+	uint32_t l3 = 0;
+
+	e->src_port = rte_cpu_to_be_16(
+					(uint16_t)(range->src_port_min + idx % span[0]));
+	idx /= span[0];
+	e->dst_port = rte_cpu_to_be_16(
+					(uint16_t)(range->dst_port_min + idx % span[1]));
+	idx /= span[1];
+	e->src_ip = rte_cpu_to_be_32(
+					(uint32_t)(range->src_ip_min + idx % span[2]));
+	idx /= span[2];
+	e->dst_ip = rte_cpu_to_be_32(
+					(uint32_t)(range->dst_ip_min + idx % span[3]));
+
+	/* addresses are covered by both IPv4 and pseudo header checksums */
+	l3 = cksum_delta32(old->src_ip, e->src_ip) +
+			cksum_delta32(old->dst_ip, e->dst_ip);
+	e->l3_delta = cksum_fold(l3);
+	e->l4_delta = cksum_fold(l3 +
+			cksum_delta16(old->src_port, e->src_port) +
+			cksum_delta16(old->dst_port, e->dst_port));
+}
+
+/**
+ * Fill the table with the tuples whose Toeplitz hash lands on the DUT
+ * queues with flows left to fill, see rss.h
+ *
+ * The tuples are scanned in order, so the crafted flows are distinct.
+ */
+static int
+__flow_fill_rss(struct flow_table *table, const struct pkt_seq *tmpl,
+				const struct flow_entry *old,
+				const struct pkt_seq_range *range, const uint64_t *span,
+				uint64_t total)
+{
+	const struct rss_conf *conf = &pktsender.rss;
+	uint32_t quotas[RSS_QUEUES_MAX];
+	uint8_t in[RSS_INPUT_LEN_MAX];
+	struct rss_toeplitz *t = NULL;
+	struct flow_entry e;
+	uint64_t idx = 0, max = 0;
+	uint32_t i = 0;
+	uint16_t q = 0;
+	uint8_t has_ports = 0, len = 0;
+
+	t = (struct rss_toeplitz *)malloc(sizeof(struct rss_toeplitz));
+	if (t == NULL) {
+		LOG_ERROR("Failed to allocate memory for Toeplitz tables");
+		return ERR_MEMORY;
+	}
+	rss_toeplitz_init(t, conf->key, conf->key_len);
+	rss_quotas(conf, table->nb_flows, quotas);
+	has_ports = (tmpl->proto == IPPROTO_TCP || tmpl->proto == IPPROTO_UDP);
+
+	max = RTE_MIN(total, (uint64_t)table->nb_flows * conf->nb_queues *
+					FLOW_RSS_SCAN_FACTOR);
+	for (idx = 0; idx < max && i < table->nb_flows; idx++) {
+		__flow_entry_set(&e, old, range, span, idx);
+		len = rss_tuple_input(tmpl->is_ipv6, tmpl->src_ip6, tmpl->dst_ip6,
+						e.src_ip, e.dst_ip, has_ports, e.src_port,
+						e.dst_port, in);
+		q = rss_queue(conf, rss_toeplitz_hash(t, in, len));
+		if (quotas[q] == 0)
+			continue;
+
+		quotas[q]--;
+		table->flows[i++] = e;
+	}
+	free(t);
+
+	if (i < table->nb_flows) {
+		LOG_ERROR("Only %u of %u flows land on the wanted RSS queues after "
+						"%lu tuples, widen the ip/port ranges", i,
+						table->nb_flows, idx);
+		return ERR_PARAM;
+	}
+
+	LOG_DEBUG("Craft %u flows for %u RSS queues out of %lu tuples",
+					table->nb_flows, conf->nb_queues, idx);
+	return 0;
+}
+
+/**
+ * Fill the table with distinct tuples
+ *
+ * Flow i is the i-th tuple of the ranges in mixed radix, source port
+ * first, unless the flows are crafted for RSS queues. The table is
+ * shuffled afterwards.
+ */
+static int
+__flow_fill(struct flow_table *table, const struct pkt_seq *tmpl,
+				const struct pkt_seq_range *range)
+{
+	struct flow_entry old, tmp;
+	struct rand_state rng;
+	uint64_t span[4], total = 1;
+	uint32_t i = 0, j = 0;
+	uint8_t k = 0;
+	int ret = 0;
+
+	span[0] = (uint64_t)range->src_port_max - range->src_port_min + 1;
+	span[1] = (uint64_t)range->dst_port_max - range->dst_port_min + 1;
+	span[2] = (uint64_t)range->src_ip_max - range->src_ip_min + 1;
+	span[3] = (uint64_t)range->dst_ip_max - range->dst_ip_min + 1;
+
+	/* crafting scans beyond nb_flows tuples, stop before overflowing */
+	for (k = 0; k < 4 && (total < table->nb_flows ||
+					pktsender.rss.nb_queues != 0); k++) {
+		if (total > UINT64_MAX / span[k]) {
+			total = UINT64_MAX;
+			break;
+		}
+		total *= span[k];
+	}
+
+	if (total < table->nb_flows) {
+		LOG_ERROR("The ip/port ranges hold only %lu tuples, less than "
+						"%u flows", total, table->nb_flows);
+		return ERR_PARAM;
+	}
+
+	old.src_ip = rte_cpu_to_be_32(tmpl->src_ip);
+	old.dst_ip = rte_cpu_to_be_32(tmpl->dst_ip);
+	old.src_port = rte_cpu_to_be_16(tmpl->src_port);
+	old.dst_port = rte_cpu_to_be_16(tmpl->dst_port);
+
+	if (pktsender.rss.nb_queues != 0) {
+		ret = __flow_fill_rss(table, tmpl, &old, range, span, total);
+		if (ret < 0)
+			return ret;
+	} else {
+		for (i = 0; i < table->nb_flows; i++)
+			__flow_entry_set(&table->flows[i], &old, range, span, i);
+	}
+
+	/* Fisher-Yates shuffle, with the same order on every socket */
+	rand_init(&rng, table->nb_flows);
+	for (i = table->nb_flows - 1; i > 0; i--) {
+		j = rand_scale(rand_next(&rng), 0, (uint64_t)i + 1);
+		tmp = table->flows[i];
+		table->flows[i] = table->flows[j];
+		table->flows[j] = tmp;
+	}
+	return 0;
+}
+
+/**
+ * Build the alias sampler of a Zipf popularity (Vose's method)
+ *
+ * Each column holds at most two flows, so a flow is picked in O(1) with
+ * two random values whatever the number of flows.
+ */
+static int
+__flow_build_alias(struct flow_table *table, double skew)
+{
+	uint32_t n = table->nb_flows;
+	uint32_t *small = NULL, *large = NULL;
+	uint32_t nb_small = 0, nb_large = 0, i = 0, l = 0, g = 0;
+	double *p = NULL, sum = 0;
+	int ret = 0;
+
+	p = malloc(sizeof(double) * n);
+	small = malloc(sizeof(uint32_t) * n);
+	large = malloc(sizeof(uint32_t) * n);
+	if (p == NULL || small == NULL || large == NULL) {
+		ret = ERR_MEMORY;
+		goto out;
+	}
+
+	for (i = 0; i < n; i++) {
+		p[i] = 1.0 / pow((double)i + 1, skew);
+		sum += p[i];
+	}
+
+	/* scale so that the average column holds exactly 1 */
+	for (i = 0; i < n; i++) {
+		p[i] = p[i] * n / sum;
+		if (p[i] < 1.0)
+			small[nb_small++] = i;
+		else
+			large[nb_large++] = i;
+	}
+
+	while (nb_small > 0 && nb_large > 0) {
+		l = small[--nb_small];
+		g = large[--nb_large];
+
+		table->alias[l].prob = (uint32_t)(p[l] * 4294967296.0);
+		table->alias[l].alias = g;
+
+		p[g] = (p[g] + p[l]) - 1.0;
+		if (p[g] < 1.0)
+			small[nb_small++] = g;
+		else
+			large[nb_large++] = g;
+	}
+
+	/* left-overs are full columns, up to rounding errors */
+	while (nb_large > 0) {
+		g = large[--nb_large];
+		table->alias[g].prob = UINT32_MAX;
+		table->alias[g].alias = g;
+	}
+	while (nb_small > 0) {
+		l = small[--nb_small];
+		table->alias[l].prob = UINT32_MAX;
+		table->alias[l].alias = l;
+	}
+
+out:
+	free(p);
+	free(small);
+	free(large);
+	return ret;
+}
+
+/* free a single flow table */
+static void
+__flow_table_free(struct flow_table *table)
+{
+	if (table == NULL)
+		return;
+
+	if (table->flows != NULL)
+		rte_free(table->flows);
+	if (table->alias != NULL)
+		rte_free(table->alias);
+	rte_free(table);
+}
+
+/* build the flow table of a socket */
+static struct flow_table *
+__flow_table_create(int socketid)
+{
+	struct flow_table *table = NULL;
+
+	table = rte_zmalloc_socket("flow_table", sizeof(struct flow_table),
+					RTE_CACHE_LINE_SIZE, socketid);
+	if (table == NULL)
+		goto fail_mem;
+
+	table->nb_flows = pktsender.nb_flows;
+	table->dist = pktsender.flow_dist;
+	table->flows = rte_malloc_socket("flow_entries",
+					sizeof(struct flow_entry) * table->nb_flows,
+					RTE_CACHE_LINE_SIZE, socketid);
+	if (table->flows == NULL)
+		goto fail_mem;
+
+	if (__flow_fill(table, &pktsender.tx_pkt, &pktsender.tx_range) < 0)
+		goto fail;
+
+	if (table->dist == FLOW_DIST_ZIPF) {
+		table->alias = rte_malloc_socket("flow_alias",
+						sizeof(struct flow_alias) * table->nb_flows,
+						RTE_CACHE_LINE_SIZE, socketid);
+		if (table->alias == NULL ||
+				__flow_build_alias(table, pktsender.flow_skew) < 0)
+			goto fail_mem;
+	}
+
+	LOG_INFO("Build %u flows on socket %d", table->nb_flows, socketid);
+	return table;
+
+fail_mem:
+	LOG_ERROR("Failed to allocate %u flows on socket %d",
+					pktsender.nb_flows, socketid);
+fail:
+	__flow_table_free(table);
+	return NULL;
+}
+
+/* get the flow table of a socket, build it on first use */
+const struct flow_table *
+flow_table_get(int socketid)
+{
+	if (socketid < 0 || socketid >= RTE_MAX_NUMA_NODES)
+		socketid = 0;
+
+	if (flow_tables[socketid] == NULL)
+		flow_tables[socketid] = __flow_table_create(socketid);
+	return flow_tables[socketid];
+}
+
+/* free the flow tables of all sockets */
+void
+flow_table_free(void)
+{
+	int i = 0;
+
+	for (i = 0; i < RTE_MAX_NUMA_NODES; i++) {
+		__flow_table_free(flow_tables[i]);
+		flow_tables[i] = NULL;
+	}
+}
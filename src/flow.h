@@ -0,0 +1,128 @@
+#ifndef _PKTSENDER_FLOW_H_
+#define _PKTSENDER_FLOW_H_
+
+/**
+ * @file
+ * Flow table
+ *
+ * A read-only table of distinct 5-tuples, built once per socket and shared
+ * by all TX queues on it. Each entry carries the checksum deltas of its
+ * tuple against the packet template, so a packet is moved to a flow by
+ * patching 12 bytes and adjusting two checksums.
+ */
+
+#include <stdint.h>
+
+/** Default number of flows */
+#define FLOW_NB_DEFAULT	1024
+/** Default skew of the Zipf popularity */
+#define FLOW_ZIPF_SKEW_DEFAULT	1.0
+/** Flows crafted for RSS queues give up after scanning this many tuples
+ * per flow and DUT queue */
+#define FLOW_RSS_SCAN_FACTOR	16
+
+/** Flow selection */
+enum {
+	/** every flow in turn */
+	FLOW_DIST_RR = 0,
+	/** uniform random flows */
+	FLOW_DIST_UNIFORM,
+	/** Zipf popularity, flow of rank k is picked with p ~ 1/k^s */
+	FLOW_DIST_ZIPF,
+};
+
+/** A flow, 16 bytes so that four of them share a cache line */
+struct flow_entry {
+	/** source ipv4 address, low 32 bits of an ipv6 one (network byte
+	 * order) */
+	uint32_t src_ip;
+	/** destination ipv4 address, low 32 bits of an ipv6 one (network byte
+	 * order) */
+	uint32_t dst_ip;
+	/** source port (network byte order) */
+	uint16_t src_port;
+	/** destination port (network byte order) */
+	uint16_t dst_port;
+	/** ones' complement sum of the address changes */
+	uint16_t l3_delta;
+	/** ones' complement sum of the address and port changes */
+	uint16_t l4_delta;
+} __attribute__((__packed__));
+
+/** A column of the alias sampler */
+struct flow_alias {
+	/** The column keeps its own flow if a random value is below this */
+	uint32_t prob;
+	/** Flow picked otherwise */
+	uint32_t alias;
+};
+
+/** Flow table of a socket */
+struct flow_table {
+	/** Number of flows */
+	uint32_t nb_flows;
+	/** Flow selection, FLOW_DIST_* */
+	uint8_t dist;
+	/** Flows, in random order so that popular flows are spread out */
+	struct flow_entry *flows;
+	/** Alias sampler of the Zipf popularity, NULL for other selections */
+	struct flow_alias *alias;
+};
+
+/**
+ * Parse a flow selection
+ *
+ * @param str
+ *	"rr", "uniform", "zipf" or "zipf:<skew>"
+ * @param dist
+ *	Output: FLOW_DIST_*
+ * @param skew
+ *	Output: skew of the Zipf popularity
+ * @return
+ *	- 0 on success
+ *	- Negative value on failure
+ */
+int flow_parse_dist(const char *str, uint8_t *dist, double *skew);
+
+/**
+ * Get the flow table of a socket, build it on first use
+ *
+ * Tuples are taken from the ranges of the random pattern (pktsender.tx_range)
+ * around the global packet template (pktsender.tx_pkt).
+ *
+ * @param socketid
+ *	The socket to allocate the table on
+ * @return
+ *	- Pointer to the flow table
+ *	- NULL on failure
+ */
+const struct flow_table *flow_table_get(int socketid);
+
+/**
+ * Free the flow tables of all sockets
+ */
+void flow_table_free(void);
+
+/**
+ * Pick a flow
+ *
+ * @param table
+ *	Pointer to a flow table using the uniform or Zipf selection
+ * @param r1
+ *	Uniform 32-bit random value
+ * @param r2
+ *	Another uniform 32-bit random value, only used by Zipf
+ * @return
+ *	Index of the flow
+ */
+static inline uint32_t
+flow_table_sample(const struct flow_table *table, uint32_t r1, uint32_t r2)
+{
+	uint32_t col = (uint32_t)(((uint64_t)r1 * table->nb_flows) >> 32);
+
+	if (table->alias == NULL)
+		return col;
+	return (r2 < table->alias[col].prob) ? col : table->alias[col].alias;
+}
+
+#endif /* _PKTSENDER_FLOW_H_ */
@@ -0,0 +1,246 @@
+#include "util.h"
+#include "latency.h"
+#include "pt_trace.h"
+
+#include <rte_atomic.h>
+
+/** TX and RX timestamps of a probe */
+struct latency_slot {
+	/** Probe index + 1 of the TX timestamp, 0 if none */
+	uint64_t tx_tag;
+	/** TX timestamp in ns */
+	uint64_t tx_ns;
+	/** Probe index + 1 of the RX timestamp, 0 if none */
+	volatile uint64_t rx_tag;
+	/** RX timestamp in ns */
+	uint64_t rx_ns;
+};
+
+/** Probes of a sender port */
+struct latency_sender {
+	/** Next probe to match */
+	uint64_t next;
+	/** Index + 1 of the last probe with a TX timestamp */
+	uint64_t tx_end;
+	/** Index + 1 of the last probe handed to the NIC */
+	uint64_t sent;
+	/** Probes from this index on are not collected, UINT64_MAX if no
+	 * latency_mark() is pending */
+	uint64_t mark;
+	/** Timestamps, probe i in slot (i % LATENCY_WINDOW) */
+	struct latency_slot slots[LATENCY_WINDOW];
+};
+
+static struct latency_sender *senders = NULL;
+static uint8_t nb_senders = 0;
+static struct latency_hist hist;
+
+/* middle of the range of a bucket */
+static inline uint64_t
+__latency_bucket_value(uint32_t idx)
+{
+	uint32_t shift = 0;
+
+	if (idx < (2u << LATENCY_SUB_BITS))
+		return idx;
+
+	shift = (idx >> LATENCY_SUB_BITS) - 1;
+	return ((uint64_t)((idx & ((1u << LATENCY_SUB_BITS) - 1)) +
+			(1u << LATENCY_SUB_BITS)) << shift) + (1ul << shift) / 2;
+}
+
+static inline uint64_t
+__latency_ns(const struct record_ts *ts)
+{
+	return (uint64_t)ts->u.timespec.tv_sec * 1000000000ul +
+			ts->u.timespec.tv_nsec;
+}
+
+/* keep the hardware timestamps of probes */
+static void
+__latency_trace_hook(uint8_t loc, uint32_t sender, uint64_t idx,
+				const struct record_ts *ts)
+{
+	struct latency_slot *slot = NULL;
+
+	if (sender >= nb_senders || ts->ts_type != TIMESTAMP_TIMESPEC)
+		return;
+
+	slot = &senders[sender].slots[idx & (LATENCY_WINDOW - 1)];
+	if (loc == LOC_HARDWARE_TX) {
+		slot->tx_ns = __latency_ns(ts);
+		slot->tx_tag = idx + 1;
+		senders[sender].tx_end = MAX(senders[sender].tx_end, idx + 1);
+	} else if (loc == LOC_HARDWARE_RX) {
+		slot->rx_ns = __latency_ns(ts);
+		rte_smp_wmb();
+		slot->rx_tag = idx + 1;
+	}
+}
+
+/* init the collector */
+int
+latency_init(uint8_t nb_ports)
+{
+	senders = (struct latency_sender *)calloc(nb_ports,
+					sizeof(struct latency_sender));
+	if (senders == NULL) {
+		LOG_ERROR("Failed to allocate memory for latency senders");
+		return ERR_MEMORY;
+	}
+	nb_senders = nb_ports;
+
+	latency_reset();
+	trace_set_hook(__latency_trace_hook);
+	return 0;
+}
+
+/* free the collector */
+void
+latency_free(void)
+{
+	trace_set_hook(NULL);
+	zfree(senders);
+	nb_senders = 0;
+}
+
+/* match the probes of a sender */
+void
+latency_collect(uint32_t sender, uint64_t end)
+{
+	struct latency_sender *s = &senders[sender];
+	struct latency_slot *slot = NULL;
+	uint64_t i = 0, ns = 0;
+
+	/* probes sent after the mark wait for the next trial */
+	end = MIN(end, s->mark);
+
+	/* older probes were overwritten */
+	if (end > s->next + LATENCY_WINDOW)
+		s->next = end - LATENCY_WINDOW;
+
+	for (i = s->next; i < end; i++) {
+		slot = &s->slots[i & (LATENCY_WINDOW - 1)];
+		/* no TX timestamp, nothing to measure */
+		if (slot->tx_tag != i + 1)
+			continue;
+
+		if (slot->rx_tag != i + 1) {
+			hist.nb_lost++;
+			continue;
+		}
+		rte_smp_rmb();
+
+		ns = (slot->rx_ns > slot->tx_ns) ? slot->rx_ns - slot->tx_ns : 0;
+		latency_hist_add(&hist, ns);
+	}
+	s->next = MAX(s->next, end);
+}
+
+/* note the probes handed to the NIC */
+void
+latency_sent(uint32_t sender, uint64_t end)
+{
+	senders[sender].sent = MAX(senders[sender].sent, end);
+}
+
+/* remember the probes sent so far */
+void
+latency_mark(void)
+{
+	uint8_t i = 0;
+
+	for (i = 0; i < nb_senders; i++)
+		senders[i].mark = MAX(senders[i].tx_end, senders[i].sent);
+}
+
+/* match the probes sent before the mark, then drop the mark */
+void
+latency_collect_mark(void)
+{
+	uint8_t i = 0;
+
+	for (i = 0; i < nb_senders; i++) {
+		latency_collect(i, senders[i].mark);
+		senders[i].mark = UINT64_MAX;
+	}
+}
+
+/* clear the histogram */
+void
+latency_reset(void)
+{
+	uint8_t i = 0;
+
+	latency_hist_reset(&hist);
+	/* probes still in flight were sent before the reset too */
+	for (i = 0; i < nb_senders; i++) {
+		senders[i].next = MAX(senders[i].tx_end, senders[i].sent);
+		senders[i].mark = UINT64_MAX;
+	}
+}
+
+/* clear a histogram */
+void
+latency_hist_reset(struct latency_hist *h)
+{
+	memset(h, 0, sizeof(struct latency_hist));
+	h->min = UINT64_MAX;
+}
+
+/* add the samples of a histogram to another one */
+void
+latency_hist_merge(struct latency_hist *dst, const struct latency_hist *src)
+{
+	uint32_t i = 0;
+
+	for (i = 0; i < LATENCY_NB_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+	dst->nb_samples += src->nb_samples;
+	dst->nb_lost += src->nb_lost;
+	dst->sum += src->sum;
+	dst->min = MIN(dst->min, src->min);
+	dst->max = MAX(dst->max, src->max);
+}
+
+/* value below which a share of the samples fall */
+static uint64_t
+__latency_percentile(const struct latency_hist *h, double share)
+{
+	uint64_t rank = (uint64_t)(share * h->nb_samples), cnt = 0;
+	uint32_t i = 0;
+
+	for (i = 0; i < LATENCY_NB_BUCKETS; i++) {
+		cnt += h->buckets[i];
+		if (cnt > rank)
+			return MIN(MAX(__latency_bucket_value(i), h->min), h->max);
+	}
+	return h->max;
+}
+
+/* summarize a histogram */
+void
+latency_hist_summary(const struct latency_hist *h, double ns_per_unit,
+				struct latency_summary *sum)
+{
+	memset(sum, 0, sizeof(struct latency_summary));
+	sum->nb_lost = h->nb_lost;
+	if (h->nb_samples == 0)
+		return;
+
+	sum->nb_samples = h->nb_samples;
+	sum->min = (uint64_t)(h->min * ns_per_unit);
+	sum->max = (uint64_t)(h->max * ns_per_unit);
+	sum->avg = (uint64_t)((double)h->sum / h->nb_samples * ns_per_unit);
+	sum->p50 = (uint64_t)(__latency_percentile(h, 0.5) * ns_per_unit);
+	sum->p99 = (uint64_t)(__latency_percentile(h, 0.99) * ns_per_unit);
+	sum->p999 = (uint64_t)(__latency_percentile(h, 0.999) * ns_per_unit);
+	sum->p9999 = (uint64_t)(__latency_percentile(h, 0.9999) * ns_per_unit);
+}
+
+/* summarize the probe histogram */
+void
+latency_get_summary(struct latency_summary *sum)
+{
+	latency_hist_summary(&hist, 1, sum);
+}
@@ -0,0 +1,181 @@
+#ifndef _PKTSENDER_LATENCY_H_
+#define _PKTSENDER_LATENCY_H_
+
+/**
+ * @file
+ * Probe latency collector
+ *
+ * Matches the hardware TX and RX timestamps of the probes recorded by
+ * pkttracer and keeps the latencies in a log-linear histogram. TX
+ * timestamps are recorded on the statistics lcore, RX timestamps on the
+ * RX lcores; probes are matched on the statistics lcore once they are
+ * old enough to be back.
+ *
+ * The histogram also keeps the per-packet latencies of seqnum.h.
+ */
+
+#include <stdint.h>
+
+/** Number of probes of a sender kept for matching, a power of 2 */
+#define LATENCY_WINDOW	8192
+/** Sub-buckets per power of 2 of the histogram, as a number of bits */
+#define LATENCY_SUB_BITS	6
+/** Number of histogram buckets, covering all 64-bit latencies */
+#define LATENCY_NB_BUCKETS	((64 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+/** Latency summary in ns */
+struct latency_summary {
+	/** Number of probes matched */
+	uint64_t nb_samples;
+	/** Number of probes sent but not received */
+	uint64_t nb_lost;
+	uint64_t min;
+	uint64_t avg;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t p9999;
+	uint64_t max;
+};
+
+/** Log-linear histogram of latencies, in any time unit */
+struct latency_hist {
+	uint64_t nb_samples;
+	uint64_t nb_lost;
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+	uint64_t buckets[LATENCY_NB_BUCKETS];
+};
+
+/**
+ * Bucket of a latency: exact below 2^(LATENCY_SUB_BITS + 1), then
+ * LATENCY_SUB_BITS bits of mantissa per power of 2
+ */
+static inline uint32_t
+latency_bucket(uint64_t val)
+{
+	uint32_t shift = 0;
+
+	if (val < (2ul << LATENCY_SUB_BITS))
+		return (uint32_t)val;
+
+	shift = 63 - __builtin_clzl(val) - LATENCY_SUB_BITS;
+	return ((shift + 1) << LATENCY_SUB_BITS) +
+			(uint32_t)((val >> shift) - (1ul << LATENCY_SUB_BITS));
+}
+
+/**
+ * Add a sample to a histogram
+ *
+ * @param hist
+ *	The histogram, written by a single lcore
+ * @param val
+ *	The latency
+ */
+static inline void
+latency_hist_add(struct latency_hist *hist, uint64_t val)
+{
+	hist->buckets[latency_bucket(val)]++;
+	hist->nb_samples++;
+	hist->sum += val;
+	if (val < hist->min)
+		hist->min = val;
+	if (val > hist->max)
+		hist->max = val;
+}
+
+/**
+ * Clear a histogram
+ */
+void latency_hist_reset(struct latency_hist *hist);
+
+/**
+ * Add the samples of a histogram to another one
+ *
+ * @param dst
+ *	The histogram to add to
+ * @param src
+ *	The histogram added, may be written meanwhile by its lcore
+ */
+void latency_hist_merge(struct latency_hist *dst,
+				const struct latency_hist *src);
+
+/**
+ * Summarize a histogram
+ *
+ * @param hist
+ *	The histogram
+ * @param ns_per_unit
+ *	Nanoseconds per unit of the histogram, 1 if it counts ns
+ * @param sum
+ *	Output: the summary
+ */
+void latency_hist_summary(const struct latency_hist *hist,
+				double ns_per_unit, struct latency_summary *sum);
+
+/**
+ * Initialize the collector and hook it into pkttracer
+ *
+ * @param nb_ports
+ *	Number of all ports in DPDK
+ * @return
+ *	- 0 on success
+ *	- ERR_MEMORY on failure
+ */
+int latency_init(uint8_t nb_ports);
+
+/**
+ * Free the collector
+ */
+void latency_free(void);
+
+/**
+ * Match the probes of a sender
+ *
+ * @param sender
+ *	Port which sent the probes
+ * @param end
+ *	Probes before this index are matched, or counted as lost
+ */
+void latency_collect(uint32_t sender, uint64_t end);
+
+/**
+ * Note the probes handed to the NIC, whose TX timestamps may come later
+ *
+ * @param sender
+ *	Port which sent the probes
+ * @param end
+ *	Index + 1 of the last probe sent
+ */
+void latency_sent(uint32_t sender, uint64_t end);
+
+/**
+ * Remember the probes sent so far
+ *
+ * Until latency_collect_mark() or latency_reset(), latency_collect() leaves
+ * the probes sent later alone.
+ */
+void latency_mark(void);
+
+/**
+ * Match the probes sent at the last latency_mark() and drop the mark
+ *
+ * Probes sent later are left for the next collection.
+ */
+void latency_collect_mark(void);
+
+/**
+ * Clear the histogram and skip the probes sent so far, in flight or not
+ */
+void latency_reset(void);
+
+/**
+ * Summarize the histogram
+ *
+ * @param sum
+ *	Output: the summary
+ */
+void latency_get_summary(struct latency_summary *sum);
+
+#endif /* _PKTSENDER_LATENCY_H_ */
@@ -40,6 +40,14 @@
 #include "pktsender.h"
 #include "stat.h"
 #include "probe.h"
+#include "transmitter.h"
+#include "flow.h"
+#include "profile.h"
+#include "rfc2544.h"
+#include "pkt_tmpl.h"
+#include "seqnum.h"
+#include "capture.h"
+#include "rss.h"
 //#include "pkt_seq.h"
 
 #include <rte_eal.h>
@@ -67,6 +75,41 @@ struct pktsender pktsender = {
 		.pkt_len = PKT_SEQ_PKT_LEN,
 	},
 	.tx_rate = 0,
+	.tx_rate_pps = 0,
+	.tx_profile = NULL,
+	.tx_tmpl = NULL,
+	.pcap_file = NULL,
+	.pcap_speed = 0,
+	.tx_pinned = 0,
+	.tx_split = 0,
+	.tx_cksum_offload = 0,
+	.tx_seqnum = 0,
+	.tx_tsc_every = 0,
+	.seqnum_off = 0,
+	.probe_rate = PROBE_RATE_PER_SEC,
+	.probe_poisson = 0,
+	.probe_inband = 0,
+	.capture_file = NULL,
+	.capture_snaplen = CAPTURE_SNAPLEN_MAX,
+	.max_pkt_len = MAX_PKT_LEN,
+	.nb_flows = FLOW_NB_DEFAULT,
+	.flow_dist = FLOW_DIST_RR,
+	.flow_skew = FLOW_ZIPF_SKEW_DEFAULT,
+	.rss = {
+		.key = RSS_KEY_DEFAULT,
+		.key_len = RSS_KEY_LEN_DEFAULT,
+		.is_key_set = 0,
+		.nb_queues = 0,
+		.reta_size = RSS_RETA_SIZE_DEFAULT,
+		.spread = RSS_SPREAD_BALANCED,
+	},
+	.rfc2544 = {
+		.tests = 0,
+		.latency_step = 0,
+		.trial = RFC2544_TRIAL_DEFAULT,
+		.settle = RFC2544_SETTLE_DEFAULT,
+		.loss = 0,
+	},
 };
 
 #define MAX_LCORE_PARAMS 128
@@ -84,11 +127,54 @@ static uint16_t nb_lcore_params;
 
 static unsigned long portmask = 0;
 
+/* per-port sizes of --port-conf, applied once the ports are known */
+struct port_conf_params {
+	uint8_t port_id;
+	struct port_conf conf;
+};
+
+static struct port_conf_params port_conf_params[MAX_PORT_NUM];
+static uint8_t nb_port_conf_params = 0;
+
 /* prefix of output file */
 static char *prefix = NULL;
 
 #define OPTION_CONFIG	"config"
 #define OPTION_MAC_DST	"mac-dst"
+#define OPTION_PATTERN	"pattern"
+#define OPTION_IP_SRC_RANGE	"ip-src-range"
+#define OPTION_IP_DST_RANGE	"ip-dst-range"
+#define OPTION_PORT_SRC_RANGE	"port-src-range"
+#define OPTION_PORT_DST_RANGE	"port-dst-range"
+#define OPTION_RAND_MAC	"rand-mac"
+#define OPTION_PCAP	"pcap"
+#define OPTION_PCAP_SPEED	"pcap-speed"
+#define OPTION_PCAP_STREAM	"pcap-stream"
+#define OPTION_TX_TEMPLATE	"tx-template"
+#define OPTION_TX_PINNED	"tx-pinned"
+#define OPTION_TX_SPLIT	"tx-split"
+#define OPTION_TX_CKSUM_OFFLOAD	"tx-cksum-offload"
+#define OPTION_SEQNUM	"seqnum"
+#define OPTION_SW_LATENCY	"sw-latency"
+#define OPTION_PROBE_RATE	"probe-rate"
+#define OPTION_PROBE_POISSON	"probe-poisson"
+#define OPTION_PROBE_INBAND	"probe-inband"
+#define OPTION_CAPTURE	"capture"
+#define OPTION_CAPTURE_SNAPLEN	"capture-snaplen"
+#define OPTION_PKT_SIZE	"pkt-size"
+#define OPTION_JUMBO	"jumbo"
+#define OPTION_FLOWS	"flows"
+#define OPTION_FLOW_DIST	"flow-dist"
+#define OPTION_RSS_KEY	"rss-key"
+#define OPTION_RSS_QUEUES	"rss-queues"
+#define OPTION_RSS_SPREAD	"rss-spread"
+#define OPTION_PORT_CONF	"port-conf"
+#define OPTION_RATE_PROFILE	"rate-profile"
+#define OPTION_RFC2544	"rfc2544"
+#define OPTION_RFC2544_TRIAL	"rfc2544-trial"
+#define OPTION_RFC2544_SETTLE	"rfc2544-settle"
+#define OPTION_RFC2544_LOSS	"rfc2544-loss"
+#define OPTION_RFC2544_LATENCY	"rfc2544-latency"
 
 /**
  * Initialize lcore_conf and port info
@@ -97,6 +183,7 @@ static int32_t __init_lcore_port(void)
 {
 	uint16_t i;
 	uint8_t lcore, port, job;
+	int queue = 0;
 	struct lcore_job *lcore_job = NULL;
 
 	for (i = 0; i < nb_lcore_params; ++i) {
@@ -112,12 +199,18 @@ static int32_t __init_lcore_port(void)
 					  lcore, job, MAX_PORT_PER_JOB);
 			return ERR_OUT_OF_RANGE;
 		}
+		/* update the lcore mapping of the port */
+		if (lcore != pktsender.stat_lcore) {
+			queue = port_update_lcore(port, lcore, job);
+			if (queue < 0)
+				return queue;
+		} else {
+			queue = 0;
+		}
+
 		lcore_job->port_list[lcore_job->nb_ports] = port;
+		lcore_job->queue_list[lcore_job->nb_ports] = (uint8_t)queue;
 		lcore_job->nb_ports++;
-
-		/* update the lcore mapping of the port */
-		if (lcore != pktsender.stat_lcore)
-			port_update_lcore(port, lcore, job);
 	}
 	return 0;
 }
@@ -127,13 +220,93 @@ static void __print_usage(const char *prgname)
 {
 	printf("%s [EAL options] -- -p <PORTMASK> -r <tx_rate> -o <output_prefix>"
 		" -- "OPTION_MAC_DST" <destination MAC>"
-		"  --"OPTION_CONFIG" (port,R/T,lcore)[,(port,R/T,lcore]\n"
+		"  --"OPTION_CONFIG" (port,R/T/P/W,lcore)[,(port,R/T/P/W,lcore]\n"
 		"  -p <PORTMASK>: mask of enabled ports\n"
-		"  -r <tx_rate>: per-port transmit rate (bps), s.t. \"1G\", \"20M\"\n"
+		"  -r <tx_rate>: per-port transmit rate in bps or pps,"
+		" s.t. \"1G\", \"20Mbps\", \"1.5Mpps\"\n"
 		"  -o <output_prefix>: prefix of output file name\n"
 		"  --"OPTION_MAC_DST": destination mac address of packets sent\n"
-		"  --"OPTION_CONFIG": port-lcore mapping configuration\n",
-		prgname);
+		"  --"OPTION_CONFIG": port-lcore mapping configuration, a port may"
+		" have several RX and TX lcores, each one drives its own queue,"
+		" RSS spreads the flows over the RX queues."
+		" P is the pcap reader of --"OPTION_PCAP_STREAM", W the writer of"
+		" --"OPTION_CAPTURE", one lcore for all ports\n"
+		"  --"OPTION_PATTERN" <single|random|pcap|flow>: TX pattern\n"
+		"  --"OPTION_IP_SRC_RANGE" <a.b.c.d-e.f.g.h|a::b-a::c>: source ipv4"
+		" or ipv6 range of random packets, ipv6 ranges cover the low 32"
+		" bits of the addresses and make all packets ipv6\n"
+		"  --"OPTION_IP_DST_RANGE" <a.b.c.d-e.f.g.h|a::b-a::c>: destination"
+		" ipv4 or ipv6 range of random packets\n"
+		"  --"OPTION_PORT_SRC_RANGE" <min-max>: source port range of"
+		" random packets\n"
+		"  --"OPTION_PORT_DST_RANGE" <min-max>: destination port range of"
+		" random packets\n"
+		"  --"OPTION_RAND_MAC": randomize the low 32 bits of MAC addresses"
+		" of random packets\n"
+		"  --"OPTION_PCAP" <file>: replay the frames of a pcap file\n"
+		"  --"OPTION_PCAP_SPEED" <x>: keep the original pcap gaps, x times"
+		" faster, instead of using the TX rate\n"
+		"  --"OPTION_PCAP_STREAM" <file>: replay a pcap file too large for"
+		" memory, read by the P lcore of each port\n"
+		"  --"OPTION_TX_TEMPLATE" <file>: build packets from a template"
+		" describing their header stack and how each field changes\n"
+		"  --"OPTION_TX_PINNED": re-send a ring of pinned mbufs instead of"
+		" allocating each burst (single pattern only)\n"
+		"  --"OPTION_TX_SPLIT": build packets from a small header mbuf"
+		" chained to a payload shared by all packets of the same size\n"
+		"  --"OPTION_TX_CKSUM_OFFLOAD": let the NIC compute the IPv4 and"
+		" TCP/UDP checksums when it supports it\n"
+		"  --"OPTION_SEQNUM": stamp built packets with a per-queue sequence"
+		" number after their headers, and count the losses, reordering and"
+		" duplicates of each stream at RX\n"
+		"  --"OPTION_SW_LATENCY" <n>: stamp the TX TSC of every n-th built"
+		" packet after its headers, and measure its latency at RX (ports"
+		" looped back to this host)\n"
+		"  --"OPTION_PROBE_RATE" <n>: latency probes sent per second on"
+		" each port, default %u, at most %u\n"
+		"  --"OPTION_PROBE_POISSON": space the probes by exponential gaps"
+		" instead of fixed ones\n"
+		"  --"OPTION_PROBE_INBAND": send the probes behind the data of the"
+		" first TX queue instead of on their own queue\n"
+		"  --"OPTION_CAPTURE" <file>: write the packets received by the"
+		" ports with a W lcore to a pcapng file\n"
+		"  --"OPTION_CAPTURE_SNAPLEN" <n>: bytes kept of each packet"
+		" captured, default %u\n"
+		"  --"OPTION_PKT_SIZE" <N|imix|s:w,...>: frame size (incl. FCS), the"
+		" simple IMIX, or sizes with their weights, up to %u with jumbo"
+		" frames\n"
+		"  --"OPTION_JUMBO": accept jumbo frames on all ports, implied by"
+		" a --"OPTION_PKT_SIZE" above 1518\n"
+		"  --"OPTION_FLOWS" <n>: number of flows of the flow pattern, taken"
+		" from the ip/port ranges\n"
+		"  --"OPTION_FLOW_DIST" <rr|uniform|zipf[:s]>: flow selection of the"
+		" flow pattern\n"
+		"  --"OPTION_RSS_KEY" <hex>: RSS key of the DUT, also programmed in"
+		" the ports with several RX queues, default the DPDK one\n"
+		"  --"OPTION_RSS_QUEUES" <n[:reta]>: craft the flows of the flow"
+		" pattern for the n RSS queues (and redirection table size, default"
+		" %u) of the DUT, and count the DUT queue of the packets received\n"
+		"  --"OPTION_RSS_SPREAD" <balanced|one[:q]|skew:w0,w1,...>: spread of"
+		" the crafted flows over the DUT queues, default balanced\n"
+		"  --"OPTION_PORT_CONF" (port,burst,rxd,txd[,mbufs])[,(...)]: burst"
+		" size (at most %u), RX/TX ring descriptors and mbufs per mempool"
+		" of a port, 0 keeps the default\n"
+		"  --"OPTION_RATE_PROFILE" <file>: vary the per-port rate over time"
+		" (ramp, step, sine, square segments), instead of -r\n"
+		"  --"OPTION_RFC2544": search the zero-loss rate of each frame size"
+		" (--"OPTION_PKT_SIZE" list or 64..1518), up to -r or the link"
+		" speed, results in <output_prefix>rfc2544.txt\n"
+		"  --"OPTION_RFC2544_TRIAL" <s>: duration of a trial, default %u\n"
+		"  --"OPTION_RFC2544_SETTLE" <s>: wait after a trial, default %u\n"
+		"  --"OPTION_RFC2544_LOSS" <%%>: loss tolerance, default 0\n"
+		"  --"OPTION_RFC2544_LATENCY" <%%>: probe latency at every <%%> step"
+		" of the throughput found by --"OPTION_RFC2544" (of the max rate"
+		" without it), up to 100%%\n",
+		prgname, PROBE_RATE_PER_SEC, PROBE_RATE_MAX, CAPTURE_SNAPLEN_MAX,
+		PKT_SEQ_JUMBO_FRAME_LEN,
+		RSS_RETA_SIZE_DEFAULT, MAX_PKT_BURST,
+		RFC2544_TRIAL_DEFAULT,
+		RFC2544_SETTLE_DEFAULT);
 }
 
 static int32_t __parse_config(const char *q_arg)
@@ -188,6 +361,10 @@ static int32_t __parse_config(const char *q_arg)
 			lcore_params_array[nb_lcore_params].job = LCORE_JOB_RX;
 		else if (strcmp(str_fld[FLD_JOB], "T") == 0)
 			lcore_params_array[nb_lcore_params].job = LCORE_JOB_TX;
+		else if (strcmp(str_fld[FLD_JOB], "P") == 0)
+			lcore_params_array[nb_lcore_params].job = LCORE_JOB_READER;
+		else if (strcmp(str_fld[FLD_JOB], "W") == 0)
+			lcore_params_array[nb_lcore_params].job = LCORE_JOB_WRITER;
 		else
 			return -1;
 
@@ -197,6 +374,181 @@ static int32_t __parse_config(const char *q_arg)
 	return 0;
 }
 
+static int32_t __parse_port_conf(const char *q_arg)
+{
+	char s[256];
+	const char *p, *p0 = q_arg;
+	enum fieldnames {
+		FLD_PORT = 0,
+		FLD_BURST,
+		FLD_RXD,
+		FLD_TXD,
+		FLD_MBUFS,
+		_NUM_FLD
+	};
+	char *str_fld[_NUM_FLD], *end = NULL;
+	unsigned long val[_NUM_FLD];
+	struct port_conf_params *params = NULL;
+	uint32_t size;
+	int nb_fld = 0, i = 0;
+
+	nb_port_conf_params = 0;
+
+	while ((p = strchr(p0, '(')) != NULL) {
+		if (nb_port_conf_params >= MAX_PORT_NUM) {
+			LOG_ERROR("exceeded max number of port confs: %u",
+							nb_port_conf_params);
+			return -1;
+		}
+
+		++p;
+		p0 = strchr(p, ')');
+		if (p0 == NULL)
+			return -1;
+
+		size = p0 - p;
+		if (size >= sizeof(s))
+			return -1;
+
+		snprintf(s, sizeof(s), "%.*s", size, p);
+		nb_fld = rte_strsplit(s, sizeof(s), str_fld, _NUM_FLD, ',');
+		if (nb_fld < FLD_MBUFS)
+			return -1;
+
+		val[FLD_MBUFS] = 0;
+		for (i = 0; i < nb_fld; i++) {
+			errno = 0;
+			val[i] = strtoul(str_fld[i], &end, 10);
+			if (errno != 0 || end == str_fld[i] || *end != '\0')
+				return -1;
+		}
+		if (val[FLD_PORT] >= MAX_PORT_NUM || val[FLD_BURST] > MAX_PKT_BURST ||
+				val[FLD_RXD] > UINT16_MAX || val[FLD_TXD] > UINT16_MAX ||
+				val[FLD_MBUFS] > UINT32_MAX)
+			return -1;
+
+		params = &port_conf_params[nb_port_conf_params];
+		params->port_id = (uint8_t)val[FLD_PORT];
+		params->conf.burst = (uint16_t)val[FLD_BURST];
+		params->conf.nb_rxd = (uint16_t)val[FLD_RXD];
+		params->conf.nb_txd = (uint16_t)val[FLD_TXD];
+		params->conf.nb_mbufs = (uint32_t)val[FLD_MBUFS];
+		++nb_port_conf_params;
+	}
+	return 0;
+}
+
+static int32_t __parse_pattern(const char *str)
+{
+	if (strcmp(str, "single") == 0)
+		pktsender.tx_pattern = TX_PATTERN_SINGLE;
+	else if (strcmp(str, "random") == 0)
+		pktsender.tx_pattern = TX_PATTERN_RANDOM;
+	else if (strcmp(str, "pcap") == 0)
+		pktsender.tx_pattern = TX_PATTERN_PCAP;
+	else if (strcmp(str, "flow") == 0)
+		pktsender.tx_pattern = TX_PATTERN_FLOW;
+	else {
+		LOG_ERROR("Unknown TX pattern %s", str);
+		return -1;
+	}
+	return 0;
+}
+
+static int32_t __parse_flows(const char *str)
+{
+	char *end = NULL;
+	unsigned long val = 0;
+
+	errno = 0;
+	val = strtoul(str, &end, 10);
+	if (errno != 0 || end == str || *end != '\0' || val == 0 ||
+					val > UINT32_MAX) {
+		LOG_ERROR("Wrong number of flows %s", str);
+		return -1;
+	}
+	pktsender.nb_flows = (uint32_t)val;
+	return 0;
+}
+
+static int32_t __parse_sw_latency(const char *str)
+{
+	char *end = NULL;
+	unsigned long val = 0;
+
+	errno = 0;
+	val = strtoul(str, &end, 10);
+	if (errno != 0 || end == str || *end != '\0' || val == 0 ||
+					val > UINT32_MAX) {
+		LOG_ERROR("Wrong latency sampling interval %s", str);
+		return -1;
+	}
+	pktsender.tx_tsc_every = (uint32_t)val;
+	return 0;
+}
+
+static int32_t __parse_capture_snaplen(const char *str)
+{
+	char *end = NULL;
+	unsigned long val = 0;
+
+	errno = 0;
+	val = strtoul(str, &end, 10);
+	if (errno != 0 || end == str || *end != '\0' || val == 0 ||
+					val > CAPTURE_SNAPLEN_MAX) {
+		LOG_ERROR("Wrong capture snaplen %s, valid range is [1,%u]",
+						str, CAPTURE_SNAPLEN_MAX);
+		return -1;
+	}
+	pktsender.capture_snaplen = (uint32_t)val;
+	return 0;
+}
+
+static int32_t __parse_pcap_speed(const char *str)
+{
+	char *end = NULL;
+
+	errno = 0;
+	pktsender.pcap_speed = strtod(str, &end);
+	if (errno != 0 || end == str || *end != '\0' ||
+			pktsender.pcap_speed <= 0) {
+		LOG_ERROR("Wrong pcap speed multiplier %s", str);
+		return -1;
+	}
+	return 0;
+}
+
+/* parse an ipv4 or ipv6 range of --ip-src-range/--ip-dst-range, both
+ * ranges must have the same version */
+static int32_t __parse_ip_range(const char *str, uint8_t is_dst)
+{
+	static uint8_t nb_ranges = 0;
+	struct pkt_seq *pkt = &pktsender.tx_pkt;
+	struct pkt_seq_range *range = &pktsender.tx_range;
+	uint32_t *min = is_dst ? &range->dst_ip_min : &range->src_ip_min;
+	uint32_t *max = is_dst ? &range->dst_ip_max : &range->src_ip_max;
+	uint8_t is_ipv6 = (strchr(str, ':') != NULL);
+
+	if (nb_ranges++ > 0 && is_ipv6 != pkt->is_ipv6) {
+		LOG_ERROR("Source and destination ranges mix ipv4 and ipv6");
+		return -1;
+	}
+
+	if (!is_ipv6)
+		return pkt_seq_parse_ip_range(str, min, max);
+
+	if (pkt_seq_parse_ip6_range(str, is_dst ? pkt->dst_ip6 : pkt->src_ip6,
+					min, max) < 0)
+		return -1;
+	/* the low 32 bits of the address of the single pattern */
+	if (is_dst)
+		pkt->dst_ip = *min;
+	else
+		pkt->src_ip = *min;
+	pkt->is_ipv6 = 1;
+	return 0;
+}
+
 #define __STRNCMP(name, opt) (!strncmp(name, opt, sizeof(opt)))
 static int32_t __parse_args_long_options(
 				struct option *lgopts, int32_t option_index)
@@ -210,6 +562,104 @@ static int32_t __parse_args_long_options(
 			LOG_ERROR("invalid config");
 	} else if (__STRNCMP(optname, OPTION_MAC_DST)) {
 		ret = pkt_seq_parse_mac(optarg, &pktsender.tx_pkt.dst_mac);
+	} else if (__STRNCMP(optname, OPTION_PATTERN)) {
+		ret = __parse_pattern(optarg);
+	} else if (__STRNCMP(optname, OPTION_IP_SRC_RANGE)) {
+		ret = __parse_ip_range(optarg, 0);
+	} else if (__STRNCMP(optname, OPTION_IP_DST_RANGE)) {
+		ret = __parse_ip_range(optarg, 1);
+	} else if (__STRNCMP(optname, OPTION_PORT_SRC_RANGE)) {
+		ret = pkt_seq_parse_port_range(optarg,
+						&pktsender.tx_range.src_port_min,
+						&pktsender.tx_range.src_port_max);
+	} else if (__STRNCMP(optname, OPTION_PORT_DST_RANGE)) {
+		ret = pkt_seq_parse_port_range(optarg,
+						&pktsender.tx_range.dst_port_min,
+						&pktsender.tx_range.dst_port_max);
+	} else if (__STRNCMP(optname, OPTION_RAND_MAC)) {
+		pktsender.tx_range.rand_mac = 1;
+		ret = 0;
+	} else if (__STRNCMP(optname, OPTION_PCAP)) {
+		pktsender.pcap_file = strdup(optarg);
+		pktsender.tx_pattern = TX_PATTERN_PCAP;
+		ret = 0;
+	} else if (__STRNCMP(optname, OPTION_PCAP_SPEED)) {
+		ret = __parse_pcap_speed(optarg);
+	} else if (__STRNCMP(optname, OPTION_PCAP_STREAM)) {
+		pktsender.pcap_file = strdup(optarg);
+		pktsender.tx_pattern = TX_PATTERN_PCAP_STREAM;
+		ret = 0;
+	} else if (__STRNCMP(optname, OPTION_TX_TEMPLATE)) {
+		pkt_tmpl_free(pktsender.tx_tmpl);
+		pktsender.tx_tmpl = pkt_tmpl_load(optarg);
+		pktsender.tx_pattern = TX_PATTERN_TEMPLATE;
+		ret = (pktsender.tx_tmpl == NULL) ? -1 : 0;
+	} else if (__STRNCMP(optname, OPTION_TX_PINNED)) {
+		pktsender.tx_pinned = 1;
+		ret = 0;
+	} else if (__STRNCMP(optname, OPTION_TX_SPLIT)) {
+		pktsender.tx_split = 1;
+		ret = 0;
+	} else if (__STRNCMP(optname, OPTION_TX_CKSUM_OFFLOAD)) {
+		pktsender.tx_cksum_offload = 1;
+		ret = 0;
+	} else if (__STRNCMP(optname, OPTION_SEQNUM)) {
+		pktsender.tx_seqnum = 1;
+		ret = 0;
+	} else if (__STRNCMP(optname, OPTION_SW_LATENCY)) {
+		ret = __parse_sw_latency(optarg);
+	} else if (__STRNCMP(optname, OPTION_PROBE_RATE)) {
+		ret = probe_parse_rate(optarg, &pktsender.probe_rate);
+	} else if (__STRNCMP(optname, OPTION_PROBE_POISSON)) {
+		pktsender.probe_poisson = 1;
+		ret = 0;
+	} else if (__STRNCMP(optname, OPTION_PROBE_INBAND)) {
+		pktsender.probe_inband = 1;
+		ret = 0;
+	} else if (__STRNCMP(optname, OPTION_CAPTURE)) {
+		zfree(pktsender.capture_file);
+		pktsender.capture_file = strdup(optarg);
+		ret = 0;
+	} else if (__STRNCMP(optname, OPTION_CAPTURE_SNAPLEN)) {
+		ret = __parse_capture_snaplen(optarg);
+	} else if (__STRNCMP(optname, OPTION_PKT_SIZE)) {
+		ret = pkt_seq_parse_size(optarg, &pktsender.tx_size);
+		if (ret == 0)
+			pktsender.tx_pkt.pkt_len = pktsender.tx_size.len[0];
+	} else if (__STRNCMP(optname, OPTION_JUMBO)) {
+		pktsender.max_pkt_len = MAX_JUMBO_PKT_LEN;
+		ret = 0;
+	} else if (__STRNCMP(optname, OPTION_FLOWS)) {
+		ret = __parse_flows(optarg);
+	} else if (__STRNCMP(optname, OPTION_FLOW_DIST)) {
+		ret = flow_parse_dist(optarg, &pktsender.flow_dist,
+						&pktsender.flow_skew);
+	} else if (__STRNCMP(optname, OPTION_RSS_KEY)) {
+		ret = rss_parse_key(optarg, &pktsender.rss);
+	} else if (__STRNCMP(optname, OPTION_RSS_QUEUES)) {
+		ret = rss_parse_queues(optarg, &pktsender.rss);
+	} else if (__STRNCMP(optname, OPTION_RSS_SPREAD)) {
+		ret = rss_parse_spread(optarg, &pktsender.rss);
+	} else if (__STRNCMP(optname, OPTION_PORT_CONF)) {
+		ret = __parse_port_conf(optarg);
+		if (ret < 0)
+			LOG_ERROR("invalid port conf");
+	} else if (__STRNCMP(optname, OPTION_RATE_PROFILE)) {
+		profile_free(pktsender.tx_profile);
+		pktsender.tx_profile = profile_load(optarg, pktsender.cpu_hz);
+		ret = (pktsender.tx_profile == NULL) ? -1 : 0;
+	} else if (__STRNCMP(optname, OPTION_RFC2544)) {
+		pktsender.rfc2544.tests |= RFC2544_THROUGHPUT;
+		ret = 0;
+	} else if (__STRNCMP(optname, OPTION_RFC2544_TRIAL)) {
+		ret = rfc2544_parse_value(optarg, &pktsender.rfc2544.trial, 0);
+	} else if (__STRNCMP(optname, OPTION_RFC2544_SETTLE)) {
+		ret = rfc2544_parse_value(optarg, &pktsender.rfc2544.settle, 0);
+	} else if (__STRNCMP(optname, OPTION_RFC2544_LOSS)) {
+		ret = rfc2544_parse_value(optarg, &pktsender.rfc2544.loss, 1);
+	} else if (__STRNCMP(optname, OPTION_RFC2544_LATENCY)) {
+		ret = rfc2544_parse_step(optarg, &pktsender.rfc2544.latency_step);
+		pktsender.rfc2544.tests |= RFC2544_LATENCY;
 	}
 
 	return ret;
@@ -221,8 +671,11 @@ static int32_t __parse_args_long_options(
  *
  * A valid mapping should satisfy:
  * 	- Both port and lcore are enabled.
- * 	- This queue is not mapped to another lcore.
  *  - No duplicate mapping.
+ *  - Writer mappings exist only with --capture and share one lcore.
+ *
+ * A port may have several RX and TX mappings on different lcores, each of
+ * them gets a separate RX or TX queue.
  * @return
  *	- The number of valid mappings.
  */
@@ -232,6 +685,7 @@ static int __check_mapping(void)
 	struct lcore_params *lcore_p = NULL, *iter = NULL;
 	bool is_dup = false;
 	uint8_t nb_port_max = 0;
+	uint8_t writer_lcore = RTE_MAX_LCORE;
 
 	LOG_INFO("Checking port/(R/T)job/lcore mappings......");
 
@@ -266,12 +720,35 @@ static int __check_mapping(void)
 			continue;
 		}
 
+		/* one writer lcore owns the capture file */
+		if (lcore_p->job == LCORE_JOB_WRITER) {
+			if (pktsender.capture_file == NULL) {
+				LOG_WARN("Port %u has a writer lcore but no --"OPTION_CAPTURE
+								" is given.", lcore_p->port_id);
+				continue;
+			}
+			if (writer_lcore == RTE_MAX_LCORE) {
+				writer_lcore = lcore_p->lcore_id;
+			} else if (lcore_p->lcore_id != writer_lcore) {
+				LOG_WARN("Lcore %u already writes the capture, remove the"
+								" writer lcore %u of port %u.",
+								writer_lcore, lcore_p->lcore_id,
+								lcore_p->port_id);
+				continue;
+			}
+		}
+
 		/* check for duplication */
 		is_dup = false;
 		for (j = 0; j < real_cnt; j++) {
 			iter = &lcore_params[j];
 			if (lcore_p->port_id == iter->port_id &&
 							lcore_p->job == iter->job) {
+				if ((lcore_p->job == LCORE_JOB_RX ||
+						lcore_p->job == LCORE_JOB_TX) &&
+						lcore_p->lcore_id != iter->lcore_id)
+					continue;
+
 				is_dup = true;
 				if (lcore_p->lcore_id == iter->lcore_id) {
 					LOG_WARN("Found duplicate port/job/lcore mapping for (%u,%u,%u),"
@@ -342,45 +819,173 @@ static uint8_t __parse_portmask(const char *str)
 	return 0;
 }
 
-/* Format: e.g 1000k => 1000 kbps, 2m => 2 mbps,
- * 			   128 => 128 bps
- */
-static uint64_t
-__parse_rate(const char *rate_str)
+/* the RFC 2544 test needs packets built from tx_seq and sets the rate */
+static int32_t __check_rfc2544(void)
 {
-	long val = 0;
-	char *unit = NULL;
-	uint64_t tx_rate = 0;
-
-	val = strtol(rate_str, &unit, 10);
-	if (errno == EINVAL || errno == ERANGE
-					|| unit == rate_str) {
-		LOG_ERROR("Failed to parse TX rate %s", rate_str);
-		return 0;
+	if (pktsender.tx_pattern == TX_PATTERN_PCAP ||
+			pktsender.tx_pattern == TX_PATTERN_PCAP_STREAM) {
+		LOG_ERROR("--"OPTION_RFC2544" does not support the pcap patterns");
+		return -1;
+	}
+	if (pktsender.tx_profile != NULL) {
+		LOG_ERROR("--"OPTION_RFC2544" and --"OPTION_RATE_PROFILE
+						" both set the rate");
+		return -1;
+	}
+	/* pinned mbufs keep the sizes they were built with */
+	pktsender.tx_pinned = 0;
+
+	if (pktsender.tx_size.nb_sizes == 0) {
+		if (pkt_seq_parse_size(pktsender.tx_pkt.is_ipv6 ?
+						RFC2544_SIZES_IPV6 : RFC2544_SIZES,
+						&pktsender.tx_size) < 0)
+			return -1;
+		pktsender.tx_pkt.pkt_len = pktsender.tx_size.len[0];
 	}
+	return 0;
+}
 
-	if (val < 0) {
-		LOG_ERROR("Wrong rate value %ld", val);
+/* ipv6 packets built from tx_seq must hold their headers, the default
+ * length only fits ipv4 ones */
+static int32_t __check_ipv6(void)
+{
+	uint16_t hdr_len = sizeof(struct ether_hdr) + sizeof(struct ipv6_hdr);
+	uint8_t i = 0;
+
+	if (pktsender.tx_pkt.proto == IPPROTO_TCP)
+		hdr_len += sizeof(struct tcp_hdr);
+	else if (pktsender.tx_pkt.proto == IPPROTO_UDP)
+		hdr_len += sizeof(struct udp_hdr);
+
+	if (pktsender.tx_size.nb_sizes == 0) {
+		pktsender.tx_pkt.pkt_len = MAX(pktsender.tx_pkt.pkt_len,
+						PKT_SEQ_IP6_PKT_LEN);
 		return 0;
 	}
+	for (i = 0; i < pktsender.tx_size.nb_sizes; i++) {
+		if (pktsender.tx_size.len[i] < hdr_len) {
+			LOG_ERROR("Packets are shorter than the %u bytes of ipv6"
+							" headers", hdr_len);
+			return -1;
+		}
+	}
+	return 0;
+}
 
-	switch(*unit) {
-		case 'k':	case 'K':
-			tx_rate = val << 10;
-			break;
-		case 'm':	case 'M':
-			tx_rate = val << 20;
-			break;
-		case 'g':	case 'G':
-			tx_rate = val << 40;
-			break;
-		default:
-			tx_rate = val;
+/* every packet must hold the header stack of the template */
+static int32_t __check_template(void)
+{
+	uint16_t hdr_len = pktsender.tx_tmpl->hdr_len;
+	uint8_t i = 0;
+
+	if (pktsender.tx_pkt.pkt_len < hdr_len)
+		goto fail;
+	for (i = 0; i < pktsender.tx_size.nb_sizes; i++) {
+		if (pktsender.tx_size.len[i] < hdr_len)
+			goto fail;
+	}
+	return 0;
+
+fail:
+	LOG_ERROR("Packets are shorter than the %u bytes of headers of --"
+					OPTION_TX_TEMPLATE, hdr_len);
+	return -1;
+}
+
+/* the stamp follows the headers of every packet, in the private head of
+ * split packets */
+static int32_t __check_seqnum(void)
+{
+	struct pkt_seq *seq = &pktsender.tx_pkt;
+	uint16_t off = 0, len = 0;
+	uint8_t i = 0;
+
+	if (pktsender.tx_pattern == TX_PATTERN_PCAP ||
+			pktsender.tx_pattern == TX_PATTERN_PCAP_STREAM) {
+		LOG_ERROR("--"OPTION_SEQNUM" and --"OPTION_SW_LATENCY
+						" do not support the pcap patterns");
+		return -1;
+	}
+
+	if (pktsender.tx_pattern == TX_PATTERN_TEMPLATE) {
+		off = pktsender.tx_tmpl->hdr_len;
+	} else {
+		off = sizeof(struct ether_hdr) + pkt_seq_l3_len(seq);
+		if (seq->proto == IPPROTO_TCP)
+			off += sizeof(struct tcp_hdr);
+		else if (seq->proto == IPPROTO_UDP)
+			off += sizeof(struct udp_hdr);
+	}
+	len = off + sizeof(struct seqnum_stamp);
+	if (len > TX_HDR_LEN_MAX) {
+		LOG_ERROR("The %u bytes of headers leave no room for the stamp"
+						" of --"OPTION_SEQNUM" or --"OPTION_SW_LATENCY, off);
+		return -1;
+	}
+
+	if (pktsender.tx_size.nb_sizes == 0 && seq->pkt_len < len)
+		goto fail;
+	for (i = 0; i < pktsender.tx_size.nb_sizes; i++) {
+		if (pktsender.tx_size.len[i] < len)
+			goto fail;
+	}
+
+	/* pinned mbufs are sent again as they are */
+	if (pktsender.tx_pinned) {
+		LOG_WARN("--"OPTION_TX_PINNED" is ignored with stamped packets");
+		pktsender.tx_pinned = 0;
+	}
+	pktsender.seqnum_off = off;
+	return 0;
+
+fail:
+	LOG_ERROR("Packets are shorter than the %u bytes of headers and"
+					" stamp", len);
+	return -1;
+}
+
+/* the spread must fit the DUT queues, and the key the hash input */
+static int32_t __check_rss(void)
+{
+	struct rss_conf *rss = &pktsender.rss;
+	uint64_t total = 0;
+	uint8_t len = 0;
+	uint16_t q = 0;
+
+	if (rss->spread == RSS_SPREAD_ONE && rss->hot_queue >= rss->nb_queues) {
+		LOG_ERROR("--"OPTION_RSS_SPREAD" queue %u is not one of the %u"
+						" queues", rss->hot_queue, rss->nb_queues);
+		return -1;
+	}
+	if (rss->spread == RSS_SPREAD_SKEW) {
+		for (q = 0; q < RSS_QUEUES_MAX; q++) {
+			if (q >= rss->nb_queues && rss->weights[q] != 0) {
+				LOG_ERROR("--"OPTION_RSS_SPREAD" has more weights than the"
+								" %u queues", rss->nb_queues);
+				return -1;
+			}
+			total += rss->weights[q];
+		}
+		if (total == 0) {
+			LOG_ERROR("--"OPTION_RSS_SPREAD" weights are all 0");
+			return -1;
+		}
+	}
+
+	len = pktsender.tx_pkt.is_ipv6 ? 32 : 8;
+	if (pktsender.tx_pkt.proto == IPPROTO_TCP ||
+			pktsender.tx_pkt.proto == IPPROTO_UDP)
+		len += 4;
+	if (rss->key_len < len + 4) {
+		LOG_ERROR("The %u bytes RSS key is too short to hash %u bytes",
+						rss->key_len, len);
+		return -1;
 	}
 
-	LOG_INFO("Set tx rate to %lu bps (%lf Mbps)",
-					tx_rate, (tx_rate / (double)(1024 * 1024)));
-	return tx_rate;
+	if (pktsender.tx_pattern != TX_PATTERN_FLOW)
+		LOG_WARN("--"OPTION_RSS_QUEUES" only crafts the flows of the flow"
+						" pattern");
+	return 0;
 }
 
 static int32_t
@@ -390,8 +995,44 @@ __parse_args(int32_t argc, char **argv)
 	char **argvopt;
 	int32_t option_index;
 	char *prgname = argv[0];
+	uint8_t i = 0;
 	static struct option lgopts[] = {
 		{OPTION_CONFIG, 1, 0, 0},
+		{OPTION_MAC_DST, 1, 0, 0},
+		{OPTION_PATTERN, 1, 0, 0},
+		{OPTION_IP_SRC_RANGE, 1, 0, 0},
+		{OPTION_IP_DST_RANGE, 1, 0, 0},
+		{OPTION_PORT_SRC_RANGE, 1, 0, 0},
+		{OPTION_PORT_DST_RANGE, 1, 0, 0},
+		{OPTION_RAND_MAC, 0, 0, 0},
+		{OPTION_PCAP, 1, 0, 0},
+		{OPTION_PCAP_SPEED, 1, 0, 0},
+		{OPTION_PCAP_STREAM, 1, 0, 0},
+		{OPTION_TX_TEMPLATE, 1, 0, 0},
+		{OPTION_TX_PINNED, 0, 0, 0},
+		{OPTION_TX_SPLIT, 0, 0, 0},
+		{OPTION_TX_CKSUM_OFFLOAD, 0, 0, 0},
+		{OPTION_SEQNUM, 0, 0, 0},
+		{OPTION_SW_LATENCY, 1, 0, 0},
+		{OPTION_PROBE_RATE, 1, 0, 0},
+		{OPTION_PROBE_POISSON, 0, 0, 0},
+		{OPTION_PROBE_INBAND, 0, 0, 0},
+		{OPTION_CAPTURE, 1, 0, 0},
+		{OPTION_CAPTURE_SNAPLEN, 1, 0, 0},
+		{OPTION_PKT_SIZE, 1, 0, 0},
+		{OPTION_JUMBO, 0, 0, 0},
+		{OPTION_FLOWS, 1, 0, 0},
+		{OPTION_FLOW_DIST, 1, 0, 0},
+		{OPTION_RSS_KEY, 1, 0, 0},
+		{OPTION_RSS_QUEUES, 1, 0, 0},
+		{OPTION_RSS_SPREAD, 1, 0, 0},
+		{OPTION_PORT_CONF, 1, 0, 0},
+		{OPTION_RATE_PROFILE, 1, 0, 0},
+		{OPTION_RFC2544, 0, 0, 0},
+		{OPTION_RFC2544_TRIAL, 1, 0, 0},
+		{OPTION_RFC2544_SETTLE, 1, 0, 0},
+		{OPTION_RFC2544_LOSS, 1, 0, 0},
+		{OPTION_RFC2544_LATENCY, 1, 0, 0},
 		{NULL, 0, 0, 0}
 	};
 
@@ -409,7 +1050,11 @@ __parse_args(int32_t argc, char **argv)
 			}
 			break;
 		case 'r':
-			pktsender.tx_rate = __parse_rate(optarg);
+			if (tx_parse_rate(optarg, &pktsender.tx_rate,
+							&pktsender.tx_rate_pps) < 0) {
+				__print_usage(prgname);
+				return -1;
+			}
 			break;
 		case 'o':
 			prefix = strdup(optarg);
@@ -426,6 +1071,64 @@ __parse_args(int32_t argc, char **argv)
 		}
 	}
 
+	if (pktsender.tx_pattern == TX_PATTERN_PCAP &&
+			pktsender.pcap_file == NULL) {
+		LOG_ERROR("The pcap pattern needs a pcap file (--"OPTION_PCAP")");
+		return -1;
+	}
+
+	/* pcap frames keep their captured sizes */
+	if (pktsender.tx_size.nb_sizes > 1 &&
+			(pktsender.tx_pattern == TX_PATTERN_PCAP ||
+			 pktsender.tx_pattern == TX_PATTERN_PCAP_STREAM))
+		LOG_WARN("--"OPTION_PKT_SIZE" is ignored by the pcap patterns");
+
+	if (pktsender.tx_profile != NULL && pktsender.tx_rate != 0)
+		LOG_WARN("-r is overridden by --"OPTION_RATE_PROFILE);
+
+	if (pktsender.rfc2544.tests != 0 && __check_rfc2544() < 0)
+		return -1;
+
+	if (pktsender.tx_pattern == TX_PATTERN_TEMPLATE &&
+			__check_template() < 0)
+		return -1;
+
+	if (pktsender.tx_pkt.is_ipv6 &&
+			(pktsender.tx_pattern == TX_PATTERN_SINGLE ||
+			 pktsender.tx_pattern == TX_PATTERN_RANDOM ||
+			 pktsender.tx_pattern == TX_PATTERN_FLOW) &&
+			__check_ipv6() < 0)
+		return -1;
+
+	if ((pktsender.tx_seqnum || pktsender.tx_tsc_every != 0) &&
+			__check_seqnum() < 0)
+		return -1;
+
+	if (pktsender.rss.nb_queues != 0 && __check_rss() < 0)
+		return -1;
+
+	/* ports must accept the largest frames sent */
+	for (i = 0; i < pktsender.tx_size.nb_sizes; i++) {
+		if (pktsender.tx_size.len[i] > MAX_PKT_LEN)
+			pktsender.max_pkt_len = MAX_JUMBO_PKT_LEN;
+	}
+	if (pktsender.max_pkt_len > MAX_PKT_LEN &&
+			pktsender.tx_pattern == TX_PATTERN_PCAP_STREAM)
+		LOG_WARN("The streaming pcap pattern skips jumbo frames");
+
+	/* other patterns rewrite or replace the packets on every burst */
+	if (pktsender.tx_pinned && pktsender.tx_pattern != TX_PATTERN_SINGLE) {
+		LOG_WARN("--"OPTION_TX_PINNED" only applies to the single pattern");
+		pktsender.tx_pinned = 0;
+	}
+
+	/* pcap frames are sent as they were captured */
+	if (pktsender.tx_split && (pktsender.tx_pattern == TX_PATTERN_PCAP ||
+			pktsender.tx_pattern == TX_PATTERN_PCAP_STREAM)) {
+		LOG_WARN("--"OPTION_TX_SPLIT" does not apply to the pcap patterns");
+		pktsender.tx_split = 0;
+	}
+
 	if (optind >= 0)
 		argv[optind-1] = prgname;
 
@@ -437,21 +1140,37 @@ __parse_args(int32_t argc, char **argv)
 
 static void __pktsender_free(void)
 {
+	/* free the capture before the RX mempools of its mbufs */
+	capture_free();
 	/* free port_list */
 	port_free();
 	/* free port_stat */
 	stat_free();
 	/* free probe_list */
 	probe_free();
+	/* free sequence number trackers */
+	seqnum_free();
+	/* free RSS queue counters */
+	rss_free();
+	/* free flow tables */
+	flow_table_free();
 
 	if (prefix)
 		free(prefix);
+
+	zfree(pktsender.pcap_file);
+	zfree(pktsender.capture_file);
+	profile_free(pktsender.tx_profile);
+	pktsender.tx_profile = NULL;
+	pkt_tmpl_free(pktsender.tx_tmpl);
+	pktsender.tx_tmpl = NULL;
 }
 
 int32_t main(int32_t argc, char **argv)
 {
 	int32_t ret;
 	uint32_t lcoreid;
+	uint8_t i = 0;
 //	uint8_t socket_id, port_id;
 
 	/* init EAL */
@@ -467,6 +1186,7 @@ int32_t main(int32_t argc, char **argv)
 	pktsender.nb_lcores = rte_lcore_count();
 	pktsender.cpu_hz = rte_get_tsc_hz();
 	pkt_seq_init_local(&pktsender.tx_pkt, NULL, NULL);
+	pkt_seq_init_range(&pktsender.tx_range, &pktsender.tx_pkt);
 
 	/* parse application arguments (after the EAL ones) */
 	ret = __parse_args(argc, argv);
@@ -481,6 +1201,13 @@ int32_t main(int32_t argc, char **argv)
 		return -1;
 	}
 
+	/* apply per-port burst and ring sizes */
+	for (i = 0; i < nb_port_conf_params; i++) {
+		if (port_set_conf(port_conf_params[i].port_id,
+						&port_conf_params[i].conf) < 0)
+			goto fail_free_all;
+	}
+
 	/* Set stat_lcore */
 	pktsender.stat_lcore = rte_get_master_lcore();
 	LOG_DEBUG("Statistics lcore is %u", pktsender.stat_lcore);
@@ -521,6 +1248,21 @@ int32_t main(int32_t argc, char **argv)
 		goto fail_free_all;
 	}
 
+	/* track the stamps of received packets */
+	if (pktsender.seqnum_off != 0 &&
+			seqnum_init(pktsender.nb_ports, pktsender.seqnum_off) < 0)
+		goto fail_free_all;
+
+	/* count the DUT queue of the packets received */
+	if (pktsender.rss.nb_queues != 0 && rss_init(pktsender.nb_ports) < 0)
+		goto fail_free_all;
+
+	/* hand the packets received to the writer lcore */
+	if (pktsender.capture_file != NULL &&
+			capture_init(pktsender.nb_ports, pktsender.capture_file,
+						pktsender.capture_snaplen) < 0)
+		goto fail_free_all;
+
 	/* start ports */
 	ret = port_start();
 	if (ret < 0) {
@@ -534,6 +1276,13 @@ int32_t main(int32_t argc, char **argv)
 	/* start probe timer */
 	probe_start(pktsender.cpu_hz, pktsender.stat_lcore);
 
+	/* start RFC 2544 test */
+	if (pktsender.rfc2544.tests != 0 &&
+			rfc2544_start(pktsender.stat_lcore, prefix) < 0) {
+		LOG_ERROR("Failed to start the RFC 2544 test");
+		goto fail_free_all;
+	}
+
 	/* set job state to all running */
 	pktsender.job_state = JOB_FLAGS_ALL;
 
@@ -551,9 +1300,16 @@ int32_t main(int32_t argc, char **argv)
 	/* stop probe timer */
 	probe_stop();
 
+	/* write the packets left by the writer lcore */
+	capture_stop();
+
 	/* stop statistics */
 	stat_stop();
 
+	/* stop RFC 2544 test */
+	if (pktsender.rfc2544.tests != 0)
+		rfc2544_stop();
+
 	__pktsender_free();
 	return 0;
 
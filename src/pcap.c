@@ -0,0 +1,158 @@
+#include "util.h"
+#include "pcap.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static inline uint32_t
+__pcap_u32(struct pcap_file *pf, uint32_t val)
+{
+	return pf->swapped ? __builtin_bswap32(val) : val;
+}
+
+/* open and map a pcap file */
+int
+pcap_open(struct pcap_file *pf, const char *path)
+{
+	struct stat st;
+	const struct pcap_file_hdr *hdr = NULL;
+	void *addr = NULL;
+
+	memset(pf, 0, sizeof(struct pcap_file));
+
+	pf->fd = open(path, O_RDONLY);
+	if (pf->fd < 0) {
+		LOG_ERROR("Failed to open pcap file %s: %s", path, strerror(errno));
+		return ERR_FILE;
+	}
+
+	if (fstat(pf->fd, &st) < 0 ||
+			(size_t)st.st_size < sizeof(struct pcap_file_hdr)) {
+		LOG_ERROR("Wrong pcap file %s", path);
+		goto fail_close;
+	}
+	pf->size = st.st_size;
+
+	addr = mmap(NULL, pf->size, PROT_READ, MAP_PRIVATE, pf->fd, 0);
+	if (addr == MAP_FAILED) {
+		LOG_ERROR("Failed to mmap pcap file %s: %s", path, strerror(errno));
+		goto fail_close;
+	}
+	pf->base = addr;
+
+	hdr = (const struct pcap_file_hdr *)pf->base;
+	switch (hdr->magic) {
+	case PCAP_MAGIC_USEC:
+		break;
+	case PCAP_MAGIC_NSEC:
+		pf->nsec = 1;
+		break;
+	case __builtin_bswap32(PCAP_MAGIC_USEC):
+		pf->swapped = 1;
+		break;
+	case __builtin_bswap32(PCAP_MAGIC_NSEC):
+		pf->swapped = 1;
+		pf->nsec = 1;
+		break;
+	default:
+		LOG_ERROR("%s is not a pcap file, magic %x", path, hdr->magic);
+		goto fail_unmap;
+	}
+
+	if (__pcap_u32(pf, hdr->linktype) != PCAP_LINKTYPE_ETHERNET) {
+		LOG_ERROR("Unsupported link type %u of pcap file %s",
+						__pcap_u32(pf, hdr->linktype), path);
+		goto fail_unmap;
+	}
+
+	pf->snaplen = __pcap_u32(pf, hdr->snaplen);
+	pf->offset = sizeof(struct pcap_file_hdr);
+
+	LOG_DEBUG("Open pcap file %s, %lu bytes, snaplen %u, %s timestamps",
+					path, pf->size, pf->snaplen, pf->nsec ? "ns" : "us");
+	return 0;
+
+fail_unmap:
+	munmap((void *)pf->base, pf->size);
+	pf->base = NULL;
+	close(pf->fd);
+	pf->fd = -1;
+	return ERR_FORMAT;
+
+fail_close:
+	close(pf->fd);
+	pf->fd = -1;
+	return ERR_FILE;
+}
+
+/* read the next packet record */
+int
+pcap_next(struct pcap_file *pf, struct pcap_pkt *pkt)
+{
+	struct pcap_rec_hdr rec;
+
+	if (pf->offset == pf->size)
+		return 0;
+
+	if (pf->offset + sizeof(rec) > pf->size)
+		goto truncated;
+
+	memcpy(&rec, pf->base + pf->offset, sizeof(rec));
+	pkt->caplen = __pcap_u32(pf, rec.caplen);
+	pkt->len = __pcap_u32(pf, rec.len);
+	pkt->ts_ns = (uint64_t)__pcap_u32(pf, rec.ts_sec) * 1000000000ull;
+	pkt->ts_ns += pf->nsec ? __pcap_u32(pf, rec.ts_frac) :
+				(uint64_t)__pcap_u32(pf, rec.ts_frac) * 1000;
+
+	if (pf->offset + sizeof(rec) + pkt->caplen > pf->size)
+		goto truncated;
+
+	pkt->data = pf->base + pf->offset + sizeof(rec);
+	pf->offset += sizeof(rec) + pkt->caplen;
+	return 1;
+
+truncated:
+	LOG_WARN("Truncated pcap record at offset %lu", pf->offset);
+	pf->offset = pf->size;
+	return ERR_FORMAT;
+}
+
+/* advise sequential access */
+void
+pcap_set_sequential(struct pcap_file *pf)
+{
+	if (madvise((void *)pf->base, pf->size, MADV_SEQUENTIAL) < 0)
+		LOG_WARN("madvise(MADV_SEQUENTIAL) failed: %s", strerror(errno));
+}
+
+/* drop the pages already read */
+void
+pcap_release_consumed(struct pcap_file *pf)
+{
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t len = pf->offset & ~(page - 1);
+
+	if (len > 0)
+		madvise((void *)pf->base, len, MADV_DONTNEED);
+}
+
+/* go back to the first record */
+void
+pcap_rewind(struct pcap_file *pf)
+{
+	pf->offset = sizeof(struct pcap_file_hdr);
+}
+
+/* unmap and close, a file is only kept open while it is mapped */
+void
+pcap_close(struct pcap_file *pf)
+{
+	if (pf->base == NULL)
+		return;
+
+	munmap((void *)pf->base, pf->size);
+	pf->base = NULL;
+	close(pf->fd);
+	pf->fd = -1;
+}
@@ -0,0 +1,127 @@
+#ifndef _PKTSENDER_PCAP_H_
+#define _PKTSENDER_PCAP_H_
+
+/**
+ * @file
+ * Memory-mapped pcap file reader
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Magic number of pcap files with microsecond timestamps */
+#define PCAP_MAGIC_USEC	0xa1b2c3d4
+/** Magic number of pcap files with nanosecond timestamps */
+#define PCAP_MAGIC_NSEC	0xa1b23c4d
+/** Link type: Ethernet */
+#define PCAP_LINKTYPE_ETHERNET	1
+
+/** pcap global header */
+struct pcap_file_hdr {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+} __attribute__((__packed__));
+
+/** pcap record header */
+struct pcap_rec_hdr {
+	uint32_t ts_sec;
+	uint32_t ts_frac;
+	uint32_t caplen;
+	uint32_t len;
+} __attribute__((__packed__));
+
+/** An opened pcap file */
+struct pcap_file {
+	/** File descriptor */
+	int fd;
+	/** Start of the mapped file */
+	const uint8_t *base;
+	/** Size of the file */
+	size_t size;
+	/** Offset of the next record */
+	size_t offset;
+	/** Whether the file uses the opposite byte order */
+	uint8_t swapped;
+	/** Whether timestamps are in nanoseconds */
+	uint8_t nsec;
+	/** Snapshot length */
+	uint32_t snaplen;
+};
+
+/** A packet record */
+struct pcap_pkt {
+	/** Timestamp in nanoseconds */
+	uint64_t ts_ns;
+	/** Number of bytes captured */
+	uint32_t caplen;
+	/** Original length on the wire */
+	uint32_t len;
+	/** Captured bytes, pointing into the mapped file */
+	const uint8_t *data;
+};
+
+/**
+ * Open and map a pcap file
+ *
+ * Only Ethernet captures are accepted.
+ *
+ * @param pf
+ *	Pointer to the pcap_file to initialize
+ * @param path
+ *	Path of the file
+ * @return
+ *	- 0 on success
+ *	- ERR_FILE on failure of file operations
+ *	- ERR_FORMAT if the file is not a supported pcap file
+ */
+int pcap_open(struct pcap_file *pf, const char *path);
+
+/**
+ * Read the next packet record
+ *
+ * @param pf
+ *	Pointer to the opened pcap_file
+ * @param pkt
+ *	Pointer to store the record
+ * @return
+ *	- 1 if a record is read
+ *	- 0 at the end of file
+ *	- ERR_FORMAT if the record is truncated
+ */
+int pcap_next(struct pcap_file *pf, struct pcap_pkt *pkt);
+
+/**
+ * Advise the kernel that the file is read sequentially
+ *
+ * @param pf
+ *	Pointer to the opened pcap_file
+ */
+void pcap_set_sequential(struct pcap_file *pf);
+
+/**
+ * Drop the mapped pages before the current record
+ *
+ * Used by streaming readers so that a capture larger than memory does
+ * not stay resident once it has been read.
+ *
+ * @param pf
+ *	Pointer to the opened pcap_file
+ */
+void pcap_release_consumed(struct pcap_file *pf);
+
+/**
+ * Go back to the first record
+ */
+void pcap_rewind(struct pcap_file *pf);
+
+/**
+ * Unmap and close a pcap file
+ */
+void pcap_close(struct pcap_file *pf);
+
+#endif /* _PKTSENDER_PCAP_H_ */
@@ -0,0 +1,218 @@
+#include "util.h"
+#include "pcap_stream.h"
+#include "port.h"
+
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_ring.h>
+
+/* free all mbufs left in the rings and pending buffers */
+static void
+__pcap_stream_drain(struct pcap_stream *stream)
+{
+	struct rte_mbuf *pkts[MAX_PKT_BURST];
+	struct pcap_stream_pending *pend = NULL;
+	unsigned n = 0;
+	uint8_t q = 0;
+
+	for (q = 0; q < stream->nb_txq; q++) {
+		if (stream->rings[q] != NULL) {
+			while ((n = rte_ring_dequeue_burst(stream->rings[q],
+							(void **)pkts, MAX_PKT_BURST)) > 0)
+				rte_pktmbuf_free_bulk(pkts, n);
+		}
+
+		pend = &stream->pending[q];
+		rte_pktmbuf_free_bulk(&pend->pkts[pend->head],
+						pend->len - pend->head);
+		pend->len = 0;
+		pend->head = 0;
+	}
+}
+
+/* free a streaming reader */
+void
+pcap_stream_free(struct pcap_stream *stream)
+{
+	uint8_t q = 0;
+
+	if (stream == NULL)
+		return;
+
+	__pcap_stream_drain(stream);
+
+	for (q = 0; q < stream->nb_txq; q++) {
+		if (stream->rings[q] != NULL)
+			rte_ring_free(stream->rings[q]);
+	}
+
+	if (stream->mp != NULL)
+		rte_mempool_free(stream->mp);
+
+	pcap_close(&stream->pf);
+	rte_free(stream);
+}
+
+/* create the streaming reader of a port */
+struct pcap_stream *
+pcap_stream_create(uint8_t portid, const char *file,
+				uint8_t nb_txq, int socketid)
+{
+	struct pcap_stream *stream = NULL;
+	char name[32];
+	uint8_t q = 0;
+
+	if (nb_txq == 0 || nb_txq > PCAP_STREAM_TXQ_MAX) {
+		LOG_ERROR("Port %u: %u TX queues can't be fed by a pcap reader",
+						portid, nb_txq);
+		return NULL;
+	}
+
+	stream = rte_zmalloc_socket("pcap_stream", sizeof(struct pcap_stream),
+					RTE_CACHE_LINE_SIZE, socketid);
+	if (stream == NULL) {
+		LOG_ERROR("Failed to allocate pcap reader of port %u", portid);
+		return NULL;
+	}
+	stream->portid = portid;
+	stream->nb_txq = nb_txq;
+
+	if (pcap_open(&stream->pf, file) < 0)
+		goto fail_free;
+	pcap_set_sequential(&stream->pf);
+
+	/* enough mbufs to fill all rings and all TX descriptors */
+	snprintf(name, sizeof(name), "stream_mp_%u", portid);
+	stream->mp = rte_pktmbuf_pool_create(name,
+					nb_txq * (PCAP_STREAM_RING_SIZE +
+							port_get_conf(portid)->nb_txd +
+							MAX_PKT_BURST * 2),
+					MEMPOOL_CACHE_SIZE, 0,
+					RTE_MBUF_DEFAULT_BUF_SIZE, socketid);
+	if (stream->mp == NULL) {
+		LOG_ERROR("Failed to create pcap reader mempool of port %u", portid);
+		goto fail_free;
+	}
+
+	/* single producer (reader) and single consumer (TX lcore) */
+	for (q = 0; q < nb_txq; q++) {
+		snprintf(name, sizeof(name), "stream_ring_%u_%u", portid, q);
+		stream->rings[q] = rte_ring_create(name, PCAP_STREAM_RING_SIZE,
+						socketid, RING_F_SP_ENQ | RING_F_SC_DEQ);
+		if (stream->rings[q] == NULL) {
+			LOG_ERROR("Failed to create pcap reader ring %s", name);
+			goto fail_free;
+		}
+	}
+
+	LOG_INFO("Port %u: stream %s to %u TX queue(s) from socket %d",
+					portid, file, nb_txq, socketid);
+	return stream;
+
+fail_free:
+	pcap_stream_free(stream);
+	return NULL;
+}
+
+/* push pending frames of a queue, return true if all of them are gone */
+static inline bool
+__pcap_stream_flush(struct pcap_stream *stream, uint8_t q)
+{
+	struct pcap_stream_pending *pend = &stream->pending[q];
+	unsigned n = 0;
+
+	if (pend->head == pend->len)
+		return true;
+
+	n = rte_ring_sp_enqueue_burst(stream->rings[q],
+					(void **)&pend->pkts[pend->head],
+					pend->len - pend->head);
+	pend->head += n;
+	if (pend->head < pend->len)
+		return false;
+
+	pend->head = 0;
+	pend->len = 0;
+	return true;
+}
+
+/* read one batch of frames and feed the TX rings */
+void
+pcap_stream_read(struct pcap_stream *stream)
+{
+	struct rte_mbuf *pkts[MAX_PKT_BURST];
+	struct pcap_stream_pending *pend = NULL;
+	struct pcap_pkt rec;
+	bool is_full = false;
+	uint16_t i = 0, n = 0;
+	uint8_t q = 0;
+	int ret = 0;
+
+	/* frames not accepted last time go first */
+	for (q = 0; q < stream->nb_txq; q++) {
+		if (!__pcap_stream_flush(stream, q))
+			is_full = true;
+	}
+
+	if (unlikely(stream->is_empty))
+		return;
+
+	if (is_full) {
+		if (!stream->is_stalled) {
+			stream->is_stalled = 1;
+			stream->nb_stalls++;
+		}
+		return;
+	}
+	stream->is_stalled = 0;
+
+	if (rte_pktmbuf_alloc_bulk(stream->mp, pkts, MAX_PKT_BURST) < 0)
+		return;
+
+	while (n < MAX_PKT_BURST) {
+		ret = pcap_next(&stream->pf, &rec);
+		if (ret <= 0) {
+			/* replay the capture in a loop, unless nothing in it
+			 * can be sent */
+			if (stream->loop_valid == 0) {
+				LOG_ERROR("Port %u: no frame of the capture can be sent",
+								stream->portid);
+				stream->is_empty = 1;
+				break;
+			}
+			pcap_rewind(&stream->pf);
+			stream->released = 0;
+			stream->loop_valid = 0;
+			stream->nb_loops++;
+			continue;
+		}
+
+		if (rec.caplen > MAX_PKT_LEN || rec.caplen == 0)
+			continue;
+		stream->nb_read++;
+		stream->loop_valid++;
+
+		rte_memcpy(rte_pktmbuf_mtod(pkts[n], void *), rec.data, rec.caplen);
+		pkts[n]->pkt_len = rec.caplen;
+		pkts[n]->data_len = rec.caplen;
+
+		pend = &stream->pending[stream->next_q];
+		pend->pkts[pend->len++] = pkts[n++];
+		if (++stream->next_q == stream->nb_txq)
+			stream->next_q = 0;
+	}
+
+	/* return the mbufs not used */
+	for (i = n; i < MAX_PKT_BURST; i++)
+		rte_pktmbuf_free(pkts[i]);
+
+	for (q = 0; q < stream->nb_txq; q++)
+		__pcap_stream_flush(stream, q);
+
+	/* do not keep the part already replayed in memory */
+	if (stream->pf.offset - stream->released >= PCAP_STREAM_RELEASE_CHUNK) {
+		pcap_release_consumed(&stream->pf);
+		stream->released = stream->pf.offset;
+	}
+}
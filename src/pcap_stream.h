@@ -0,0 +1,98 @@
+#ifndef _PKTSENDER_PCAP_STREAM_H_
+#define _PKTSENDER_PCAP_STREAM_H_
+
+/**
+ * @file
+ * Streaming pcap replay
+ *
+ * A reader lcore reads the capture sequentially, builds mbufs and feeds
+ * them to the TX queues of a port through one ring per queue, so a
+ * capture does not have to fit in memory.
+ */
+
+#include "pktsender.h"
+#include "pcap.h"
+
+/** Max number of TX queues fed by one reader */
+#define PCAP_STREAM_TXQ_MAX	8
+/** Number of mbufs in each TX ring */
+#define PCAP_STREAM_RING_SIZE	4096
+/** Release the pages of the capture after each chunk of this size */
+#define PCAP_STREAM_RELEASE_CHUNK	(64ul << 20)
+
+/** Frames read but not yet accepted by a full ring */
+struct pcap_stream_pending {
+	/** Number of mbufs */
+	uint16_t len;
+	/** Index of the first mbuf not enqueued */
+	uint16_t head;
+	/** mbufs */
+	struct rte_mbuf *pkts[MAX_PKT_BURST];
+};
+
+/** Streaming reader of a port */
+struct pcap_stream {
+	/** DPDK port id */
+	uint8_t portid;
+	/** Number of TX queues fed by this reader */
+	uint8_t nb_txq;
+	/** TX queue receiving the next frame */
+	uint8_t next_q;
+	/** The capture */
+	struct pcap_file pf;
+	/** Offset of the last released chunk */
+	size_t released;
+	/** mbuf mempool, on the socket of the reader lcore */
+	struct rte_mempool *mp;
+	/** One ring per TX queue */
+	struct rte_ring *rings[PCAP_STREAM_TXQ_MAX];
+	/** Pending frames per TX queue */
+	struct pcap_stream_pending pending[PCAP_STREAM_TXQ_MAX];
+	/** Whether the capture has no frame that can be sent */
+	uint8_t is_empty;
+	/** Whether the reader is stalled by full rings */
+	uint8_t is_stalled;
+	/** Number of times the reader got stalled by full rings */
+	uint64_t nb_stalls;
+	/** Number of frames read */
+	uint64_t nb_read;
+	/** Number of frames read in the current loop that can be sent */
+	uint64_t loop_valid;
+	/** Number of times the capture was replayed from the start */
+	uint64_t nb_loops;
+};
+
+/**
+ * Create the streaming reader of a port
+ *
+ * @param portid
+ *	DPDK port id
+ * @param file
+ *	Path of the capture
+ * @param nb_txq
+ *	Number of TX queues to feed, frame i goes to queue (i % nb_txq)
+ * @param socketid
+ *	Socket of the reader lcore
+ * @return
+ *	- Pointer to the reader on success
+ *	- NULL on failure
+ */
+struct pcap_stream *pcap_stream_create(uint8_t portid, const char *file,
+				uint8_t nb_txq, int socketid);
+
+/**
+ * Free a streaming reader and all mbufs it holds
+ */
+void pcap_stream_free(struct pcap_stream *stream);
+
+/**
+ * Read one batch of frames and feed the TX rings
+ *
+ * Called in the loop of the reader lcore.
+ *
+ * @param stream
+ *	Pointer to the reader
+ */
+void pcap_stream_read(struct pcap_stream *stream);
+
+#endif /* _PKTSENDER_PCAP_STREAM_H_ */
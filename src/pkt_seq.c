@@ -1,7 +1,9 @@
 #include "util.h"
 #include "pkt_seq.h"
+#include "cksum.h"
+
+#include <strings.h>
 
-#include <rte_hash_crc.h>
 #include <rte_malloc.h>
 #include <rte_mbuf.h>
 
@@ -9,6 +11,10 @@
 #define IP_HDRLEN 0x05
 #define IP_VHL_DEF (IP_VERSION | IP_HDRLEN)
 #define IP_TTL_DEF 64
+#define IP6_VTC_FLOW_DEF 0x60000000
+
+static const uint8_t __ip6_prefix_def[PKT_SEQ_IP6_PREFIX_LEN] =
+				PKT_SEQ_IP6_PREFIX;
 
 /* convert a MAC address string to ether_addr structure */
 int pkt_seq_parse_mac(const char *str, struct ether_addr *addr)
@@ -29,6 +35,208 @@ int pkt_seq_parse_mac(const char *str, struct ether_addr *addr)
 	return 0;
 }
 
+/* split "a-b" into two strings, b is NULL if there is no '-' */
+static int
+__split_range(const char *str, char *buf, size_t len, char **lo, char **hi)
+{
+	char *sep = NULL;
+
+	if (snprintf(buf, len, "%s", str) >= (int)len)
+		return ERR_FORMAT;
+
+	*lo = buf;
+	*hi = NULL;
+	sep = strchr(buf, '-');
+	if (sep != NULL) {
+		*sep = '\0';
+		*hi = sep + 1;
+	}
+	return 0;
+}
+
+/* parse an ipv4 address range */
+int
+pkt_seq_parse_ip_range(const char *str, uint32_t *min, uint32_t *max)
+{
+	char buf[64];
+	char *lo = NULL, *hi = NULL;
+	struct in_addr addr;
+
+	if (__split_range(str, buf, sizeof(buf), &lo, &hi) < 0 ||
+			inet_pton(AF_INET, lo, &addr) != 1) {
+		LOG_ERROR("Failed to parse ipv4 range %s", str);
+		return ERR_FORMAT;
+	}
+	*min = ntohl(addr.s_addr);
+
+	if (hi == NULL) {
+		*max = *min;
+	} else {
+		if (inet_pton(AF_INET, hi, &addr) != 1) {
+			LOG_ERROR("Failed to parse ipv4 range %s", str);
+			return ERR_FORMAT;
+		}
+		*max = ntohl(addr.s_addr);
+	}
+
+	if (*max < *min) {
+		LOG_ERROR("Wrong ipv4 range %s", str);
+		return ERR_FORMAT;
+	}
+	return 0;
+}
+
+/* parse an ipv6 address */
+static int
+__parse_ip6(const char *str, uint8_t *prefix, uint32_t *low)
+{
+	struct in6_addr addr;
+
+	if (inet_pton(AF_INET6, str, &addr) != 1)
+		return ERR_FORMAT;
+
+	memcpy(prefix, addr.s6_addr, PKT_SEQ_IP6_PREFIX_LEN);
+	memcpy(low, addr.s6_addr + PKT_SEQ_IP6_PREFIX_LEN, sizeof(*low));
+	*low = ntohl(*low);
+	return 0;
+}
+
+/* parse an ipv6 address range, of the low 32 bits */
+int
+pkt_seq_parse_ip6_range(const char *str, uint8_t *prefix, uint32_t *min,
+				uint32_t *max)
+{
+	uint8_t hi_prefix[PKT_SEQ_IP6_PREFIX_LEN];
+	char buf[128];
+	char *lo = NULL, *hi = NULL;
+
+	if (__split_range(str, buf, sizeof(buf), &lo, &hi) < 0 ||
+			__parse_ip6(lo, prefix, min) < 0) {
+		LOG_ERROR("Failed to parse ipv6 range %s", str);
+		return ERR_FORMAT;
+	}
+
+	if (hi == NULL) {
+		*max = *min;
+	} else if (__parse_ip6(hi, hi_prefix, max) < 0) {
+		LOG_ERROR("Failed to parse ipv6 range %s", str);
+		return ERR_FORMAT;
+	} else if (memcmp(prefix, hi_prefix, PKT_SEQ_IP6_PREFIX_LEN) != 0) {
+		LOG_ERROR("Bounds of ipv6 range %s differ in their upper 96 bits",
+						str);
+		return ERR_FORMAT;
+	}
+
+	if (*max < *min) {
+		LOG_ERROR("Wrong ipv6 range %s", str);
+		return ERR_FORMAT;
+	}
+	return 0;
+}
+
+/* parse an L4 port range */
+int
+pkt_seq_parse_port_range(const char *str, uint16_t *min, uint16_t *max)
+{
+	char buf[32];
+	char *lo = NULL, *hi = NULL, *end = NULL;
+	unsigned long val = 0;
+
+	if (__split_range(str, buf, sizeof(buf), &lo, &hi) < 0)
+		goto fail;
+
+	errno = 0;
+	val = strtoul(lo, &end, 10);
+	if (errno != 0 || end == lo || *end != '\0' || val > UINT16_MAX)
+		goto fail;
+	*min = (uint16_t)val;
+	*max = (uint16_t)val;
+
+	if (hi != NULL) {
+		val = strtoul(hi, &end, 10);
+		if (errno != 0 || end == hi || *end != '\0' || val > UINT16_MAX)
+			goto fail;
+		*max = (uint16_t)val;
+	}
+
+	if (*max < *min)
+		goto fail;
+	return 0;
+
+fail:
+	LOG_ERROR("Failed to parse port range %s", str);
+	return ERR_FORMAT;
+}
+
+/* parse a packet size distribution */
+int
+pkt_seq_parse_size(const char *str, struct pkt_seq_size *size)
+{
+	char buf[128];
+	char *tok = NULL, *save = NULL, *end = NULL;
+	unsigned long len = 0, weight = 0;
+
+	if (strcasecmp(str, "imix") == 0)
+		str = PKT_SEQ_SIZE_IMIX;
+
+	if (snprintf(buf, sizeof(buf), "%s", str) >= (int)sizeof(buf))
+		goto fail;
+
+	size->nb_sizes = 0;
+	for (tok = strtok_r(buf, ",", &save); tok != NULL;
+					tok = strtok_r(NULL, ",", &save)) {
+		if (size->nb_sizes == PKT_SEQ_SIZE_MAX) {
+			LOG_ERROR("At most %u packet sizes are supported",
+							PKT_SEQ_SIZE_MAX);
+			goto fail;
+		}
+
+		errno = 0;
+		len = strtoul(tok, &end, 10);
+		if (errno != 0 || end == tok || len < ETHER_MIN_LEN ||
+						len > PKT_SEQ_JUMBO_FRAME_LEN)
+			goto fail;
+
+		weight = 1;
+		if (*end == ':') {
+			tok = end + 1;
+			weight = strtoul(tok, &end, 10);
+			if (errno != 0 || end == tok || weight == 0 ||
+							weight > UINT16_MAX)
+				goto fail;
+		}
+		if (*end != '\0')
+			goto fail;
+
+		size->len[size->nb_sizes] = (uint16_t)(len - ETHER_CRC_LEN);
+		size->weight[size->nb_sizes] = (uint32_t)weight;
+		size->nb_sizes++;
+	}
+
+	if (size->nb_sizes == 0)
+		goto fail;
+	return 0;
+
+fail:
+	LOG_ERROR("Failed to parse packet sizes %s", str);
+	return ERR_FORMAT;
+}
+
+/* fix every field of the range to the value of pkt */
+void
+pkt_seq_init_range(struct pkt_seq_range *range, struct pkt_seq *pkt)
+{
+	range->src_ip_min = pkt->src_ip;
+	range->src_ip_max = pkt->src_ip;
+	range->dst_ip_min = pkt->dst_ip;
+	range->dst_ip_max = pkt->dst_ip;
+	range->src_port_min = pkt->src_port;
+	range->src_port_max = pkt->src_port;
+	range->dst_port_min = pkt->dst_port;
+	range->dst_port_max = pkt->dst_port;
+	range->rand_mac = 0;
+}
+
 ///* convert a host 64bit number to MAC address in network byte order */
 //static inline void
 //inet_h64tom(uint64_t value, struct ether_addr *eaddr)
@@ -51,6 +259,9 @@ pkt_seq_init_local(struct pkt_seq *local,
 
 		local->src_ip = PKT_SEQ_IP_SRC;
 		local->dst_ip = PKT_SEQ_IP_DST;
+		local->is_ipv6 = 0;
+		memcpy(local->src_ip6, __ip6_prefix_def, PKT_SEQ_IP6_PREFIX_LEN);
+		memcpy(local->dst_ip6, __ip6_prefix_def, PKT_SEQ_IP6_PREFIX_LEN);
 		local->proto = PKT_SEQ_PROTO;
 		local->src_port = PKT_SEQ_PORT_SRC;
 		local->dst_port = PKT_SEQ_PORT_DST;
@@ -60,6 +271,9 @@ pkt_seq_init_local(struct pkt_seq *local,
 
 		local->src_ip = global->src_ip;
 		local->dst_ip = global->dst_ip;
+		local->is_ipv6 = global->is_ipv6;
+		memcpy(local->src_ip6, global->src_ip6, PKT_SEQ_IP6_PREFIX_LEN);
+		memcpy(local->dst_ip6, global->dst_ip6, PKT_SEQ_IP6_PREFIX_LEN);
 		local->proto = global->proto;
 		local->src_port = global->src_port;
 		local->dst_port = global->dst_port;
@@ -70,20 +284,6 @@ pkt_seq_init_local(struct pkt_seq *local,
 		ether_addr_copy(port_mac, &local->src_mac);
 }
 
-/* calculate 16-bit CRC checksum */
-static inline uint16_t
-__checksum_16(const void *data, uint32_t len)
-{
-	uint32_t crc32 = 0;
-
-	crc32 = rte_hash_crc(data, len, 0);
-
-	crc32 = (crc32 & 0xffff) + (crc32 >> 16);
-	crc32 = (crc32 & 0xffff) + (crc32 >> 16);
-
-	return ~((uint16_t)crc32);
-}
-
 /**
  * Construct ethernet header
  *
@@ -97,7 +297,8 @@ __construct_eth_hdr(struct pkt_seq *pkt, void *hdr)
 
 	ether_addr_copy(&pkt->src_mac, &eth->s_addr);
 	ether_addr_copy(&pkt->dst_mac, &eth->d_addr);
-	eth->ether_type = rte_cpu_to_be_16(ETHER_TYPE_IPv4);
+	eth->ether_type = rte_cpu_to_be_16(pkt->is_ipv6 ?
+					ETHER_TYPE_IPv6 : ETHER_TYPE_IPv4);
 
 	return (char *)(eth + 1);
 }
@@ -125,78 +326,108 @@ __construct_ipv4_hdr(struct pkt_seq *pkt, void *hdr)
 					pkt->pkt_len - sizeof(struct ether_hdr));
 
 	/* Compute IPv4 header checksum */
-	ip->hdr_checksum = __checksum_16(ip, sizeof(struct ipv4_hdr));
+	ip->hdr_checksum = cksum_finish(cksum_sum(ip,
+					sizeof(struct ipv4_hdr), 0));
+}
+
+/** Construct ipv6 header */
+static void
+__construct_ipv6_hdr(struct pkt_seq *pkt, void *hdr)
+{
+	struct ipv6_hdr *ip6 = (struct ipv6_hdr*)hdr;
+	uint32_t low = 0;
+
+	/* zero out the header space */
+	memset((char *)ip6, 0, sizeof(struct ipv6_hdr));
+
+	/* Construct IPv6 header, there is no header checksum */
+	ip6->vtc_flow = rte_cpu_to_be_32(IP6_VTC_FLOW_DEF);
+	ip6->proto = pkt->proto;
+	ip6->hop_limits = IP_TTL_DEF;
+	/* the payload size, excluding the header */
+	ip6->payload_len = rte_cpu_to_be_16(pkt->pkt_len -
+					sizeof(struct ether_hdr) - sizeof(struct ipv6_hdr));
+
+	memcpy(ip6->src_addr, pkt->src_ip6, PKT_SEQ_IP6_PREFIX_LEN);
+	low = rte_cpu_to_be_32(pkt->src_ip);
+	memcpy(ip6->src_addr + PKT_SEQ_IP6_PREFIX_LEN, &low, sizeof(low));
+	memcpy(ip6->dst_addr, pkt->dst_ip6, PKT_SEQ_IP6_PREFIX_LEN);
+	low = rte_cpu_to_be_32(pkt->dst_ip);
+	memcpy(ip6->dst_addr + PKT_SEQ_IP6_PREFIX_LEN, &low, sizeof(low));
+}
+
+/* partial sum of the pseudo header of an L4 header after the L3 one */
+static inline uint64_t
+__l4_phdr_sum(struct pkt_seq *pkt, const void *l3_hdr, uint16_t l4_len)
+{
+	const struct ipv4_hdr *ip = (const struct ipv4_hdr *)l3_hdr;
+	const struct ipv6_hdr *ip6 = (const struct ipv6_hdr *)l3_hdr;
+
+	if (pkt->is_ipv6)
+		return cksum_ipv6_phdr(ip6->src_addr, ip6->dst_addr, ip6->proto,
+						l4_len);
+	return cksum_ipv4_phdr(ip->src_addr, ip->dst_addr, ip->next_proto_id,
+					l4_len);
 }
 
 /**
  * Construct TCP header
+ *
+ * The checksum covers the pseudo header of the IP header in front of it,
+ * and the payload following it.
  */
 static void
-__construct_tcp_hdr(struct pkt_seq *pkt, void *hdr)
+__construct_tcp_hdr(struct pkt_seq *pkt, char *l3_hdr)
 {
+	struct tcp_hdr *tcp = (struct tcp_hdr *)(l3_hdr + pkt_seq_l3_len(pkt));
 	uint16_t tlen = 0;
-	struct tcpip_hdr *tcpip = (struct tcpip_hdr*)hdr;
 
-	tlen = pkt->pkt_len - sizeof(struct ether_hdr)
-						- sizeof(struct ipv4_hdr);
+	tlen = pkt->pkt_len - sizeof(struct ether_hdr) - pkt_seq_l3_len(pkt);
 
 	/* zero out the header space */
-	memset(tcpip, 0, sizeof(struct tcpip_hdr));
+	memset(tcp, 0, sizeof(struct tcp_hdr));
 
 	/* Construct TCP header */
-	tcpip->tcp.src_port = rte_cpu_to_be_16(pkt->src_port);
-	tcpip->tcp.dst_port = rte_cpu_to_be_16(pkt->dst_port);
-	tcpip->tcp.sent_seq = rte_cpu_to_be_32(PKT_SEQ_TCP_SEQ);
-	tcpip->tcp.recv_ack = rte_cpu_to_be_32(PKT_SEQ_TCP_ACK);
-	tcpip->tcp.data_off = ((sizeof(struct tcp_hdr) / sizeof(uint32_t)) << 4);
-	tcpip->tcp.tcp_flags = PKT_SEQ_TCP_FLAGS;
-	tcpip->tcp.rx_win = rte_cpu_to_be_16(PKT_SEQ_TCP_WINDOW);
-	tcpip->tcp.tcp_urp = 0;
-
-	/* Construct part of IP header */
-	tcpip->ip.src_addr = rte_cpu_to_be_32(pkt->src_ip);
-	tcpip->ip.dst_addr = rte_cpu_to_be_32(pkt->dst_ip);
-	tcpip->ip.total_length = rte_cpu_to_be_16(tlen);
-	tcpip->ip.next_proto_id = IPPROTO_TCP;
+	tcp->src_port = rte_cpu_to_be_16(pkt->src_port);
+	tcp->dst_port = rte_cpu_to_be_16(pkt->dst_port);
+	tcp->sent_seq = rte_cpu_to_be_32(PKT_SEQ_TCP_SEQ);
+	tcp->recv_ack = rte_cpu_to_be_32(PKT_SEQ_TCP_ACK);
+	tcp->data_off = ((sizeof(struct tcp_hdr) / sizeof(uint32_t)) << 4);
+	tcp->tcp_flags = PKT_SEQ_TCP_FLAGS;
+	tcp->rx_win = rte_cpu_to_be_16(PKT_SEQ_TCP_WINDOW);
+	tcp->tcp_urp = 0;
 
 	/* Calculate tcp checksum */
-	tcpip->tcp.cksum = __checksum_16(tcpip, tlen);
+	tcp->cksum = cksum_finish(cksum_sum(tcp, tlen,
+					__l4_phdr_sum(pkt, l3_hdr, tlen)));
 }
 
 /**
  * Construct UDP header
  */
 static void
-__construct_udp_hdr(struct pkt_seq *pkt, void *hdr)
+__construct_udp_hdr(struct pkt_seq *pkt, char *l3_hdr)
 {
-	struct udpip_hdr *udpip = (struct udpip_hdr *)hdr;
+	struct udp_hdr *udp = (struct udp_hdr *)(l3_hdr + pkt_seq_l3_len(pkt));
 	uint16_t tlen = 0, crc = 0;
 
-	/* zero out the header space */
-	memset(udpip, 0, sizeof(struct udpip_hdr));
-
-	tlen = pkt->pkt_len - sizeof(struct ether_hdr)
-						- sizeof(struct ipv4_hdr);
+	tlen = pkt->pkt_len - sizeof(struct ether_hdr) - pkt_seq_l3_len(pkt);
 
-	/* Construct pseudo IPv4 header */
-	udpip->ip.next_proto_id = IPPROTO_UDP;
-	/* In udp checksum compution, the total_length of IP pseudo header
-	 * equals to the length of udp datagram (udp header + udp payload).
-	 */
-	udpip->ip.total_length = rte_cpu_to_be_16(tlen);
-	udpip->ip.src_addr = rte_cpu_to_be_32(pkt->src_ip);
-	udpip->ip.dst_addr = rte_cpu_to_be_32(pkt->dst_ip);
+	/* zero out the header space */
+	memset(udp, 0, sizeof(struct udp_hdr));
 
 	/* Construct UDP header */
-	udpip->udp.src_port = rte_cpu_to_be_16(pkt->src_port);
-	udpip->udp.dst_port = rte_cpu_to_be_16(pkt->dst_port);
-	udpip->udp.dgram_len = rte_cpu_to_be_16(tlen);
-
-	/* Calculate UDP checksum */
-	crc = __checksum_16(udpip, tlen);
+	udp->src_port = rte_cpu_to_be_16(pkt->src_port);
+	udp->dst_port = rte_cpu_to_be_16(pkt->dst_port);
+	udp->dgram_len = rte_cpu_to_be_16(tlen);
+
+	/* Calculate UDP checksum, 0 means "no checksum" (and is not allowed
+	 * over IPv6) */
+	crc = cksum_finish(cksum_sum(udp, tlen,
+					__l4_phdr_sum(pkt, l3_hdr, tlen)));
 	if (crc == 0)
 		crc = 0xFFFF;
-	udpip->udp.dgram_cksum = crc;
+	udp->dgram_cksum = crc;
 }
 
 /** Construct packet based on the pkt_seq value */
@@ -208,6 +439,12 @@ pkt_seq_construct_pkt(struct pkt_seq *pkt, void *hdr)
 	/* construct ethernet header */
 	l3_hdr = __construct_eth_hdr(pkt, hdr);
 
+	/* construct IP header, the L4 checksums need its addresses */
+	if (pkt->is_ipv6)
+		__construct_ipv6_hdr(pkt, l3_hdr);
+	else
+		__construct_ipv4_hdr(pkt, l3_hdr);
+
 	if (pkt->proto == IPPROTO_UDP) {
 		/* construct UDP header */
 		__construct_udp_hdr(pkt, l3_hdr);
@@ -215,7 +452,4 @@ pkt_seq_construct_pkt(struct pkt_seq *pkt, void *hdr)
 		/* construct TCP header */
 		__construct_tcp_hdr(pkt, l3_hdr);
 	}
-
-	/* construct IPv4 header */
-	__construct_ipv4_hdr(pkt, l3_hdr);
 }
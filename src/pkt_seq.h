@@ -28,6 +28,22 @@ struct udpip_hdr {
 	struct udp_hdr udp;
 } __attribute__((__packed__));
 
+/** IPv6 + TCP headers */
+struct tcpip6_hdr {
+	/** IPv6 header */
+	struct ipv6_hdr ip6;
+	/** tcp header */
+	struct tcp_hdr tcp;
+} __attribute__((__packed__));
+
+/** IPv6 + UDP headers */
+struct udpip6_hdr {
+	/** IPv6 header */
+	struct ipv6_hdr ip6;
+	/** udp header */
+	struct udp_hdr udp;
+} __attribute__((__packed__));
+
 /** Packet header */
 struct pkt_hdr {
 	/** Ethernet header */
@@ -40,6 +56,12 @@ struct pkt_hdr {
 		struct tcpip_hdr tcpip;
 		/** UDP */
 		struct udpip_hdr udpip;
+		/** IPv6 */
+		struct ipv6_hdr ip6;
+		/** TCP over IPv6 */
+		struct tcpip6_hdr tcpip6;
+		/** UDP over IPv6 */
+		struct udpip6_hdr udpip6;
 	} u;
 } __attribute__((__packed__));
 
@@ -50,8 +72,15 @@ struct pkt_hdr {
 #define PKT_SEQ_IP_SRC	IPv4(192,168,0,12)
 /** Default destination ipv4 address */
 #define PKT_SEQ_IP_DST	IPv4(192,168,0,21)
+/** Upper 96 bits of the default ipv6 addresses (2001:db8::/96), the low 32
+ * bits are the default ipv4 ones */
+#define PKT_SEQ_IP6_PREFIX	{0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0}
+/** Length of the upper part of ipv6 addresses kept by ranges */
+#define PKT_SEQ_IP6_PREFIX_LEN	12
 /** Default length of packet */
 #define PKT_SEQ_PKT_LEN 60
+/** Default length of ipv6 packets, the 78-byte frames of RFC 5180 */
+#define PKT_SEQ_IP6_PKT_LEN 74
 /** Default L3 protocol */
 #define PKT_SEQ_PROTO IPPROTO_UDP
 /** Default source port */
@@ -68,6 +97,16 @@ struct pkt_hdr {
 /** Default tcp window size */
 #define PKT_SEQ_TCP_WINDOW 8192
 
+/** Max number of packet sizes in a size distribution */
+#define PKT_SEQ_SIZE_MAX	8
+/** MTU of jumbo frames */
+#define PKT_SEQ_JUMBO_MTU	9000
+/** Max frame size (including FCS) of jumbo frames */
+#define PKT_SEQ_JUMBO_FRAME_LEN	(PKT_SEQ_JUMBO_MTU + ETHER_HDR_LEN + \
+				ETHER_CRC_LEN)
+/** Simple IMIX: frame sizes (including FCS) and their weights */
+#define PKT_SEQ_SIZE_IMIX	"64:7,594:4,1518:1"
+
 /** Structure of a packet sequence */
 struct pkt_seq {
 	/** source mac address */
@@ -78,6 +117,13 @@ struct pkt_seq {
 	uint32_t src_ip;
 	/** destination ipv4 address */
 	uint32_t dst_ip;
+	/** whether packets are ipv6, src_ip and dst_ip are then the low 32
+	 * bits of the addresses */
+	uint8_t is_ipv6;
+	/** upper 96 bits of the source ipv6 address */
+	uint8_t src_ip6[PKT_SEQ_IP6_PREFIX_LEN];
+	/** upper 96 bits of the destination ipv6 address */
+	uint8_t dst_ip6[PKT_SEQ_IP6_PREFIX_LEN];
 	/** L3 protocol */
 	uint8_t proto;
 	/** source port */
@@ -88,6 +134,39 @@ struct pkt_seq {
 	uint16_t pkt_len;
 };
 
+/** Value ranges used to randomize packet fields (host byte order), ranges
+ * of ipv6 addresses cover their low 32 bits */
+struct pkt_seq_range {
+	/** min source ipv4 address */
+	uint32_t src_ip_min;
+	/** max source ipv4 address */
+	uint32_t src_ip_max;
+	/** min destination ipv4 address */
+	uint32_t dst_ip_min;
+	/** max destination ipv4 address */
+	uint32_t dst_ip_max;
+	/** min source port */
+	uint16_t src_port_min;
+	/** max source port */
+	uint16_t src_port_max;
+	/** min destination port */
+	uint16_t dst_port_min;
+	/** max destination port */
+	uint16_t dst_port_max;
+	/** whether to randomize the low 32 bits of both MAC addresses */
+	uint8_t rand_mac;
+};
+
+/** Distribution of packet sizes */
+struct pkt_seq_size {
+	/** Number of sizes, more than one means a size mix */
+	uint8_t nb_sizes;
+	/** Length of each size (excluding FCS) */
+	uint16_t len[PKT_SEQ_SIZE_MAX];
+	/** Relative weight of each size */
+	uint32_t weight[PKT_SEQ_SIZE_MAX];
+};
+
 /**
  * Convert a MAC address string to a ether_addr structure.
  *
@@ -101,6 +180,84 @@ struct pkt_seq {
  */
 int pkt_seq_parse_mac(const char *str, struct ether_addr *addr);
 
+/**
+ * Parse an ipv4 address range.
+ *
+ * @param str
+ *	A range string, formatted as "a.b.c.d-e.f.g.h" or "a.b.c.d"
+ * @param min
+ *	Pointer to store the lower bound (host byte order)
+ * @param max
+ *	Pointer to store the upper bound (host byte order)
+ * @return
+ *	- 0 on success
+ *	- Negative value on failure
+ */
+int pkt_seq_parse_ip_range(const char *str, uint32_t *min, uint32_t *max);
+
+/**
+ * Parse an ipv6 address range.
+ *
+ * Both bounds must share their upper 96 bits, ranges only cover the low
+ * 32 bits of the addresses.
+ *
+ * @param str
+ *	A range string, formatted as "a::b-a::c" or "a::b"
+ * @param prefix
+ *	Pointer to store the upper 96 bits (PKT_SEQ_IP6_PREFIX_LEN bytes)
+ * @param min
+ *	Pointer to store the low 32 bits of the lower bound (host byte order)
+ * @param max
+ *	Pointer to store the low 32 bits of the upper bound (host byte order)
+ * @return
+ *	- 0 on success
+ *	- Negative value on failure
+ */
+int pkt_seq_parse_ip6_range(const char *str, uint8_t *prefix, uint32_t *min,
+				uint32_t *max);
+
+/**
+ * Parse an L4 port range.
+ *
+ * @param str
+ *	A range string, formatted as "a-b" or "a"
+ * @param min
+ *	Pointer to store the lower bound
+ * @param max
+ *	Pointer to store the upper bound
+ * @return
+ *	- 0 on success
+ *	- Negative value on failure
+ */
+int pkt_seq_parse_port_range(const char *str, uint16_t *min, uint16_t *max);
+
+/**
+ * Parse a packet size distribution.
+ *
+ * Sizes are Ethernet frame sizes including FCS, from ETHER_MIN_LEN to
+ * PKT_SEQ_JUMBO_FRAME_LEN. Sizes above ETHER_MAX_LEN are jumbo frames.
+ *
+ * @param str
+ *	"imix" for the simple IMIX (PKT_SEQ_SIZE_IMIX), a single size "N",
+ *	or a list of sizes and weights "s:w,s:w,..."
+ * @param size
+ *	Pointer to store the distribution
+ * @return
+ *	- 0 on success
+ *	- Negative value on failure
+ */
+int pkt_seq_parse_size(const char *str, struct pkt_seq_size *size);
+
+/**
+ * Initialize a range so that every field keeps the value of pkt
+ *
+ * @param range
+ *	Pointer to the range to initialize
+ * @param pkt
+ *	Pointer to the pkt_seq holding the fixed values
+ */
+void pkt_seq_init_range(struct pkt_seq_range *range, struct pkt_seq *pkt);
+
 /**
  * Initialize per-port local pkt_seq
  *
@@ -126,4 +283,46 @@ void pkt_seq_init_local(struct pkt_seq *local, struct pkt_seq *global,
  */
 void pkt_seq_construct_pkt(struct pkt_seq *pkt, void *hdr);
 
+/**
+ * Length of the L3 header of the packets of a pkt_seq
+ *
+ * @param pkt
+ *	Pointer to the pkt_seq structure.
+ */
+static inline uint16_t
+pkt_seq_l3_len(const struct pkt_seq *pkt)
+{
+	return pkt->is_ipv6 ? sizeof(struct ipv6_hdr) : sizeof(struct ipv4_hdr);
+}
+
+/**
+ * Offset of the source address in the packets of a pkt_seq, of its low 32
+ * bits with ipv6
+ *
+ * @param pkt
+ *	Pointer to the pkt_seq structure.
+ */
+static inline uint16_t
+pkt_seq_src_ip_off(const struct pkt_seq *pkt)
+{
+	return sizeof(struct ether_hdr) + (pkt->is_ipv6 ?
+			offsetof(struct ipv6_hdr, src_addr) + PKT_SEQ_IP6_PREFIX_LEN :
+			offsetof(struct ipv4_hdr, src_addr));
+}
+
+/**
+ * Offset of the destination address in the packets of a pkt_seq, of its
+ * low 32 bits with ipv6
+ *
+ * @param pkt
+ *	Pointer to the pkt_seq structure.
+ */
+static inline uint16_t
+pkt_seq_dst_ip_off(const struct pkt_seq *pkt)
+{
+	return sizeof(struct ether_hdr) + (pkt->is_ipv6 ?
+			offsetof(struct ipv6_hdr, dst_addr) + PKT_SEQ_IP6_PREFIX_LEN :
+			offsetof(struct ipv4_hdr, dst_addr));
+}
+
 #endif /* _PKT_SEQ_H_ */
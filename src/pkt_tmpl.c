@@ -0,0 +1,793 @@
+#include "util.h"
+#include "pkt_tmpl.h"
+#include "pkt_seq.h"
+
+/* max number of fields of a template line */
+#define TMPL_NB_FIELDS	(PKT_TMPL_HDR_FIELDS_MAX + 1)
+
+/* ether types and ports of the encapsulations */
+#define TMPL_ETHER_TYPE_QINQ	0x88A8
+#define TMPL_ETHER_TYPE_MPLS	0x8847
+#define TMPL_ETHER_TYPE_TEB	0x6558
+#define TMPL_UDP_PORT_VXLAN	4789
+#define TMPL_UDP_PORT_GRE	4754
+
+/* VXLAN flags with a valid VNI */
+#define TMPL_VXLAN_FLAGS	0x08000000
+/* GRE flags with a key */
+#define TMPL_GRE_FLAGS	0x2000
+/* version bits of the first word of an IPv6 header */
+#define TMPL_IPV6_VERSION	0x60000000
+/* bottom of stack bit of an MPLS label stack entry */
+#define TMPL_MPLS_BOS	0x100
+
+/* MPLS label stack entry */
+struct tmpl_mpls_hdr {
+	uint32_t lse;
+} __attribute__((__packed__));
+
+/* GRE header with a key */
+struct tmpl_gre_hdr {
+	uint16_t flags;
+	uint16_t proto;
+	uint32_t key;
+} __attribute__((__packed__));
+
+/* kind of value of a field */
+enum {
+	TMPL_KIND_INT = 0,
+	TMPL_KIND_IPV4,
+	TMPL_KIND_IPV6,
+	TMPL_KIND_MAC,
+};
+
+/* a field of a header, bits [shift, shift + bits) of a word */
+struct tmpl_field_def {
+	const char *name;
+	/* offset of the word in the header */
+	uint16_t offset;
+	/* width of the word in bytes */
+	uint8_t width;
+	uint8_t shift;
+	uint8_t bits;
+	/* TMPL_KIND_* */
+	uint8_t kind;
+	/* PKT_TMPL_IN_PHDR if the field is part of a pseudo header */
+	uint8_t flags;
+	/* value if the description does not set it (host byte order) */
+	uint32_t def;
+};
+
+/* a field filling its word */
+#define TMPL_FIELD(n, type, member, w, kind, flags, def) \
+	{n, offsetof(type, member), w, 0, 8 * (w), kind, flags, def}
+/* an integer field of some bits of a word */
+#define TMPL_BITS(n, off, w, shift, bits, def) \
+	{n, off, w, shift, bits, TMPL_KIND_INT, 0, def}
+
+/* a header type */
+struct tmpl_hdr_def {
+	const char *name;
+	uint16_t len;
+	uint8_t nb_fields;
+	const struct tmpl_field_def *fields;
+};
+
+static const struct tmpl_field_def __eth_fields[] = {
+	TMPL_FIELD("dst", struct ether_hdr, d_addr, ETHER_ADDR_LEN,
+					TMPL_KIND_MAC, 0, 0),
+	TMPL_FIELD("src", struct ether_hdr, s_addr, ETHER_ADDR_LEN,
+					TMPL_KIND_MAC, 0, 0),
+};
+
+static const struct tmpl_field_def __ipv4_fields[] = {
+	TMPL_FIELD("src", struct ipv4_hdr, src_addr, 4,
+					TMPL_KIND_IPV4, PKT_TMPL_IN_PHDR, PKT_SEQ_IP_SRC),
+	TMPL_FIELD("dst", struct ipv4_hdr, dst_addr, 4,
+					TMPL_KIND_IPV4, PKT_TMPL_IN_PHDR, PKT_SEQ_IP_DST),
+	TMPL_FIELD("tos", struct ipv4_hdr, type_of_service, 1,
+					TMPL_KIND_INT, 0, 0),
+	TMPL_FIELD("ttl", struct ipv4_hdr, time_to_live, 1,
+					TMPL_KIND_INT, 0, 64),
+	TMPL_FIELD("id", struct ipv4_hdr, packet_id, 2,
+					TMPL_KIND_INT, 0, 0),
+};
+
+/* IPv6 addresses are written as their upper 96 bits and a 32-bit field */
+#define TMPL_IPV6_ADDR(n, member, def) \
+	{n, offsetof(struct ipv6_hdr, member) + PKT_SEQ_IP6_PREFIX_LEN, 4, 0, \
+		32, TMPL_KIND_IPV6, PKT_TMPL_IN_PHDR, def}
+
+static const struct tmpl_field_def __ipv6_fields[] = {
+	TMPL_IPV6_ADDR("src", src_addr, PKT_SEQ_IP_SRC),
+	TMPL_IPV6_ADDR("dst", dst_addr, PKT_SEQ_IP_DST),
+	TMPL_BITS("tc", offsetof(struct ipv6_hdr, vtc_flow), 4, 20, 8, 0),
+	TMPL_BITS("flow", offsetof(struct ipv6_hdr, vtc_flow), 4, 0, 20, 0),
+	TMPL_FIELD("hlim", struct ipv6_hdr, hop_limits, 1,
+					TMPL_KIND_INT, 0, 64),
+};
+
+static const uint8_t __ip6_prefix_def[PKT_SEQ_IP6_PREFIX_LEN] =
+				PKT_SEQ_IP6_PREFIX;
+
+/* index of dport, defaulting to the port of a tunnel */
+#define TMPL_UDP_DPORT	1
+
+static const struct tmpl_field_def __udp_fields[] = {
+	TMPL_FIELD("sport", struct udp_hdr, src_port, 2,
+					TMPL_KIND_INT, 0, PKT_SEQ_PORT_SRC),
+	TMPL_FIELD("dport", struct udp_hdr, dst_port, 2,
+					TMPL_KIND_INT, 0, PKT_SEQ_PORT_DST),
+};
+
+static const struct tmpl_field_def __tcp_fields[] = {
+	TMPL_FIELD("sport", struct tcp_hdr, src_port, 2,
+					TMPL_KIND_INT, 0, PKT_SEQ_PORT_SRC),
+	TMPL_FIELD("dport", struct tcp_hdr, dst_port, 2,
+					TMPL_KIND_INT, 0, PKT_SEQ_PORT_DST),
+	TMPL_FIELD("seq", struct tcp_hdr, sent_seq, 4,
+					TMPL_KIND_INT, 0, PKT_SEQ_TCP_SEQ),
+	TMPL_FIELD("ack", struct tcp_hdr, recv_ack, 4,
+					TMPL_KIND_INT, 0, PKT_SEQ_TCP_ACK),
+	TMPL_FIELD("flags", struct tcp_hdr, tcp_flags, 1,
+					TMPL_KIND_INT, 0, PKT_SEQ_TCP_FLAGS),
+	TMPL_FIELD("win", struct tcp_hdr, rx_win, 2,
+					TMPL_KIND_INT, 0, PKT_SEQ_TCP_WINDOW),
+};
+
+/* 802.1Q and 802.1ad tags share the layout of their TCI */
+static const struct tmpl_field_def __vlan_fields[] = {
+	TMPL_BITS("pcp", offsetof(struct vlan_hdr, vlan_tci), 2, 13, 3, 0),
+	TMPL_BITS("dei", offsetof(struct vlan_hdr, vlan_tci), 2, 12, 1, 0),
+	TMPL_BITS("vid", offsetof(struct vlan_hdr, vlan_tci), 2, 0, 12, 1),
+};
+
+static const struct tmpl_field_def __mpls_fields[] = {
+	TMPL_BITS("label", offsetof(struct tmpl_mpls_hdr, lse), 4, 12, 20, 16),
+	TMPL_BITS("tc", offsetof(struct tmpl_mpls_hdr, lse), 4, 9, 3, 0),
+	TMPL_BITS("ttl", offsetof(struct tmpl_mpls_hdr, lse), 4, 0, 8, 64),
+};
+
+static const struct tmpl_field_def __vxlan_fields[] = {
+	TMPL_BITS("vni", offsetof(struct vxlan_hdr, vx_vni), 4, 8, 24, 1),
+};
+
+static const struct tmpl_field_def __gre_fields[] = {
+	TMPL_BITS("key", offsetof(struct tmpl_gre_hdr, key), 4, 0, 32, 1),
+};
+
+#define TMPL_HDR_DEF(n, type, fields) \
+	{n, sizeof(type), RTE_DIM(fields), fields}
+
+/* indexed by PKT_TMPL_HDR_* */
+static const struct tmpl_hdr_def __hdr_defs[PKT_TMPL_HDR_MAX_TYPE] = {
+	TMPL_HDR_DEF("eth", struct ether_hdr, __eth_fields),
+	TMPL_HDR_DEF("ipv4", struct ipv4_hdr, __ipv4_fields),
+	TMPL_HDR_DEF("udp", struct udp_hdr, __udp_fields),
+	TMPL_HDR_DEF("tcp", struct tcp_hdr, __tcp_fields),
+	TMPL_HDR_DEF("vlan", struct vlan_hdr, __vlan_fields),
+	TMPL_HDR_DEF("qinq", struct vlan_hdr, __vlan_fields),
+	TMPL_HDR_DEF("mpls", struct tmpl_mpls_hdr, __mpls_fields),
+	TMPL_HDR_DEF("vxlan", struct vxlan_hdr, __vxlan_fields),
+	TMPL_HDR_DEF("gre", struct tmpl_gre_hdr, __gre_fields),
+	TMPL_HDR_DEF("ipv6", struct ipv6_hdr, __ipv6_fields),
+};
+
+static inline bool
+__tmpl_is_l4(uint8_t type)
+{
+	return type == PKT_TMPL_HDR_UDP || type == PKT_TMPL_HDR_TCP;
+}
+
+static inline bool
+__tmpl_is_l3(uint8_t type)
+{
+	return type == PKT_TMPL_HDR_IPV4 || type == PKT_TMPL_HDR_IPV6;
+}
+
+/* whether a header may follow another one, prev is MAX_TYPE at the start */
+static bool
+__tmpl_can_follow(uint8_t prev, uint8_t type)
+{
+	switch (prev) {
+	case PKT_TMPL_HDR_MAX_TYPE:
+		return type == PKT_TMPL_HDR_ETH;
+	case PKT_TMPL_HDR_ETH:
+		return type == PKT_TMPL_HDR_VLAN || type == PKT_TMPL_HDR_QINQ ||
+				type == PKT_TMPL_HDR_MPLS || __tmpl_is_l3(type);
+	case PKT_TMPL_HDR_QINQ:
+		return type == PKT_TMPL_HDR_VLAN;
+	case PKT_TMPL_HDR_VLAN:
+		return type == PKT_TMPL_HDR_VLAN || type == PKT_TMPL_HDR_MPLS ||
+				__tmpl_is_l3(type);
+	case PKT_TMPL_HDR_MPLS:
+		return type == PKT_TMPL_HDR_MPLS || __tmpl_is_l3(type);
+	case PKT_TMPL_HDR_IPV4:
+	case PKT_TMPL_HDR_IPV6:
+		return __tmpl_is_l4(type) || type == PKT_TMPL_HDR_GRE;
+	case PKT_TMPL_HDR_UDP:
+		return type == PKT_TMPL_HDR_VXLAN || type == PKT_TMPL_HDR_GRE;
+	case PKT_TMPL_HDR_VXLAN:
+		return type == PKT_TMPL_HDR_ETH;
+	case PKT_TMPL_HDR_GRE:
+		return type == PKT_TMPL_HDR_ETH || __tmpl_is_l3(type);
+	default:
+		return false;
+	}
+}
+
+/* parse the mutator following the '/' of a range */
+static int
+__tmpl_parse_mutator(const char *str, struct pkt_tmpl_value *val)
+{
+	char *end = NULL;
+	unsigned long step = 1;
+
+	if (strcmp(str, "random") == 0) {
+		val->mutator = PKT_TMPL_MUT_RANDOM;
+		return 0;
+	}
+
+	if (strncmp(str, "inc", 3) == 0)
+		val->mutator = PKT_TMPL_MUT_INC;
+	else if (strncmp(str, "dec", 3) == 0)
+		val->mutator = PKT_TMPL_MUT_DEC;
+	else
+		return ERR_FORMAT;
+
+	str += 3;
+	if (*str == ':') {
+		errno = 0;
+		step = strtoul(str + 1, &end, 0);
+		if (errno != 0 || end == str + 1 || *end != '\0' || step == 0 ||
+				step > UINT32_MAX)
+			return ERR_FORMAT;
+	} else if (*str != '\0') {
+		return ERR_FORMAT;
+	}
+	val->step = (uint32_t)step;
+	return 0;
+}
+
+/* parse an integer range "a-b" of a field */
+static int
+__tmpl_parse_int_range(char *str, uint8_t bits, uint32_t *min,
+				uint32_t *max)
+{
+	uint64_t limit = (1ull << bits) - 1;
+	unsigned long long lo = 0, hi = 0;
+	char *end = NULL;
+
+	errno = 0;
+	lo = strtoull(str, &end, 0);
+	if (errno != 0 || end == str || lo > limit)
+		return ERR_FORMAT;
+	hi = lo;
+
+	if (*end == '-') {
+		str = end + 1;
+		hi = strtoull(str, &end, 0);
+		if (errno != 0 || end == str || hi > limit || hi < lo)
+			return ERR_FORMAT;
+	}
+	if (*end != '\0')
+		return ERR_FORMAT;
+
+	*min = (uint32_t)lo;
+	*max = (uint32_t)hi;
+	return 0;
+}
+
+/* parse the value of a field */
+static int
+__tmpl_parse_value(const struct tmpl_field_def *def, char *str,
+				struct pkt_tmpl_value *val)
+{
+	char *mut = NULL;
+
+	memset(val, 0, sizeof(struct pkt_tmpl_value));
+	val->is_set = 1;
+
+	if (def->kind == TMPL_KIND_MAC)
+		return pkt_seq_parse_mac(str, &val->mac);
+
+	mut = strchr(str, '/');
+	if (mut != NULL)
+		*mut++ = '\0';
+
+	if (def->kind == TMPL_KIND_IPV4) {
+		if (pkt_seq_parse_ip_range(str, &val->min, &val->max) < 0)
+			return ERR_FORMAT;
+	} else if (def->kind == TMPL_KIND_IPV6) {
+		if (pkt_seq_parse_ip6_range(str, val->ip6, &val->min,
+						&val->max) < 0)
+			return ERR_FORMAT;
+	} else if (__tmpl_parse_int_range(str, def->bits, &val->min,
+					&val->max) < 0) {
+		return ERR_FORMAT;
+	}
+
+	if (val->min == val->max)
+		val->mutator = PKT_TMPL_MUT_FIXED;
+	else if (mut == NULL)
+		val->mutator = PKT_TMPL_MUT_RANDOM;
+	else if (__tmpl_parse_mutator(mut, val) < 0)
+		return ERR_FORMAT;
+	return 0;
+}
+
+/* parse one header line */
+static int
+__tmpl_parse_hdr(struct pkt_tmpl_desc *desc, char **fld, int nb_fld)
+{
+	struct pkt_tmpl_hdr *hdr = &desc->hdrs[desc->nb_hdrs];
+	const struct tmpl_hdr_def *hdef = NULL;
+	uint8_t prev = PKT_TMPL_HDR_MAX_TYPE, j = 0;
+	char *val = NULL;
+	int i = 0;
+
+	memset(hdr, 0, sizeof(struct pkt_tmpl_hdr));
+	for (hdr->type = 0; hdr->type < PKT_TMPL_HDR_MAX_TYPE; hdr->type++) {
+		if (strcmp(fld[0], __hdr_defs[hdr->type].name) == 0)
+			break;
+	}
+	if (hdr->type == PKT_TMPL_HDR_MAX_TYPE) {
+		LOG_ERROR("Unknown header %s", fld[0]);
+		return ERR_PARAM;
+	}
+	hdef = &__hdr_defs[hdr->type];
+
+	if (desc->nb_hdrs > 0)
+		prev = desc->hdrs[desc->nb_hdrs - 1].type;
+	if (!__tmpl_can_follow(prev, hdr->type)) {
+		LOG_ERROR("Header %s cannot follow %s", hdef->name,
+						(desc->nb_hdrs > 0) ?
+						__hdr_defs[prev].name : "nothing");
+		return ERR_PARAM;
+	}
+
+	for (i = 1; i < nb_fld; i++) {
+		val = strchr(fld[i], '=');
+		if (val == NULL) {
+			LOG_ERROR("Field %s has no value", fld[i]);
+			return ERR_PARAM;
+		}
+		*val++ = '\0';
+
+		for (j = 0; j < hdef->nb_fields; j++) {
+			if (strcmp(fld[i], hdef->fields[j].name) == 0)
+				break;
+		}
+		if (j == hdef->nb_fields) {
+			LOG_ERROR("Unknown field %s of %s", fld[i], hdef->name);
+			return ERR_PARAM;
+		}
+		if (__tmpl_parse_value(&hdef->fields[j], val,
+						&hdr->values[j]) < 0) {
+			LOG_ERROR("Wrong value %s of %s.%s", val, hdef->name,
+							fld[i]);
+			return ERR_PARAM;
+		}
+		if (hdr->values[j].mutator != PKT_TMPL_MUT_FIXED)
+			desc->nb_fields++;
+	}
+
+	if (desc->nb_fields > PKT_TMPL_FIELD_MAX) {
+		LOG_ERROR("At most %u mutable fields are supported",
+						PKT_TMPL_FIELD_MAX);
+		return ERR_PARAM;
+	}
+	return 0;
+}
+
+/* load a template description file */
+struct pkt_tmpl_desc *
+pkt_tmpl_load(const char *path)
+{
+	struct pkt_tmpl_desc *desc = NULL;
+	char line[512], *fld[TMPL_NB_FIELDS + 1], *p = NULL;
+	int nb_fld = 0;
+	uint32_t lineno = 0;
+	FILE *fp = NULL;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		LOG_ERROR("Failed to open template %s: %s", path, strerror(errno));
+		return NULL;
+	}
+
+	desc = (struct pkt_tmpl_desc *)calloc(1, sizeof(struct pkt_tmpl_desc));
+	if (desc == NULL) {
+		LOG_ERROR("Failed to allocate memory for template %s", path);
+		goto fail;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+
+		nb_fld = 0;
+		p = strtok(line, " \t\r\n");
+		while (p != NULL && nb_fld <= TMPL_NB_FIELDS) {
+			fld[nb_fld++] = p;
+			p = strtok(NULL, " \t\r\n");
+		}
+		if (nb_fld == 0 || fld[0][0] == '#')
+			continue;
+
+		if (desc->nb_hdrs >= PKT_TMPL_NB_HDRS_MAX ||
+				nb_fld > TMPL_NB_FIELDS) {
+			LOG_ERROR("Too many headers or fields at %s:%u",
+							path, lineno);
+			goto fail;
+		}
+		if (__tmpl_parse_hdr(desc, fld, nb_fld) < 0) {
+			LOG_ERROR("Wrong header at %s:%u", path, lineno);
+			goto fail;
+		}
+
+		desc->hdr_len += __hdr_defs[desc->hdrs[desc->nb_hdrs].type].len;
+		desc->nb_hdrs++;
+	}
+
+	/* the protocol fields are derived from the next header */
+	if (desc->nb_hdrs == 0 ||
+			!__tmpl_is_l4(desc->hdrs[desc->nb_hdrs - 1].type)) {
+		LOG_ERROR("Template %s does not end with an L4 header", path);
+		goto fail;
+	}
+	if (desc->hdr_len > PKT_TMPL_HDR_MAX) {
+		LOG_ERROR("Template %s has %u bytes of headers, more than %u",
+						path, desc->hdr_len, PKT_TMPL_HDR_MAX);
+		goto fail;
+	}
+
+	fclose(fp);
+	LOG_INFO("Loaded template %s: %u headers, %u bytes",
+					path, desc->nb_hdrs, desc->hdr_len);
+	return desc;
+
+fail:
+	zfree(desc);
+	fclose(fp);
+	return NULL;
+}
+
+/* free a template description */
+void
+pkt_tmpl_free(struct pkt_tmpl_desc *desc)
+{
+	zfree(desc);
+}
+
+/* first value written into the template */
+static inline uint32_t
+__tmpl_first_value(const struct tmpl_field_def *def,
+				const struct pkt_tmpl_value *val)
+{
+	if (!val->is_set)
+		return def->def;
+	return (val->mutator == PKT_TMPL_MUT_DEC) ? val->max : val->min;
+}
+
+/* bits of a field in its word */
+static inline uint32_t
+__tmpl_mask(const struct tmpl_field_def *def)
+{
+	return (uint32_t)(((1ull << def->bits) - 1) << def->shift);
+}
+
+/* write a field, keeping the other bits of its word */
+static void
+__tmpl_put(uint8_t *p, const struct tmpl_field_def *def, uint32_t val)
+{
+	uint32_t mask = __tmpl_mask(def), w32 = 0;
+	uint16_t w16 = 0;
+
+	val <<= def->shift;
+	if (def->width == 4) {
+		memcpy(&w32, p + def->offset, sizeof(w32));
+		w32 = rte_cpu_to_be_32((rte_be_to_cpu_32(w32) & ~mask) | val);
+		memcpy(p + def->offset, &w32, sizeof(w32));
+	} else if (def->width == 2) {
+		memcpy(&w16, p + def->offset, sizeof(w16));
+		w16 = rte_cpu_to_be_16((rte_be_to_cpu_16(w16) & ~mask) | val);
+		memcpy(p + def->offset, &w16, sizeof(w16));
+	} else {
+		p[def->offset] = (p[def->offset] & ~mask) | val;
+	}
+}
+
+/* write the fields of a header */
+static void
+__tmpl_write_fields(const struct pkt_tmpl_hdr *hdr, uint8_t *p,
+				const struct ether_addr *port_mac)
+{
+	const struct tmpl_hdr_def *hdef = &__hdr_defs[hdr->type];
+	const struct tmpl_field_def *def = NULL;
+	struct ether_addr mac;
+	uint8_t j = 0;
+
+	for (j = 0; j < hdef->nb_fields; j++) {
+		def = &hdef->fields[j];
+		if (def->kind == TMPL_KIND_MAC) {
+			if (hdr->values[j].is_set)
+				ether_addr_copy(&hdr->values[j].mac, &mac);
+			else if (def->offset == offsetof(struct ether_hdr, s_addr))
+				ether_addr_copy(port_mac, &mac);
+			else
+				pkt_seq_parse_mac(PKT_SEQ_MAC_DST, &mac);
+			memcpy(p + def->offset, &mac, ETHER_ADDR_LEN);
+			continue;
+		}
+		if (def->kind == TMPL_KIND_IPV6)
+			memcpy(p + def->offset - PKT_SEQ_IP6_PREFIX_LEN,
+							hdr->values[j].is_set ?
+							hdr->values[j].ip6 : __ip6_prefix_def,
+							PKT_SEQ_IP6_PREFIX_LEN);
+
+		__tmpl_put(p, def, __tmpl_first_value(def, &hdr->values[j]));
+	}
+}
+
+/* ether type announcing a header */
+static uint16_t
+__tmpl_ether_type(uint8_t type)
+{
+	switch (type) {
+	case PKT_TMPL_HDR_VLAN:
+		return ETHER_TYPE_VLAN;
+	case PKT_TMPL_HDR_QINQ:
+		return TMPL_ETHER_TYPE_QINQ;
+	case PKT_TMPL_HDR_MPLS:
+		return TMPL_ETHER_TYPE_MPLS;
+	case PKT_TMPL_HDR_ETH:
+		return TMPL_ETHER_TYPE_TEB;
+	case PKT_TMPL_HDR_IPV6:
+		return ETHER_TYPE_IPv6;
+	default:
+		return ETHER_TYPE_IPv4;
+	}
+}
+
+/* IP protocol announcing a header */
+static uint8_t
+__tmpl_ip_proto(uint8_t type)
+{
+	switch (type) {
+	case PKT_TMPL_HDR_TCP:
+		return IPPROTO_TCP;
+	case PKT_TMPL_HDR_GRE:
+		return IPPROTO_GRE;
+	default:
+		return IPPROTO_UDP;
+	}
+}
+
+/* fill the derived fields of a header, checksums excluded */
+static void
+__tmpl_build_hdr(const struct pkt_tmpl_desc *desc, uint8_t i,
+				uint8_t *p, uint16_t len)
+{
+	struct ether_hdr *eth = (struct ether_hdr *)p;
+	struct vlan_hdr *vlan = (struct vlan_hdr *)p;
+	struct tmpl_mpls_hdr *mpls = (struct tmpl_mpls_hdr *)p;
+	struct ipv4_hdr *ip = (struct ipv4_hdr *)p;
+	struct ipv6_hdr *ip6 = (struct ipv6_hdr *)p;
+	struct udp_hdr *udp = (struct udp_hdr *)p;
+	struct tcp_hdr *tcp = (struct tcp_hdr *)p;
+	struct vxlan_hdr *vxlan = (struct vxlan_hdr *)p;
+	struct tmpl_gre_hdr *gre = (struct tmpl_gre_hdr *)p;
+	uint8_t next = (i + 1 < desc->nb_hdrs) ?
+			desc->hdrs[i + 1].type : PKT_TMPL_HDR_MAX_TYPE;
+
+	switch (desc->hdrs[i].type) {
+	case PKT_TMPL_HDR_ETH:
+		eth->ether_type = rte_cpu_to_be_16(__tmpl_ether_type(next));
+		break;
+	case PKT_TMPL_HDR_VLAN:
+	case PKT_TMPL_HDR_QINQ:
+		vlan->eth_proto = rte_cpu_to_be_16(__tmpl_ether_type(next));
+		break;
+	case PKT_TMPL_HDR_MPLS:
+		if (next != PKT_TMPL_HDR_MPLS)
+			mpls->lse |= rte_cpu_to_be_32(TMPL_MPLS_BOS);
+		break;
+	case PKT_TMPL_HDR_IPV4:
+		ip->version_ihl = 0x45;
+		ip->next_proto_id = __tmpl_ip_proto(next);
+		ip->total_length = rte_cpu_to_be_16(len);
+		break;
+	case PKT_TMPL_HDR_IPV6:
+		/* tc and flow label share the word of the version */
+		ip6->vtc_flow |= rte_cpu_to_be_32(TMPL_IPV6_VERSION);
+		ip6->proto = __tmpl_ip_proto(next);
+		ip6->payload_len = rte_cpu_to_be_16(len - sizeof(struct ipv6_hdr));
+		break;
+	case PKT_TMPL_HDR_UDP:
+		udp->dgram_len = rte_cpu_to_be_16(len);
+		if (desc->hdrs[i].values[TMPL_UDP_DPORT].is_set)
+			break;
+		if (next == PKT_TMPL_HDR_VXLAN)
+			udp->dst_port = rte_cpu_to_be_16(TMPL_UDP_PORT_VXLAN);
+		else if (next == PKT_TMPL_HDR_GRE)
+			udp->dst_port = rte_cpu_to_be_16(TMPL_UDP_PORT_GRE);
+		break;
+	case PKT_TMPL_HDR_TCP:
+		tcp->data_off = (sizeof(struct tcp_hdr) / sizeof(uint32_t)) << 4;
+		break;
+	case PKT_TMPL_HDR_VXLAN:
+		vxlan->vx_flags = rte_cpu_to_be_32(TMPL_VXLAN_FLAGS);
+		break;
+	case PKT_TMPL_HDR_GRE:
+		gre->flags = rte_cpu_to_be_16(TMPL_GRE_FLAGS);
+		gre->proto = rte_cpu_to_be_16(__tmpl_ether_type(next));
+		break;
+	default:
+		break;
+	}
+}
+
+/* compute the checksum of a header, the ones of inner headers are final */
+static void
+__tmpl_cksum_hdr(const struct pkt_tmpl_desc *desc, uint8_t i,
+				const uint16_t *off, uint8_t *buf, uint16_t pkt_len)
+{
+	struct ipv4_hdr *ip = (struct ipv4_hdr *)(buf + off[i]);
+	struct udp_hdr *udp = (struct udp_hdr *)(buf + off[i]);
+	struct tcp_hdr *tcp = (struct tcp_hdr *)(buf + off[i]);
+	const struct ipv4_hdr *outer = NULL;
+	const struct ipv6_hdr *outer6 = NULL;
+	uint16_t l4_len = pkt_len - off[i];
+	uint64_t sum = 0;
+
+	/* L4 headers always follow an IP header, the payload is zero */
+	if (__tmpl_is_l4(desc->hdrs[i].type)) {
+		outer = (const struct ipv4_hdr *)(buf + off[i - 1]);
+		outer6 = (const struct ipv6_hdr *)(buf + off[i - 1]);
+		if (desc->hdrs[i - 1].type == PKT_TMPL_HDR_IPV6)
+			sum = cksum_ipv6_phdr(outer6->src_addr, outer6->dst_addr,
+							outer6->proto, l4_len);
+		else
+			sum = cksum_ipv4_phdr(outer->src_addr, outer->dst_addr,
+							outer->next_proto_id, l4_len);
+		sum = cksum_sum(buf + off[i], desc->hdr_len - off[i], sum);
+	}
+
+	switch (desc->hdrs[i].type) {
+	case PKT_TMPL_HDR_IPV4:
+		ip->hdr_checksum = cksum_finish(cksum_sum(ip,
+						sizeof(struct ipv4_hdr), 0));
+		break;
+	case PKT_TMPL_HDR_UDP:
+		/* tunnels go without checksum, so that inner fields vary
+		 * without fixing it */
+		if (i + 1 < desc->nb_hdrs) {
+			udp->dgram_cksum = 0;
+			break;
+		}
+		/* 0 means "no checksum" */
+		udp->dgram_cksum = cksum_finish(sum);
+		if (udp->dgram_cksum == 0)
+			udp->dgram_cksum = 0xFFFF;
+		break;
+	case PKT_TMPL_HDR_TCP:
+		tcp->cksum = cksum_finish(sum);
+		break;
+	default:
+		break;
+	}
+}
+
+/* offset of the checksum of an IPv4 or L4 header */
+static uint16_t
+__tmpl_cksum_off(uint8_t type)
+{
+	switch (type) {
+	case PKT_TMPL_HDR_IPV4:
+		return offsetof(struct ipv4_hdr, hdr_checksum);
+	case PKT_TMPL_HDR_UDP:
+		return offsetof(struct udp_hdr, dgram_cksum);
+	case PKT_TMPL_HDR_TCP:
+		return offsetof(struct tcp_hdr, cksum);
+	default:
+		return 0;
+	}
+}
+
+/* record the mutable fields of a header and the checksums covering them */
+static void
+__tmpl_add_fields(const struct pkt_tmpl_desc *desc, uint8_t i,
+				const uint16_t *off, struct pkt_tmpl *tmpl)
+{
+	const struct pkt_tmpl_hdr *hdr = &desc->hdrs[i];
+	const struct tmpl_hdr_def *hdef = &__hdr_defs[hdr->type];
+	const struct pkt_tmpl_value *val = NULL;
+	struct pkt_tmpl_field *field = NULL;
+	uint8_t j = 0, l4 = i;
+
+	/* an IP header is in the pseudo header of the L4 one after it */
+	if (__tmpl_is_l3(hdr->type))
+		l4 = i + 1;
+
+	for (j = 0; j < hdef->nb_fields; j++) {
+		val = &hdr->values[j];
+		if (!val->is_set || val->mutator == PKT_TMPL_MUT_FIXED)
+			continue;
+
+		field = &tmpl->fields[tmpl->nb_fields++];
+		memset(field, 0, sizeof(struct pkt_tmpl_field));
+		field->offset = off[i] + hdef->fields[j].offset;
+		field->width = hdef->fields[j].width;
+		field->shift = hdef->fields[j].shift;
+		field->mask = __tmpl_mask(&hdef->fields[j]);
+		field->mutator = val->mutator;
+		field->min = val->min;
+		field->step = val->step;
+		field->span = (uint64_t)val->max - val->min + 1;
+
+		if (hdr->type == PKT_TMPL_HDR_IPV4) {
+			field->cksum_flags |= PKT_TMPL_CKSUM_L3;
+			field->l3_cksum_off = off[i] + __tmpl_cksum_off(hdr->type);
+		}
+		if (__tmpl_is_l3(hdr->type) &&
+				!(hdef->fields[j].flags & PKT_TMPL_IN_PHDR))
+			continue;
+		if (l4 < desc->nb_hdrs && __tmpl_is_l4(desc->hdrs[l4].type)) {
+			field->cksum_flags |= PKT_TMPL_CKSUM_L4 |
+					hdef->fields[j].flags;
+			field->l4_cksum_off = off[l4] +
+					__tmpl_cksum_off(desc->hdrs[l4].type);
+			field->l4_proto = (desc->hdrs[l4].type == PKT_TMPL_HDR_TCP) ?
+					IPPROTO_TCP : IPPROTO_UDP;
+		}
+	}
+}
+
+/* compile a template description */
+int
+pkt_tmpl_compile(const struct pkt_tmpl_desc *desc,
+				const struct ether_addr *port_mac, uint16_t pkt_len,
+				uint8_t *buf, struct pkt_tmpl *tmpl)
+{
+	uint16_t off[PKT_TMPL_NB_HDRS_MAX];
+	int i = 0;
+
+	if (pkt_len < desc->hdr_len) {
+		LOG_ERROR("Packets of %u bytes cannot hold the %u bytes of headers"
+						" of the template", pkt_len, desc->hdr_len);
+		return ERR_PARAM;
+	}
+
+	memset(tmpl, 0, sizeof(struct pkt_tmpl));
+	memset(buf, 0, desc->hdr_len);
+	tmpl->hdr_len = desc->hdr_len;
+
+	for (i = 0; i < desc->nb_hdrs; i++) {
+		off[i] = (i == 0) ? 0 :
+				off[i - 1] + __hdr_defs[desc->hdrs[i - 1].type].len;
+		__tmpl_write_fields(&desc->hdrs[i], buf + off[i], port_mac);
+		__tmpl_build_hdr(desc, i, buf + off[i], pkt_len - off[i]);
+
+		if (__tmpl_is_l3(desc->hdrs[i].type) && tmpl->nb_l3++ == 0) {
+			tmpl->l3_off = off[i];
+			tmpl->l4_proto = __tmpl_ip_proto((i + 1 < desc->nb_hdrs) ?
+					desc->hdrs[i + 1].type : PKT_TMPL_HDR_MAX_TYPE);
+		}
+	}
+
+	i = desc->nb_hdrs - 1;
+	tmpl->inner_l4_proto = __tmpl_ip_proto(desc->hdrs[i].type);
+	tmpl->inner_l4_cksum_off = off[i] +
+			((tmpl->inner_l4_proto == IPPROTO_TCP) ?
+			offsetof(struct tcp_hdr, cksum) :
+			offsetof(struct udp_hdr, dgram_cksum));
+
+	/* outer L4 checksums cover the inner headers */
+	for (i = desc->nb_hdrs - 1; i >= 0; i--)
+		__tmpl_cksum_hdr(desc, i, off, buf, pkt_len);
+
+	/* the description holds at most PKT_TMPL_FIELD_MAX of them */
+	for (i = 0; i < desc->nb_hdrs; i++)
+		__tmpl_add_fields(desc, i, off, tmpl);
+	return 0;
+}
@@ -0,0 +1,288 @@
+#ifndef _PKTSENDER_PKT_TMPL_H_
+#define _PKTSENDER_PKT_TMPL_H_
+
+/**
+ * @file
+ * Declarative packet templates
+ *
+ * A template file describes a header stack, one header per line from the
+ * outermost one, with the value of its fields:
+ *	<header> [<field>=<value> ...]
+ * Empty lines and lines starting with '#' are skipped. Headers and their
+ * fields are:
+ *	- eth: dst, src (MAC addresses, src defaults to the port address)
+ *	- vlan: pcp, dei, vid (802.1Q tag)
+ *	- qinq: pcp, dei, vid (802.1ad service tag, followed by a vlan one)
+ *	- mpls: label, tc, ttl (one label stack entry)
+ *	- ipv4: src, dst (addresses), tos, ttl, id
+ *	- ipv6: src, dst (addresses, ranges cover their low 32 bits), tc,
+ *	  flow, hlim
+ *	- udp: sport, dport
+ *	- tcp: sport, dport, seq, ack, flags, win
+ *	- vxlan: vni (after udp, followed by the inner eth)
+ *	- gre: key (after ipv4 or udp, followed by eth or ipv4)
+ * Type, protocol, length, checksum, bottom-of-stack and tunnel flag fields
+ * are derived from the stack, which ends with the innermost udp or tcp.
+ * A udp header carrying a tunnel defaults to its IANA port and has no
+ * checksum.
+ *
+ * A value is either fixed, "<value>", or a range changed on every packet,
+ * "<min>-<max>[/<mutator>]" where the mutator is "random" (default),
+ * "inc[:<step>]" or "dec[:<step>]". MAC addresses are always fixed.
+ *
+ * A description is compiled once per TX queue into the header bytes and a
+ * list of mutable field records. Sending a packet only rewrites these
+ * fields and adjusts the checksums covering them incrementally, the
+ * encapsulations cost nothing per packet unless a field of theirs varies.
+ */
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include <rte_ether.h>
+
+#include "cksum.h"
+#include "pkt_seq.h"
+
+/** Max length of a header stack, fits the head of split packets */
+#define PKT_TMPL_HDR_MAX	128
+/** Max number of headers of a stack */
+#define PKT_TMPL_NB_HDRS_MAX	16
+/** Max number of fields of a header */
+#define PKT_TMPL_HDR_FIELDS_MAX	8
+/** Max number of mutable fields of a template */
+#define PKT_TMPL_FIELD_MAX	16
+
+/** Header type */
+enum {
+	PKT_TMPL_HDR_ETH = 0,
+	PKT_TMPL_HDR_IPV4,
+	PKT_TMPL_HDR_UDP,
+	PKT_TMPL_HDR_TCP,
+	PKT_TMPL_HDR_VLAN,
+	PKT_TMPL_HDR_QINQ,
+	PKT_TMPL_HDR_MPLS,
+	PKT_TMPL_HDR_VXLAN,
+	PKT_TMPL_HDR_GRE,
+	PKT_TMPL_HDR_IPV6,
+	PKT_TMPL_HDR_MAX_TYPE,
+};
+
+/** How a field changes from one packet to the next */
+enum {
+	/** same value in every packet */
+	PKT_TMPL_MUT_FIXED = 0,
+	/** walk the range up by step, wrapping around */
+	PKT_TMPL_MUT_INC,
+	/** walk the range down by step, wrapping around */
+	PKT_TMPL_MUT_DEC,
+	/** uniform random value of the range */
+	PKT_TMPL_MUT_RANDOM,
+};
+
+/** Value of a field in a description */
+struct pkt_tmpl_value {
+	/** Whether the description sets the field */
+	uint8_t is_set;
+	/** PKT_TMPL_MUT_* */
+	uint8_t mutator;
+	/** Lower bound (host byte order), the value of a fixed field */
+	uint32_t min;
+	/** Upper bound (host byte order) */
+	uint32_t max;
+	/** Step of inc/dec */
+	uint32_t step;
+	/** Value of a MAC address field */
+	struct ether_addr mac;
+	/** Upper 96 bits of an IPv6 address field, min and max are the low
+	 * 32 bits */
+	uint8_t ip6[PKT_SEQ_IP6_PREFIX_LEN];
+};
+
+/** A header of a description */
+struct pkt_tmpl_hdr {
+	/** PKT_TMPL_HDR_* */
+	uint8_t type;
+	/** Value of each field, in the order of the header fields */
+	struct pkt_tmpl_value values[PKT_TMPL_HDR_FIELDS_MAX];
+};
+
+/** A template description, as loaded from a file */
+struct pkt_tmpl_desc {
+	/** Number of headers */
+	uint8_t nb_hdrs;
+	/** Length of the header stack */
+	uint16_t hdr_len;
+	/** Number of mutable fields */
+	uint8_t nb_fields;
+	/** Headers from the outermost one */
+	struct pkt_tmpl_hdr hdrs[PKT_TMPL_NB_HDRS_MAX];
+};
+
+/** The field is covered by the IPv4 header checksum at l3_cksum_off */
+#define PKT_TMPL_CKSUM_L3	0x1
+/** The field is covered by the L4 checksum at l4_cksum_off */
+#define PKT_TMPL_CKSUM_L4	0x2
+/** l4_cksum_off holds the pseudo header sum of an offloaded checksum */
+#define PKT_TMPL_CKSUM_PHDR	0x4
+/** The field is part of the pseudo header of the L4 checksum */
+#define PKT_TMPL_IN_PHDR	0x8
+
+/** A mutable field of a compiled template */
+struct pkt_tmpl_field {
+	/** Offset from the start of the packet */
+	uint16_t offset;
+	/** Width in bytes of the word holding the field: 1, 2 or 4 */
+	uint8_t width;
+	/** Position of the lowest bit of the field in the word */
+	uint8_t shift;
+	/** Bits of the field in the word (host byte order) */
+	uint32_t mask;
+	/** PKT_TMPL_MUT_* */
+	uint8_t mutator;
+	/** Checksums covering the field, PKT_TMPL_CKSUM_* */
+	uint8_t cksum_flags;
+	/** L4 protocol of the L4 checksum, a zero UDP checksum is none */
+	uint8_t l4_proto;
+	/** Offset of the IPv4 header checksum */
+	uint16_t l3_cksum_off;
+	/** Offset of the L4 checksum */
+	uint16_t l4_cksum_off;
+	/** Lower bound (host byte order) */
+	uint32_t min;
+	/** Step of inc/dec */
+	uint32_t step;
+	/** Number of values in the range */
+	uint64_t span;
+};
+
+/** A compiled template */
+struct pkt_tmpl {
+	/** Length of the header stack */
+	uint16_t hdr_len;
+	/** Number of IPv4 and IPv6 headers */
+	uint8_t nb_l3;
+	/** Offset of the first one */
+	uint16_t l3_off;
+	/** Protocol of the L4 header following it, 0 if none */
+	uint8_t l4_proto;
+	/** Protocol of the innermost L4 header, the last one of the stack */
+	uint8_t inner_l4_proto;
+	/** Offset of its checksum */
+	uint16_t inner_l4_cksum_off;
+	/** Number of mutable fields */
+	uint8_t nb_fields;
+	/** Mutable fields, in the order of the stack */
+	struct pkt_tmpl_field fields[PKT_TMPL_FIELD_MAX];
+};
+
+/**
+ * Load a template description file
+ *
+ * @param path
+ *	The template file
+ * @return
+ *	- Pointer to the description, to be freed with pkt_tmpl_free()
+ *	- NULL on failure
+ */
+struct pkt_tmpl_desc *pkt_tmpl_load(const char *path);
+
+/**
+ * Free a template description
+ *
+ * @param desc
+ *	The description, may be NULL
+ */
+void pkt_tmpl_free(struct pkt_tmpl_desc *desc);
+
+/**
+ * Compile a template description
+ *
+ * Mutable fields start at the first value of their range.
+ *
+ * @param desc
+ *	The description
+ * @param port_mac
+ *	Default source MAC address
+ * @param pkt_len
+ *	Length of the packets (excluding FCS), at least the stack length
+ * @param buf
+ *	Output: the packet, the bytes following the header stack must be
+ *	zero
+ * @param tmpl
+ *	Output: the compiled template
+ * @return
+ *	- 0 on success
+ *	- ERR_PARAM if the packets are shorter than the stack
+ */
+int pkt_tmpl_compile(const struct pkt_tmpl_desc *desc,
+				const struct ether_addr *port_mac, uint16_t pkt_len,
+				uint8_t *buf, struct pkt_tmpl *tmpl);
+
+/**
+ * Write a new value of a mutable field and fix the checksums covering it
+ *
+ * @param data
+ *	Start of the packet
+ * @param field
+ *	The field
+ * @param val
+ *	New value (host byte order), the other bits of its word are kept
+ */
+static inline void
+pkt_tmpl_write(uint8_t *data, const struct pkt_tmpl_field *field,
+				uint32_t val)
+{
+	uint32_t old32 = 0, new32 = 0;
+	uint16_t old16 = 0, new16 = 0, delta = 0, cksum = 0;
+	uint16_t word = field->offset & ~1;
+
+	val <<= field->shift;
+	switch (field->width) {
+	case 4:
+		memcpy(&old32, data + field->offset, sizeof(old32));
+		new32 = rte_cpu_to_be_32((rte_be_to_cpu_32(old32) & ~field->mask) |
+						val);
+		memcpy(data + field->offset, &new32, sizeof(new32));
+		delta = cksum_fold(cksum_delta32(old32, new32));
+		break;
+	case 2:
+		memcpy(&old16, data + field->offset, sizeof(old16));
+		new16 = rte_cpu_to_be_16((rte_be_to_cpu_16(old16) &
+						~(uint16_t)field->mask) | (uint16_t)val);
+		memcpy(data + field->offset, &new16, sizeof(new16));
+		delta = cksum_fold(cksum_delta16(old16, new16));
+		break;
+	default:
+		/* headers start at even offsets, sum the 16-bit word around */
+		memcpy(&old16, data + word, sizeof(old16));
+		data[field->offset] = (data[field->offset] &
+						~(uint8_t)field->mask) | (uint8_t)val;
+		memcpy(&new16, data + word, sizeof(new16));
+		delta = cksum_fold(cksum_delta16(old16, new16));
+		break;
+	}
+
+	if (field->cksum_flags & PKT_TMPL_CKSUM_L3) {
+		memcpy(&cksum, data + field->l3_cksum_off, sizeof(cksum));
+		cksum = cksum_adjust(cksum, delta);
+		memcpy(data + field->l3_cksum_off, &cksum, sizeof(cksum));
+	}
+
+	if (field->cksum_flags & PKT_TMPL_CKSUM_L4) {
+		memcpy(&cksum, data + field->l4_cksum_off, sizeof(cksum));
+		/* a zero UDP checksum means "no checksum" */
+		if (field->l4_proto == IPPROTO_UDP && cksum == 0)
+			return;
+		cksum = cksum_adjust(cksum, delta);
+		if (field->l4_proto == IPPROTO_UDP && cksum == 0)
+			cksum = 0xFFFF;
+		memcpy(data + field->l4_cksum_off, &cksum, sizeof(cksum));
+	} else if (field->cksum_flags & PKT_TMPL_CKSUM_PHDR) {
+		memcpy(&cksum, data + field->l4_cksum_off, sizeof(cksum));
+		cksum = cksum_adjust_phdr(cksum, delta);
+		memcpy(data + field->l4_cksum_off, &cksum, sizeof(cksum));
+	}
+}
+
+#endif /* _PKTSENDER_PKT_TMPL_H_ */
@@ -4,6 +4,9 @@
 //#include "control.h"
 #include "port.h"
 #include "probe.h"
+#include "seqnum.h"
+#include "capture.h"
+#include "rss.h"
 
 #include <rte_common.h>
 #include <rte_lcore.h>
@@ -11,6 +14,7 @@
 #include <rte_ethdev.h>
 #include <rte_mempool.h>
 #include <rte_timer.h>
+#include <rte_cycles.h>
 
 #include <signal.h>
 #include <syscall.h>
@@ -34,8 +38,8 @@ static inline bool __is_tx_running(void)
 /**
  * Global signal handler.
  *
- * The first CTRL-C will stop all TX jobs, the second CTRL-C will safely
- * stop the whole process.
+ * The first CTRL-C will stop all TX jobs, the pcap readers feeding them
+ * included, the second CTRL-C will safely stop the whole process.
  */
 void pktsender_sig_handler(int signo)
 {
@@ -46,7 +50,8 @@ void pktsender_sig_handler(int signo)
 		if (sig_recved == 0) {
 			LOG_INFO("The first signal %d reveiced by thread %d. Stopping TX.",
 							signo, tid);
-			pktsender.job_state &= (~(1u << LCORE_JOB_TX));
+			pktsender.job_state &= ~((1u << LCORE_JOB_TX) |
+							(1u << LCORE_JOB_READER));
 		} else if (sig_recved == 1) {
 			LOG_INFO("The second signal %d reveiced by thread %d."
 							" Stopping all jobs.",
@@ -57,29 +62,90 @@ void pktsender_sig_handler(int signo)
 	}
 }
 
-static void __process_rx(uint8_t portid,
-				struct rte_mbuf *pkts[])
+/**
+ * RX a burst of an RX queue
+ *
+ * @param burst
+ *	Burst size, a constant in the specialized variants below
+ */
+static inline __attribute__((always_inline)) void
+__process_rx(uint8_t portid, uint8_t queueid, struct rte_mbuf *pkts[],
+				const uint16_t burst)
 {
-	uint16_t nb_rx = 0;
-//	uint64_t recv_cyc = 0;
+	uint16_t nb_rx = 0, nb_cap = 0;
+	uint64_t rx_tsc = 0;
 
 	/* RX from hardware */
-	nb_rx = rte_eth_rx_burst(portid, RXQ_RX, pkts, MAX_PKT_BURST);
-//	nb_rx = rte_eth_rx_burst(portid, RXQ_RX, pkts, 1);
+	nb_rx = rte_eth_rx_burst(portid, queueid, pkts, burst);
+//	nb_rx = rte_eth_rx_burst(portid, queueid, pkts, 1);
 
 	if (nb_rx == 0)
 		return;
+	rx_tsc = rte_rdtsc();
 
 	// TODO: extract latency probe packets and handle them.
 	probe_receive(portid, pkts, nb_rx);
 
-	/* free all mbufs */
-	rte_pktmbuf_free_bulk(pkts, nb_rx);
+	if (pktsender.seqnum_off != 0)
+		seqnum_receive(portid, queueid, pkts, nb_rx, rx_tsc);
+
+	if (pktsender.rss.nb_queues != 0)
+		rss_receive(portid, queueid, pkts, nb_rx);
+
+	/* captured mbufs are freed by the writer lcore */
+	if (pktsender.capture_file != NULL)
+		nb_cap = capture_receive(portid, queueid, pkts, nb_rx, rx_tsc);
+
+	/* free all other mbufs */
+	rte_pktmbuf_free_bulk(pkts + nb_cap, nb_rx - nb_cap);
 //	usleep(200000);
 //	LOG_DEBUG("lcore %u RX for port %u, job_state %u",
 //					lcoreid, portid, pktsender.job_state);
 }
 
+typedef void (*rx_burst_fn_t)(uint8_t portid, uint8_t queueid,
+				struct rte_mbuf *pkts[]);
+
+/* variants of __process_rx() for common burst sizes */
+#define RX_BURST_FN(n) \
+static void \
+__process_rx_##n(uint8_t portid, uint8_t queueid, struct rte_mbuf *pkts[]) \
+{ \
+	__process_rx(portid, queueid, pkts, n); \
+}
+
+RX_BURST_FN(8)
+RX_BURST_FN(16)
+RX_BURST_FN(32)
+RX_BURST_FN(64)
+
+#undef RX_BURST_FN
+
+/* any other burst size */
+static void
+__process_rx_any(uint8_t portid, uint8_t queueid, struct rte_mbuf *pkts[])
+{
+	__process_rx(portid, queueid, pkts, port_get_conf(portid)->burst);
+}
+
+/* pick the variant of the burst size of a port */
+static rx_burst_fn_t
+__get_rx_fn(uint8_t portid)
+{
+	switch (port_get_conf(portid)->burst) {
+	case 8:
+		return __process_rx_8;
+	case 16:
+		return __process_rx_16;
+	case 32:
+		return __process_rx_32;
+	case 64:
+		return __process_rx_64;
+	default:
+		return __process_rx_any;
+	}
+}
+
 static void __launch_measure_lcore(
 				uint8_t lcoreid, struct lcore_conf *conf)
 {
@@ -93,6 +159,8 @@ static void __launch_measure_lcore(
 			/** check timer */
 			rte_timer_manage();
 		}
+		/* TX timestamps of the probes sent by the timer */
+		probe_poll();
 	}
 }
 
@@ -101,28 +169,51 @@ static void __launch_rxtx_lcore(
 {
 	struct lcore_job *jobs = NULL;
 	uint8_t portid = 0, is_err = 0;
-	uint8_t nb_rx, nb_tx, *port_list = NULL;
+	uint8_t nb_rx, nb_tx, nb_reader, nb_writer;
+	uint8_t *port_list = NULL, *queue_list = NULL;
 	struct rte_mbuf *pkts_recv[MAX_PKT_BURST];
+	rx_burst_fn_t rx_fn[MAX_PORT_PER_JOB];
 
 	jobs = conf->jobs;
 	nb_rx = jobs[LCORE_JOB_RX].nb_ports;
 	nb_tx = jobs[LCORE_JOB_TX].nb_ports;
+	nb_reader = jobs[LCORE_JOB_READER].nb_ports;
+	nb_writer = jobs[LCORE_JOB_WRITER].nb_ports;
+
+	LOG_DEBUG("Lcore %u handles %u rx jobs, %u tx jobs, %u reader jobs,"
+					" %u writer jobs",
+					lcoreid, nb_rx, nb_tx, nb_reader, nb_writer);
 
-	LOG_DEBUG("Lcore %u handles %u rx jobs, %u tx jobs",
-					lcoreid, nb_rx, nb_tx);
+	for (portid = 0; portid < nb_rx; portid++)
+		rx_fn[portid] = __get_rx_fn(jobs[LCORE_JOB_RX].port_list[portid]);
 
 	while (__is_running(conf->job_flags)) {
 		// rx
 		port_list = jobs[LCORE_JOB_RX].port_list;
+		queue_list = jobs[LCORE_JOB_RX].queue_list;
 		for (portid = 0; portid < nb_rx; portid++) {
-			__process_rx(port_list[portid], pkts_recv);
+			rx_fn[portid](port_list[portid], queue_list[portid], pkts_recv);
+		}
+
+		// capture writer
+		port_list = jobs[LCORE_JOB_WRITER].port_list;
+		for (portid = 0; portid < nb_writer; portid++)
+			capture_write(port_list[portid]);
+
+		// pcap reader, only needed while TX is running
+		if (nb_reader > 0 && __is_tx_running()) {
+			port_list = jobs[LCORE_JOB_READER].port_list;
+			for (portid = 0; portid < nb_reader; portid++)
+				port_read_stream(port_list[portid]);
 		}
 
 		// tx
 		if (__is_tx_running()) {
 			port_list = jobs[LCORE_JOB_TX].port_list;
+			queue_list = jobs[LCORE_JOB_TX].queue_list;
 			for (portid = 0; portid < nb_tx; portid++) {
-				if (port_transmit(port_list[portid]) < 0) {
+				if (port_transmit(port_list[portid],
+								queue_list[portid]) < 0) {
 					is_err = 1;
 					break;
 				}
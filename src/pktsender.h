@@ -8,9 +8,13 @@
 #include <rte_ether.h>
 
 #include "pkt_seq.h"
+#include "rfc2544.h"
+#include "rss.h"
 
-/** Burst size */
-#define MAX_PKT_BURST	32
+/** Max burst size, bounds all burst buffers */
+#define MAX_PKT_BURST	64
+/** Default burst size */
+#define DEFAULT_PKT_BURST	32
 
 /** Cache size of mbuf mempool */
 #define MEMPOOL_CACHE_SIZE	256
@@ -33,6 +37,10 @@
 
 /** Max length of one packet */
 #define MAX_PKT_LEN	(ETHER_MAX_LEN - FCS_SIZE)
+/** Max length of one jumbo packet. Jumbo packets built by pkt-sender
+ * carry their first MAX_PKT_LEN bytes in their own mbuf, and the rest in
+ * a payload segment shared by all packets of the same size. */
+#define MAX_JUMBO_PKT_LEN	(PKT_SEQ_JUMBO_FRAME_LEN - FCS_SIZE)
 
 /** Total length of extra ethernet fields */
 #define FRAME_EXTRA_BYTES (INTER_FRAME_GAP + \
@@ -42,12 +50,16 @@
 enum {
 	LCORE_JOB_RX = 0,
 	LCORE_JOB_TX,
+	/** Read a capture for the streaming pcap pattern */
+	LCORE_JOB_READER,
+	/** Write the packets received to the capture file */
+	LCORE_JOB_WRITER,
 //	LCORE_JOB_LATENCY,
 	LCORE_JOB_MAX,
 };
 
 /** Job flags if all jobs are running */
-#define JOB_FLAGS_ALL 0x3
+#define JOB_FLAGS_ALL 0xF
 
 /** port list of a job */
 struct lcore_job {
@@ -55,6 +67,8 @@ struct lcore_job {
 	uint8_t nb_ports;
 	/** Array of port ids */
 	uint8_t port_list[MAX_PORT_PER_JOB];
+	/** Array of queue ids, one for each port in port_list */
+	uint8_t queue_list[MAX_PORT_PER_JOB];
 };
 
 /** Per-lcore configuration */
@@ -66,6 +80,8 @@ struct lcore_conf {
 } __rte_cache_aligned;
 
 struct port_info;
+struct profile;
+struct pkt_tmpl_desc;
 
 /** Global data of pkt-sender */
 struct pktsender {
@@ -89,8 +105,61 @@ struct pktsender {
 	uint8_t tx_pattern;
 	/** Global TX packet configuration */
 	struct pkt_seq tx_pkt;
-	/** TX rate in unit of bps */
+	/** Field ranges of the random pattern */
+	struct pkt_seq_range tx_range;
+	/** Packet sizes of the patterns building packets */
+	struct pkt_seq_size tx_size;
+	/** Max length of packets sent and received, MAX_JUMBO_PKT_LEN if the
+	 * ports accept jumbo frames */
+	uint16_t max_pkt_len;
+	/** Number of flows of the flow pattern */
+	uint32_t nb_flows;
+	/** Flow selection of the flow pattern, FLOW_DIST_* */
+	uint8_t flow_dist;
+	/** Skew of the Zipf flow popularity */
+	double flow_skew;
+	/** RSS of the DUT the flows are crafted for, see rss.h */
+	struct rss_conf rss;
+	/** Per-port TX rate in unit of bps (pps if tx_rate_pps is set),
+	 * split across TX queues */
 	uint64_t tx_rate;
+	/** Whether tx_rate counts packets instead of bits */
+	uint8_t tx_rate_pps;
+	/** Time-varying per-port TX rate, overrides tx_rate if not NULL */
+	struct profile *tx_profile;
+	/** Packet template of the template pattern */
+	struct pkt_tmpl_desc *tx_tmpl;
+	/** Capture file replayed by the pcap patterns */
+	char *pcap_file;
+	/** Speed multiplier of the original pcap gaps, 0 to use tx_rate */
+	double pcap_speed;
+	/** Re-send pinned mbufs of the single pattern instead of allocating */
+	uint8_t tx_pinned;
+	/** Chain packets to a shared payload right after their headers */
+	uint8_t tx_split;
+	/** Leave the checksums of built packets to the NIC if it can */
+	uint8_t tx_cksum_offload;
+	/** Track the sequence numbers of the stamps, see seqnum.h */
+	uint8_t tx_seqnum;
+	/** Stamp the TX TSC of one built packet every tx_tsc_every, 0 if
+	 * none */
+	uint32_t tx_tsc_every;
+	/** Offset of the stamp, right after the headers. 0 if built packets
+	 * are not stamped. */
+	uint16_t seqnum_off;
+	/** pcapng file the packets received are written to, see capture.h */
+	char *capture_file;
+	/** Max number of bytes kept of each packet captured */
+	uint32_t capture_snaplen;
+	/** Number of latency probes sent per second on each port, see
+	 * probe.h */
+	uint32_t probe_rate;
+	/** Space the probes by exponential gaps instead of fixed ones */
+	uint8_t probe_poisson;
+	/** Send the probes behind the data of the first TX data queue */
+	uint8_t probe_inband;
+	/** RFC 2544 throughput test */
+	struct rfc2544_conf rfc2544;
 };
 
 /** Transmition pattern */
@@ -101,6 +170,12 @@ enum {
 	TX_PATTERN_RANDOM,
 	/** packets from pcap */
 	TX_PATTERN_PCAP,
+	/** packets streamed from a pcap by a reader lcore */
+	TX_PATTERN_PCAP_STREAM,
+	/** packets spread over a table of flows */
+	TX_PATTERN_FLOW,
+	/** packets built from a template description */
+	TX_PATTERN_TEMPLATE,
 };
 
 /** Global pkt-sender configuration data */
@@ -117,8 +192,9 @@ int pktsender_launch_one_lcore(void *arg);
 /**
  * Free a list of packet mbufs back into its original mempool.
  *
- * Free a list of mbufs by calling rte_pktmbuf_free() in a loop as a
- * wrapper function.
+ * Segments released by their last reference are collected and put back
+ * with one rte_mempool_put_bulk() per run of segments sharing the same
+ * mempool, instead of one rte_mempool_put() per segment.
  *
  * @param m_list
  *   An array of rte_mbuf pointers to be freed.
@@ -128,8 +204,32 @@ int pktsender_launch_one_lcore(void *arg);
 static inline void __attribute__((always_inline))
 rte_pktmbuf_free_bulk(struct rte_mbuf *m_list[], int16_t npkts)
 {
-	while (npkts--)
-		rte_pktmbuf_free(*m_list++);
+	struct rte_mbuf *free_list[MAX_PKT_BURST];
+	struct rte_mempool *mp = NULL;
+	struct rte_mbuf *m = NULL, *next = NULL;
+	unsigned nb_free = 0;
+
+	while (npkts--) {
+		m = *m_list++;
+		while (m != NULL) {
+			next = m->next;
+			m = __rte_pktmbuf_prefree_seg(m);
+			if (m != NULL) {
+				if (nb_free == MAX_PKT_BURST ||
+						(nb_free > 0 && m->pool != mp)) {
+					rte_mempool_put_bulk(mp, (void **)free_list, nb_free);
+					nb_free = 0;
+				}
+				m->next = NULL;
+				mp = m->pool;
+				free_list[nb_free++] = m;
+			}
+			m = next;
+		}
+	}
+
+	if (nb_free > 0)
+		rte_mempool_put_bulk(mp, (void **)free_list, nb_free);
 }
 
 /**
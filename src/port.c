@@ -1,6 +1,9 @@
 #include "pktsender.h"
 #include "util.h"
 #include "port.h"
+#include "pcap_stream.h"
+#include "seqnum.h"
+#include "capture.h"
 
 #include <rte_memory.h>
 #include <rte_byteorder.h>
@@ -8,6 +11,7 @@
 #include <rte_ethdev.h>
 #include <rte_mempool.h>
 #include <rte_mbuf.h>
+#include <rte_version.h>
 #include <rte_string_fns.h>
 
 static struct rte_eth_conf port_eth_conf = {
@@ -25,7 +29,7 @@ static struct rte_eth_conf port_eth_conf = {
 		.rss_conf = {
 			.rss_key = NULL,
 			.rss_key_len = 0,
-			.rss_hf = ETH_RSS_IP,
+			.rss_hf = ETH_RSS_IP | ETH_RSS_UDP | ETH_RSS_TCP,
 		},
 	},
 	.txmode = {
@@ -48,9 +52,85 @@ bool port_is_enabled(uint8_t portid)
 }
 
 /** Update the lcore mapping of a port job */
-void port_update_lcore(uint8_t portid, uint8_t lcoreid, uint8_t job)
+int port_update_lcore(uint8_t portid, uint8_t lcoreid, uint8_t job)
 {
-	port_list[portid].lcore_map[job] = lcoreid;
+	struct port_info *port = &port_list[portid];
+
+	if (job == LCORE_JOB_RX) {
+		if (port->nb_rxq >= MAX_RXQ_PER_PORT) {
+			LOG_ERROR("Number of RX queues of port %u exceeds the max value %u",
+							portid, MAX_RXQ_PER_PORT);
+			return ERR_OUT_OF_RANGE;
+		}
+
+		port->rxq[port->nb_rxq].lcoreid = lcoreid;
+		return port->nb_rxq++;
+	}
+
+	if (job == LCORE_JOB_READER) {
+		port->reader_lcore = lcoreid;
+		return 0;
+	}
+
+	if (job == LCORE_JOB_WRITER) {
+		port->writer_lcore = lcoreid;
+		return 0;
+	}
+
+	if (port->nb_txq >= MAX_TXQ_PER_PORT) {
+		LOG_ERROR("Number of TX queues of port %u exceeds the max value %u",
+						portid, MAX_TXQ_PER_PORT);
+		return ERR_OUT_OF_RANGE;
+	}
+
+	port->txq[port->nb_txq].lcoreid = lcoreid;
+	return port->nb_txq++;
+}
+
+/* get the number of RX queues of a port */
+uint8_t port_get_nb_rxq(uint8_t portid)
+{
+	return port_list[portid].nb_rxq;
+}
+
+/* get the lcore writing the capture of a port */
+uint8_t port_get_writer_lcore(uint8_t portid)
+{
+	return port_list[portid].writer_lcore;
+}
+
+/* set the burst and ring sizes of a port */
+int port_set_conf(uint8_t portid, const struct port_conf *conf)
+{
+	struct port_conf *cur = NULL;
+
+	if (!port_is_enabled(portid)) {
+		LOG_ERROR("Port %u is not enabled", portid);
+		return ERR_PARAM;
+	}
+
+	if (conf->burst > MAX_PKT_BURST) {
+		LOG_ERROR("Burst size %u of port %u exceeds %u",
+						conf->burst, portid, MAX_PKT_BURST);
+		return ERR_PARAM;
+	}
+
+	cur = &port_list[portid].conf;
+	if (conf->burst > 0)
+		cur->burst = conf->burst;
+	if (conf->nb_rxd > 0)
+		cur->nb_rxd = conf->nb_rxd;
+	if (conf->nb_txd > 0)
+		cur->nb_txd = conf->nb_txd;
+	if (conf->nb_mbufs > 0)
+		cur->nb_mbufs = conf->nb_mbufs;
+	return 0;
+}
+
+/* get the burst and ring sizes of a port */
+const struct port_conf *port_get_conf(uint8_t portid)
+{
+	return &port_list[portid].conf;
 }
 
 /**
@@ -63,7 +143,7 @@ void port_update_lcore(uint8_t portid, uint8_t lcoreid, uint8_t job)
 uint8_t port_parse_opt(unsigned long portmask)
 {
 //	struct port_info *info = NULL;
-	uint8_t i = 0, j = 0;
+	uint8_t i = 0;
 	uint8_t enabled_ports = 0;
 
 	port_nb_max = rte_eth_dev_count();
@@ -86,9 +166,14 @@ uint8_t port_parse_opt(unsigned long portmask)
 
 		port_list[i].id = i;
 		port_list[i].is_enabled = 1;
-
-		for (j = 0; j < LCORE_JOB_MAX; j++)
-			port_list[i].lcore_map[j] = RTE_MAX_LCORE;
+		port_list[i].nb_rxq = 0;
+		port_list[i].nb_txq = 0;
+		port_list[i].reader_lcore = RTE_MAX_LCORE;
+		port_list[i].writer_lcore = RTE_MAX_LCORE;
+		port_list[i].conf.burst = DEFAULT_PKT_BURST;
+		port_list[i].conf.nb_rxd = RX_DESC_DEFAULT;
+		port_list[i].conf.nb_txd = TX_DESC_DEFAULT;
+		port_list[i].conf.nb_mbufs = 0;
 
 		enabled_ports++;
 	}
@@ -106,7 +191,7 @@ uint8_t port_parse_opt(unsigned long portmask)
 /* Print all enabled ports */
 void port_dump()
 {
-	uint8_t i = 0;
+	uint8_t i = 0, q = 0;
 	struct port_info *iter = NULL;
 
 	for (i = 0; i < port_nb_max; i++) {
@@ -115,7 +200,7 @@ void port_dump()
 			continue;
 
 		LOG_INFO("Port %u: MAC %02x:%02x:%02x:%02x:%02x:%02x, "
-						"RX lcore %u, TX lcore %u",
+						"%u RX queue(s), %u TX queue(s)",
 					iter->id,
 					(uint32_t)(iter->mac.addr_bytes[0]),
 					(uint32_t)(iter->mac.addr_bytes[1]),
@@ -123,8 +208,21 @@ void port_dump()
 					(uint32_t)(iter->mac.addr_bytes[3]),
 					(uint32_t)(iter->mac.addr_bytes[4]),
 					(uint32_t)(iter->mac.addr_bytes[5]),
-					iter->lcore_map[LCORE_JOB_RX],
-					iter->lcore_map[LCORE_JOB_TX]);
+					iter->nb_rxq, iter->nb_txq);
+		LOG_INFO("Port %u: burst %u, %u RX desc, %u TX desc, %u mbufs",
+					iter->id, iter->conf.burst, iter->conf.nb_rxd,
+					iter->conf.nb_txd, iter->conf.nb_mbufs);
+
+		for (q = 0; q < iter->nb_rxq; q++)
+			LOG_INFO("Port %u: rxq %u, RX lcore %u",
+						iter->id, q, iter->rxq[q].lcoreid);
+
+		for (q = 0; q < iter->nb_txq; q++) {
+			LOG_INFO("Port %u: txq %u, TX lcore %u, rate %lu %s",
+						iter->id, q, iter->txq[q].lcoreid,
+						iter->txq[q].tx_ctl.rate,
+						iter->txq[q].tx_ctl.rate_pps ? "pps" : "bps");
+		}
 	}
 }
 
@@ -132,6 +230,7 @@ void port_dump()
 static int __port_init_dev(struct port_info *port,
 				struct rte_eth_dev_info *dev_info)
 {
+	struct rte_eth_conf eth_conf;
 	int ret = 0;
 
 	rte_eth_dev_info_get(port->id, dev_info);
@@ -139,98 +238,199 @@ static int __port_init_dev(struct port_info *port,
 	/* get mac address of this port */
 	rte_eth_macaddr_get(port->id, &port->mac);
 
-	/* check TX queue numbers */
-	if (dev_info->max_tx_queues < TXQ_NUM_PER_PORT) {
+	if (dev_info->max_rx_queues < port->nb_rxq) {
+		LOG_ERROR("port %u doesn't have enough RX queue "
+						"(at least %u RX queues)",
+						port->id, port->nb_rxq);
+		return ERR_OUT_OF_RANGE;
+	}
+
+	/* check TX queue numbers: data queues + 1 probe queue */
+	if (dev_info->max_tx_queues < port->nb_txq + 1) {
 		LOG_ERROR("port %u doesn't have enough TX queue "
 						"(at least %u TX queues)",
-						port->id, TXQ_NUM_PER_PORT);
+						port->id, port->nb_txq + 1);
 		return ERR_OUT_OF_RANGE;
 	}
 
-	/* configure RX and TX queues of this port */
-	ret = rte_eth_dev_configure(port->id, RXQ_NUM_PER_PORT,
-					TXQ_NUM_PER_PORT, &port_eth_conf);
+	/* jumbo frames are scattered over regular RX mbufs */
+	if (pktsender.max_pkt_len > MAX_PKT_LEN) {
+		if (dev_info->max_rx_pktlen < pktsender.max_pkt_len + FCS_SIZE) {
+			LOG_ERROR("port %u doesn't support %u-byte frames",
+							port->id, pktsender.max_pkt_len + FCS_SIZE);
+			return ERR_OUT_OF_RANGE;
+		}
+		port_eth_conf.rxmode.jumbo_frame = 1;
+		port_eth_conf.rxmode.enable_scatter = 1;
+		port_eth_conf.rxmode.max_rx_pkt_len = pktsender.max_pkt_len + FCS_SIZE;
+	}
+
+	/* spread the flows over the RX queues, the hash functions the NIC
+	 * lacks are left out */
+	eth_conf = port_eth_conf;
+	if (port->nb_rxq > 1) {
+		eth_conf.rxmode.mq_mode = ETH_MQ_RX_RSS;
+		eth_conf.rx_adv_conf.rss_conf.rss_hf &=
+						dev_info->flow_type_rss_offloads;
+		if (eth_conf.rx_adv_conf.rss_conf.rss_hf == 0) {
+			LOG_ERROR("port %u can't spread packets over %u RX queues",
+							port->id, port->nb_rxq);
+			return ERR_OUT_OF_RANGE;
+		}
+		/* the DUT key, so that the NIC hash can be checked */
+		if (pktsender.rss.is_key_set) {
+			eth_conf.rx_adv_conf.rss_conf.rss_key = pktsender.rss.key;
+			eth_conf.rx_adv_conf.rss_conf.rss_key_len =
+							pktsender.rss.key_len;
+		}
+	}
+
+	/* configure RX and TX queues of this port, a port without RX lcore
+	 * keeps one RX queue which is never polled */
+	ret = rte_eth_dev_configure(port->id, RTE_MAX(port->nb_rxq, 1),
+					port->nb_txq + 1, &eth_conf);
 	if (ret < 0) {
 		LOG_ERROR("Failed to configure port %u, err=%d",
 						port->id, ret);
 		return ERR_DPDK;
 	}
 
+	if (pktsender.max_pkt_len > MAX_PKT_LEN) {
+		ret = rte_eth_dev_set_mtu(port->id, PKT_SEQ_JUMBO_MTU);
+		if (ret < 0)
+			LOG_WARN("Failed to set the MTU of port %u to %u, err=%d",
+							port->id, PKT_SEQ_JUMBO_MTU, ret);
+	}
+
+#if RTE_VERSION >= RTE_VERSION_NUM(17, 5, 0, 0)
+	/* fit the ring sizes into the limits of the NIC */
+	ret = rte_eth_dev_adjust_nb_rx_tx_desc(port->id, &port->conf.nb_rxd,
+					&port->conf.nb_txd);
+	if (ret < 0) {
+		LOG_ERROR("Failed to adjust ring sizes of port %u, err=%d",
+						port->id, ret);
+		return ERR_DPDK;
+	}
+#endif
+
 	return 0;
 }
 
-/** Initialize rx mempool of a port */
-static int __port_init_rx_pool(struct port_info *port,
+/** Initialize rx mempool of an RX queue */
+static int __port_init_rx_pool(struct port_info *port, uint8_t queueid,
 				uint8_t socketid)
 {
 	char s[64];
-
-	snprintf(s, sizeof(s), "rx_mbuf_pool_%u_%u", port->id, socketid);
-	port->rx_mp = rte_pktmbuf_pool_create(s, NB_MBUFS,
+	struct port_rxq *rxq = &port->rxq[queueid];
+	uint32_t nb_mbufs = 0;
+
+	nb_mbufs = (port->conf.nb_mbufs > 0) ? port->conf.nb_mbufs :
+					NB_RX_MBUFS(port->conf.nb_rxd, port->conf.burst);
+	/* captured mbufs wait in the ring and the cache of the writer lcore */
+	if (port->writer_lcore != RTE_MAX_LCORE)
+		nb_mbufs += CAPTURE_RING_SIZE + MEMPOOL_CACHE_SIZE;
+
+	snprintf(s, sizeof(s), "rx_mbuf_pool_%u_%u_%u",
+					port->id, queueid, socketid);
+	rxq->rx_mp = rte_pktmbuf_pool_create(s, nb_mbufs,
 					MEMPOOL_CACHE_SIZE, 0,
 					RTE_MBUF_DEFAULT_BUF_SIZE, socketid);
-	if (port->rx_mp == NULL) {
-		LOG_ERROR("Cannot create RX mbuf pool of port %u on socket %u",
-						port->id, socketid);
+	if (rxq->rx_mp == NULL) {
+		LOG_ERROR("Cannot create RX mbuf pool of port %u rxq %u on socket %u",
+						port->id, queueid, socketid);
 		return ERR_MEMORY;
 	}
 
-	LOG_DEBUG("Allocate rx mbuf pool on socket %u for port %u",
-					socketid, port->id);
+	LOG_DEBUG("Allocate rx mbuf pool on socket %u for port %u rxq %u",
+					socketid, port->id, queueid);
 	return 0;
 }
 
-/** Initialize tx mempool of a port */
-static int __port_init_tx_pool(struct port_info *port,
+/** Initialize tx mempool of a TX queue */
+static int __port_init_tx_pool(struct port_info *port, uint8_t queueid,
 				uint8_t socketid)
 {
 	char s[64];
-
-	snprintf(s, sizeof(s), "tx_mbuf_pool_%u_%u", port->id, socketid);
-	port->tx_mp = rte_pktmbuf_pool_create(s, NB_MBUFS,
-					MEMPOOL_CACHE_SIZE, 0,
-					RTE_MBUF_DEFAULT_BUF_SIZE, socketid);
-	if (port->tx_mp == NULL) {
-		LOG_ERROR("Cannot create TX mbuf pool of port %u on socket %u",
-						port->id, socketid);
+	struct port_txq *txq = &port->txq[queueid];
+
+	snprintf(s, sizeof(s), "tx_mbuf_pool_%u_%u_%u",
+					port->id, queueid, socketid);
+	txq->tx_mp = rte_pktmbuf_pool_create(s, (port->conf.nb_mbufs > 0) ?
+					port->conf.nb_mbufs :
+					NB_TX_MBUFS(port->conf.nb_txd, port->conf.burst),
+					MEMPOOL_CACHE_SIZE, 0, TX_MBUF_BUF_SIZE, socketid);
+	if (txq->tx_mp == NULL) {
+		LOG_ERROR("Cannot create TX mbuf pool of port %u txq %u on socket %u",
+						port->id, queueid, socketid);
 		return ERR_MEMORY;
 	}
 
-	LOG_DEBUG("Allocate tx mbuf pool on socket %u for port %u",
-					socketid, port->id);
+	LOG_DEBUG("Allocate tx mbuf pool on socket %u for port %u txq %u",
+					socketid, port->id, queueid);
 	return 0;
 }
 
 /** setup tx queue */
 static int __setup_tx_queue(uint8_t portid, uint8_t queueid,
-				uint8_t lcoreid, struct rte_eth_txconf *txconf)
+				uint8_t lcoreid, uint16_t nb_txd,
+				struct rte_eth_txconf *txconf, uint32_t txq_flags)
 {
 	int ret;
 	uint8_t socketid = 0;
 
-	txconf->txq_flags = 0;
+	txconf->txq_flags = txq_flags;
 	socketid = (uint8_t)rte_lcore_to_socket_id(lcoreid);
 
 	LOG_DEBUG("Setup port %u, txq %u, lcore %u, socket %u",
-					portid, TXQ_TX, lcoreid, socketid);
+					portid, queueid, lcoreid, socketid);
 
-	ret = rte_eth_tx_queue_setup(portid, queueid, TX_DESC_DEFAULT,
+	ret = rte_eth_tx_queue_setup(portid, queueid, nb_txd,
 					socketid, txconf);
 	if (ret < 0) {
 		LOG_ERROR("Failed to setup txq: err=%d, port %u, txq %u",
-						ret, portid, TXQ_TX);
+						ret, portid, queueid);
 		return ERR_DPDK;
 	}
 	return 0;
 }
 
+/** Free all mempools of a port */
+static void __port_free_mempools(struct port_info *port)
+{
+	uint8_t q = 0;
+
+	/* free rx mempools */
+	for (q = 0; q < port->nb_rxq; q++) {
+		if (port->rxq[q].rx_mp) {
+			rte_mempool_free(port->rxq[q].rx_mp);
+			port->rxq[q].rx_mp = NULL;
+		}
+	}
+
+	/* free the streaming reader before the TX queues it feeds */
+	if (port->stream) {
+		pcap_stream_free(port->stream);
+		port->stream = NULL;
+	}
+
+	/* free tx mempools */
+	for (q = 0; q < port->nb_txq; q++) {
+		tx_ctl_free(&port->txq[q].tx_ctl);
+		if (port->txq[q].tx_mp) {
+			rte_mempool_free(port->txq[q].tx_mp);
+			port->txq[q].tx_mp = NULL;
+		}
+	}
+}
+
 /** Initialize a single port */
 static int __port_init_single(uint8_t portid)
 {
 	struct rte_eth_dev_info dev_info;
 	struct rte_eth_txconf *txconf = NULL;
 	struct port_info *port = NULL;
-	uint8_t lcoreid, socketid, job = 0;
+	struct port_txq *txq = NULL;
+	uint8_t lcoreid, socketid, q = 0;
 	int ret;
 
 	port = &port_list[portid];
@@ -241,93 +441,102 @@ static int __port_init_single(uint8_t portid)
 		return ret;
 	}
 
-	/*  setup RX and TX queues */
-	for (job = 0; job < LCORE_JOB_MAX; job++) {
-		lcoreid = port->lcore_map[job];
-		if (lcoreid == RTE_MAX_LCORE) {
-			LOG_WARN("No lcore is assigned to port %u job %u.", portid, job);
-			continue;
-		}
+	/* setup RX queues, each with its own NUMA-local mempool */
+	if (port->nb_rxq == 0)
+		LOG_WARN("No lcore is assigned to port %u job %u.",
+						portid, LCORE_JOB_RX);
 
+	for (q = 0; q < port->nb_rxq; q++) {
+		lcoreid = port->rxq[q].lcoreid;
 		socketid = (uint8_t)rte_lcore_to_socket_id(lcoreid);
 
-		/* setup RX queue */
-		if (job == LCORE_JOB_RX) {
-			ret = __port_init_rx_pool(port, socketid);
-			if (ret < 0)
-				return ERR_MEMORY;
-
-			LOG_DEBUG("Setup port %u, rxq %u, lcore %u, socket %u",
-							portid, RXQ_RX, lcoreid, socketid);
-
-			ret = rte_eth_rx_queue_setup(portid, RXQ_RX,
-							RX_DESC_DEFAULT, socketid, NULL,
-							port->rx_mp);
-			if (ret < 0) {
-				LOG_ERROR("Failed to setup rxq: err=%d, port %u, rxq %u",
-								ret, portid, RXQ_RX);
-				goto fail_free_mp;
-			}
-		} else {
-			ret = __port_init_tx_pool(port, socketid);
-			if (ret < 0)
-				goto fail_free_mp;
-
-			txconf = &dev_info.default_txconf;
-
-			/* setup TX queue */
-			ret = __setup_tx_queue(portid, TXQ_TX, lcoreid, txconf);
-			if (ret < 0)
-				goto fail_free_mp;
-
-			/* init tx controller */
-			tx_ctl_init(&port->tx_ctl, &port->mac, TXQ_TX);
-			/* setup default packets */
-			tx_ctl_setup_mempool(&port->tx_ctl, port->tx_mp);
-
-			/* setup TX probe queue */
-			ret = __setup_tx_queue(portid, TXQ_LATENCY,
-							pktsender.stat_lcore, txconf);
-			if (ret < 0)
-				goto fail_free_mp;
+		ret = __port_init_rx_pool(port, q, socketid);
+		if (ret < 0)
+			goto fail_free_mp;
+
+		LOG_DEBUG("Setup port %u, rxq %u, lcore %u, socket %u",
+						portid, q, lcoreid, socketid);
+
+		ret = rte_eth_rx_queue_setup(portid, q,
+						port->conf.nb_rxd, socketid, NULL,
+						port->rxq[q].rx_mp);
+		if (ret < 0) {
+			LOG_ERROR("Failed to setup rxq: err=%d, port %u, rxq %u",
+							ret, portid, q);
+			goto fail_free_mp;
 		}
 	}
-	return 0;
 
-fail_free_mp:
-	/* free rx mempool */
-	if (port->rx_mp) {
-		rte_mempool_free(port->rx_mp);
-		port->rx_mp = NULL;
+	if (port->nb_txq == 0)
+		LOG_WARN("No lcore is assigned to port %u job %u.",
+						portid, LCORE_JOB_TX);
+
+	txconf = &dev_info.default_txconf;
+
+	/* the streaming reader feeds all TX queues from its own socket */
+	if (pktsender.tx_pattern == TX_PATTERN_PCAP_STREAM && port->nb_txq > 0) {
+		if (port->reader_lcore == RTE_MAX_LCORE) {
+			LOG_ERROR("No pcap reader lcore is assigned to port %u", portid);
+			ret = ERR_PARAM;
+			goto fail_free_mp;
+		}
+
+		port->stream = pcap_stream_create(portid, pktsender.pcap_file,
+						port->nb_txq,
+						rte_lcore_to_socket_id(port->reader_lcore));
+		if (port->stream == NULL) {
+			ret = ERR_MEMORY;
+			goto fail_free_mp;
+		}
 	}
 
-	/* free tx mempool */
-	if (port->tx_mp) {
-		rte_mempool_free(port->tx_mp);
-		port->tx_mp = NULL;
+	/* setup TX data queues, each with its own NUMA-local mempool */
+	for (q = 0; q < port->nb_txq; q++) {
+		txq = &port->txq[q];
+		socketid = (uint8_t)rte_lcore_to_socket_id(txq->lcoreid);
+
+		ret = __port_init_tx_pool(port, q, socketid);
+		if (ret < 0)
+			goto fail_free_mp;
+
+		/* init tx controller, port rate is split across queues */
+		tx_ctl_init(&txq->tx_ctl, &port->mac, q, port->nb_txq,
+						port->conf.burst, dev_info.tx_offload_capa);
+		if (port->stream != NULL)
+			txq->tx_ctl.u.tx_stream.ring = port->stream->rings[q];
+		txq->tx_ctl.seqnum.stream = SEQNUM_STREAM(portid, q);
+
+		/* let the driver free mbufs as cheaply as the pattern allows */
+		ret = __setup_tx_queue(portid, q, txq->lcoreid, port->conf.nb_txd,
+						txconf, tx_ctl_get_txq_flags(&txq->tx_ctl));
+		if (ret < 0)
+			goto fail_free_mp;
+		/* setup default packets */
+		ret = tx_ctl_setup_mempool(&txq->tx_ctl, txq->tx_mp);
+		if (ret < 0)
+			goto fail_free_mp;
 	}
+
+	/* setup TX probe queue */
+	ret = __setup_tx_queue(portid, port_get_probe_queue(portid),
+					pktsender.stat_lcore, port->conf.nb_txd, txconf, 0);
+	if (ret < 0)
+		goto fail_free_mp;
+
+	return 0;
+
+fail_free_mp:
+	__port_free_mempools(port);
 	return ret;
 }
 
 /* Free a port_info structure */
 void __port_free_single(uint8_t portid)
 {
-	struct port_info *port = NULL;
-
 	if (!port_is_enabled(portid))
 		return;
 
-	port = &port_list[portid];
-
-	if (port->rx_mp) {
-		rte_mempool_free(port->rx_mp);
-		port->rx_mp = NULL;
-	}
-
-	if (port->tx_mp) {
-		rte_mempool_free(port->tx_mp);
-		port->tx_mp = NULL;
-	}
+	__port_free_mempools(&port_list[portid]);
 }
 
 /* Initialize all ports */
@@ -429,16 +638,71 @@ void port_close(void)
 	LOG_DEBUG("Close all ports");
 }
 
-/* send on all ports */
-int port_transmit(uint8_t portid)
+/* send on a TX data queue of the port */
+int port_transmit(uint8_t portid, uint8_t queueid)
+{
+	struct port_txq *txq = &port_list[portid].txq[queueid];
+
+	return tx_ctl_tx_burst(portid, &txq->tx_ctl, txq->tx_mp);
+}
+
+/* request a new rate and packet size on all TX data queues of the port */
+void port_request_tx(uint8_t portid, uint64_t rate, uint8_t size_idx)
+{
+	struct port_info *port = &port_list[portid];
+	uint8_t q = 0;
+
+	for (q = 0; q < port->nb_txq; q++)
+		tx_ctl_request(&port->txq[q].tx_ctl, rate, size_idx);
+}
+
+/* read a batch of frames for the streaming pcap pattern */
+void port_read_stream(uint8_t portid)
+{
+	if (port_list[portid].stream != NULL)
+		pcap_stream_read(port_list[portid].stream);
+}
+
+/* get the counters of the streaming pcap pattern */
+bool port_get_stream_stats(uint8_t portid, uint64_t *stalls,
+				uint64_t *underruns, uint64_t *starved_cycles)
+{
+	struct port_info *port = &port_list[portid];
+	struct tx_stream *tx_stream = NULL;
+	uint8_t q = 0;
+
+	if (port->stream == NULL)
+		return false;
+
+	*stalls = port->stream->nb_stalls;
+	*underruns = 0;
+	*starved_cycles = 0;
+	for (q = 0; q < port->nb_txq; q++) {
+		tx_stream = &port->txq[q].tx_ctl.u.tx_stream;
+		*underruns += tx_stream->nb_underruns;
+		*starved_cycles += tx_stream->starved_cycles;
+	}
+	return true;
+}
+
+/* get the probe queue, which follows all data queues */
+uint8_t port_get_probe_queue(uint8_t portid)
+{
+	return port_list[portid].nb_txq;
+}
+
+/* get the TX controller of a data queue */
+struct tx_ctl *
+port_get_tx_ctl(uint8_t portid, uint8_t queueid)
 {
-	return tx_ctl_tx_burst(portid, &port_list[portid].tx_ctl,
-						port_list[portid].tx_mp);
+	if (queueid >= port_list[portid].nb_txq)
+		return NULL;
+	return &port_list[portid].txq[queueid].tx_ctl;
 }
 
 /* get pkt_seq */
 struct pkt_seq *
 port_get_pkt_seq(uint8_t portid)
 {
-	return &(port_list[portid].tx_ctl.tx_seq);
+	return &(port_list[portid].txq[0].tx_ctl.tx_seq);
 }
@@ -12,22 +12,24 @@
 /** Max number of ports */
 #define MAX_PORT_NUM	16
 
-/** RX queue assignment of each port */
-enum {
-	RXQ_RX = 0,
-	/** Default number of RX queues per port */
-	RXQ_NUM_PER_PORT,
-};
+/**
+ * RX queue assignment of each port: one queue per (port,R,lcore) mapping,
+ * RSS spreads the packets over them when there are several.
+ */
 
-/** TX queue assignment of each port */
-enum {
-	/** txq 0 is used to transmit user-specified major traffic */
-	TXQ_TX = 0,
-	/** txq 1 is used to transmit latency probe traffic */
-	TXQ_LATENCY = 1,
-	/** Default number of TX queues per port */
-	TXQ_NUM_PER_PORT,
-};
+/** Max number of RX queues per port */
+#define MAX_RXQ_PER_PORT	8
+
+/**
+ * TX queue assignment of each port:
+ *	- txq [0, nb_txq) are used to transmit user-specified major traffic,
+ *	  one queue per (port,T,lcore) mapping.
+ *	- txq nb_txq is used to transmit latency probe traffic, unless
+ *	  --probe-inband sends it behind the data of txq 0.
+ */
+
+/** Max number of TX data queues per port */
+#define MAX_TXQ_PER_PORT	8
 
 /** Default number of RX ring descriptors */
 #define RX_DESC_DEFAULT 128
@@ -36,6 +38,58 @@ enum {
 
 /** Default number of items in each mbuf mempool */
 #define NB_MBUFS	TX_DESC_DEFAULT
+/** Number of items in each RX mempool: a full RX ring, the per-lcore
+ * cache and the burst being processed */
+#define NB_RX_MBUFS(nb_rxd, burst) \
+	RTE_MAX(NB_MBUFS, (nb_rxd) + MEMPOOL_CACHE_SIZE + 2 * (burst))
+/** Number of items in each TX mempool: a full TX ring waiting to be
+ * freed by the driver, the per-lcore cache and the burst being built */
+#define NB_TX_MBUFS(nb_txd, burst) \
+	((nb_txd) + MEMPOOL_CACHE_SIZE + 2 * (burst))
+/** Data room of TX mbufs, only the heads of the packets with
+ * --tx-split */
+#define TX_MBUF_BUF_SIZE	(pktsender.tx_split ? \
+				RTE_PKTMBUF_HEADROOM + TX_SPLIT_HEAD_LEN : \
+				RTE_MBUF_DEFAULT_BUF_SIZE)
+
+/**
+ * Tunable sizes of a port, set by --port-conf
+ */
+struct port_conf {
+	/** RX and TX burst size, at most MAX_PKT_BURST */
+	uint16_t burst;
+	/** Number of RX ring descriptors */
+	uint16_t nb_rxd;
+	/** Number of TX ring descriptors of each TX queue */
+	uint16_t nb_txd;
+	/** Number of mbufs in each RX/TX mempool, 0 to derive it from the
+	 * ring and burst sizes */
+	uint32_t nb_mbufs;
+};
+
+/**
+ * Per-queue RX context
+ */
+struct port_rxq {
+	/** lcore receiving on this queue */
+	uint8_t lcoreid;
+	/** RX mbuf mempool, allocated on the socket of lcoreid */
+	struct rte_mempool *rx_mp;
+} __rte_cache_aligned;
+
+/**
+ * Per-queue TX context
+ */
+struct port_txq {
+	/** lcore transmitting on this queue */
+	uint8_t lcoreid;
+	/** TX mbuf mempool, allocated on the socket of lcoreid */
+	struct rte_mempool *tx_mp;
+	/** TX controller */
+	struct tx_ctl tx_ctl;
+} __rte_cache_aligned;
+
+struct pcap_stream;
 
 /**
  * Port Information Structure
@@ -47,14 +101,23 @@ struct port_info {
 	uint8_t is_enabled;
 	/** MAC address */
 	struct ether_addr mac;
-	/** RX mbuf mempool */
-	struct rte_mempool *rx_mp;
-	/** TX mbuf mempool */
-	struct rte_mempool *tx_mp;
-	/** lcore mappings of each job */
-	uint8_t lcore_map[LCORE_JOB_MAX];
-	/** TX controller  */
-	struct tx_ctl tx_ctl;
+	/** Number of RX queues */
+	uint8_t nb_rxq;
+	/** RX queues */
+	struct port_rxq rxq[MAX_RXQ_PER_PORT];
+	/** Number of TX data queues */
+	uint8_t nb_txq;
+	/** TX data queues */
+	struct port_txq txq[MAX_TXQ_PER_PORT];
+	/** lcore reading the capture of the streaming pcap pattern */
+	uint8_t reader_lcore;
+	/** Streaming pcap reader */
+	struct pcap_stream *stream;
+	/** lcore writing the packets received to the capture file, see
+	 * capture.h */
+	uint8_t writer_lcore;
+	/** Burst and ring sizes */
+	struct port_conf conf;
 };
 
 /**
@@ -70,9 +133,56 @@ bool port_is_enabled(uint8_t portid);
 /**
  * Update the lcore mapping of a port job
  *
+ * Every RX and TX mapping of a port gets its own RX or TX data queue.
+ *
  * @param portid
+ * @param lcoreid
+ * @param job
+ * @return
+ *	- The queue id assigned to the lcore on success
+ *	- ERR_OUT_OF_RANGE if the port has no more RX or TX queues
  */
-void port_update_lcore(uint8_t portid, uint8_t lcoreid, uint8_t job);
+int port_update_lcore(uint8_t portid, uint8_t lcoreid, uint8_t job);
+
+/**
+ * Get the number of RX queues of a port
+ *
+ * @param portid
+ * @return
+ *	Number of RX queues, one per RX lcore
+ */
+uint8_t port_get_nb_rxq(uint8_t portid);
+
+/**
+ * Get the lcore writing the capture of a port
+ *
+ * @param portid
+ * @return
+ *	- The writer lcore
+ *	- RTE_MAX_LCORE if the port is not captured
+ */
+uint8_t port_get_writer_lcore(uint8_t portid);
+
+/**
+ * Set the burst and ring sizes of a port
+ *
+ * @param portid
+ * @param conf
+ *	The sizes, 0 keeps the current value
+ * @return
+ *	- 0 on success
+ *	- ERR_PARAM if the port is not enabled or a size is out of range
+ */
+int port_set_conf(uint8_t portid, const struct port_conf *conf);
+
+/**
+ * Get the burst and ring sizes of a port
+ *
+ * @param portid
+ * @return
+ *	Pointer to the sizes
+ */
+const struct port_conf *port_get_conf(uint8_t portid);
 
 /**
  * Parse a portmask and initialize port_list array
@@ -124,8 +234,69 @@ void port_free(void);
  *
  * @param portid
  *	DPDK port id
+ * @param queueid
+ *	TX data queue id
+ */
+int port_transmit(uint8_t portid, uint8_t queueid);
+
+/**
+ * Request a new rate and packet size on all TX data queues of a port
+ *
+ * @param portid
+ *	DPDK port id
+ * @param rate
+ *	Per-port rate, split across the queues. 0 stops sending.
+ * @param size_idx
+ *	Index in the size mix of the only size to send, or TX_SIZE_ANY
+ */
+void port_request_tx(uint8_t portid, uint64_t rate, uint8_t size_idx);
+
+/**
+ * Read a batch of frames for the streaming pcap pattern
+ *
+ * @param portid
+ *	DPDK port id
+ */
+void port_read_stream(uint8_t portid);
+
+/**
+ * Get the counters of the streaming pcap pattern
+ *
+ * @param portid
+ *	DPDK port id
+ * @param stalls
+ *	Number of times the reader was stalled by full TX rings
+ * @param underruns
+ *	Number of times TX queues found their ring empty, summed
+ * @param starved_cycles
+ *	Cycles TX queues spent waiting for the reader, summed
+ * @return
+ *	- True if the port streams a capture
+ *	- False otherwise
+ */
+bool port_get_stream_stats(uint8_t portid, uint64_t *stalls,
+				uint64_t *underruns, uint64_t *starved_cycles);
+
+/**
+ * Get the TX queue used to send latency probes
+ *
+ * @param portid
+ * @return
+ *	The probe queue id, which follows all TX data queues
+ */
+uint8_t port_get_probe_queue(uint8_t portid);
+
+/**
+ * Get the TX controller of a data queue
+ *
+ * @param portid
+ * @param queueid
+ *	The TX data queue
+ * @return
+ *	- NULL if the port has no such data queue
+ *	- Pointer to the tx_ctl structure otherwise
  */
-int port_transmit(uint8_t portid);
+struct tx_ctl *port_get_tx_ctl(uint8_t portid, uint8_t queueid);
 
 /**
  * Get port-local pkt_seq structure
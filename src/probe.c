@@ -3,6 +3,10 @@
 #include "port.h"
 #include "pktsender.h"
 #include "pt_trace.h"
+#include "latency.h"
+#include "rand.h"
+
+#include <math.h>
 
 #include <rte_errno.h>
 #include <rte_ring.h>
@@ -16,6 +20,18 @@ static uint8_t nb_probe = 0;
 
 /** TX timer */
 static struct rte_timer probe_timer;
+/** Mean cycles between two ticks */
+static uint64_t probe_interval = 0;
+/** Lcore running the timer */
+static uint8_t probe_lcore = 0;
+/** Probes sent within PROBE_RETURN_MS, not matched yet */
+static uint64_t probe_lag = 1;
+/** Exponential gaps of --probe-poisson */
+static struct rand_state probe_rng;
+/** Cycles of PROBE_TX_TS_TIMEOUT_US */
+static uint64_t tx_ts_timeout = 0;
+/** Number of ports with a pending TX timestamp */
+static uint8_t nb_tx_pending = 0;
 
 /** Probe TX mempool */
 static struct rte_mempool *probe_mp = NULL;
@@ -32,6 +48,8 @@ probe_free(void)
 		probe_mp = NULL;
 	}
 
+	latency_free();
+
 	LOG_DEBUG("Free probe_list");
 }
 
@@ -73,6 +91,33 @@ __init_local_probe(uint8_t portid, uint8_t queueid)
 	ctl->next_pkt = NULL;
 	ctl->next_idx = 0;
 
+	/* a port without TX lcore has no data queue to carry the probes */
+	if (pktsender.probe_inband) {
+		ctl->inband = port_get_tx_ctl(portid, PROBE_INBAND_QUEUE);
+		if (ctl->inband == NULL)
+			LOG_WARN("Port %u has no data queue, probes go out of band",
+							portid);
+	}
+
+	return 0;
+}
+
+/* parse the number of probes sent per second */
+int
+probe_parse_rate(const char *str, uint32_t *rate)
+{
+	char *end = NULL;
+	unsigned long val = 0;
+
+	errno = 0;
+	val = strtoul(str, &end, 10);
+	if (errno != 0 || end == str || *end != '\0' || val == 0 ||
+			val > PROBE_RATE_MAX) {
+		LOG_ERROR("Wrong probe rate %s, expect 1 to %u per second", str,
+						PROBE_RATE_MAX);
+		return ERR_PARAM;
+	}
+	*rate = (uint32_t)val;
 	return 0;
 }
 
@@ -96,13 +141,18 @@ probe_init(uint8_t nb_ports)
 		if (!port_is_enabled(portid))
 			continue;
 
-		if (__init_local_probe(portid, TXQ_LATENCY) < 0) {
+		if (__init_local_probe(portid,
+						port_get_probe_queue(portid)) < 0) {
 			LOG_ERROR("Failed to initialize probe_ctl for port %u",
 							portid);
 			goto fail_free_all;
 		}
 	}
 
+	/* match probe timestamps on the fly */
+	if (latency_init(nb_ports) < 0)
+		goto fail_free_all;
+
 	/* create mempool */
 	probe_mp = rte_pktmbuf_pool_create("probe_mbuf_pool", PROBE_PKT_MAX,
 					PROBE_MP_CACHE, 0, RTE_MBUF_DEFAULT_BUF_SIZE, 0);
@@ -162,14 +212,81 @@ __construct_probe(struct probe_ctl *ctl)
 	return 0;
 }
 
+/* read the TX timestamp of the last probe of a port if it is latched */
+static void
+__poll_tx_timestamp(struct probe_ctl *ctl, uint64_t now)
+{
+	/* an in-band probe waits for a data burst */
+	if (ctl->tx_tsc == 0) {
+		if (tx_ctl_probe_pending(ctl->inband))
+			return;
+		ctl->tx_tsc = now;
+	}
+
+	if (trace_hw_tx_poll(ctl->portid, ctl->portid, ctl->tx_tag - 1) < 0) {
+		if (now - ctl->tx_tsc < tx_ts_timeout)
+			return;
+		ctl->nb_tx_ts_lost++;
+	}
+	ctl->tx_tag = 0;
+	nb_tx_pending--;
+}
+
+/* send a probe, out of band or handed to the data queue */
+static int
+__send_probe(struct probe_ctl *ctl, uint64_t now)
+{
+	int ret = 0;
+
+	trace_hw_tx_prepare(ctl->portid, &ctl->next_pkt, 1);
+
+	if (ctl->inband != NULL) {
+		tx_ctl_inject_probe(ctl->inband, ctl->next_pkt);
+		ctl->tx_tsc = 0;
+	} else {
+		/* the driver frees the probe once sent */
+		ret = rte_eth_tx_burst(ctl->portid, ctl->queueid,
+						&ctl->next_pkt, 1);
+		if (ret < 1) {
+			LOG_ERROR("Failed to send probe packet to port %u",
+							ctl->portid);
+			return ERR_DPDK;
+		}
+		ctl->tx_tsc = now;
+	}
+
+	/* its TX timestamp is polled later on */
+	ctl->tx_tag = ctl->next_idx;
+	latency_sent(ctl->portid, ctl->next_idx);
+	nb_tx_pending++;
+	ctl->next_pkt = NULL;
+	return 0;
+}
+
+/* cycles to the next tick, exponential with --probe-poisson */
+static uint64_t
+__next_interval(void)
+{
+	double u = 0;
+
+	if (!pktsender.probe_poisson)
+		return probe_interval;
+
+	u = ((double)rand_next(&probe_rng) + 0.5) / 4294967296.0;
+	return (uint64_t)(-log(u) * probe_interval) + 1;
+}
+
 static void
 __process_probe(struct rte_timer *timer __rte_unused,
 				void *arg __rte_unused)
 {
 	uint8_t i = 0;
 	struct probe_ctl *ctl = NULL;
-	int ret = 0;
-//	uint64_t cycle = 0;
+	uint64_t now = rte_get_tsc_cycles();
+
+	if (pktsender.probe_poisson)
+		rte_timer_reset(&probe_timer, __next_interval(), SINGLE,
+						probe_lcore, __process_probe, NULL);
 
 	if ((pktsender.job_state & (1 << LCORE_JOB_TX)) == 0)
 		return;
@@ -181,30 +298,26 @@ __process_probe(struct rte_timer *timer __rte_unused,
 
 		ctl = &probe_list[i];
 
+		/* probes sent PROBE_RETURN_MS ago are back by now */
+		latency_collect(ctl->portid, ctl->next_idx > probe_lag ?
+						ctl->next_idx - probe_lag : 0);
+
+		/* the NIC would not latch the TX timestamp of another probe */
+		if (ctl->tx_tag != 0) {
+			__poll_tx_timestamp(ctl, now);
+			if (ctl->tx_tag != 0) {
+				ctl->nb_skipped++;
+				continue;
+			}
+		}
+
 		if (ctl->next_pkt == NULL) {
 			if (__construct_probe(ctl) < 0) {
 				return;
 			}
 		}
 
-//		cycle = rte_get_tsc_cycles();
-
-		trace_hw_tx_prepare(ctl->portid, &ctl->next_pkt, 1);
-
-		/* send probe packet */
-		ret = rte_eth_tx_burst(ctl->portid, ctl->queueid, &ctl->next_pkt, 1);
-		if (ret < 1) {
-			LOG_ERROR("Failed to send probe packet to port %u", ctl->portid);
-			continue;
-		}
-		trace_hw_tx_record(ctl->portid, ctl->next_pkt);
-
-//		LOG_DEBUG("Port %u: send probe pkt %lu",
-//						ctl->portid, ctl->next_idx - 1);
-//		fprintf(ctl->tx_output, "%u\t%lu\t%lu\n",
-//						ctl->portid, ctl->next_idx - 1, cycle);
-		rte_pktmbuf_free(ctl->next_pkt);
-		ctl->next_pkt = NULL;
+		__send_probe(ctl, now);
 	}
 }
 
@@ -263,18 +376,27 @@ probe_receive(uint8_t portid, struct rte_mbuf *pkts[], uint16_t cnt)
 /* Setup and start probe_timer */
 void probe_start(uint64_t hz, uint8_t lcoreid)
 {
-	uint64_t interval = 0;
 	uint8_t i = 0;
 
-	interval = hz / PROBE_RATE_PER_SEC;
+	probe_interval = hz / pktsender.probe_rate;
+	tx_ts_timeout = hz / 1000000 * PROBE_TX_TS_TIMEOUT_US;
+	probe_lcore = lcoreid;
+	probe_lag = RTE_MAX((uint64_t)pktsender.probe_rate * PROBE_RETURN_MS /
+					1000, 1ul);
+	rand_init(&probe_rng, rte_rdtsc());
 
 	/* init timer structure */
 	rte_timer_init(&probe_timer);
 
-	LOG_DEBUG("start probe timer: interval %lu, lcore %u",
-					interval, lcoreid);
-	rte_timer_reset(&probe_timer, interval, PERIODICAL, lcoreid,
-				   __process_probe, NULL);
+	LOG_DEBUG("start probe timer: interval %lu%s, lcore %u",
+					probe_interval,
+					pktsender.probe_poisson ? " on average" : "", lcoreid);
+	if (pktsender.probe_poisson)
+		rte_timer_reset(&probe_timer, __next_interval(), SINGLE, lcoreid,
+					   __process_probe, NULL);
+	else
+		rte_timer_reset(&probe_timer, probe_interval, PERIODICAL, lcoreid,
+					   __process_probe, NULL);
 
 	for (i = 0; i < nb_probe; i++) {
 		struct probe_ctl *ctl = &probe_list[i];
@@ -286,8 +408,49 @@ void probe_start(uint64_t hz, uint8_t lcoreid)
 	}
 }
 
+/* poll the pending TX timestamps */
+void
+probe_poll(void)
+{
+	uint64_t now = 0;
+	uint8_t i = 0;
+
+	if (nb_tx_pending == 0)
+		return;
+
+	now = rte_get_tsc_cycles();
+	for (i = 0; i < nb_probe; i++) {
+		if (probe_list[i].tx_tag != 0)
+			__poll_tx_timestamp(&probe_list[i], now);
+	}
+}
+
 /* stop probe_timer */
 void probe_stop(void)
 {
+	uint8_t i = 0;
+
 	rte_timer_stop_sync(&probe_timer);
+
+	for (i = 0; i < nb_probe; i++) {
+		if (!port_is_enabled(i))
+			continue;
+
+		/* an in-band probe left behind by the TX lcore */
+		if (probe_list[i].inband != NULL) {
+			rte_pktmbuf_free(tx_ctl_take_probe(probe_list[i].inband));
+			if (probe_list[i].tx_tag != 0) {
+				probe_list[i].tx_tag = 0;
+				nb_tx_pending--;
+			}
+		}
+
+		if (probe_list[i].nb_skipped > 0)
+			LOG_INFO("Port %u: %lu probes skipped, waiting for a TX"
+							" timestamp%s", i, probe_list[i].nb_skipped,
+							probe_list[i].inband ? " or a data burst" : "");
+		if (probe_list[i].nb_tx_ts_lost > 0)
+			LOG_WARN("Port %u: %lu probes without TX timestamp", i,
+							probe_list[i].nb_tx_ts_lost);
+	}
 }
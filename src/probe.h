@@ -1,8 +1,31 @@
 #ifndef _PKTSENDER_PROBE_H_
 #define _PKTSENDER_PROBE_H_
 
+/**
+ * @file
+ * Latency probes
+ *
+ * Every tick of the probe timer sends one probe per port, --probe-rate
+ * ticks per second. With --probe-poisson the gaps between ticks are
+ * exponential rather than fixed, so probes do not phase-lock with
+ * periodic behaviours of the DUT.
+ *
+ * Probes go out of band on the probe queue of each port, or with
+ * --probe-inband on its first data queue: the statistics lcore hands the
+ * probe to the TX lcore, which sends it behind the data of its next burst
+ * so that it waits in the same queues.
+ *
+ * The NIC latches the TX timestamp of one probe at a time. The statistics
+ * lcore does not wait for it after sending: it polls the pending
+ * timestamps between two runs of its timers, and a port skips the ticks
+ * until the timestamp of its previous probe is read or
+ * PROBE_TX_TS_TIMEOUT_US passed.
+ */
+
 #include "pkt_seq.h"
 
+struct tx_ctl;
+
 /** Payload of probe packets */
 struct probe_payload {
 	/** Probe ID */
@@ -32,8 +55,17 @@ struct probe_pkt {
 #define PROBE_PKT_PROTO	IPPROTO_UDP
 /** Magic value of probe packets */
 #define PROBE_PKT_MAGIC 0x12345678
-/** Number of probe packets sent per second */
+/** Default number of probe packets sent per second */
 #define PROBE_RATE_PER_SEC	10
+/** Max number of probe packets sent per second, probes sent within
+ * PROBE_RETURN_MS must fit in LATENCY_WINDOW */
+#define PROBE_RATE_MAX	50000
+/** Probes are matched this long after they were sent */
+#define PROBE_RETURN_MS	100
+/** A TX timestamp not read this long after its probe was sent is lost */
+#define PROBE_TX_TS_TIMEOUT_US	1000
+/** Data queue carrying the in-band probes */
+#define PROBE_INBAND_QUEUE	0
 /** Max number of probe IDs */
 #define PROBE_PKT_MAX	256
 /** Mempool cache size */
@@ -53,6 +85,19 @@ struct probe_ctl {
 	uint64_t next_idx;
 	/** Next probe packet to send */
 	struct rte_mbuf *next_pkt;
+	/** TX controller of the data queue carrying the in-band probes, NULL
+	 * if they go out of band */
+	struct tx_ctl *inband;
+	/** Index + 1 of the probe whose TX timestamp is not read yet, 0 if
+	 * none */
+	uint64_t tx_tag;
+	/** TSC the probe of tx_tag was seen sent at, 0 while an in-band one
+	 * waits for a data burst */
+	uint64_t tx_tsc;
+	/** Number of ticks skipped while a TX timestamp was pending */
+	uint64_t nb_skipped;
+	/** Number of TX timestamps not read within PROBE_TX_TS_TIMEOUT_US */
+	uint64_t nb_tx_ts_lost;
 	/** Packet configuration */
 	struct pkt_seq pkt_configure;
 };
@@ -73,6 +118,19 @@ int probe_init(uint8_t nb_ports);
  */
 void probe_free(void);
 
+/**
+ * Parse the number of probes sent per second
+ *
+ * @param str
+ *	1 to PROBE_RATE_MAX
+ * @param rate
+ *	Output: the rate
+ * @return
+ *	- 0 on success
+ *	- ERR_PARAM on failure
+ */
+int probe_parse_rate(const char *str, uint32_t *rate);
+
 /**
  * Setup and start probe_timer
  *
@@ -83,6 +141,14 @@ void probe_free(void);
  */
 void probe_start(uint64_t hz, uint8_t lcoreid);
 
+/**
+ * Read the pending TX timestamps of the probes, without waiting
+ *
+ * Only the lcore running the probe timer may call it, between two runs of
+ * its timers.
+ */
+void probe_poll(void);
+
 /**
  * Stop probe_timer
  */
@@ -0,0 +1,250 @@
+#include "util.h"
+#include "profile.h"
+#include "transmitter.h"
+
+#include <math.h>
+
+/* max number of fields of a profile line */
+#define PROFILE_NB_FIELDS	5
+/* is_pps of a profile before its first rate */
+#define PROFILE_UNIT_UNKNOWN	UINT8_MAX
+
+/* rate at a fraction of the way from one rate to another */
+static inline uint64_t
+__profile_lerp(uint64_t from, uint64_t to, double frac)
+{
+	return (uint64_t)((double)from + ((double)to - (double)from) * frac);
+}
+
+/* parse a duration in seconds into cycles */
+static int
+__profile_parse_time(const char *str, uint64_t hz, uint64_t *cycles)
+{
+	char *end = NULL;
+	double val = 0;
+
+	errno = 0;
+	val = strtod(str, &end);
+	if (errno != 0 || end == str || *end != '\0' || val <= 0)
+		return ERR_PARAM;
+
+	*cycles = (uint64_t)(val * hz);
+	return (*cycles > 0) ? 0 : ERR_PARAM;
+}
+
+/* parse a rate, all non-zero rates of a profile share the same unit */
+static int
+__profile_parse_rate(struct profile *profile, const char *str,
+				uint64_t *rate)
+{
+	uint8_t is_pps = 0;
+
+	if (tx_parse_rate(str, rate, &is_pps) < 0)
+		return ERR_PARAM;
+	if (*rate == 0)
+		return 0;
+
+	if (profile->is_pps != PROFILE_UNIT_UNKNOWN && is_pps != profile->is_pps) {
+		LOG_ERROR("Mixed bps and pps rates in the profile");
+		return ERR_PARAM;
+	}
+	profile->is_pps = is_pps;
+	return 0;
+}
+
+/* parse one segment */
+static int
+__profile_parse_seg(struct profile *profile, char **fld, int nb_fld,
+				uint64_t hz)
+{
+	struct profile_seg *seg = &profile->segs[profile->nb_segs];
+	char *end = NULL;
+	double duty = 0;
+	unsigned long steps = 0;
+
+	memset(seg, 0, sizeof(struct profile_seg));
+
+	if (strcmp(fld[0], "ramp") == 0 && nb_fld == 4) {
+		seg->type = PROFILE_SEG_RAMP;
+	} else if (strcmp(fld[0], "step") == 0 && nb_fld == 5) {
+		seg->type = PROFILE_SEG_STEP;
+	} else if (strcmp(fld[0], "sine") == 0 && nb_fld == 5) {
+		seg->type = PROFILE_SEG_SINE;
+	} else if (strcmp(fld[0], "square") == 0 && nb_fld == 5) {
+		seg->type = PROFILE_SEG_SQUARE;
+	} else {
+		LOG_ERROR("Unknown profile segment %s with %d fields",
+						fld[0], nb_fld);
+		return ERR_PARAM;
+	}
+
+	if (__profile_parse_time(fld[1], hz, &seg->cycles) < 0 ||
+			__profile_parse_rate(profile, fld[2], &seg->from) < 0)
+		return ERR_PARAM;
+
+	switch (seg->type) {
+	case PROFILE_SEG_RAMP:
+		return __profile_parse_rate(profile, fld[3], &seg->to);
+	case PROFILE_SEG_STEP:
+		if (__profile_parse_rate(profile, fld[3], &seg->to) < 0)
+			return ERR_PARAM;
+		errno = 0;
+		steps = strtoul(fld[4], &end, 10);
+		if (errno != 0 || end == fld[4] || *end != '\0' || steps == 0 ||
+				steps > seg->cycles)
+			return ERR_PARAM;
+		seg->nb_steps = (uint32_t)steps;
+		seg->period = seg->cycles / steps;
+		return 0;
+	case PROFILE_SEG_SINE:
+		if (__profile_parse_rate(profile, fld[3], &seg->to) < 0)
+			return ERR_PARAM;
+		return __profile_parse_time(fld[4], hz, &seg->period);
+	case PROFILE_SEG_SQUARE:
+		if (__profile_parse_time(fld[3], hz, &seg->period) < 0)
+			return ERR_PARAM;
+		errno = 0;
+		duty = strtod(fld[4], &end);
+		if (errno != 0 || end == fld[4] || *end != '\0' ||
+				duty <= 0 || duty > 1)
+			return ERR_PARAM;
+		seg->on = (uint64_t)(duty * seg->period);
+		return 0;
+	default:
+		return ERR_PARAM;
+	}
+}
+
+/* load a profile file */
+struct profile *
+profile_load(const char *path, uint64_t hz)
+{
+	struct profile *profile = NULL;
+	char line[256], *fld[PROFILE_NB_FIELDS + 1], *p = NULL;
+	int nb_fld = 0;
+	uint32_t lineno = 0;
+	FILE *fp = NULL;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		LOG_ERROR("Failed to open profile %s: %s", path, strerror(errno));
+		return NULL;
+	}
+
+	profile = (struct profile *)calloc(1, sizeof(struct profile));
+	if (profile == NULL) {
+		LOG_ERROR("Failed to allocate memory for profile %s", path);
+		goto fail;
+	}
+	profile->update_cycles = MAX(hz / 1000000 * PROFILE_UPDATE_US, 1);
+	profile->is_pps = PROFILE_UNIT_UNKNOWN;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+
+		nb_fld = 0;
+		p = strtok(line, " \t\r\n");
+		while (p != NULL && nb_fld <= PROFILE_NB_FIELDS) {
+			fld[nb_fld++] = p;
+			p = strtok(NULL, " \t\r\n");
+		}
+		if (nb_fld == 0 || fld[0][0] == '#')
+			continue;
+
+		if (profile->nb_segs >= PROFILE_SEG_MAX) {
+			LOG_ERROR("Profile %s has more than %u segments",
+							path, PROFILE_SEG_MAX);
+			goto fail;
+		}
+		if (__profile_parse_seg(profile, fld, nb_fld, hz) < 0) {
+			LOG_ERROR("Wrong segment at %s:%u", path, lineno);
+			goto fail;
+		}
+
+		profile->segs[profile->nb_segs].start = profile->loop_cycles;
+		profile->loop_cycles += profile->segs[profile->nb_segs].cycles;
+		profile->nb_segs++;
+	}
+
+	if (profile->nb_segs == 0) {
+		LOG_ERROR("Profile %s has no segment", path);
+		goto fail;
+	}
+
+	if (profile->is_pps == PROFILE_UNIT_UNKNOWN)
+		profile->is_pps = 0;
+
+	fclose(fp);
+	LOG_INFO("Loaded profile %s: %u segments, %.3f s per loop",
+					path, profile->nb_segs,
+					(double)profile->loop_cycles / hz);
+	return profile;
+
+fail:
+	zfree(profile);
+	fclose(fp);
+	return NULL;
+}
+
+/* free a profile */
+void
+profile_free(struct profile *profile)
+{
+	zfree(profile);
+}
+
+/* get the rate of a profile at t */
+uint64_t
+profile_get_rate(const struct profile *profile, uint64_t t,
+				uint16_t *seg, uint64_t *next)
+{
+	const struct profile_seg *s = NULL;
+	uint64_t rate = 0, pos = 0, left = 0;
+	uint32_t k = 0;
+
+	t %= profile->loop_cycles;
+	if (*seg >= profile->nb_segs || t < profile->segs[*seg].start)
+		*seg = 0;
+	while (t >= profile->segs[*seg].start + profile->segs[*seg].cycles)
+		(*seg)++;
+
+	s = &profile->segs[*seg];
+	t -= s->start;
+	left = s->cycles - t;
+	*next = profile->update_cycles;
+
+	switch (s->type) {
+	case PROFILE_SEG_RAMP:
+		rate = __profile_lerp(s->from, s->to, (double)t / s->cycles);
+		break;
+	case PROFILE_SEG_STEP:
+		/* steps change the rate only at their boundaries */
+		k = (uint32_t)MIN(t / s->period, s->nb_steps - 1);
+		rate = s->from;
+		if (s->nb_steps > 1)
+			rate = __profile_lerp(s->from, s->to,
+							(double)k / (s->nb_steps - 1));
+		*next = (k == s->nb_steps - 1) ? left : (k + 1) * s->period - t;
+		break;
+	case PROFILE_SEG_SINE:
+		rate = __profile_lerp(s->from, s->to,
+						(1 - cos(2 * M_PI * (t % s->period) / s->period)) / 2);
+		break;
+	case PROFILE_SEG_SQUARE:
+		/* and so does a square at its edges */
+		pos = t % s->period;
+		if (pos < s->on) {
+			rate = s->from;
+			*next = s->on - pos;
+		} else {
+			rate = 0;
+			*next = s->period - pos;
+		}
+		break;
+	default:
+		break;
+	}
+
+	*next = MIN(*next, left);
+	return rate;
+}
@@ -0,0 +1,103 @@
+#ifndef _PKTSENDER_PROFILE_H_
+#define _PKTSENDER_PROFILE_H_
+
+/**
+ * @file
+ * Time-varying TX rate profile
+ *
+ * A profile is a list of segments played in turn and looped. Each line of
+ * a profile file is one segment, durations and periods are in seconds and
+ * rates use the -r format:
+ *	- ramp <duration> <from> <to>: linear ramp
+ *	- step <duration> <from> <to> <steps>: ladder of equal steps
+ *	- sine <duration> <min> <max> <period>: sine wave starting at min
+ *	- square <duration> <rate> <period> <duty>: on/off, on for duty
+ *	  (0, 1] of each period and silent otherwise
+ * Empty lines and lines starting with '#' are skipped. All rates of a
+ * profile are either bit rates or packet rates.
+ */
+
+#include <stdint.h>
+
+/** Max number of segments of a profile */
+#define PROFILE_SEG_MAX	64
+/** Max time (us) between two evaluations of a smoothly varying rate */
+#define PROFILE_UPDATE_US	1000
+
+/** Segment type */
+enum {
+	PROFILE_SEG_RAMP = 0,
+	PROFILE_SEG_STEP,
+	PROFILE_SEG_SINE,
+	PROFILE_SEG_SQUARE,
+};
+
+/** A segment of a profile, times in cycles */
+struct profile_seg {
+	/** PROFILE_SEG_* */
+	uint8_t type;
+	/** Start since the beginning of a loop */
+	uint64_t start;
+	/** Duration */
+	uint64_t cycles;
+	/** Rate at the start, min of a sine, on rate of a square */
+	uint64_t from;
+	/** Rate at the end, max of a sine */
+	uint64_t to;
+	/** Period of a sine or a square, length of a step */
+	uint64_t period;
+	/** On time of each square period */
+	uint64_t on;
+	/** Number of steps */
+	uint32_t nb_steps;
+};
+
+/** A rate profile */
+struct profile {
+	/** Whether rates count packets instead of bits */
+	uint8_t is_pps;
+	/** Number of segments */
+	uint16_t nb_segs;
+	/** Duration of one loop in cycles */
+	uint64_t loop_cycles;
+	/** Max cycles between two evaluations */
+	uint64_t update_cycles;
+	/** Segments in play order */
+	struct profile_seg segs[PROFILE_SEG_MAX];
+};
+
+/**
+ * Load a profile file
+ *
+ * @param path
+ *	The profile file
+ * @param hz
+ *	TSC frequency
+ * @return
+ *	- Pointer to the profile, to be freed with profile_free()
+ *	- NULL on failure
+ */
+struct profile *profile_load(const char *path, uint64_t hz);
+
+/**
+ * Free a profile
+ */
+void profile_free(struct profile *profile);
+
+/**
+ * Get the per-port rate of a profile
+ *
+ * @param profile
+ * @param t
+ *	Cycles since the profile started
+ * @param seg
+ *	In/out: segment of the previous call, speeds up the lookup
+ * @param next
+ *	Output: cycles after t until the rate should be evaluated again
+ * @return
+ *	The rate, in the unit of the profile. 0 means silent.
+ */
+uint64_t profile_get_rate(const struct profile *profile, uint64_t t,
+				uint16_t *seg, uint64_t *next);
+
+#endif /* _PKTSENDER_PROFILE_H_ */
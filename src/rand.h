@@ -0,0 +1,108 @@
+#ifndef _PKTSENDER_RAND_H_
+#define _PKTSENDER_RAND_H_
+
+/**
+ * @file
+ * Fast pseudo random number generator
+ *
+ * Four independent xorshift32 generators run in the lanes of one SSE
+ * register, so a full burst of random values is produced with a handful
+ * of vector instructions.
+ */
+
+#include <stdint.h>
+#include <emmintrin.h>
+
+/** Number of generator lanes */
+#define RAND_LANES	4
+
+/** Generator state */
+struct rand_state {
+	/** Per-lane xorshift32 state, never zero */
+	uint32_t lanes[RAND_LANES];
+};
+
+/**
+ * Seed the generator
+ *
+ * Each lane is derived from the seed by splitmix64, so nearby seeds
+ * still give unrelated sequences.
+ *
+ * @param st
+ *	Pointer to the generator state
+ * @param seed
+ *	Any 64-bit value
+ */
+static inline void
+rand_init(struct rand_state *st, uint64_t seed)
+{
+	uint64_t z = 0;
+	int i = 0;
+
+	for (i = 0; i < RAND_LANES; i++) {
+		seed += 0x9E3779B97F4A7C15ull;
+		z = seed;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		z = z ^ (z >> 31);
+		st->lanes[i] = (uint32_t)z;
+		if (st->lanes[i] == 0)
+			st->lanes[i] = 0x6D2B79F5;
+	}
+}
+
+/**
+ * Fill an array with random values
+ *
+ * @param st
+ *	Pointer to the generator state
+ * @param out
+ *	Output array, must have room for n rounded up to RAND_LANES
+ * @param n
+ *	Number of values needed
+ */
+static inline void
+rand_fill(struct rand_state *st, uint32_t *out, unsigned n)
+{
+	__m128i x = _mm_loadu_si128((const __m128i *)st->lanes);
+	unsigned i = 0;
+
+	for (i = 0; i < n; i += RAND_LANES) {
+		x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+		x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+		_mm_storeu_si128((__m128i *)&out[i], x);
+	}
+
+	_mm_storeu_si128((__m128i *)st->lanes, x);
+}
+
+/**
+ * Generate a single random value
+ */
+static inline uint32_t
+rand_next(struct rand_state *st)
+{
+	uint32_t r[RAND_LANES];
+
+	rand_fill(st, r, 1);
+	return r[0];
+}
+
+/**
+ * Map a random value into [min, min + span) without division
+ *
+ * @param r
+ *	Uniform 32-bit random value
+ * @param min
+ *	Lower bound
+ * @param span
+ *	Number of values in the range, at most 2^32
+ */
+static inline uint32_t
+rand_scale(uint32_t r, uint32_t min, uint64_t span)
+{
+	return min + (uint32_t)(((uint64_t)r * span) >> 32);
+}
+
+#endif /* _PKTSENDER_RAND_H_ */
@@ -0,0 +1,581 @@
+#include "util.h"
+#include "rfc2544.h"
+#include "pktsender.h"
+#include "port.h"
+#include "latency.h"
+
+#include <rte_cycles.h>
+#include <rte_ethdev.h>
+#include <rte_timer.h>
+
+/** Test state */
+enum {
+	/** waiting for the ports before the first trial */
+	RFC2544_STATE_WARMUP = 0,
+	/** sending at the trial rate */
+	RFC2544_STATE_TRIAL,
+	/** waiting for the frames still in flight */
+	RFC2544_STATE_SETTLE,
+};
+
+/** Result of a load step of the latency test */
+struct rfc2544_lat_result {
+	/** Per-port rate */
+	uint64_t rate;
+	/** Frames sent */
+	uint64_t tx_pkts;
+	/** Frames received */
+	uint64_t rx_pkts;
+	/** Probe latency */
+	struct latency_summary lat;
+};
+
+/** Result of a frame size */
+struct rfc2544_result {
+	/** Packet length (excluding FCS) */
+	uint16_t len;
+	/** Highest passing per-port rate, 0 if none passed */
+	uint64_t rate;
+	/** Frames sent by the best trial */
+	uint64_t tx_pkts;
+	/** Frames received by the best trial */
+	uint64_t rx_pkts;
+	/** Number of trials */
+	uint32_t nb_trials;
+	/** Number of load steps done by the latency test */
+	uint8_t nb_steps;
+	/** Results of each load step */
+	struct rfc2544_lat_result steps[RFC2544_LAT_STEPS_MAX];
+};
+
+/** Test controller */
+struct rfc2544_test {
+	/** Lcore of the test timer */
+	uint8_t lcoreid;
+	/** RFC2544_STATE_* */
+	uint8_t state;
+	/** Test of the current trial, RFC2544_THROUGHPUT or RFC2544_LATENCY */
+	uint8_t phase;
+	/** Number of load steps of the latency test */
+	uint8_t nb_steps;
+	/** Whether rates count packets instead of bits */
+	uint8_t is_pps;
+	/** Number of frame sizes */
+	uint8_t nb_sizes;
+	/** Frame size under test */
+	uint8_t size_idx;
+	/** Upper bound of the search */
+	uint64_t max_rate;
+	/** Highest passing rate so far */
+	uint64_t lo;
+	/** Lowest failing rate so far */
+	uint64_t hi;
+	/** Rate of the current trial */
+	uint64_t rate;
+	/** 100% load of the latency test */
+	uint64_t base_rate;
+	/** Summed TX counter at the start of the trial */
+	uint64_t tx_start;
+	/** Summed RX counter at the start of the trial */
+	uint64_t rx_start;
+	/** Summed RX drops of the tester at the start of the trial */
+	uint64_t missed_start;
+	/** Results of each frame size */
+	struct rfc2544_result results[PKT_SEQ_SIZE_MAX];
+	/** Results file, NULL to only log the results */
+	char *path;
+	/** Test timer */
+	struct rte_timer timer;
+};
+
+static struct rfc2544_test test;
+
+/* parse a duration or a loss tolerance */
+int
+rfc2544_parse_value(const char *str, double *val, uint8_t allow_zero)
+{
+	char *end = NULL;
+
+	errno = 0;
+	*val = strtod(str, &end);
+	if (errno != 0 || end == str || *end != '\0' || *val < 0 ||
+			(*val == 0 && !allow_zero)) {
+		LOG_ERROR("Wrong RFC 2544 value %s", str);
+		return ERR_PARAM;
+	}
+	return 0;
+}
+
+/* parse the load step of the latency test */
+int
+rfc2544_parse_step(const char *str, uint8_t *step)
+{
+	char *end = NULL;
+	unsigned long val = 0;
+
+	errno = 0;
+	val = strtoul(str, &end, 10);
+	if (errno != 0 || end == str || *end != '\0' || val == 0 || val > 100) {
+		LOG_ERROR("Wrong RFC 2544 load step %s", str);
+		return ERR_PARAM;
+	}
+	*step = (uint8_t)val;
+	return 0;
+}
+
+/* sum the counters of all enabled ports */
+static void
+__rfc2544_read(uint64_t *tx, uint64_t *rx, uint64_t *missed)
+{
+	struct rte_eth_stats stats;
+	uint8_t portid = 0;
+
+	*tx = *rx = *missed = 0;
+	for (portid = 0; portid < pktsender.nb_ports; portid++) {
+		if (!port_is_enabled(portid))
+			continue;
+
+		rte_eth_stats_get(portid, &stats);
+		*tx += stats.opackets;
+		*rx += stats.ipackets;
+		*missed += stats.imissed;
+	}
+}
+
+/* request a rate on all enabled ports */
+static void
+__rfc2544_request(uint64_t rate)
+{
+	uint8_t portid = 0;
+	uint8_t size_idx = (test.nb_sizes > 1) ? test.size_idx : TX_SIZE_ANY;
+
+	for (portid = 0; portid < pktsender.nb_ports; portid++) {
+		if (port_is_enabled(portid))
+			port_request_tx(portid, rate, size_idx);
+	}
+}
+
+static void __rfc2544_timer_cb(struct rte_timer *timer, void *arg);
+
+/* arm the test timer */
+static void
+__rfc2544_arm(uint8_t state, double seconds)
+{
+	test.state = state;
+	rte_timer_reset(&test.timer, (uint64_t)(seconds * pktsender.cpu_hz),
+					SINGLE, test.lcoreid, __rfc2544_timer_cb, NULL);
+}
+
+/* start a trial */
+static void
+__rfc2544_trial(uint64_t rate)
+{
+	test.rate = rate;
+	__rfc2544_read(&test.tx_start, &test.rx_start, &test.missed_start);
+	if (test.phase == RFC2544_LATENCY)
+		latency_reset();
+	__rfc2544_request(rate);
+	__rfc2544_arm(RFC2544_STATE_TRIAL, pktsender.rfc2544.trial);
+
+	LOG_INFO("RFC 2544 %s: %u-byte frames, trial at %lu %s (%.2lf%%)",
+					test.phase == RFC2544_LATENCY ? "latency" : "throughput",
+					test.results[test.size_idx].len + FCS_SIZE, rate,
+					test.is_pps ? "pps" : "bps",
+					rate * 100.0 / test.max_rate);
+}
+
+/* rate of a load step of the latency test, the last one is 100% */
+static inline uint64_t
+__rfc2544_step_rate(uint8_t step)
+{
+	uint32_t load = MIN((step + 1) * pktsender.rfc2544.latency_step, 100);
+
+	return (uint64_t)(test.base_rate * (load / 100.0));
+}
+
+static void __rfc2544_next_size(void);
+
+/* start the latency test of the current size */
+static void
+__rfc2544_begin_latency(void)
+{
+	struct rfc2544_result *res = &test.results[test.size_idx];
+
+	if ((pktsender.rfc2544.tests & RFC2544_LATENCY) == 0) {
+		__rfc2544_next_size();
+		return;
+	}
+
+	test.base_rate = (pktsender.rfc2544.tests & RFC2544_THROUGHPUT) ?
+					res->rate : test.max_rate;
+	if (test.base_rate == 0) {
+		LOG_WARN("RFC 2544: no throughput for %u-byte frames, skip the"
+						" latency test", res->len + FCS_SIZE);
+		__rfc2544_next_size();
+		return;
+	}
+
+	test.phase = RFC2544_LATENCY;
+	__rfc2544_trial(__rfc2544_step_rate(0));
+}
+
+/* start the tests of the current size */
+static void
+__rfc2544_begin_size(void)
+{
+	if ((pktsender.rfc2544.tests & RFC2544_THROUGHPUT) == 0) {
+		__rfc2544_begin_latency();
+		return;
+	}
+
+	test.phase = RFC2544_THROUGHPUT;
+	test.lo = 0;
+	test.hi = test.max_rate;
+	__rfc2544_trial(test.max_rate);
+}
+
+/* per-port rate in Mbps and pps */
+static void
+__rfc2544_convert(uint16_t len, uint64_t rate, double *mbps, double *pps)
+{
+	uint32_t wire = len + FRAME_EXTRA_BYTES;
+
+	if (test.is_pps) {
+		*pps = rate;
+		*mbps = rate * wire * 8 / 1e6;
+	} else {
+		*pps = rate / (wire * 8.0);
+		*mbps = rate / 1e6;
+	}
+}
+
+/* log a line of the results and write it to the results file */
+static void
+__rfc2544_output(FILE *fp, const char *line)
+{
+	LOG_INFO("%s", line);
+	if (fp != NULL)
+		fprintf(fp, "%s\n", line);
+}
+
+/* loss in percent of the frames sent */
+static inline double
+__rfc2544_loss(uint64_t tx, uint64_t rx)
+{
+	return (tx > rx) ? (tx - rx) * 100.0 / tx : 0;
+}
+
+/* throughput table */
+static void
+__rfc2544_output_throughput(FILE *fp)
+{
+	const struct rfc2544_result *res = NULL;
+	char line[256];
+	double mbps = 0, pps = 0;
+	uint8_t i = 0;
+
+	snprintf(line, sizeof(line), "# RFC 2544 throughput: trial %.1lf s,"
+					" settle %.1lf s, loss tolerance %lf%%, max %lu %s",
+					pktsender.rfc2544.trial, pktsender.rfc2544.settle,
+					pktsender.rfc2544.loss, test.max_rate,
+					test.is_pps ? "pps" : "bps");
+	__rfc2544_output(fp, line);
+
+	snprintf(line, sizeof(line), "# %5s %12s %14s %8s %14s %14s %10s %6s",
+					"frame", "Mbps", "pps", "load(%)", "tx_pkts", "rx_pkts",
+					"loss(%)", "trials");
+	__rfc2544_output(fp, line);
+
+	for (i = 0; i < test.nb_sizes; i++) {
+		res = &test.results[i];
+		if (res->nb_trials == 0)
+			break;
+
+		__rfc2544_convert(res->len, res->rate, &mbps, &pps);
+		snprintf(line, sizeof(line),
+						"  %5u %12.3lf %14.1lf %8.3lf %14lu %14lu %10.6lf %6u",
+						res->len + FCS_SIZE, mbps, pps,
+						res->rate * 100.0 / test.max_rate,
+						res->tx_pkts, res->rx_pkts,
+						__rfc2544_loss(res->tx_pkts, res->rx_pkts),
+						res->nb_trials);
+		__rfc2544_output(fp, line);
+	}
+}
+
+/* latency table, in ns */
+static void
+__rfc2544_output_latency(FILE *fp)
+{
+	const struct rfc2544_result *res = NULL;
+	const struct rfc2544_lat_result *step = NULL;
+	char line[256];
+	double mbps = 0, pps = 0;
+	uint8_t i = 0, j = 0;
+
+	snprintf(line, sizeof(line), "# RFC 2544 latency: trial %.1lf s,"
+					" settle %.1lf s, load step %u%% of the %s, latency in ns",
+					pktsender.rfc2544.trial, pktsender.rfc2544.settle,
+					pktsender.rfc2544.latency_step,
+					(pktsender.rfc2544.tests & RFC2544_THROUGHPUT) ?
+					"throughput" : "max rate");
+	__rfc2544_output(fp, line);
+
+	snprintf(line, sizeof(line), "# %5s %4s %12s %14s %10s %8s %6s"
+					" %10s %10s %10s %10s %10s %10s",
+					"frame", "step", "Mbps", "pps", "loss(%)", "probes",
+					"lost", "min", "avg", "p50", "p99", "p99.9", "max");
+	__rfc2544_output(fp, line);
+
+	for (i = 0; i < test.nb_sizes; i++) {
+		res = &test.results[i];
+		for (j = 0; j < res->nb_steps; j++) {
+			step = &res->steps[j];
+			__rfc2544_convert(res->len, step->rate, &mbps, &pps);
+			snprintf(line, sizeof(line), "  %5u %4u %12.3lf %14.1lf %10.6lf"
+							" %8lu %6lu %10lu %10lu %10lu %10lu %10lu %10lu",
+							res->len + FCS_SIZE, j + 1, mbps, pps,
+							__rfc2544_loss(step->tx_pkts, step->rx_pkts),
+							step->lat.nb_samples, step->lat.nb_lost,
+							step->lat.min, step->lat.avg, step->lat.p50,
+							step->lat.p99, step->lat.p999, step->lat.max);
+			__rfc2544_output(fp, line);
+		}
+	}
+}
+
+/* log and write the results tables, then stop all jobs */
+static void
+__rfc2544_finish(void)
+{
+	FILE *fp = NULL;
+
+	__rfc2544_request(0);
+
+	if (test.path != NULL) {
+		fp = fopen(test.path, "w");
+		if (fp == NULL)
+			LOG_ERROR("Failed to open %s: %s", test.path, strerror(errno));
+	}
+
+	if (pktsender.rfc2544.tests & RFC2544_THROUGHPUT)
+		__rfc2544_output_throughput(fp);
+	if (pktsender.rfc2544.tests & RFC2544_LATENCY)
+		__rfc2544_output_latency(fp);
+
+	if (fp != NULL) {
+		fclose(fp);
+		LOG_INFO("RFC 2544 results written to %s", test.path);
+	}
+
+	/* the tests are over, stop all lcores */
+	pktsender.job_state = 0;
+}
+
+/* go on with the next frame size */
+static void
+__rfc2544_next_size(void)
+{
+	if (++test.size_idx == test.nb_sizes) {
+		__rfc2544_finish();
+		return;
+	}
+	__rfc2544_begin_size();
+}
+
+/* counters of the last trial */
+static void
+__rfc2544_count(uint64_t *tx, uint64_t *rx)
+{
+	uint64_t missed = 0;
+
+	__rfc2544_read(tx, rx, &missed);
+	*tx -= test.tx_start;
+	*rx -= test.rx_start;
+	missed -= test.missed_start;
+
+	/* frames dropped by the tester itself are not lost by the DUT */
+	if (missed > 0)
+		LOG_WARN("RFC 2544: %lu frames missed by the tester RX, counted"
+						" as received", missed);
+	*rx += missed;
+}
+
+/* keep the latency of the last trial and go on with the next step */
+static void
+__rfc2544_eval_latency(void)
+{
+	struct rfc2544_result *res = &test.results[test.size_idx];
+	struct rfc2544_lat_result *step = &res->steps[res->nb_steps];
+
+	step->rate = test.rate;
+	__rfc2544_count(&step->tx_pkts, &step->rx_pkts);
+	/* probes of the trial had the settle time to come back */
+	latency_collect_mark();
+	latency_get_summary(&step->lat);
+
+	LOG_INFO("RFC 2544: %u-byte frames at %lu %s: %lu probes, latency"
+					" min %lu avg %lu p99 %lu max %lu ns",
+					res->len + FCS_SIZE, test.rate,
+					test.is_pps ? "pps" : "bps", step->lat.nb_samples,
+					step->lat.min, step->lat.avg, step->lat.p99,
+					step->lat.max);
+
+	if (++res->nb_steps == test.nb_steps) {
+		__rfc2544_next_size();
+		return;
+	}
+	__rfc2544_trial(__rfc2544_step_rate(res->nb_steps));
+}
+
+/* judge the last throughput trial and pick the next rate */
+static void
+__rfc2544_eval_throughput(void)
+{
+	struct rfc2544_result *res = &test.results[test.size_idx];
+	uint64_t tx = 0, rx = 0, next = 0;
+	double loss = 0;
+	bool pass = false;
+
+	__rfc2544_count(&tx, &rx);
+	loss = __rfc2544_loss(tx, rx);
+	pass = (tx > 0 && loss <= pktsender.rfc2544.loss);
+	res->nb_trials++;
+
+	LOG_INFO("RFC 2544: %u-byte frames at %lu %s: tx %lu, rx %lu,"
+					" loss %lf%%, %s",
+					res->len + FCS_SIZE, test.rate,
+					test.is_pps ? "pps" : "bps", tx, rx, loss,
+					pass ? "pass" : "fail");
+
+	if (pass) {
+		test.lo = test.rate;
+		res->rate = test.rate;
+		res->tx_pkts = tx;
+		res->rx_pkts = rx;
+	} else {
+		test.hi = test.rate;
+	}
+
+	next = test.lo + (test.hi - test.lo) / 2;
+	if (test.lo == test.max_rate || next == test.lo ||
+			test.hi - test.lo <= test.max_rate * RFC2544_RESOLUTION) {
+		/* the search of this size is done */
+		__rfc2544_begin_latency();
+		return;
+	}
+
+	__rfc2544_trial(next);
+}
+
+static void
+__rfc2544_timer_cb(struct rte_timer *timer __rte_unused,
+				void *arg __rte_unused)
+{
+	/* the first CTRL-C aborts the test */
+	if ((pktsender.job_state & (1 << LCORE_JOB_TX)) == 0) {
+		LOG_WARN("RFC 2544: TX stopped, the test is aborted");
+		__rfc2544_finish();
+		return;
+	}
+
+	switch (test.state) {
+	case RFC2544_STATE_WARMUP:
+		__rfc2544_begin_size();
+		break;
+	case RFC2544_STATE_TRIAL:
+		/* probes sent after the trial do not measure its load */
+		if (test.phase == RFC2544_LATENCY)
+			latency_mark();
+		/* stop and let the DUT drain before reading the counters */
+		__rfc2544_request(0);
+		__rfc2544_arm(RFC2544_STATE_SETTLE, pktsender.rfc2544.settle);
+		break;
+	case RFC2544_STATE_SETTLE:
+		if (test.phase == RFC2544_LATENCY)
+			__rfc2544_eval_latency();
+		else
+			__rfc2544_eval_throughput();
+		break;
+	default:
+		break;
+	}
+}
+
+/* get the max rate: -r if given, the slowest link otherwise */
+static int
+__rfc2544_max_rate(void)
+{
+	struct rte_eth_link link;
+	uint8_t portid = 0;
+
+	if (pktsender.tx_rate != 0) {
+		test.max_rate = pktsender.tx_rate;
+		test.is_pps = pktsender.tx_rate_pps;
+		return 0;
+	}
+
+	test.max_rate = UINT64_MAX;
+	test.is_pps = 0;
+	for (portid = 0; portid < pktsender.nb_ports; portid++) {
+		if (!port_is_enabled(portid))
+			continue;
+
+		memset(&link, 0, sizeof(link));
+		rte_eth_link_get(portid, &link);
+		if (link.link_status == 0 || link.link_speed == 0) {
+			LOG_ERROR("RFC 2544: port %u is down, set the max rate with -r",
+							portid);
+			return ERR_DPDK;
+		}
+		test.max_rate = MIN(test.max_rate, link.link_speed * 1000000ul);
+	}
+	return 0;
+}
+
+/* start the tests */
+int
+rfc2544_start(uint8_t lcoreid, const char *prefix)
+{
+	struct pkt_seq_size *size = &pktsender.tx_size;
+	char path[256];
+	uint8_t i = 0;
+
+	memset(&test, 0, sizeof(test));
+	test.lcoreid = lcoreid;
+
+	if (__rfc2544_max_rate() < 0)
+		return ERR_DPDK;
+
+	if (size->nb_sizes > 1) {
+		test.nb_sizes = size->nb_sizes;
+		for (i = 0; i < size->nb_sizes; i++)
+			test.results[i].len = size->len[i];
+	} else {
+		test.nb_sizes = 1;
+		test.results[0].len = pktsender.tx_pkt.pkt_len;
+	}
+	test.nb_steps = (100 + pktsender.rfc2544.latency_step - 1) /
+					MAX(pktsender.rfc2544.latency_step, 1);
+
+	if (prefix != NULL) {
+		snprintf(path, sizeof(path), "%srfc2544.txt", prefix);
+		test.path = strdup(path);
+	}
+
+	LOG_INFO("RFC 2544: %u frame sizes, max rate %lu %s",
+					test.nb_sizes, test.max_rate,
+					test.is_pps ? "pps" : "bps");
+
+	rte_timer_init(&test.timer);
+	__rfc2544_arm(RFC2544_STATE_WARMUP, pktsender.rfc2544.settle);
+	return 0;
+}
+
+/* stop the tests */
+void
+rfc2544_stop(void)
+{
+	rte_timer_stop_sync(&test.timer);
+	zfree(test.path);
+}
@@ -0,0 +1,107 @@
+#ifndef _PKTSENDER_RFC2544_H_
+#define _PKTSENDER_RFC2544_H_
+
+/**
+ * @file
+ * RFC 2544 throughput and latency tests
+ *
+ * For each frame size, the throughput test binary-searches the highest
+ * per-port rate whose loss stays within the tolerance. A trial sends at
+ * one rate for the trial duration, stops, waits the settle time for
+ * frames still in flight, then compares the TX and RX counters summed
+ * over all enabled ports.
+ *
+ * The latency test then runs one trial per load step, a share of the
+ * throughput found (or of the max rate without the throughput test), and
+ * summarizes the latency of the probes sent during the trial.
+ *
+ * The tests run on the statistics lcore, TX lcores only follow the rate
+ * and size they request.
+ */
+
+#include <stdint.h>
+
+/** Frame sizes (including FCS) tested by default */
+#define RFC2544_SIZES	"64:1,128:1,256:1,512:1,1024:1,1280:1,1518:1"
+/** Frame sizes tested by default with IPv6, the smallest one holds the
+ * IPv6 and TCP headers (RFC 5180) */
+#define RFC2544_SIZES_IPV6	"78:1,128:1,256:1,512:1,1024:1,1280:1,1518:1"
+/** Default trial duration in seconds */
+#define RFC2544_TRIAL_DEFAULT	60
+/** Default settle time in seconds */
+#define RFC2544_SETTLE_DEFAULT	2
+/** The search stops once the rate is known within this share of the
+ * max rate */
+#define RFC2544_RESOLUTION	0.001
+/** Max number of load steps of the latency test */
+#define RFC2544_LAT_STEPS_MAX	100
+
+/** Throughput test */
+#define RFC2544_THROUGHPUT	0x1
+/** Latency test */
+#define RFC2544_LATENCY	0x2
+
+/** Configuration of the tests */
+struct rfc2544_conf {
+	/** Tests replacing the normal TX, RFC2544_THROUGHPUT|RFC2544_LATENCY */
+	uint8_t tests;
+	/** Load step of the latency test in percent */
+	uint8_t latency_step;
+	/** Trial duration in seconds */
+	double trial;
+	/** Settle time in seconds */
+	double settle;
+	/** Loss tolerance in percent of the frames sent */
+	double loss;
+};
+
+/**
+ * Parse a duration or a loss tolerance of the test
+ *
+ * @param str
+ *	The string to parse
+ * @param val
+ *	Output: the value
+ * @param allow_zero
+ *	Whether 0 is valid
+ * @return
+ *	- 0 on success
+ *	- ERR_PARAM on failure
+ */
+int rfc2544_parse_value(const char *str, double *val, uint8_t allow_zero);
+
+/**
+ * Parse the load step of the latency test
+ *
+ * @param str
+ *	Step in percent of the throughput, from 1 to 100
+ * @param step
+ *	Output: the step
+ * @return
+ *	- 0 on success
+ *	- ERR_PARAM on failure
+ */
+int rfc2544_parse_step(const char *str, uint8_t *step);
+
+/**
+ * Start the tests
+ *
+ * TX queues start silent, the first trial begins after the settle time.
+ * All jobs are stopped when the tests finish.
+ *
+ * @param lcoreid
+ *	The lcore running the test timer
+ * @param prefix
+ *	Prefix of the results file, NULL to only log the results
+ * @return
+ *	- 0 on success
+ *	- Negative value on failure
+ */
+int rfc2544_start(uint8_t lcoreid, const char *prefix);
+
+/**
+ * Stop the tests
+ */
+void rfc2544_stop(void);
+
+#endif /* _PKTSENDER_RFC2544_H_ */
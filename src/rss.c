@@ -0,0 +1,434 @@
+#include "util.h"
+#include "rss.h"
+#include "pktsender.h"
+#include "port.h"
+
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_udp.h>
+
+/** DUT queues of the packets received by an RX queue, written by its RX
+ * lcore */
+struct rss_rxq {
+	uint64_t hits[RSS_QUEUES_MAX];
+	/** Packets whose NIC hash differs from the software one */
+	uint64_t nb_mismatch;
+};
+
+/** DUT queues of the packets received by a port */
+struct rss_port {
+	struct rss_rxq rxq[MAX_RXQ_PER_PORT];
+	/** Sums over the RX queues at the last report, kept by the statistics
+	 * lcore */
+	uint64_t last[RSS_QUEUES_MAX];
+	uint64_t last_mismatch;
+};
+
+static struct rss_port *ports = NULL;
+static uint8_t nb_rss_ports = 0;
+/** Lookup tables of the key, shared by all RX lcores */
+static struct rss_toeplitz *toeplitz = NULL;
+
+/* value of a hex digit, -1 if it is none */
+static int
+__rss_hex(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* parse a key */
+int
+rss_parse_key(const char *str, struct rss_conf *conf)
+{
+	const char *p = str;
+	uint8_t len = 0;
+	int hi = 0, lo = 0;
+
+	while (*p != '\0') {
+		if (*p == ':') {
+			p++;
+			continue;
+		}
+		hi = __rss_hex(p[0]);
+		lo = (hi < 0) ? -1 : __rss_hex(p[1]);
+		if (lo < 0 || len >= RSS_KEY_LEN_MAX)
+			goto fail;
+		conf->key[len++] = (uint8_t)(hi << 4 | lo);
+		p += 2;
+	}
+
+	/* an IPv4 TCP/UDP tuple and the 4 bytes of the last window */
+	if (len < 16)
+		goto fail;
+	conf->key_len = len;
+	conf->is_key_set = 1;
+	return 0;
+
+fail:
+	LOG_ERROR("Wrong RSS key %s, expect 16 to %u hex bytes", str,
+					RSS_KEY_LEN_MAX);
+	return ERR_PARAM;
+}
+
+/* parse the queues of the DUT */
+int
+rss_parse_queues(const char *str, struct rss_conf *conf)
+{
+	const char *p = NULL;
+	char *end = NULL;
+	unsigned long val = 0;
+
+	errno = 0;
+	val = strtoul(str, &end, 10);
+	if (errno != 0 || end == str || val == 0 || val > RSS_QUEUES_MAX)
+		goto fail;
+	conf->nb_queues = (uint16_t)val;
+
+	if (*end == ':') {
+		p = end + 1;
+		val = strtoul(p, &end, 10);
+		if (errno != 0 || end == p || val < conf->nb_queues ||
+				val > UINT16_MAX)
+			goto fail;
+		conf->reta_size = (uint16_t)val;
+	}
+	if (*end != '\0')
+		goto fail;
+	return 0;
+
+fail:
+	LOG_ERROR("Wrong RSS queues %s, expect <1-%u>[:<reta size>]", str,
+					RSS_QUEUES_MAX);
+	return ERR_PARAM;
+}
+
+/* parse a spread */
+int
+rss_parse_spread(const char *str, struct rss_conf *conf)
+{
+	const char *p = NULL;
+	char *end = NULL;
+	unsigned long val = 0;
+	uint16_t q = 0;
+
+	errno = 0;
+	if (strcmp(str, "balanced") == 0) {
+		conf->spread = RSS_SPREAD_BALANCED;
+	} else if (strncmp(str, "one", 3) == 0) {
+		conf->spread = RSS_SPREAD_ONE;
+		conf->hot_queue = 0;
+		if (str[3] == ':') {
+			val = strtoul(str + 4, &end, 10);
+			if (errno != 0 || end == str + 4 || *end != '\0' ||
+					val >= RSS_QUEUES_MAX)
+				goto fail;
+			conf->hot_queue = (uint16_t)val;
+		} else if (str[3] != '\0') {
+			goto fail;
+		}
+	} else if (strncmp(str, "skew:", 5) == 0) {
+		conf->spread = RSS_SPREAD_SKEW;
+		memset(conf->weights, 0, sizeof(conf->weights));
+		for (p = str + 5; q < RSS_QUEUES_MAX; p = end + 1) {
+			val = strtoul(p, &end, 10);
+			if (errno != 0 || end == p || val > UINT32_MAX)
+				goto fail;
+			conf->weights[q++] = (uint32_t)val;
+			if (*end != ',')
+				break;
+		}
+		if (*end != '\0')
+			goto fail;
+	} else {
+		goto fail;
+	}
+	return 0;
+
+fail:
+	LOG_ERROR("Unknown RSS spread %s", str);
+	return ERR_PARAM;
+}
+
+/* hash of every value of every input byte */
+void
+rss_toeplitz_init(struct rss_toeplitz *t, const uint8_t *key,
+				uint8_t key_len)
+{
+	uint64_t window = 0;
+	uint32_t i = 0, v = 0, b = 0;
+
+	for (i = 0; i < RSS_INPUT_LEN_MAX; i++) {
+		/* key bits 8i to 8i + 39, the windows of the 8 input bits */
+		window = 0;
+		for (b = 0; b < 5; b++)
+			window = window << 8 | ((i + b < key_len) ? key[i + b] : 0);
+
+		for (v = 0; v < 256; v++) {
+			t->tbl[i][v] = 0;
+			for (b = 0; b < 8; b++) {
+				if (v & (0x80 >> b))
+					t->tbl[i][v] ^= (uint32_t)(window >> (8 - b));
+			}
+		}
+	}
+}
+
+/* hash input of a tuple */
+uint8_t
+rss_tuple_input(uint8_t is_ipv6, const uint8_t *src_ip6,
+				const uint8_t *dst_ip6, uint32_t src_ip, uint32_t dst_ip,
+				uint8_t has_ports, uint16_t src_port, uint16_t dst_port,
+				uint8_t *in)
+{
+	uint8_t len = 0;
+
+	if (is_ipv6) {
+		memcpy(in, src_ip6, PKT_SEQ_IP6_PREFIX_LEN);
+		memcpy(in + PKT_SEQ_IP6_PREFIX_LEN, &src_ip, sizeof(src_ip));
+		memcpy(in + 16, dst_ip6, PKT_SEQ_IP6_PREFIX_LEN);
+		memcpy(in + 16 + PKT_SEQ_IP6_PREFIX_LEN, &dst_ip, sizeof(dst_ip));
+		len = 32;
+	} else {
+		memcpy(in, &src_ip, sizeof(src_ip));
+		memcpy(in + 4, &dst_ip, sizeof(dst_ip));
+		len = 8;
+	}
+
+	if (has_ports) {
+		memcpy(in + len, &src_port, sizeof(src_port));
+		memcpy(in + len + 2, &dst_port, sizeof(dst_port));
+		len += 4;
+	}
+	return len;
+}
+
+/* number of flows of each DUT queue */
+void
+rss_quotas(const struct rss_conf *conf, uint32_t nb_flows, uint32_t *quotas)
+{
+	uint64_t total = 0, left = nb_flows;
+	uint16_t q = 0;
+
+	memset(quotas, 0, sizeof(uint32_t) * conf->nb_queues);
+
+	switch (conf->spread) {
+	case RSS_SPREAD_ONE:
+		quotas[conf->hot_queue] = nb_flows;
+		return;
+	case RSS_SPREAD_SKEW:
+		for (q = 0; q < conf->nb_queues; q++)
+			total += conf->weights[q];
+		for (q = 0; q < conf->nb_queues; q++) {
+			quotas[q] = (uint32_t)((uint64_t)nb_flows * conf->weights[q] /
+							total);
+			left -= quotas[q];
+		}
+		/* the rounding leftovers go to the weighted queues in turn */
+		for (q = 0; left > 0; q = (q + 1) % conf->nb_queues) {
+			if (conf->weights[q] != 0) {
+				quotas[q]++;
+				left--;
+			}
+		}
+		return;
+	default:
+		for (q = 0; q < conf->nb_queues; q++)
+			quotas[q] = nb_flows / conf->nb_queues +
+					(q < nb_flows % conf->nb_queues ? 1 : 0);
+		return;
+	}
+}
+
+/* init the counters and the lookup tables */
+int
+rss_init(uint8_t nb_ports)
+{
+	ports = (struct rss_port *)calloc(nb_ports, sizeof(struct rss_port));
+	toeplitz = (struct rss_toeplitz *)malloc(sizeof(struct rss_toeplitz));
+	if (ports == NULL || toeplitz == NULL) {
+		LOG_ERROR("Failed to allocate memory for RSS counters");
+		rss_free();
+		return ERR_MEMORY;
+	}
+	nb_rss_ports = nb_ports;
+
+	rss_toeplitz_init(toeplitz, pktsender.rss.key, pktsender.rss.key_len);
+	return 0;
+}
+
+/* free the counters */
+void
+rss_free(void)
+{
+	zfree(ports);
+	zfree(toeplitz);
+	nb_rss_ports = 0;
+}
+
+/**
+ * Hash input of a received packet
+ *
+ * @return
+ *	Length of the input, 0 if the packet is neither IPv4 nor IPv6
+ */
+static inline uint8_t
+__rss_pkt_input(const struct rte_mbuf *m, uint8_t *in)
+{
+	const struct ether_hdr *eth = rte_pktmbuf_mtod(m, struct ether_hdr *);
+	const struct ipv4_hdr *ip = (const struct ipv4_hdr *)(eth + 1);
+	const struct ipv6_hdr *ip6 = (const struct ipv6_hdr *)(eth + 1);
+	const uint16_t *l4 = NULL;
+	uint32_t src_ip = 0, dst_ip = 0;
+	uint16_t l3_len = 0;
+	uint8_t proto = 0, is_ipv6 = 0;
+
+	if (eth->ether_type == rte_cpu_to_be_16(ETHER_TYPE_IPv4)) {
+		l3_len = (ip->version_ihl & 0xf) * 4;
+		proto = ip->next_proto_id;
+		/* fragments are hashed on their addresses */
+		if (ip->fragment_offset & rte_cpu_to_be_16(IPV4_HDR_OFFSET_MASK |
+						IPV4_HDR_MF_FLAG))
+			proto = 0;
+		src_ip = ip->src_addr;
+		dst_ip = ip->dst_addr;
+	} else if (eth->ether_type == rte_cpu_to_be_16(ETHER_TYPE_IPv6)) {
+		l3_len = sizeof(struct ipv6_hdr);
+		proto = ip6->proto;
+		is_ipv6 = 1;
+		memcpy(&src_ip, ip6->src_addr + PKT_SEQ_IP6_PREFIX_LEN,
+						sizeof(src_ip));
+		memcpy(&dst_ip, ip6->dst_addr + PKT_SEQ_IP6_PREFIX_LEN,
+						sizeof(dst_ip));
+	} else {
+		return 0;
+	}
+
+	if (proto != IPPROTO_TCP && proto != IPPROTO_UDP)
+		proto = 0;
+	if (m->data_len < sizeof(*eth) + l3_len + (proto ? 4 : 0))
+		return 0;
+
+	l4 = (const uint16_t *)((const uint8_t *)(eth + 1) + l3_len);
+	return rss_tuple_input(is_ipv6, ip6->src_addr, ip6->dst_addr, src_ip,
+					dst_ip, proto != 0, proto ? l4[0] : 0, proto ? l4[1] : 0, in);
+}
+
+/* count the DUT queue of a burst */
+void
+rss_receive(uint8_t portid, uint8_t queueid, struct rte_mbuf **pkts,
+				uint16_t n)
+{
+	struct rss_rxq *rxq = &ports[portid].rxq[queueid];
+	const struct rss_conf *conf = &pktsender.rss;
+	uint8_t in[RSS_INPUT_LEN_MAX];
+	uint32_t hash = 0;
+	uint16_t i = 0;
+	uint8_t len = 0;
+
+	for (i = 0; i < n; i++) {
+		len = __rss_pkt_input(pkts[i], in);
+		if (len == 0 || len + 4 > conf->key_len)
+			continue;
+
+		hash = rss_toeplitz_hash(toeplitz, in, len);
+		rxq->hits[rss_queue(conf, hash)]++;
+
+		/* the local NIC hashes with the same key */
+		if (conf->is_key_set && (pkts[i]->ol_flags & PKT_RX_RSS_HASH) &&
+				pkts[i]->hash.rss != hash)
+			rxq->nb_mismatch++;
+	}
+}
+
+/* sum the counters of the RX queues of a port */
+static void
+__rss_sum(const struct rss_port *port, uint64_t *hits, uint64_t *mismatch)
+{
+	uint16_t q = 0;
+	uint8_t r = 0;
+
+	memset(hits, 0, sizeof(uint64_t) * RSS_QUEUES_MAX);
+	*mismatch = 0;
+	for (r = 0; r < MAX_RXQ_PER_PORT; r++) {
+		for (q = 0; q < pktsender.rss.nb_queues; q++)
+			hits[q] += port->rxq[r].hits[q];
+		*mismatch += port->rxq[r].nb_mismatch;
+	}
+}
+
+/* log the share of each DUT queue in a number of packets */
+static void
+__rss_log(uint8_t portid, const char *title, const uint64_t *hits,
+				uint64_t nb_pkts, uint64_t mismatch)
+{
+	char s[RSS_QUEUES_MAX * 16];
+	uint16_t q = 0;
+	int len = 0;
+
+	s[0] = '\0';
+	for (q = 0; q < pktsender.rss.nb_queues && len < (int)sizeof(s); q++)
+		len += snprintf(s + len, sizeof(s) - len, " %u:%.1lf%%", q,
+						nb_pkts ? hits[q] * 100.0 / nb_pkts : 0.0);
+
+	LOG_INFO("Port %u: %sDUT queues of %lu packets%s, NIC hash mismatches"
+					" %lu", portid, title, nb_pkts, s, mismatch);
+}
+
+/* log the shares since the last report */
+void
+rss_report(void)
+{
+	uint64_t hits[RSS_QUEUES_MAX], mismatch = 0, nb_pkts = 0;
+	struct rss_port *port = NULL;
+	uint16_t q = 0;
+	uint8_t portid = 0;
+
+	for (portid = 0; portid < nb_rss_ports; portid++) {
+		if (!port_is_enabled(portid))
+			continue;
+
+		port = &ports[portid];
+		/* the RX lcores keep counting meanwhile */
+		__rss_sum(port, hits, &mismatch);
+		nb_pkts = 0;
+		for (q = 0; q < pktsender.rss.nb_queues; q++) {
+			hits[q] -= port->last[q];
+			port->last[q] += hits[q];
+			nb_pkts += hits[q];
+		}
+		/* nothing received since the last report */
+		if (nb_pkts == 0)
+			continue;
+
+		__rss_log(portid, "", hits, nb_pkts, mismatch - port->last_mismatch);
+		port->last_mismatch = mismatch;
+	}
+}
+
+/* log the shares of all packets */
+void
+rss_summary(void)
+{
+	uint64_t hits[RSS_QUEUES_MAX], mismatch = 0, nb_pkts = 0;
+	uint16_t q = 0;
+	uint8_t portid = 0;
+
+	for (portid = 0; portid < nb_rss_ports; portid++) {
+		if (!port_is_enabled(portid))
+			continue;
+
+		__rss_sum(&ports[portid], hits, &mismatch);
+		nb_pkts = 0;
+		for (q = 0; q < pktsender.rss.nb_queues; q++)
+			nb_pkts += hits[q];
+		if (nb_pkts > 0)
+			__rss_log(portid, "total ", hits, nb_pkts, mismatch);
+	}
+}
@@ -0,0 +1,262 @@
+#ifndef _PKTSENDER_RSS_H_
+#define _PKTSENDER_RSS_H_
+
+/**
+ * @file
+ * Toeplitz hash of the DUT and flows crafted for its RSS queues
+ *
+ * Given the RSS key, the number of queues and the redirection table size
+ * of the DUT (--rss-key, --rss-queues), the flow pattern only keeps the
+ * tuples of its ranges whose hash lands on the queues wanted by
+ * --rss-spread: the same number of flows on every queue, all of them on
+ * one queue, or a share of them per queue. The redirection table of the
+ * DUT is assumed to hold queue (i % nb_queues) in entry i, as DPDK and
+ * most drivers set it by default.
+ *
+ * The hash covers the addresses and, for TCP and UDP, the ports, as the
+ * IPv4/IPv6 TCP/UDP hash types do. It is computed a byte at a time from
+ * tables holding the hash of every value of every input byte.
+ *
+ * RX lcores hash the packets they receive the same way and count the DUT
+ * queue of each one, so the spread can be checked on looped back ports.
+ * Ports with several RX queues use the same key, and the hash reported
+ * by the NIC is compared to the software one.
+ */
+
+#include <stdint.h>
+
+#include <rte_mbuf.h>
+
+/** Length of the default key */
+#define RSS_KEY_LEN_DEFAULT	40
+/** Max length of a key */
+#define RSS_KEY_LEN_MAX	52
+/** Max length of a hash input: two IPv6 addresses and two ports */
+#define RSS_INPUT_LEN_MAX	36
+/** Max number of DUT queues */
+#define RSS_QUEUES_MAX	64
+/** Default size of the DUT redirection table */
+#define RSS_RETA_SIZE_DEFAULT	128
+/** Default key of DPDK and of the Microsoft RSS specification */
+#define RSS_KEY_DEFAULT { \
+	0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, \
+	0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0, \
+	0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4, \
+	0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c, \
+	0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa, \
+}
+
+/** How crafted flows are spread over the DUT queues */
+enum {
+	/** the same number of flows on every queue */
+	RSS_SPREAD_BALANCED = 0,
+	/** all flows on one queue */
+	RSS_SPREAD_ONE,
+	/** flows shared between the queues in proportion to weights */
+	RSS_SPREAD_SKEW,
+};
+
+/** RSS of the DUT */
+struct rss_conf {
+	/** Key */
+	uint8_t key[RSS_KEY_LEN_MAX];
+	/** Length of the key */
+	uint8_t key_len;
+	/** Whether the key was given, and programmed in the local NICs */
+	uint8_t is_key_set;
+	/** Number of DUT queues, 0 if flows are not crafted */
+	uint16_t nb_queues;
+	/** Size of the DUT redirection table */
+	uint16_t reta_size;
+	/** RSS_SPREAD_* */
+	uint8_t spread;
+	/** Queue of RSS_SPREAD_ONE */
+	uint16_t hot_queue;
+	/** Weight of each queue with RSS_SPREAD_SKEW */
+	uint32_t weights[RSS_QUEUES_MAX];
+};
+
+/** Lookup tables of a Toeplitz hash */
+struct rss_toeplitz {
+	/** Hash of each value of each input byte */
+	uint32_t tbl[RSS_INPUT_LEN_MAX][256];
+};
+
+/**
+ * Parse a key
+ *
+ * @param str
+ *	Hex bytes, optionally separated by ':'
+ * @param conf
+ *	Output: the key and its length
+ * @return
+ *	- 0 on success
+ *	- ERR_PARAM on failure
+ */
+int rss_parse_key(const char *str, struct rss_conf *conf);
+
+/**
+ * Parse the queues of the DUT
+ *
+ * @param str
+ *	"<nb_queues>[:<reta_size>]"
+ * @param conf
+ *	Output: the number of queues and the redirection table size
+ * @return
+ *	- 0 on success
+ *	- ERR_PARAM on failure
+ */
+int rss_parse_queues(const char *str, struct rss_conf *conf);
+
+/**
+ * Parse a spread
+ *
+ * @param str
+ *	"balanced", "one[:<queue>]" or "skew:<w0>,<w1>,..."
+ * @param conf
+ *	Output: the spread
+ * @return
+ *	- 0 on success
+ *	- ERR_PARAM on failure
+ */
+int rss_parse_spread(const char *str, struct rss_conf *conf);
+
+/**
+ * Build the lookup tables of a key
+ *
+ * @param t
+ *	Output: the tables
+ * @param key
+ *	The key, at least 4 bytes longer than the inputs to hash
+ * @param key_len
+ *	Length of the key
+ */
+void rss_toeplitz_init(struct rss_toeplitz *t, const uint8_t *key,
+				uint8_t key_len);
+
+/**
+ * Toeplitz hash of an input
+ *
+ * @param t
+ *	The lookup tables
+ * @param in
+ *	The input, in network byte order
+ * @param len
+ *	Length of the input, at most RSS_INPUT_LEN_MAX
+ */
+static inline uint32_t
+rss_toeplitz_hash(const struct rss_toeplitz *t, const uint8_t *in,
+				uint8_t len)
+{
+	uint32_t hash = 0;
+	uint8_t i = 0;
+
+	for (i = 0; i < len; i++)
+		hash ^= t->tbl[i][in[i]];
+	return hash;
+}
+
+/**
+ * DUT queue of a hash
+ *
+ * @param conf
+ *	The RSS of the DUT
+ * @param hash
+ *	Toeplitz hash of a packet
+ */
+static inline uint16_t
+rss_queue(const struct rss_conf *conf, uint32_t hash)
+{
+	return (uint16_t)((hash % conf->reta_size) % conf->nb_queues);
+}
+
+/**
+ * Build the hash input of a tuple
+ *
+ * @param is_ipv6
+ *	Whether the addresses are IPv6 ones
+ * @param src_ip6
+ *	Upper 96 bits of the IPv6 source address
+ * @param dst_ip6
+ *	Upper 96 bits of the IPv6 destination address
+ * @param src_ip
+ *	IPv4 source address or low 32 bits of the IPv6 one (network byte
+ *	order)
+ * @param dst_ip
+ *	IPv4 destination address or low 32 bits of the IPv6 one (network byte
+ *	order)
+ * @param has_ports
+ *	Whether the ports are hashed, for TCP and UDP
+ * @param src_port
+ *	Source port (network byte order)
+ * @param dst_port
+ *	Destination port (network byte order)
+ * @param in
+ *	Output: the input, RSS_INPUT_LEN_MAX bytes
+ * @return
+ *	Length of the input
+ */
+uint8_t rss_tuple_input(uint8_t is_ipv6, const uint8_t *src_ip6,
+				const uint8_t *dst_ip6, uint32_t src_ip, uint32_t dst_ip,
+				uint8_t has_ports, uint16_t src_port, uint16_t dst_port,
+				uint8_t *in);
+
+/**
+ * Number of flows to craft for each DUT queue
+ *
+ * @param conf
+ *	The RSS of the DUT
+ * @param nb_flows
+ *	Number of flows
+ * @param quotas
+ *	Output: number of flows of each queue, summing to nb_flows
+ */
+void rss_quotas(const struct rss_conf *conf, uint32_t nb_flows,
+				uint32_t *quotas);
+
+/**
+ * Initialize the counters of the DUT queues of received packets
+ *
+ * @param nb_ports
+ *	Number of all ports in DPDK
+ * @return
+ *	- 0 on success
+ *	- ERR_MEMORY on failure
+ */
+int rss_init(uint8_t nb_ports);
+
+/**
+ * Free the counters
+ */
+void rss_free(void);
+
+/**
+ * Count the DUT queue of the packets of a burst received by an RX queue
+ *
+ * Only the RX lcore of the queue may call it. Packets other than IPv4 and
+ * IPv6 ones are skipped.
+ *
+ * @param portid
+ *	The port which received the packets
+ * @param queueid
+ *	The RX queue
+ * @param pkts
+ *	The packets
+ * @param n
+ *	Number of packets
+ */
+void rss_receive(uint8_t portid, uint8_t queueid, struct rte_mbuf **pkts,
+				uint16_t n);
+
+/**
+ * Log the share of each DUT queue in the packets received since the last
+ * report
+ */
+void rss_report(void);
+
+/**
+ * Log the share of each DUT queue in all packets received
+ */
+void rss_summary(void);
+
+#endif /* _PKTSENDER_RSS_H_ */
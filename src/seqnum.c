@@ -0,0 +1,319 @@
+#include "util.h"
+#include "seqnum.h"
+#include "pktsender.h"
+#include "port.h"
+#include "latency.h"
+
+#include <rte_prefetch.h>
+
+/** Receive state of a stream on an RX queue */
+struct seqnum_stream {
+	/** Highest sequence number received + 1 */
+	uint64_t next;
+	/** Whether sequence number s of next - SEQNUM_WINDOW..next - 1 was
+	 * received, in bit (s % SEQNUM_WINDOW) */
+	uint64_t bits[SEQNUM_WINDOW / 64];
+	/** Counters, written by the RX lcore */
+	struct seqnum_counters cnt;
+};
+
+/** Streams received by an RX queue */
+struct seqnum_rxq {
+	struct seqnum_stream streams[SEQNUM_NB_STREAMS];
+	/** Latencies in TSC cycles, written by the RX lcore */
+	struct latency_hist lat;
+};
+
+/** Streams received by a port */
+struct seqnum_port {
+	struct seqnum_rxq rxq[MAX_RXQ_PER_PORT];
+	/** Counters of each stream summed over the RX queues at the last
+	 * report, kept by the statistics lcore */
+	struct seqnum_counters last[SEQNUM_NB_STREAMS];
+};
+
+static struct seqnum_port *ports = NULL;
+static uint8_t nb_seqnum_ports = 0;
+static uint16_t seqnum_off = 0;
+/** Latencies of all ports, merged by the statistics lcore */
+static struct latency_hist lat_merged;
+/** Number of latency samples at the last report */
+static uint64_t lat_last_samples = 0;
+
+/* the window starts full, as if the numbers before 0 were received */
+static void
+__seqnum_stream_reset(struct seqnum_stream *s)
+{
+	memset(s, 0, sizeof(struct seqnum_stream));
+	memset(s->bits, 0xff, sizeof(s->bits));
+}
+
+/* init the trackers */
+int
+seqnum_init(uint8_t nb_ports, uint16_t stamp_off)
+{
+	uint32_t i = 0;
+	uint8_t portid = 0, q = 0;
+
+	ports = (struct seqnum_port *)calloc(nb_ports,
+					sizeof(struct seqnum_port));
+	if (ports == NULL) {
+		LOG_ERROR("Failed to allocate memory for sequence number trackers");
+		return ERR_MEMORY;
+	}
+	nb_seqnum_ports = nb_ports;
+	seqnum_off = stamp_off;
+
+	for (portid = 0; portid < nb_ports; portid++) {
+		for (q = 0; q < MAX_RXQ_PER_PORT; q++) {
+			for (i = 0; i < SEQNUM_NB_STREAMS; i++)
+				__seqnum_stream_reset(&ports[portid].rxq[q].streams[i]);
+			latency_hist_reset(&ports[portid].rxq[q].lat);
+		}
+
+		/* RSS keeps the packets of a flow on one queue */
+		if (pktsender.tx_seqnum && port_is_enabled(portid) &&
+				port_get_nb_rxq(portid) > 1 &&
+				pktsender.tx_pattern != TX_PATTERN_SINGLE)
+			LOG_WARN("Port %u spreads packets over %u RX queues, streams"
+							" with several flows look lossy",
+							portid, port_get_nb_rxq(portid));
+	}
+	lat_last_samples = 0;
+
+	LOG_DEBUG("Init sequence number trackers, stamp at offset %u",
+					stamp_off);
+	return 0;
+}
+
+/* free the trackers */
+void
+seqnum_free(void)
+{
+	zfree(ports);
+	nb_seqnum_ports = 0;
+}
+
+/* sequence numbers of the window not received */
+static inline uint64_t
+__seqnum_missing(const struct seqnum_stream *s)
+{
+	uint64_t cnt = 0;
+	uint32_t i = 0;
+
+	for (i = 0; i < SEQNUM_WINDOW / 64; i++)
+		cnt += __builtin_popcountl(s->bits[i]);
+	return SEQNUM_WINDOW - cnt;
+}
+
+/* track one sequence number of a stream */
+static inline void
+__seqnum_track(struct seqnum_stream *s, uint64_t seq)
+{
+	uint64_t *word = &s->bits[(seq / 64) % (SEQNUM_WINDOW / 64)];
+	uint64_t bit = 1ul << (seq % 64);
+	uint64_t t = 0;
+
+	if (likely(seq >= s->next)) {
+		/* the numbers up to seq - SEQNUM_WINDOW leave the window, those
+		 * from next to seq - 1 enter it missing */
+		if (unlikely(seq - s->next >= SEQNUM_WINDOW - 1)) {
+			s->cnt.nb_lost += __seqnum_missing(s) +
+					(seq - s->next + 1 - SEQNUM_WINDOW);
+			memset(s->bits, 0, sizeof(s->bits));
+		} else {
+			for (t = s->next; t <= seq; t++) {
+				if (!(s->bits[(t / 64) % (SEQNUM_WINDOW / 64)] &
+						(1ul << (t % 64))))
+					s->cnt.nb_lost++;
+				s->bits[(t / 64) % (SEQNUM_WINDOW / 64)] &=
+						~(1ul << (t % 64));
+			}
+		}
+		*word |= bit;
+		s->next = seq + 1;
+		s->cnt.nb_rx++;
+	} else if (s->next - seq > SEQNUM_WINDOW) {
+		s->cnt.nb_late++;
+	} else if (*word & bit) {
+		s->cnt.nb_dup++;
+	} else {
+		*word |= bit;
+		s->cnt.nb_rx++;
+		s->cnt.nb_reordered++;
+	}
+}
+
+/**
+ * Track the stamped packets of a burst
+ *
+ * The stamps of the next PREFETCH_OFFSET packets are prefetched while the
+ * current one is parsed.
+ */
+void
+seqnum_receive(uint8_t portid, uint8_t queueid, struct rte_mbuf **pkts,
+				uint16_t n, uint64_t rx_tsc)
+{
+	struct seqnum_stream *streams = ports[portid].rxq[queueid].streams;
+	struct latency_hist *lat = &ports[portid].rxq[queueid].lat;
+	struct seqnum_stamp stamp;
+	uint16_t i = 0;
+
+	for (i = 0; i < PREFETCH_OFFSET && i < n; i++)
+		rte_prefetch0(rte_pktmbuf_mtod_offset(pkts[i], void *, seqnum_off));
+
+	for (i = 0; i < n; i++) {
+		if (i + PREFETCH_OFFSET < n)
+			rte_prefetch0(rte_pktmbuf_mtod_offset(pkts[i + PREFETCH_OFFSET],
+							void *, seqnum_off));
+
+		if (pkts[i]->data_len < seqnum_off + sizeof(stamp))
+			continue;
+		memcpy(&stamp, rte_pktmbuf_mtod_offset(pkts[i], void *, seqnum_off),
+						sizeof(stamp));
+		if (stamp.magic != SEQNUM_MAGIC ||
+				stamp.stream >= SEQNUM_NB_STREAMS)
+			continue;
+
+		if (pktsender.tx_seqnum)
+			__seqnum_track(&streams[stamp.stream], stamp.seq);
+		if (stamp.tsc != 0)
+			latency_hist_add(lat, (rx_tsc > stamp.tsc) ?
+							rx_tsc - stamp.tsc : 0);
+	}
+}
+
+/* log the counters of a stream, with their change since the last report */
+static void
+__seqnum_log(uint8_t portid, uint32_t stream,
+				const struct seqnum_counters *cnt,
+				const struct seqnum_counters *last)
+{
+	LOG_INFO("Port %u: stream %u.%u rx %lu (+%lu), lost %lu (+%lu),"
+					" reordered %lu (+%lu), dup %lu (+%lu), late %lu (+%lu)",
+					portid, stream / MAX_TXQ_PER_PORT,
+					stream % MAX_TXQ_PER_PORT,
+					cnt->nb_rx, cnt->nb_rx - last->nb_rx,
+					cnt->nb_lost, cnt->nb_lost - last->nb_lost,
+					cnt->nb_reordered, cnt->nb_reordered - last->nb_reordered,
+					cnt->nb_dup, cnt->nb_dup - last->nb_dup,
+					cnt->nb_late, cnt->nb_late - last->nb_late);
+}
+
+/* sum the counters of a stream over the RX queues of a port */
+static void
+__seqnum_sum(const struct seqnum_port *port, uint32_t stream,
+				struct seqnum_counters *sum)
+{
+	const struct seqnum_counters *cnt = NULL;
+	uint8_t q = 0;
+
+	memset(sum, 0, sizeof(struct seqnum_counters));
+	for (q = 0; q < MAX_RXQ_PER_PORT; q++) {
+		cnt = &port->rxq[q].streams[stream].cnt;
+		sum->nb_rx += cnt->nb_rx;
+		sum->nb_lost += cnt->nb_lost;
+		sum->nb_reordered += cnt->nb_reordered;
+		sum->nb_dup += cnt->nb_dup;
+		sum->nb_late += cnt->nb_late;
+	}
+}
+
+/* merge the latencies of all RX queues and log them */
+static void
+__seqnum_log_latency(const char *title)
+{
+	struct latency_summary sum;
+	uint8_t portid = 0, q = 0;
+
+	latency_hist_reset(&lat_merged);
+	for (portid = 0; portid < nb_seqnum_ports; portid++) {
+		if (!port_is_enabled(portid))
+			continue;
+		for (q = 0; q < port_get_nb_rxq(portid); q++)
+			latency_hist_merge(&lat_merged, &ports[portid].rxq[q].lat);
+	}
+	latency_hist_summary(&lat_merged, 1e9 / pktsender.cpu_hz, &sum);
+
+	LOG_INFO("%s latency: %lu samples (+%lu), min %lu, avg %lu, p50 %lu,"
+					" p99 %lu, p99.9 %lu, p99.99 %lu, max %lu ns", title,
+					sum.nb_samples, sum.nb_samples - lat_last_samples,
+					sum.min, sum.avg, sum.p50, sum.p99, sum.p999, sum.p9999,
+					sum.max);
+	lat_last_samples = sum.nb_samples;
+}
+
+/* log the streams which changed since the last report */
+void
+seqnum_report(void)
+{
+	struct seqnum_counters cnt;
+	struct seqnum_port *port = NULL;
+	uint32_t i = 0;
+	uint8_t portid = 0;
+
+	if (pktsender.tx_tsc_every != 0)
+		__seqnum_log_latency("Packet");
+	if (!pktsender.tx_seqnum)
+		return;
+
+	for (portid = 0; portid < nb_seqnum_ports; portid++) {
+		if (!port_is_enabled(portid))
+			continue;
+
+		port = &ports[portid];
+		for (i = 0; i < SEQNUM_NB_STREAMS; i++) {
+			/* the RX lcores keep counting meanwhile */
+			__seqnum_sum(port, i, &cnt);
+			if (memcmp(&cnt, &port->last[i], sizeof(cnt)) == 0)
+				continue;
+
+			__seqnum_log(portid, i, &cnt, &port->last[i]);
+			port->last[i] = cnt;
+		}
+	}
+}
+
+/* count the numbers missing in the windows and log the totals */
+void
+seqnum_summary(void)
+{
+	struct seqnum_counters cnt;
+	struct seqnum_stream *s = NULL;
+	uint32_t i = 0;
+	uint8_t portid = 0, q = 0;
+	bool is_seen = false;
+
+	if (pktsender.tx_tsc_every != 0)
+		__seqnum_log_latency("Total packet");
+	if (!pktsender.tx_seqnum)
+		return;
+
+	for (portid = 0; portid < nb_seqnum_ports; portid++) {
+		if (!port_is_enabled(portid))
+			continue;
+
+		for (i = 0; i < SEQNUM_NB_STREAMS; i++) {
+			is_seen = false;
+			for (q = 0; q < MAX_RXQ_PER_PORT; q++) {
+				s = &ports[portid].rxq[q].streams[i];
+				if (s->next == 0)
+					continue;
+
+				s->cnt.nb_lost += __seqnum_missing(s);
+				memset(s->bits, 0xff, sizeof(s->bits));
+				is_seen = true;
+			}
+			if (!is_seen)
+				continue;
+
+			__seqnum_sum(&ports[portid], i, &cnt);
+			LOG_INFO("Port %u: total of stream %u.%u rx %lu, lost %lu,"
+							" reordered %lu, dup %lu, late %lu",
+							portid, i / MAX_TXQ_PER_PORT,
+							i % MAX_TXQ_PER_PORT, cnt.nb_rx,
+							cnt.nb_lost, cnt.nb_reordered,
+							cnt.nb_dup, cnt.nb_late);
+		}
+	}
+}
@@ -0,0 +1,127 @@
+#ifndef _PKTSENDER_SEQNUM_H_
+#define _PKTSENDER_SEQNUM_H_
+
+/**
+ * @file
+ * Per-stream sequence numbers and latencies of data packets
+ *
+ * With --seqnum or --sw-latency, every packet built by pkt-sender carries
+ * a stamp right after its headers: a magic, the stream it belongs to, its
+ * sequence number in the stream and, for one packet every --sw-latency,
+ * the TSC it was sent at. A stream is one TX queue of one port, so
+ * sequence numbers are counted without any sharing between lcores.
+ *
+ * With --seqnum, RX lcores track each stream received by their RX queue in
+ * a sliding window of SEQNUM_WINDOW sequence numbers behind the highest one
+ * seen. A number leaving the window without being received is lost, one
+ * received below the highest is reordered, twice in the window a
+ * duplicate, and behind the window late (it was counted as lost already).
+ * The counters of the RX queues of a port are summed, so a stream must
+ * hash to a single RX queue: with several RX queues, only its headers
+ * have to be fixed.
+ *
+ * With --sw-latency, RX lcores add the TSC difference of the timestamped
+ * packets to a histogram of their RX queue. TX and RX TSCs are only comparable
+ * when the packets come back to this host and the TSC is invariant across
+ * cores; the latency includes the time spent in the TX and RX rings.
+ *
+ * The statistics lcore reports the counters and the merged histograms
+ * every second, and their totals at exit.
+ */
+
+#include <stdint.h>
+
+#include <rte_mbuf.h>
+
+#include "port.h"
+
+/** Magic of the stamp ("PKSQ"), tells stamped packets from others */
+#define SEQNUM_MAGIC	0x51534b50
+/** Number of sequence numbers tracked behind the highest one, a power of 2
+ * and a multiple of 64 */
+#define SEQNUM_WINDOW	1024
+/** Number of streams, one per TX data queue of every port */
+#define SEQNUM_NB_STREAMS	(MAX_PORT_NUM * MAX_TXQ_PER_PORT)
+/** Stream of a TX data queue */
+#define SEQNUM_STREAM(portid, queueid)	\
+	((uint32_t)(portid) * MAX_TXQ_PER_PORT + (queueid))
+
+/** Stamp following the headers of data packets, in host byte order */
+struct seqnum_stamp {
+	/** SEQNUM_MAGIC */
+	uint32_t magic;
+	/** Stream of the packet, SEQNUM_STREAM() */
+	uint32_t stream;
+	/** Sequence number of the packet in its stream, from 0 */
+	uint64_t seq;
+	/** TSC the packet was sent at, 0 if not timestamped */
+	uint64_t tsc;
+} __attribute__((__packed__));
+
+/** Counters of a stream received by a port */
+struct seqnum_counters {
+	/** Packets received once, in order or not */
+	uint64_t nb_rx;
+	/** Sequence numbers which left the window without being received */
+	uint64_t nb_lost;
+	/** Packets received after a higher sequence number */
+	uint64_t nb_reordered;
+	/** Packets received twice within the window */
+	uint64_t nb_dup;
+	/** Packets received behind the window, already counted as lost */
+	uint64_t nb_late;
+};
+
+/**
+ * Initialize the trackers of all ports
+ *
+ * @param nb_ports
+ *	Number of all ports in DPDK
+ * @param stamp_off
+ *	Offset of the stamp in the packets
+ * @return
+ *	- 0 on success
+ *	- ERR_MEMORY on failure
+ */
+int seqnum_init(uint8_t nb_ports, uint16_t stamp_off);
+
+/**
+ * Free the trackers
+ */
+void seqnum_free(void);
+
+/**
+ * Track the stamped packets of a burst received by an RX queue
+ *
+ * Only the RX lcore of the queue may call it. Packets without a stamp are
+ * skipped.
+ *
+ * @param portid
+ *	The port which received the packets
+ * @param queueid
+ *	The RX queue
+ * @param pkts
+ *	The packets
+ * @param n
+ *	Number of packets
+ * @param rx_tsc
+ *	TSC the burst was received at
+ */
+void seqnum_receive(uint8_t portid, uint8_t queueid, struct rte_mbuf **pkts,
+				uint16_t n, uint64_t rx_tsc);
+
+/**
+ * Log the counters of the streams which changed since the last report,
+ * and the latencies measured so far
+ */
+void seqnum_report(void);
+
+/**
+ * Count the sequence numbers still missing in the windows as lost and
+ * log the totals of every stream and the latencies
+ *
+ * Packets lost after the last one received by an RX queue are not seen.
+ */
+void seqnum_summary(void);
+
+#endif /* _PKTSENDER_SEQNUM_H_ */
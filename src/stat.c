@@ -2,6 +2,9 @@
 #include "stat.h"
 #include "pktsender.h"
 #include "port.h"
+#include "seqnum.h"
+#include "capture.h"
+#include "rss.h"
 
 #include <rte_cycles.h>
 #include <rte_ethdev.h>
@@ -79,11 +82,47 @@ static inline void __calculate_statis(uint8_t portid, struct rte_eth_stats *star
 				   	portid, (rx_bps / (1024*1024)), ipkts / 1000.0);
 }
 
+/* Underruns mean the disk, not the NIC, limits the TX rate */
+static inline void __calculate_stream(struct port_stats *stat)
+{
+	uint64_t stalls = 0, underruns = 0, starved = 0;
+
+	if (!port_get_stream_stats(stat->portid, &stalls, &underruns, &starved))
+		return;
+
+	LOG_INFO("Port %u: pcap reader stalls %lu (+%lu), TX underruns %lu"
+					" (+%lu), TX starved %lf ms (+%lf ms)",
+					stat->portid, stalls, stalls - stat->stream_stalls,
+					underruns, underruns - stat->stream_underruns,
+					starved * 1000.0 / pktsender.cpu_hz,
+					(starved - stat->stream_starved) * 1000.0 / pktsender.cpu_hz);
+
+	stat->stream_stalls = stalls;
+	stat->stream_underruns = underruns;
+	stat->stream_starved = starved;
+}
+
+/* Drops mean the writer lcore, or the disk, can't keep up with RX */
+static inline void __calculate_capture(struct port_stats *stat)
+{
+	uint64_t written = 0, drops = 0;
+
+	if (!capture_get_stats(stat->portid, &written, &drops))
+		return;
+
+	LOG_INFO("Port %u: captured %lu (+%lu), capture drops %lu (+%lu)",
+					stat->portid, written, written - stat->capture_written,
+					drops, drops - stat->capture_drops);
+
+	stat->capture_written = written;
+	stat->capture_drops = drops;
+}
+
 void stat_stop(void)
 {
 	uint8_t i, portid;
 	struct rte_eth_stats cur_stat;
-	uint64_t cycle = 0;
+	uint64_t cycle = 0, written = 0, drops = 0;
 
 	/* Loop until the timer stopped */
 	rte_timer_stop_sync(&stat_timer);
@@ -100,7 +139,15 @@ void stat_stop(void)
 						" TX %lu packets (%lu bytes).",
 						portid, cur_stat.ipackets, cur_stat.ibytes,
 						cur_stat.opackets, cur_stat.obytes);
+		if (capture_get_stats(portid, &written, &drops))
+			LOG_INFO("Port %u: total captured %lu packets, dropped %lu.",
+							portid, written, drops);
 	}
+
+	if (pktsender.seqnum_off != 0)
+		seqnum_summary();
+	if (pktsender.rss.nb_queues != 0)
+		rss_summary();
 }
 
 static void
@@ -116,9 +163,16 @@ __process_stat(struct rte_timer *timer __rte_unused,
 
 		rte_eth_stats_get(stat->portid, &cur_stat);
 		__calculate_statis(stat->portid, &stat->stat_last, &cur_stat);
+		__calculate_stream(stat);
+		__calculate_capture(stat);
 
 		stat->stat_last = cur_stat;
 	}
+
+	if (pktsender.seqnum_off != 0)
+		seqnum_report();
+	if (pktsender.rss.nb_queues != 0)
+		rss_report();
 }
 
 /* Setup and start statistics timer */
@@ -12,6 +12,16 @@ struct port_stats {
 	uint64_t cyc_start;
 	/** the last snapshot */
 	struct rte_eth_stats stat_last;
+	/** the last number of pcap reader stalls */
+	uint64_t stream_stalls;
+	/** the last number of pcap stream TX underruns */
+	uint64_t stream_underruns;
+	/** the last number of cycles starved by the pcap reader */
+	uint64_t stream_starved;
+	/** the last number of packets captured */
+	uint64_t capture_written;
+	/** the last number of packets dropped by the capture */
+	uint64_t capture_drops;
 };
 
 /**
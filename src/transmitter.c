@@ -2,6 +2,15 @@
 #include "pktsender.h"
 #include "transmitter.h"
 #include "port.h"
+#include "cksum.h"
+#include "pcap.h"
+#include "flow.h"
+#include "seqnum.h"
+#include "probe.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <strings.h>
 
 #include <rte_common.h>
 #include <rte_mempool.h>
@@ -9,38 +18,1503 @@
 #include <rte_memory.h>
 #include <rte_version.h>
 #include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_ring.h>
+#include <rte_atomic.h>
 
 /* default tx rate in unit of bps */
 #define TX_RATE_DEFAULT_BPS	102400
+/* how late (us) an lcore may be and still catch up on the lost credit */
+#define TX_RATE_CATCHUP_US	200
+
+#define pkt_wire_size(len) (len + FRAME_EXTRA_BYTES)
+
+/* credit cost of n packets of 'bytes' wire bytes in total */
+static inline uint64_t
+__tx_rate_cost(const struct tx_ctl *ctl, uint64_t n, uint64_t bytes)
+{
+	return n * ctl->rate_pkt_cost + bytes * ctl->rate_byte_cost;
+}
+
+/* share of a queue in the port rate, the first queues take the remainder */
+static inline uint64_t
+__tx_rate_split(uint64_t port_rate, uint8_t queueid, uint8_t nb_txq)
+{
+	return port_rate / nb_txq + ((queueid < port_rate % nb_txq) ? 1 : 0);
+}
+
+/* set the rate of the token bucket, keeping the credit earned so far, a
+ * rate of 0 silences the queue */
+static void
+__tx_rate_set(struct tx_ctl *ctl, uint64_t rate)
+{
+	uint64_t hz = pktsender.cpu_hz;
+
+	ctl->rate_off = (rate == 0);
+	if (ctl->rate_off)
+		return;
+
+	ctl->rate = rate;
+	/* keep at least one full burst of the largest packets */
+	ctl->rate_max_elapsed = MAX(hz / 1000000 * TX_RATE_CATCHUP_US,
+					__tx_rate_cost(ctl, ctl->burst, ctl->burst *
+					pkt_wire_size(pktsender.max_pkt_len)) / ctl->rate + 1);
+	ctl->rate_depth = (int64_t)(ctl->rate_max_elapsed * ctl->rate);
+	if (ctl->rate_credit > ctl->rate_depth)
+		ctl->rate_credit = ctl->rate_depth;
+}
+
+/**
+ * Init the token bucket of a tx_ctl
+ *
+ * Credit is kept in integers scaled by cpu_hz, so it is earned and spent
+ * exactly, without drift from rounding the cycles per byte.
+ */
+static void
+__tx_rate_init(struct tx_ctl *ctl, uint64_t rate, uint8_t is_pps)
+{
+	uint64_t hz = pktsender.cpu_hz;
+
+	ctl->rate_pps = is_pps;
+	ctl->rate_pkt_cost = is_pps ? hz : 0;
+	ctl->rate_byte_cost = is_pps ? 0 : hz * 8;
+
+	ctl->rate_avg_cost = __tx_rate_cost(ctl, 1,
+					pkt_wire_size(ctl->tx_seq.pkt_len));
+	ctl->rate_credit = 0;
+	ctl->rate_last_cycles = 0;
+	__tx_rate_set(ctl, rate);
+}
+
+/**
+ * Follow the rate profile
+ *
+ * The profile is evaluated only when its rate may have changed: at step
+ * and square edges, and every PROFILE_UPDATE_US while it varies smoothly.
+ */
+static inline void
+__tx_profile_update(struct tx_ctl *ctl, uint64_t cycles)
+{
+	uint64_t rate = 0, next = 0;
+
+	if (unlikely(ctl->profile_start == 0)) {
+		ctl->profile_start = cycles;
+		ctl->profile_next = cycles;
+	}
+
+	if (cycles >= ctl->profile_next) {
+		rate = profile_get_rate(ctl->profile, cycles - ctl->profile_start,
+						&ctl->profile_seg, &next);
+		ctl->profile_next = cycles + next;
+		rate = __tx_rate_split(rate, ctl->queueid, ctl->nb_txq);
+		if (ctl->rate_off || rate != ctl->rate)
+			__tx_rate_set(ctl, rate);
+	}
+}
+
+/* apply the rate and packet size requested by another lcore */
+static void
+__tx_request_apply(struct tx_ctl *ctl)
+{
+	struct tx_size_mix *mix = &ctl->size_mix;
+	uint32_t gen = ctl->req.gen;
+	uint64_t rate = 0;
+	uint8_t size_idx = 0;
+
+	rte_smp_rmb();
+	rate = ctl->req.rate;
+	size_idx = ctl->req.size_idx;
+	ctl->req_gen = gen;
+
+	__tx_rate_set(ctl, rate);
+
+	/* a one-entry schedule sends a single size of the mix */
+	if (size_idx != TX_SIZE_ANY && size_idx < mix->nb_sizes) {
+		mix->sched[0] = size_idx;
+		mix->sched_len = 1;
+		mix->sched_next = 0;
+	}
+}
+
+/**
+ * Follow rate requests and the rate profile
+ *
+ * @return
+ *	0 if the queue is silent, 1 otherwise
+ */
+static inline int
+__tx_rate_follow(struct tx_ctl *ctl, uint64_t cycles)
+{
+	if (unlikely(ctl->req.gen != ctl->req_gen))
+		__tx_request_apply(ctl);
+	if (unlikely(ctl->profile != NULL))
+		__tx_profile_update(ctl, cycles);
+
+	if (unlikely(ctl->rate_off)) {
+		/* silent time earns no credit */
+		ctl->rate_credit = MIN(ctl->rate_credit, 0);
+		ctl->rate_last_cycles = cycles;
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Earn the credit since the last call
+ *
+ * @return
+ *	The number of packets that may be sent now. Sending may leave the
+ *	credit negative, the debt is paid back before the next burst, so the
+ *	long-run rate stays exact whatever the burst size.
+ */
+static inline uint16_t
+__tx_rate_refill(struct tx_ctl *ctl, uint64_t cycles, const uint16_t burst)
+{
+	uint64_t elapsed = 0, n = 0;
+
+	if (unlikely(ctl->rate_last_cycles == 0))
+		ctl->rate_last_cycles = cycles;
+
+	elapsed = cycles - ctl->rate_last_cycles;
+	if (elapsed > ctl->rate_max_elapsed)
+		elapsed = ctl->rate_max_elapsed;
+	ctl->rate_last_cycles = cycles;
+
+	ctl->rate_credit += (int64_t)(elapsed * ctl->rate);
+	if (ctl->rate_credit > ctl->rate_depth)
+		ctl->rate_credit = ctl->rate_depth;
+	if (ctl->rate_credit < 0)
+		return 0;
+
+	/* low rates send fewer packets per burst instead of waiting for a
+	 * full burst worth of credit */
+	n = (uint64_t)ctl->rate_credit / ctl->rate_avg_cost + 1;
+	return (uint16_t)MIN(n, burst);
+}
+
+/* spend the credit of a burst */
+static inline void
+__tx_rate_charge(struct tx_ctl *ctl, uint16_t n, uint32_t bytes)
+{
+	uint64_t cost = __tx_rate_cost(ctl, n, bytes);
+
+	ctl->rate_credit -= (int64_t)cost;
+	ctl->rate_avg_cost = MAX(cost / n, 1);
+}
+
+/* parse a TX rate, s.t. 1G, 20Mbps, 1.5mpps */
+int
+tx_parse_rate(const char *str, uint64_t *rate, uint8_t *is_pps)
+{
+	double val = 0, mult = 1;
+	char *unit = NULL;
+	uint8_t pps = 0, exp = 0;
+
+	errno = 0;
+	val = strtod(str, &unit);
+	if (errno != 0 || unit == str || val < 0) {
+		LOG_ERROR("Failed to parse TX rate %s", str);
+		return ERR_PARAM;
+	}
+
+	switch(*unit) {
+		case 'k':	case 'K':
+			exp = 1;
+			unit++;
+			break;
+		case 'm':	case 'M':
+			exp = 2;
+			unit++;
+			break;
+		case 'g':	case 'G':
+			exp = 3;
+			unit++;
+			break;
+		default:
+			break;
+	}
+
+	if (*unit == '\0' || strcasecmp(unit, "bps") == 0) {
+		pps = 0;
+	} else if (strcasecmp(unit, "pps") == 0) {
+		pps = 1;
+	} else {
+		LOG_ERROR("Unknown TX rate unit %s", unit);
+		return ERR_PARAM;
+	}
+
+	while (exp--)
+		mult *= pps ? 1000 : 1024;
+
+	*rate = (uint64_t)(val * mult + 0.5);
+	*is_pps = pps;
+	if (pps) {
+		LOG_INFO("Set tx rate to %lu pps (%lf kpps)", *rate, *rate / 1000.0);
+	} else {
+		LOG_INFO("Set tx rate to %lu bps (%lf Mbps)",
+						*rate, (*rate / (double)(1024 * 1024)));
+	}
+	return 0;
+}
+
+/* whether the IP header of a header template is an IPv6 one */
+static inline bool
+__tx_is_ipv6(const uint8_t *l3_hdr)
+{
+	return (l3_hdr[0] >> 4) == 6;
+}
+
+/**
+ * Leave the checksums of a header template to the NIC
+ *
+ * The IPv4 header checksum is zeroed, the L4 one holds the pseudo header
+ * sum the NIC starts from. IPv6 headers have no checksum.
+ */
+static void
+__tx_cksum_offload_hdr(uint8_t *hdr, uint16_t l3_off, uint16_t pkt_len,
+				uint8_t cksum_offload)
+{
+	struct ipv4_hdr *ip = (struct ipv4_hdr *)(hdr + l3_off);
+	struct ipv6_hdr *ip6 = (struct ipv6_hdr *)(hdr + l3_off);
+	uint8_t *l4 = NULL;
+	uint16_t l4_len = 0, phdr = 0;
+	uint64_t sum = 0;
+	uint8_t proto = 0;
+
+	if (__tx_is_ipv6(hdr + l3_off)) {
+		l4 = hdr + l3_off + sizeof(struct ipv6_hdr);
+		l4_len = pkt_len - l3_off - sizeof(struct ipv6_hdr);
+		proto = ip6->proto;
+		sum = cksum_ipv6_phdr(ip6->src_addr, ip6->dst_addr, proto, l4_len);
+	} else {
+		if (cksum_offload & TX_CKSUM_OFFLOAD_L3)
+			ip->hdr_checksum = 0;
+		l4 = hdr + l3_off + sizeof(struct ipv4_hdr);
+		l4_len = pkt_len - l3_off - sizeof(struct ipv4_hdr);
+		proto = ip->next_proto_id;
+		sum = cksum_ipv4_phdr(ip->src_addr, ip->dst_addr, proto, l4_len);
+	}
+	if (!(cksum_offload & TX_CKSUM_OFFLOAD_L4))
+		return;
+
+	phdr = cksum_fold64(sum);
+	if (proto == IPPROTO_TCP)
+		memcpy(l4 + offsetof(struct tcp_hdr, cksum), &phdr, sizeof(phdr));
+	else if (proto == IPPROTO_UDP)
+		memcpy(l4 + offsetof(struct udp_hdr, dgram_cksum), &phdr,
+						sizeof(phdr));
+}
+
+/* add a randomized field if its range holds more than one value */
+static void
+__tx_random_add_field(struct tx_random *rnd, uint16_t offset, uint8_t width,
+				uint8_t cksum_flags, uint32_t min, uint32_t max)
+{
+	struct tx_random_field *field = NULL;
+
+	if (min == max || rnd->nb_fields >= TX_RANDOM_FIELD_MAX)
+		return;
+
+	field = &rnd->fields[rnd->nb_fields++];
+	field->offset = offset;
+	field->width = width;
+	field->cksum_flags = cksum_flags;
+	field->min = min;
+	field->span = (uint64_t)max - min + 1;
+}
+
+/* init the random pattern from the global ranges */
+static void
+__tx_random_init(struct tx_random *rnd, struct pkt_seq *seq,
+				struct ether_addr *port_mac, uint8_t queueid,
+				uint8_t cksum_offload)
+{
+	struct pkt_seq_range *range = &pktsender.tx_range;
+	uint16_t l3 = sizeof(struct ether_hdr);
+	uint16_t l4 = l3 + pkt_seq_l3_len(seq);
+	uint16_t l4_ports = 0, l4_addrs = 0, l3_addrs = TX_RANDOM_CKSUM_L3;
+
+	rnd->l4_proto = seq->proto;
+	rnd->l3_cksum_off = l3 + offsetof(struct ipv4_hdr, hdr_checksum);
+	if (seq->proto == IPPROTO_TCP) {
+		rnd->l4_cksum_off = l4 + offsetof(struct tcp_hdr, cksum);
+		l4_ports = TX_RANDOM_CKSUM_L4;
+	} else if (seq->proto == IPPROTO_UDP) {
+		rnd->l4_cksum_off = l4 + offsetof(struct udp_hdr, dgram_cksum);
+		l4_ports = TX_RANDOM_CKSUM_L4;
+	}
+	l4_addrs = l4_ports;
+
+	/* the NIC sums the ports itself, only the pseudo header is ours */
+	if (l4_ports && (cksum_offload & TX_CKSUM_OFFLOAD_L4))
+		l4_addrs = TX_RANDOM_CKSUM_PHDR;
+	/* IPv6 headers have no checksum */
+	if ((cksum_offload & TX_CKSUM_OFFLOAD_L3) || seq->is_ipv6)
+		l3_addrs = 0;
+
+	/* addresses are covered by both IPv4 and pseudo header checksums,
+	 * only the low 32 bits of IPv6 ones change */
+	__tx_random_add_field(rnd, pkt_seq_src_ip_off(seq), 4,
+					l3_addrs | l4_addrs,
+					range->src_ip_min, range->src_ip_max);
+	__tx_random_add_field(rnd, pkt_seq_dst_ip_off(seq), 4,
+					l3_addrs | l4_addrs,
+					range->dst_ip_min, range->dst_ip_max);
+
+	if (cksum_offload & TX_CKSUM_OFFLOAD_L4)
+		l4_ports = 0;
+
+	/* tcp and udp headers start with the same src/dst port fields */
+	if (rnd->l4_cksum_off != 0) {
+		__tx_random_add_field(rnd, l4 + offsetof(struct udp_hdr, src_port),
+						2, l4_ports,
+						range->src_port_min, range->src_port_max);
+		__tx_random_add_field(rnd, l4 + offsetof(struct udp_hdr, dst_port),
+						2, l4_ports,
+						range->dst_port_min, range->dst_port_max);
+	}
+
+	/* keep the first two bytes, which hold the multicast/local bits */
+	if (range->rand_mac) {
+		__tx_random_add_field(rnd, offsetof(struct ether_hdr, d_addr) + 2,
+						4, 0, 0, UINT32_MAX);
+		__tx_random_add_field(rnd, offsetof(struct ether_hdr, s_addr) + 2,
+						4, 0, 0, UINT32_MAX);
+	}
+
+	/* different seed for every port/queue, but reproducible across runs */
+	rand_init(&rnd->rng, ETHADDR_TO_UINT64((*port_mac)) ^ queueid);
+
+	LOG_DEBUG("Init random pattern for txq %u: %u fields",
+					queueid, rnd->nb_fields);
+}
+
+/* fix the L4 checksum, a zero UDP checksum means "no checksum" */
+static inline void
+__tx_random_fix_l4(uint8_t *data, uint16_t off, uint8_t proto,
+				uint32_t old_val, uint32_t new_val)
+{
+	uint16_t cksum = 0;
+
+	memcpy(&cksum, data + off, sizeof(cksum));
+	if (proto == IPPROTO_UDP && cksum == 0)
+		return;
+
+	cksum = cksum_update32(cksum, old_val, new_val);
+	if (proto == IPPROTO_UDP && cksum == 0)
+		cksum = 0xFFFF;
+	memcpy(data + off, &cksum, sizeof(cksum));
+}
+
+/* rewrite one 32-bit field of all packets in the burst */
+static inline void
+__tx_random_apply32(struct tx_random *rnd, struct tx_random_field *field,
+				struct rte_mbuf **pkts, uint16_t n, const uint32_t *r)
+{
+	uint16_t i = 0, cksum = 0;
+	uint32_t old_val = 0, new_val = 0;
+	uint8_t *data = NULL;
+
+	for (i = 0; i < n; i++) {
+		data = rte_pktmbuf_mtod(pkts[i], uint8_t *);
+		new_val = rte_cpu_to_be_32(rand_scale(r[i], field->min, field->span));
+
+		memcpy(&old_val, data + field->offset, sizeof(old_val));
+		memcpy(data + field->offset, &new_val, sizeof(new_val));
+
+		if (field->cksum_flags & TX_RANDOM_CKSUM_L3) {
+			memcpy(&cksum, data + rnd->l3_cksum_off, sizeof(cksum));
+			cksum = cksum_update32(cksum, old_val, new_val);
+			memcpy(data + rnd->l3_cksum_off, &cksum, sizeof(cksum));
+		}
+		if (field->cksum_flags & TX_RANDOM_CKSUM_L4)
+			__tx_random_fix_l4(data, rnd->l4_cksum_off, rnd->l4_proto,
+							old_val, new_val);
+		if (field->cksum_flags & TX_RANDOM_CKSUM_PHDR) {
+			memcpy(&cksum, data + rnd->l4_cksum_off, sizeof(cksum));
+			cksum = cksum_adjust_phdr(cksum,
+							cksum_fold(cksum_delta32(old_val, new_val)));
+			memcpy(data + rnd->l4_cksum_off, &cksum, sizeof(cksum));
+		}
+	}
+}
+
+/* rewrite one 16-bit field of all packets in the burst */
+static inline void
+__tx_random_apply16(struct tx_random *rnd, struct tx_random_field *field,
+				struct rte_mbuf **pkts, uint16_t n, const uint32_t *r)
+{
+	uint16_t i = 0, old_val = 0, new_val = 0;
+	uint8_t *data = NULL;
+
+	for (i = 0; i < n; i++) {
+		data = rte_pktmbuf_mtod(pkts[i], uint8_t *);
+		new_val = rte_cpu_to_be_16(
+						(uint16_t)rand_scale(r[i], field->min, field->span));
+
+		memcpy(&old_val, data + field->offset, sizeof(old_val));
+		memcpy(data + field->offset, &new_val, sizeof(new_val));
+
+		/* ports are never covered by the IPv4 header checksum */
+		if (field->cksum_flags & TX_RANDOM_CKSUM_L4)
+			__tx_random_fix_l4(data, rnd->l4_cksum_off, rnd->l4_proto,
+							old_val, new_val);
+	}
+}
+
+/**
+ * Randomize a burst of packets
+ *
+ * Fields are rewritten in place and checksums are fixed incrementally,
+ * the packets are never rebuilt from scratch.
+ */
+static inline void
+__tx_random_apply(struct tx_random *rnd, struct rte_mbuf **pkts, uint16_t n)
+{
+	uint32_t r[MAX_PKT_BURST + RAND_LANES];
+	struct tx_random_field *field = NULL;
+	uint8_t k = 0;
+
+	for (k = 0; k < rnd->nb_fields; k++) {
+		field = &rnd->fields[k];
+		rand_fill(&rnd->rng, r, n);
+
+		if (field->width == 4)
+			__tx_random_apply32(rnd, field, pkts, n, r);
+		else
+			__tx_random_apply16(rnd, field, pkts, n, r);
+	}
+}
+
+/**
+ * Build the size schedule of a size mix
+ *
+ * Weights are repeated as many times as the schedule can hold so the mix
+ * is exact, or scaled down by largest remainder if their sum is too big.
+ * A scaled down size keeps at least one slot, taken from the most frequent
+ * one.
+ */
+static void
+__tx_size_sched_init(struct tx_size_mix *mix, const uint32_t *weight,
+				uint64_t seed)
+{
+	struct rand_state rng;
+	uint64_t sum = 0, rem[PKT_SEQ_SIZE_MAX];
+	uint32_t cnt[PKT_SEQ_SIZE_MAX];
+	uint32_t reps = 0, total = 0, best = 0, j = 0;
+	uint8_t i = 0, tmp = 0;
+
+	for (i = 0; i < mix->nb_sizes; i++)
+		sum += weight[i];
+
+	if (sum <= TX_SIZE_SCHED_MAX) {
+		reps = TX_SIZE_SCHED_MAX / sum;
+		for (i = 0; i < mix->nb_sizes; i++) {
+			cnt[i] = weight[i] * reps;
+			total += cnt[i];
+		}
+	} else {
+		for (i = 0; i < mix->nb_sizes; i++) {
+			cnt[i] = weight[i] * TX_SIZE_SCHED_MAX / sum;
+			rem[i] = weight[i] * TX_SIZE_SCHED_MAX % sum;
+			if (cnt[i] == 0) {
+				cnt[i] = 1;
+				rem[i] = 0;
+			}
+			total += cnt[i];
+		}
+		while (total > TX_SIZE_SCHED_MAX) {
+			for (best = 0, i = 1; i < mix->nb_sizes; i++)
+				if (cnt[i] > cnt[best])
+					best = i;
+			cnt[best]--;
+			total--;
+		}
+		while (total < TX_SIZE_SCHED_MAX) {
+			for (best = 0, i = 1; i < mix->nb_sizes; i++)
+				if (rem[i] > rem[best])
+					best = i;
+			cnt[best]++;
+			rem[best] = 0;
+			total++;
+		}
+	}
+
+	mix->sched_len = 0;
+	for (i = 0; i < mix->nb_sizes; i++)
+		for (j = 0; j < cnt[i]; j++)
+			mix->sched[mix->sched_len++] = i;
+
+	/* Fisher-Yates shuffle */
+	rand_init(&rng, seed);
+	for (j = mix->sched_len - 1; j > 0; j--) {
+		best = rand_scale(rand_next(&rng), 0, j + 1);
+		tmp = mix->sched[j];
+		mix->sched[j] = mix->sched[best];
+		mix->sched[best] = tmp;
+	}
+	mix->sched_next = 0;
+}
+
+/* build a header template for every size of the global size mix */
+static void
+__tx_size_init(struct tx_ctl *ctl, struct ether_addr *port_mac)
+{
+	struct tx_size_mix *mix = &ctl->size_mix;
+	struct pkt_seq_size *size = &pktsender.tx_size;
+	struct pkt_seq tmp = ctl->tx_seq;
+	struct pkt_tmpl tmpl;
+	uint8_t buf[MAX_JUMBO_PKT_LEN];
+	uint16_t l3_off = sizeof(struct ether_hdr);
+	uint8_t i = 0;
+
+	mix->nb_sizes = size->nb_sizes;
+	mix->hdr_len = sizeof(struct pkt_hdr);
+	if (ctl->tx_pattern == TX_PATTERN_TEMPLATE) {
+		mix->hdr_len = ctl->u.tx_tmpl.tmpl.hdr_len;
+		l3_off = ctl->u.tx_tmpl.tmpl.l3_off;
+	}
+	/* the zero stamp the checksums were computed with is restored too */
+	if (ctl->seqnum.off != 0)
+		mix->hdr_len = MAX(mix->hdr_len,
+						ctl->seqnum.off + sizeof(struct seqnum_stamp));
+
+	for (i = 0; i < mix->nb_sizes; i++) {
+		/* checksums cover the zero payload following the headers */
+		memset(buf, 0, sizeof(buf));
+		mix->len[i] = size->len[i];
+		tmp.pkt_len = size->len[i];
+		/* sizes were checked against the template at startup */
+		if (ctl->tx_pattern == TX_PATTERN_TEMPLATE)
+			pkt_tmpl_compile(pktsender.tx_tmpl, port_mac, tmp.pkt_len,
+							buf, &tmpl);
+		else
+			pkt_seq_construct_pkt(&tmp, buf);
+		memcpy(mix->hdr[i], buf, mix->hdr_len);
+		__tx_cksum_offload_hdr(mix->hdr[i], l3_off, tmp.pkt_len,
+						ctl->cksum_offload);
+	}
+
+	__tx_size_sched_init(mix, size->weight,
+					ETHADDR_TO_UINT64((*port_mac)) ^ ctl->queueid);
+	LOG_DEBUG("Init size mix for txq %u: %u sizes, schedule of %u",
+					ctl->queueid, mix->nb_sizes, mix->sched_len);
+}
+
+/* chain a packet to the shared payload segment of its size */
+static inline void
+__tx_payload_chain(struct rte_mbuf *m, struct rte_mbuf *tail)
+{
+	rte_mbuf_refcnt_update(tail, 1);
+	m->data_len = (uint16_t)(m->pkt_len - tail->data_len);
+	m->next = tail;
+	m->nb_segs = 2;
+}
+
+/* give one packet the header and length of a size */
+static inline void
+__tx_size_set(struct tx_size_mix *mix, struct tx_payload *payload,
+				struct rte_mbuf *m, uint8_t idx)
+{
+	rte_memcpy(rte_pktmbuf_mtod(m, void *), mix->hdr[idx], mix->hdr_len);
+	m->pkt_len = mix->len[idx];
+	m->data_len = mix->len[idx];
+	if (unlikely(payload->tails[idx] != NULL))
+		__tx_payload_chain(m, payload->tails[idx]);
+}
+
+/* give each packet of a burst the next size of the schedule */
+static inline void
+__tx_size_apply(struct tx_size_mix *mix, struct tx_payload *payload,
+				struct rte_mbuf **pkts, uint16_t n)
+{
+	uint16_t i = 0;
+
+	for (i = 0; i < n; i++) {
+		__tx_size_set(mix, payload, pkts[i], mix->sched[mix->sched_next]);
+		if (++mix->sched_next == mix->sched_len)
+			mix->sched_next = 0;
+	}
+}
+
+/* give one packet the length of tx_seq, without a size mix */
+static inline void
+__tx_len_set(struct tx_ctl *ctl, struct rte_mbuf *m)
+{
+	m->pkt_len = ctl->tx_seq.pkt_len;
+	m->data_len = ctl->tx_seq.pkt_len;
+	if (unlikely(ctl->payload.tails[0] != NULL))
+		__tx_payload_chain(m, ctl->payload.tails[0]);
+}
+
+/* request the checksums of the NIC, the allocator keeps these fields */
+static inline void
+__tx_cksum_offload_set(struct tx_ctl *ctl, struct rte_mbuf *m)
+{
+	m->ol_flags = ctl->ol_flags;
+	m->l2_len = ctl->l2_len;
+	m->l3_len = ctl->l3_len;
+}
+
+/* build the template of the first MAX_PKT_LEN bytes of a packet, the
+ * checksums cover the whole zero payload */
+static void
+__tx_template_init(struct tx_single *single, struct pkt_seq *seq,
+				uint8_t cksum_offload)
+{
+	uint8_t buf[MAX_JUMBO_PKT_LEN];
+
+	/* the pad is copied whole, even past the end of short packets */
+	memset(buf, 0, sizeof(buf));
+	pkt_seq_construct_pkt(seq, buf);
+	memcpy(&single->hdr, buf, sizeof(struct pkt_hdr));
+	__tx_cksum_offload_hdr((uint8_t *)&single->hdr, sizeof(struct ether_hdr),
+					seq->pkt_len, cksum_offload);
+	memcpy(single->pad, buf + sizeof(struct pkt_hdr), sizeof(single->pad));
+	single->is_init = 1;
+}
+
+/* get the packet template of the patterns building packets from tx_seq */
+static inline struct tx_single *
+__tx_get_template(struct tx_ctl *ctl)
+{
+	switch (ctl->tx_pattern) {
+	case TX_PATTERN_SINGLE:
+		return &ctl->u.tx_single;
+	case TX_PATTERN_RANDOM:
+		return &ctl->u.tx_random.base;
+	case TX_PATTERN_FLOW:
+		return &ctl->u.tx_flow.base;
+	case TX_PATTERN_TEMPLATE:
+		return &ctl->u.tx_tmpl.base;
+	default:
+		return NULL;
+	}
+}
+
+/* init the flow pattern, the flow table is attached with the mempool */
+static void
+__tx_flow_init(struct tx_flow *flow, struct pkt_seq *seq,
+				struct ether_addr *port_mac, uint8_t queueid,
+				uint8_t nb_txq, uint8_t cksum_offload)
+{
+	uint8_t *hdr = (uint8_t *)&flow->base.hdr;
+	uint16_t l3 = sizeof(struct ether_hdr);
+	uint16_t l4 = l3 + pkt_seq_l3_len(seq);
+
+	/* the template checksums are the base of every flow */
+	__tx_template_init(&flow->base, seq, cksum_offload);
+	flow->cksum_offload = cksum_offload;
+
+	flow->l4_proto = seq->proto;
+	flow->src_ip_off = pkt_seq_src_ip_off(seq);
+	flow->dst_ip_off = pkt_seq_dst_ip_off(seq);
+	flow->l4_off = l4;
+	/* IPv6 headers have no checksum */
+	if (!seq->is_ipv6 && !(cksum_offload & TX_CKSUM_OFFLOAD_L3)) {
+		flow->l3_cksum_off = l3 + offsetof(struct ipv4_hdr, hdr_checksum);
+		memcpy(&flow->l3_cksum, hdr + flow->l3_cksum_off,
+						sizeof(flow->l3_cksum));
+	}
+	if (seq->proto == IPPROTO_TCP)
+		flow->l4_cksum_off = l4 + offsetof(struct tcp_hdr, cksum);
+	else if (seq->proto == IPPROTO_UDP)
+		flow->l4_cksum_off = l4 + offsetof(struct udp_hdr, dgram_cksum);
+	if (flow->l4_cksum_off != 0)
+		memcpy(&flow->l4_cksum, hdr + flow->l4_cksum_off,
+						sizeof(flow->l4_cksum));
+
+	/* round-robin queues take interleaved flows */
+	flow->next = queueid;
+	flow->stride = nb_txq;
+	rand_init(&flow->rng, ETHADDR_TO_UINT64((*port_mac)) ^ queueid);
+}
+
+/**
+ * Move a burst of packets to their flows
+ *
+ * Flows are picked and prefetched for the whole burst first, then each
+ * packet gets its 12 bytes of addresses and ports and two adjusted
+ * checksums.
+ *
+ * @param with_sizes
+ *	Whether packets got the header of their size just before, so their
+ *	checksums are the ones of the size template.
+ */
+static inline void
+__tx_flow_apply(struct tx_flow *flow, struct rte_mbuf **pkts, uint16_t n,
+				uint8_t with_sizes)
+{
+	const struct flow_table *table = flow->table;
+	const struct flow_entry *e[MAX_PKT_BURST];
+	uint32_t r[2 * MAX_PKT_BURST + RAND_LANES];
+	uint16_t i = 0, cksum = 0;
+	uint8_t *data = NULL;
+
+	if (table->dist == FLOW_DIST_RR) {
+		for (i = 0; i < n; i++) {
+			e[i] = &table->flows[flow->next];
+			flow->next += flow->stride;
+			if (flow->next >= table->nb_flows)
+				flow->next -= table->nb_flows;
+		}
+	} else {
+		rand_fill(&flow->rng, r, 2 * n);
+		for (i = 0; i < n; i++)
+			e[i] = &table->flows[flow_table_sample(table, r[2 * i],
+							r[2 * i + 1])];
+	}
+
+	for (i = 0; i < n; i++)
+		rte_prefetch0(e[i]);
+
+	for (i = 0; i < n; i++) {
+		data = rte_pktmbuf_mtod(pkts[i], uint8_t *);
+
+		/* only the low 32 bits of IPv6 addresses change */
+		memcpy(data + flow->src_ip_off, &e[i]->src_ip, sizeof(uint32_t));
+		memcpy(data + flow->dst_ip_off, &e[i]->dst_ip, sizeof(uint32_t));
+
+		if (flow->l3_cksum_off != 0) {
+			cksum = flow->l3_cksum;
+			if (with_sizes)
+				memcpy(&cksum, data + flow->l3_cksum_off, sizeof(cksum));
+			cksum = cksum_adjust(cksum, e[i]->l3_delta);
+			memcpy(data + flow->l3_cksum_off, &cksum, sizeof(cksum));
+		}
+
+		if (flow->l4_cksum_off == 0)
+			continue;
+
+		/* src and dst ports are adjacent */
+		memcpy(data + flow->l4_off, &e[i]->src_port, 2 * sizeof(uint16_t));
+
+		cksum = flow->l4_cksum;
+		if (with_sizes)
+			memcpy(&cksum, data + flow->l4_cksum_off, sizeof(cksum));
+		/* the pseudo header only covers the addresses */
+		if (flow->cksum_offload & TX_CKSUM_OFFLOAD_L4) {
+			cksum = cksum_adjust_phdr(cksum, e[i]->l3_delta);
+			memcpy(data + flow->l4_cksum_off, &cksum, sizeof(cksum));
+			continue;
+		}
+		/* a zero UDP checksum means "no checksum" */
+		if (flow->l4_proto == IPPROTO_UDP && cksum == 0)
+			continue;
+		cksum = cksum_adjust(cksum, e[i]->l4_delta);
+		if (flow->l4_proto == IPPROTO_UDP && cksum == 0)
+			cksum = 0xFFFF;
+		memcpy(data + flow->l4_cksum_off, &cksum, sizeof(cksum));
+	}
+}
+
+/* compile the packet template of a queue, without the offloads */
+static void
+__tx_tmpl_init(struct tx_tmpl *t, struct pkt_seq *seq,
+				struct ether_addr *port_mac, uint8_t queueid,
+				uint8_t nb_txq)
+{
+	const struct pkt_tmpl_field *f = NULL;
+	uint8_t k = 0;
+
+	/* the length was checked against the template at startup */
+	pkt_tmpl_compile(pktsender.tx_tmpl, port_mac, seq->pkt_len,
+					(uint8_t *)&t->base.hdr, &t->tmpl);
+	t->base.is_init = 1;
+
+	/* round-robin queues take interleaved values */
+	for (k = 0; k < t->tmpl.nb_fields; k++) {
+		f = &t->tmpl.fields[k];
+		t->pos[k] = ((uint64_t)f->step * queueid) % f->span;
+		t->stride[k] = ((uint64_t)f->step * nb_txq) % f->span;
+		/* each queue would stick to one value: all of them walk the
+		 * whole range by step instead, from their own start */
+		if (t->stride[k] == 0)
+			t->stride[k] = f->step % f->span;
+	}
+	rand_init(&t->rng, ETHADDR_TO_UINT64((*port_mac)) ^ queueid);
+
+	LOG_DEBUG("Init template pattern for txq %u: %u bytes of headers,"
+					" %u mutable fields", queueid, t->tmpl.hdr_len,
+					t->tmpl.nb_fields);
+}
+
+/* leave the checksums of the template to the NIC */
+static void
+__tx_tmpl_offload(struct tx_tmpl *t, uint16_t pkt_len, uint8_t cksum_offload)
+{
+	struct pkt_tmpl_field *f = NULL;
+	uint8_t k = 0;
+
+	if (cksum_offload == 0)
+		return;
+
+	__tx_cksum_offload_hdr((uint8_t *)&t->base.hdr, t->tmpl.l3_off,
+					pkt_len, cksum_offload);
+
+	/* the NIC sums the L4 header itself, only the pseudo header is ours */
+	for (k = 0; k < t->tmpl.nb_fields; k++) {
+		f = &t->tmpl.fields[k];
+		if (cksum_offload & TX_CKSUM_OFFLOAD_L3)
+			f->cksum_flags &= ~PKT_TMPL_CKSUM_L3;
+		if (!(cksum_offload & TX_CKSUM_OFFLOAD_L4) ||
+				!(f->cksum_flags & PKT_TMPL_CKSUM_L4))
+			continue;
+		f->cksum_flags &= ~PKT_TMPL_CKSUM_L4;
+		if (f->cksum_flags & PKT_TMPL_IN_PHDR)
+			f->cksum_flags |= PKT_TMPL_CKSUM_PHDR;
+	}
+}
+
+/**
+ * Rewrite the mutable fields of a burst of template packets
+ *
+ * As with the random pattern, fields are rewritten in place and the
+ * checksums covering them are fixed incrementally.
+ */
+static inline void
+__tx_tmpl_apply(struct tx_tmpl *t, struct rte_mbuf **pkts, uint16_t n)
+{
+	uint32_t r[MAX_PKT_BURST + RAND_LANES];
+	const struct pkt_tmpl_field *f = NULL;
+	uint64_t pos = 0, val = 0;
+	uint16_t i = 0;
+	uint8_t k = 0;
+
+	for (k = 0; k < t->tmpl.nb_fields; k++) {
+		f = &t->tmpl.fields[k];
+
+		if (f->mutator == PKT_TMPL_MUT_RANDOM) {
+			rand_fill(&t->rng, r, n);
+			for (i = 0; i < n; i++)
+				pkt_tmpl_write(rte_pktmbuf_mtod(pkts[i], uint8_t *), f,
+								rand_scale(r[i], f->min, f->span));
+			continue;
+		}
+
+		pos = t->pos[k];
+		for (i = 0; i < n; i++) {
+			val = (f->mutator == PKT_TMPL_MUT_INC) ?
+					pos : f->span - 1 - pos;
+			pkt_tmpl_write(rte_pktmbuf_mtod(pkts[i], uint8_t *), f,
+							(uint32_t)(f->min + val));
+			pos += t->stride[k];
+			if (pos >= f->span)
+				pos -= f->span;
+		}
+		t->pos[k] = pos;
+	}
+}
+
+/* find the L4 checksum covering the stamp, the stream is set by the port */
+static void
+__tx_seqnum_init(struct tx_ctl *ctl)
+{
+	struct tx_seqnum *sn = &ctl->seqnum;
+	const struct pkt_tmpl *tmpl = &ctl->u.tx_tmpl.tmpl;
+	uint16_t l4 = sizeof(struct ether_hdr) + pkt_seq_l3_len(&ctl->tx_seq);
+
+	sn->off = pktsender.seqnum_off;
+	sn->tsc_every = pktsender.tx_tsc_every;
+	sn->l4_proto = ctl->tx_seq.proto;
+	if (ctl->tx_pattern == TX_PATTERN_TEMPLATE) {
+		sn->l4_proto = tmpl->inner_l4_proto;
+		sn->cksum_off = tmpl->inner_l4_cksum_off;
+	} else if (sn->l4_proto == IPPROTO_TCP) {
+		sn->cksum_off = l4 + offsetof(struct tcp_hdr, cksum);
+	} else if (sn->l4_proto == IPPROTO_UDP) {
+		sn->cksum_off = l4 + offsetof(struct udp_hdr, dgram_cksum);
+	}
+
+	/* the NIC sums the payload itself */
+	if (ctl->cksum_offload & TX_CKSUM_OFFLOAD_L4)
+		sn->cksum_off = 0;
+}
+
+/**
+ * Stamp a burst of packets with their sequence numbers, right before
+ * sending them
+ *
+ * The L4 checksum is fixed for the bytes replaced, which held the previous
+ * stamp of the mbuf or the zero one of the template.
+ *
+ * @param tsc
+ *	TSC of the packets timestamped
+ * @param from_zero
+ *	Whether the checksums are the ones of the zero stamp whatever the
+ *	packets hold, as the flow pattern rewrites them from the template.
+ */
+static inline void
+__tx_seqnum_apply(struct tx_seqnum *sn, struct rte_mbuf **pkts, uint16_t n,
+				uint64_t tsc, uint8_t from_zero)
+{
+	struct seqnum_stamp stamp = {
+		.magic = SEQNUM_MAGIC,
+		.stream = sn->stream,
+	};
+	uint32_t old_w[sizeof(stamp) / 4], new_w[sizeof(stamp) / 4];
+	uint32_t sum = 0;
+	uint16_t i = 0, cksum = 0;
+	uint8_t *data = NULL, k = 0;
+
+	memset(old_w, 0, sizeof(old_w));
+	for (i = 0; i < n; i++) {
+		data = rte_pktmbuf_mtod(pkts[i], uint8_t *);
+		stamp.seq = sn->next++;
+		stamp.tsc = 0;
+		if (sn->tsc_every != 0 && sn->tsc_left-- == 0) {
+			stamp.tsc = tsc;
+			sn->tsc_left = sn->tsc_every - 1;
+		}
+
+		if (sn->cksum_off != 0 && !from_zero)
+			memcpy(old_w, data + sn->off, sizeof(old_w));
+		memcpy(data + sn->off, &stamp, sizeof(stamp));
+		if (sn->cksum_off == 0)
+			continue;
+
+		memcpy(&cksum, data + sn->cksum_off, sizeof(cksum));
+		/* a zero UDP checksum means "no checksum" */
+		if (sn->l4_proto == IPPROTO_UDP && cksum == 0)
+			continue;
+		memcpy(new_w, &stamp, sizeof(new_w));
+		sum = 0;
+		for (k = 0; k < sizeof(stamp) / 4; k++)
+			sum += cksum_delta32(old_w[k], new_w[k]);
+		cksum = cksum_adjust(cksum, cksum_fold(sum));
+		if (sn->l4_proto == IPPROTO_UDP && cksum == 0)
+			cksum = 0xFFFF;
+		memcpy(data + sn->cksum_off, &cksum, sizeof(cksum));
+	}
+}
+
+/**
+ * Count the frames of a queue and find the first/last timestamps
+ *
+ * Merged captures may go back in time, the last timestamp is the max one.
+ */
+static uint32_t
+__tx_pcap_scan(struct pcap_file *pf, struct tx_pcap *pcap, uint8_t queueid,
+				uint32_t *max_len, uint64_t *ts_first, uint64_t *ts_last)
+{
+	struct pcap_pkt rec;
+	uint32_t idx = 0, cnt = 0;
+
+	*max_len = 0;
+	while (pcap_next(pf, &rec) > 0) {
+		if (idx == 0)
+			*ts_first = rec.ts_ns;
+		*ts_last = MAX(*ts_last, rec.ts_ns);
+
+		if ((idx++ % pcap->nb_txq) != queueid)
+			continue;
+		if (rec.caplen > pktsender.max_pkt_len || rec.caplen == 0)
+			continue;
+
+		*max_len = MAX(*max_len, rec.caplen);
+		cnt++;
+	}
+	pcap_rewind(pf);
+	return cnt;
+}
+
+/**
+ * Load the frames of this queue into NUMA-local mbufs
+ *
+ * Every mbuf keeps one reference owned by the tx_ctl, so mbufs freed by
+ * the driver after transmission never go back to the mempool.
+ */
+static int
+__tx_pcap_load(struct tx_ctl *ctl, int socketid)
+{
+	static uint32_t pool_idx = 0;
+	struct tx_pcap *pcap = &ctl->u.tx_pcap;
+	struct pcap_file pf;
+	struct pcap_pkt rec;
+	struct rte_mbuf *m = NULL;
+	uint32_t idx = 0, cnt = 0, max_len = 0, nb_trunc = 0, nb_back = 0;
+	uint64_t ts_first = 0, ts_last = 0, ts = 0;
+	double cyc_per_ns = 0;
+	char name[32];
+	int ret = 0;
+
+	ret = pcap_open(&pf, pktsender.pcap_file);
+	if (ret < 0)
+		return ret;
+
+	pcap->nb_pkts = __tx_pcap_scan(&pf, pcap, ctl->queueid,
+					&max_len, &ts_first, &ts_last);
+	if (pcap->nb_pkts == 0) {
+		LOG_ERROR("No frame of %s can be sent by txq %u",
+						pktsender.pcap_file, ctl->queueid);
+		ret = ERR_FORMAT;
+		goto fail_close;
+	}
+
+	snprintf(name, sizeof(name), "pcap_mp_%u", pool_idx++);
+	pcap->mp = rte_pktmbuf_pool_create(name, pcap->nb_pkts, 0, 0,
+					RTE_PKTMBUF_HEADROOM + max_len, socketid);
+	pcap->pkts = rte_zmalloc_socket("pcap_pkts",
+					sizeof(struct rte_mbuf *) * pcap->nb_pkts,
+					RTE_CACHE_LINE_SIZE, socketid);
+	if (pcap->mp == NULL || pcap->pkts == NULL) {
+		LOG_ERROR("Failed to allocate %u mbufs for pcap replay on socket %d",
+						pcap->nb_pkts, socketid);
+		ret = ERR_MEMORY;
+		goto fail_free;
+	}
+
+	/* keep the original gaps, scaled by the speed multiplier */
+	if (pktsender.pcap_speed > 0) {
+		pcap->offsets = rte_zmalloc_socket("pcap_offsets",
+						sizeof(uint64_t) * pcap->nb_pkts,
+						RTE_CACHE_LINE_SIZE, socketid);
+		if (pcap->offsets == NULL) {
+			ret = ERR_MEMORY;
+			goto fail_free;
+		}
+		cyc_per_ns = pktsender.cpu_hz / 1e9 / pktsender.pcap_speed;
+	}
+
+	ts = ts_first;
+	while (pcap_next(&pf, &rec) > 0 && cnt < pcap->nb_pkts) {
+		/* a frame older than the previous ones is sent right after them */
+		ts = MAX(ts, rec.ts_ns);
+
+		if ((idx++ % pcap->nb_txq) != ctl->queueid)
+			continue;
+		if (rec.caplen > pktsender.max_pkt_len || rec.caplen == 0)
+			continue;
+
+		m = rte_pktmbuf_alloc(pcap->mp);
+		if (m == NULL) {
+			ret = ERR_MEMORY;
+			goto fail_free;
+		}
+
+		rte_memcpy(rte_pktmbuf_mtod(m, void *), rec.data, rec.caplen);
+		m->pkt_len = rec.caplen;
+		m->data_len = rec.caplen;
+		if (rec.caplen < rec.len)
+			nb_trunc++;
+		if (rec.ts_ns < ts)
+			nb_back++;
+
+		if (pcap->offsets != NULL)
+			pcap->offsets[cnt] = (uint64_t)((ts - ts_first) * cyc_per_ns);
+		pcap->pkts[cnt++] = m;
+	}
+	pcap->nb_pkts = cnt;
+
+	/* one loop lasts the whole capture plus one average gap */
+	if (pcap->offsets != NULL) {
+		pcap->loop_cycles = (uint64_t)((ts_last - ts_first) * cyc_per_ns);
+		if (idx > 1)
+			pcap->loop_cycles += pcap->loop_cycles / (idx - 1);
+		pcap->loop_cycles = MAX(pcap->loop_cycles, 1);
+	}
+
+	if (nb_trunc > 0)
+		LOG_WARN("%u frames of %s are truncated, only captured bytes are sent",
+						nb_trunc, pktsender.pcap_file);
+	if (nb_back > 0 && pcap->offsets != NULL)
+		LOG_WARN("%u frames of %s go back in time, they are sent without"
+						" gap", nb_back, pktsender.pcap_file);
+
+	LOG_INFO("Load %u frames (max %u bytes) of %s for txq %u on socket %d",
+					cnt, max_len, pktsender.pcap_file, ctl->queueid, socketid);
+	pcap_close(&pf);
+	return 0;
+
+fail_free:
+	tx_ctl_free(ctl);
+fail_close:
+	pcap_close(&pf);
+	return ret;
+}
+
+/**
+ * Replay a burst of pre-loaded frames
+ *
+ * The refcnt of each frame is increased before it is handed to the
+ * driver, so no packet data is copied and no mbuf is allocated.
+ */
+static inline uint16_t
+__tx_pcap_fill(struct tx_pcap *pcap, struct mbuf_table *buffer,
+				uint64_t cycles, uint16_t max)
+{
+	struct rte_mbuf *m = NULL;
+	uint16_t n = 0;
+
+	if (unlikely(pcap->loop_start == 0))
+		pcap->loop_start = cycles;
+
+	while (n < max) {
+		if (pcap->next == pcap->nb_pkts) {
+			pcap->next = 0;
+			pcap->loop_start += pcap->loop_cycles;
+		}
+
+		/* with original gaps, stop at the first frame not due yet */
+		if (pcap->offsets != NULL && pcap->loop_start +
+						pcap->offsets[pcap->next] > cycles)
+			break;
+
+		m = pcap->pkts[pcap->next++];
+		rte_mbuf_refcnt_update(m, 1);
+		buffer->m_table[n++] = m;
+		buffer->total_size += pkt_wire_size(m->pkt_len);
+	}
+	return n;
+}
+
+/**
+ * Take a burst of frames built by the pcap reader lcore
+ *
+ * An empty ring at a time a burst is due means the reader, not the NIC,
+ * is the bottleneck, which is accounted as an underrun.
+ */
+static inline uint16_t
+__tx_stream_fill(struct tx_stream *stream, struct mbuf_table *buffer,
+				uint64_t cycles, uint16_t max)
+{
+	uint16_t i = 0, n = 0;
+
+	n = rte_ring_sc_dequeue_burst(stream->ring,
+					(void **)buffer->m_table, max);
+	if (n == 0) {
+		if (!stream->is_starved) {
+			stream->is_starved = 1;
+			stream->starve_start = cycles;
+			stream->nb_underruns++;
+		}
+		return 0;
+	}
+
+	if (stream->is_starved) {
+		stream->is_starved = 0;
+		stream->starved_cycles += cycles - stream->starve_start;
+	}
+
+	for (i = 0; i < n; i++)
+		buffer->total_size += pkt_wire_size(buffer->m_table[i]->pkt_len);
+	return n;
+}
+
+/**
+ * Take the pinned mbufs of the single pattern out of its mempool
+ *
+ * The mbufs already hold the packet template and keep the reference taken
+ * here for their whole life, so the driver never returns them to the pool.
+ */
+static int
+__tx_pinned_setup(struct tx_ctl *ctl, struct rte_mempool *mp)
+{
+	struct tx_single *single = &ctl->u.tx_single;
+	struct tx_size_mix *mix = &ctl->size_mix;
+	uint16_t n = ctl->burst, i = 0;
+	int ret = 0;
+
+	/* one mbuf per schedule entry keeps the exact size mix */
+	if (mix->nb_sizes > 0)
+		n = mix->sched_len;
+
+	ret = rte_pktmbuf_alloc_bulk(mp, single->pinned, n);
+	if (ret < 0) {
+		LOG_ERROR("Failed to pin %u mbufs of %s", n, mp->name);
+		return ERR_MEMORY;
+	}
+
+	for (i = 0; i < n; i++) {
+		__tx_cksum_offload_set(ctl, single->pinned[i]);
+		if (mix->nb_sizes > 0)
+			__tx_size_set(mix, &ctl->payload, single->pinned[i], mix->sched[i]);
+		else
+			__tx_len_set(ctl, single->pinned[i]);
+	}
+
+	single->nb_pinned = n;
+	single->pinned_next = 0;
+	return 0;
+}
+
+/**
+ * Re-send the pinned mbufs
+ *
+ * A pinned mbuf may still sit in the TX ring from previous bursts, the
+ * packet content never changes so it is sent again with one more reference,
+ * and so is its payload segment, which the driver frees on its own.
+ */
+static inline uint16_t
+__tx_pinned_fill(struct tx_single *single, struct mbuf_table *buffer,
+				uint16_t max)
+{
+	struct rte_mbuf *m = NULL;
+	uint16_t i = 0;
+
+	for (i = 0; i < max; i++) {
+		m = single->pinned[single->pinned_next];
+		if (++single->pinned_next == single->nb_pinned)
+			single->pinned_next = 0;
+		rte_mbuf_refcnt_update(m, 1);
+		if (unlikely(m->next != NULL))
+			rte_mbuf_refcnt_update(m->next, 1);
+		buffer->m_table[i] = m;
+		buffer->total_size += pkt_wire_size(m->pkt_len);
+	}
+	return max;
+}
+
+static tx_burst_fn_t __tx_get_burst_fn(uint16_t burst);
+
+/* pick the checksums left to the NIC, the others stay in software */
+static void
+__tx_cksum_offload_init(struct tx_ctl *ctl, uint64_t tx_offload_capa)
+{
+	uint64_t l4_capa = 0, l4_flag = 0;
+	uint8_t proto = ctl->tx_seq.proto;
+	bool is_ipv6 = ctl->tx_seq.is_ipv6;
+
+	ctl->l2_len = sizeof(struct ether_hdr);
+	if (ctl->tx_pattern == TX_PATTERN_TEMPLATE) {
+		if (ctl->u.tx_tmpl.tmpl.nb_l3 != 1) {
+			LOG_WARN("Checksum offload needs a single IP header,"
+							" computing checksums");
+			return;
+		}
+		ctl->l2_len = ctl->u.tx_tmpl.tmpl.l3_off;
+		proto = ctl->u.tx_tmpl.tmpl.l4_proto;
+		is_ipv6 = __tx_is_ipv6((uint8_t *)&ctl->u.tx_tmpl.base.hdr +
+						ctl->l2_len);
+	}
+
+	/* IPv6 headers have no checksum, only the L4 one is offloaded */
+	if (is_ipv6) {
+		ctl->l3_len = sizeof(struct ipv6_hdr);
+	} else if (!(tx_offload_capa & DEV_TX_OFFLOAD_IPV4_CKSUM)) {
+		LOG_WARN("Port has no IPv4 checksum offload, computing checksums");
+		return;
+	} else {
+		ctl->l3_len = sizeof(struct ipv4_hdr);
+		ctl->cksum_offload = TX_CKSUM_OFFLOAD_L3;
+		ctl->ol_flags = PKT_TX_IPV4 | PKT_TX_IP_CKSUM;
+	}
+
+	if (proto == IPPROTO_TCP) {
+		l4_capa = DEV_TX_OFFLOAD_TCP_CKSUM;
+		l4_flag = PKT_TX_TCP_CKSUM;
+	} else if (proto == IPPROTO_UDP) {
+		l4_capa = DEV_TX_OFFLOAD_UDP_CKSUM;
+		l4_flag = PKT_TX_UDP_CKSUM;
+	} else {
+		return;
+	}
+
+	if (tx_offload_capa & l4_capa) {
+		ctl->cksum_offload |= TX_CKSUM_OFFLOAD_L4;
+		ctl->ol_flags |= l4_flag | (is_ipv6 ? PKT_TX_IPV6 : 0);
+	} else {
+		LOG_WARN("Port has no L4 checksum offload, computing it");
+	}
+}
+
+/* request a new rate and packet size from another lcore */
+void
+tx_ctl_request(struct tx_ctl *ctl, uint64_t port_rate, uint8_t size_idx)
+{
+	ctl->req.rate = __tx_rate_split(port_rate, ctl->queueid, ctl->nb_txq);
+	ctl->req.size_idx = size_idx;
+	rte_smp_wmb();
+	ctl->req.gen++;
+}
+
+/* hand an in-band probe to the TX lcore */
+bool
+tx_ctl_inject_probe(struct tx_ctl *ctl, struct rte_mbuf *pkt)
+{
+	if (ctl->probe != NULL)
+		return false;
+
+	/* the probe is built before the TX lcore sees it */
+	rte_smp_wmb();
+	ctl->probe = pkt;
+	return true;
+}
+
+/* check whether the last in-band probe is not sent yet */
+bool
+tx_ctl_probe_pending(const struct tx_ctl *ctl)
+{
+	return ctl->probe != NULL;
+}
 
-/* calculate cycles per byte */
-static inline double
-__get_tx_cycles_per_byte(uint64_t bps)
+/* take back the in-band probe not sent yet */
+struct rte_mbuf *
+tx_ctl_take_probe(struct tx_ctl *ctl)
 {
-	return (pktsender.cpu_hz * 8.0 / bps);
+	struct rte_mbuf *pkt = ctl->probe;
+
+	ctl->probe = NULL;
+	return pkt;
 }
 
 /* init tx_ctl */
 void tx_ctl_init(struct tx_ctl *ctl, struct ether_addr *port_mac,
-				uint8_t queueid)
+				uint8_t queueid, uint8_t nb_txq, uint16_t burst,
+				uint64_t tx_offload_capa)
 {
 	struct pkt_seq *global = &pktsender.tx_pkt;
+	uint64_t port_rate = 0, rate = 0;
+	uint8_t is_pps = 0;
 
 	/* zero out the entire tx_ctl space */
 	memset(ctl, 0, sizeof(struct tx_ctl));
 
 	ctl->queueid = queueid;
-	/* set tx_pattern and tx_rate based on global setting */
+	ctl->nb_txq = nb_txq;
+	/* set tx_pattern based on global setting */
 	ctl->tx_pattern = pktsender.tx_pattern;
-	ctl->rate_bps = (pktsender.tx_rate == 0) ?
-					TX_RATE_DEFAULT_BPS : (pktsender.tx_rate);
-	ctl->rate_cycles = __get_tx_cycles_per_byte(ctl->rate_bps);
-	LOG_DEBUG("%s: bps %lu, cycles %lf",
-					__FUNCTION__, ctl->rate_bps, ctl->rate_cycles);
+	/* packets longer than their head share a payload segment */
+	ctl->payload.head_len = pktsender.tx_split ?
+					TX_SPLIT_HEAD_LEN : MAX_PKT_LEN;
+	ctl->burst = burst;
+	ctl->tx_burst_fn = __tx_get_burst_fn(burst);
 	/* init default packet sequence */
 	pkt_seq_init_local(&ctl->tx_seq, global, port_mac);
 	LOG_DEBUG("Init tx_seq, pkt_len global %u, local %u",
 					global->pkt_len, ctl->tx_seq.pkt_len);
+
+	/* split the port rate across queues, a profile sets it on the fly */
+	if (pktsender.tx_profile != NULL) {
+		ctl->profile = pktsender.tx_profile;
+		port_rate = profile_get_rate(ctl->profile, 0, &ctl->profile_seg,
+						&ctl->profile_next);
+		is_pps = ctl->profile->is_pps;
+		ctl->profile_next = 0;
+	} else if (pktsender.tx_rate == 0) {
+		port_rate = TX_RATE_DEFAULT_BPS;
+		is_pps = 0;
+	} else {
+		port_rate = pktsender.tx_rate;
+		is_pps = pktsender.tx_rate_pps;
+	}
+	rate = __tx_rate_split(port_rate, queueid, nb_txq);
+	__tx_rate_init(ctl, rate, is_pps);
+	/* the RFC 2544 test sets the rate of each trial */
+	if (pktsender.rfc2544.tests != 0)
+		ctl->rate_off = 1;
+	LOG_DEBUG("%s: rate %lu %s, depth %ld",
+					__FUNCTION__, ctl->rate, is_pps ? "pps" : "bps",
+					ctl->rate_depth);
+
+	/* the offloads depend on the header stack of the template */
+	if (ctl->tx_pattern == TX_PATTERN_TEMPLATE)
+		__tx_tmpl_init(&ctl->u.tx_tmpl, &ctl->tx_seq, port_mac,
+						queueid, nb_txq);
+
+	if (pktsender.tx_cksum_offload && __tx_get_template(ctl) != NULL)
+		__tx_cksum_offload_init(ctl, tx_offload_capa);
+
+	if (ctl->tx_pattern == TX_PATTERN_RANDOM)
+		__tx_random_init(&ctl->u.tx_random, &ctl->tx_seq,
+						port_mac, queueid, ctl->cksum_offload);
+	else if (ctl->tx_pattern == TX_PATTERN_FLOW)
+		__tx_flow_init(&ctl->u.tx_flow, &ctl->tx_seq, port_mac,
+						queueid, nb_txq, ctl->cksum_offload);
+	else if (ctl->tx_pattern == TX_PATTERN_TEMPLATE)
+		__tx_tmpl_offload(&ctl->u.tx_tmpl, ctl->tx_seq.pkt_len,
+						ctl->cksum_offload);
+	else if (ctl->tx_pattern == TX_PATTERN_PCAP)
+		ctl->u.tx_pcap.nb_txq = nb_txq;
+
+	if (pktsender.seqnum_off != 0 && __tx_get_template(ctl) != NULL)
+		__tx_seqnum_init(ctl);
+
+	if (pktsender.tx_size.nb_sizes > 1 && __tx_get_template(ctl) != NULL)
+		__tx_size_init(ctl, port_mac);
+}
+
+/* lengths of the packets built from tx_seq, the sizes of the mix if any */
+static uint8_t
+__tx_get_sizes(const struct tx_ctl *ctl, uint16_t *len)
+{
+	if (ctl->size_mix.nb_sizes > 0) {
+		memcpy(len, ctl->size_mix.len,
+						ctl->size_mix.nb_sizes * sizeof(uint16_t));
+		return ctl->size_mix.nb_sizes;
+	}
+	len[0] = ctl->tx_seq.pkt_len;
+	return 1;
+}
+
+/* whether some packets built from tx_seq need a payload segment */
+static bool
+__tx_payload_needed(const struct tx_ctl *ctl)
+{
+	uint16_t len[PKT_SEQ_SIZE_MAX];
+	uint8_t nb = 0, i = 0;
+
+	nb = __tx_get_sizes(ctl, len);
+	for (i = 0; i < nb; i++) {
+		if (len[i] > ctl->payload.head_len)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * Create the payload segments of the sizes longer than their head
+ *
+ * Segments live in a private mempool on the socket of the TX queue, so
+ * the TX mempool only holds the heads.
+ */
+static int
+__tx_payload_setup(struct tx_ctl *ctl, int socketid)
+{
+	static uint32_t pool_idx = 0;
+	struct tx_payload *payload = &ctl->payload;
+	struct rte_mbuf *m = NULL;
+	uint16_t len[PKT_SEQ_SIZE_MAX];
+	uint16_t max_tail = 0;
+	uint8_t nb = 0, nb_tails = 0, i = 0;
+	char name[32];
+
+	if (__tx_get_template(ctl) == NULL || !__tx_payload_needed(ctl))
+		return 0;
+
+	nb = __tx_get_sizes(ctl, len);
+	for (i = 0; i < nb; i++) {
+		if (len[i] <= payload->head_len)
+			continue;
+		max_tail = MAX(max_tail, len[i] - payload->head_len);
+		nb_tails++;
+	}
+
+	snprintf(name, sizeof(name), "payload_mp_%u", pool_idx++);
+	payload->mp = rte_pktmbuf_pool_create(name, nb_tails, 0, 0,
+					RTE_PKTMBUF_HEADROOM + max_tail, socketid);
+	if (payload->mp == NULL) {
+		LOG_ERROR("Failed to allocate shared payloads on socket %d",
+						socketid);
+		return ERR_MEMORY;
+	}
+
+	for (i = 0; i < nb; i++) {
+		if (len[i] <= payload->head_len)
+			continue;
+
+		m = rte_pktmbuf_alloc(payload->mp);
+		if (m == NULL)
+			return ERR_MEMORY;
+		m->data_len = len[i] - payload->head_len;
+		m->pkt_len = m->data_len;
+		memset(rte_pktmbuf_mtod(m, void *), 0, m->data_len);
+		payload->tails[i] = m;
+	}
+
+	LOG_DEBUG("Setup %u shared payloads (head %u, max %u bytes) for txq %u",
+					nb_tails, payload->head_len, max_tail, ctl->queueid);
+	return 0;
 }
 
 /** Pre-init all mbuf in the mempool */
@@ -51,42 +1525,61 @@ __pktmbuf_setup_cb(struct rte_mempool *mp,
 {
 	struct tx_ctl *tx_ctl = (struct tx_ctl*)opaque;
 	struct rte_mbuf *m = (struct rte_mbuf*)obj;
+	/* random and flow packets start from the same template as single
+	 * ones, the varying fields are rewritten on every burst. */
+	struct tx_single *single = __tx_get_template(tx_ctl);
 
-	if (tx_ctl->tx_pattern == TX_PATTERN_SINGLE) {
-		struct tx_single *single = &tx_ctl->u.tx_single;
-
+	if (single != NULL) {
 		if (single->is_init == 0) {
 			/* construct static packet template */
-			pkt_seq_construct_pkt(&tx_ctl->tx_seq, &single->hdr);
-			single->is_init = 1;
+			__tx_template_init(single, &tx_ctl->tx_seq,
+							tx_ctl->cksum_offload);
 		}
 
-		/* copy the packet template into the mbuf */
+		/* copy the head of the packet template into the mbuf */
 		rte_memcpy((uint8_t*)m->buf_addr + m->data_off,
-						(uint8_t*)&single->hdr, MAX_PKT_LEN);
+						(uint8_t*)&single->hdr, tx_ctl->payload.head_len);
+		/* longer packets are chained to their payload when sent */
 		m->pkt_len = tx_ctl->tx_seq.pkt_len;
-		m->data_len = tx_ctl->tx_seq.pkt_len;
+		m->data_len = RTE_MIN(tx_ctl->tx_seq.pkt_len,
+						tx_ctl->payload.head_len);
+		__tx_cksum_offload_set(tx_ctl, m);
 
 //		LOG_DEBUG("Setup cb %u", m->pkt_len);
-
-	} else if (tx_ctl->tx_pattern == TX_PATTERN_RANDOM) {
-		// TODO setup random packets
-	} else if (tx_ctl->tx_pattern == TX_PATTERN_PCAP) {
-		// TODO setup pcap packets
 	}
 }
 
 /** Setup the default packets to be sent */
-void
+int
 tx_ctl_setup_mempool(struct tx_ctl *tx_ctl, struct rte_mempool *mp)
 {
 	if (tx_ctl == NULL || mp == NULL) {
 		LOG_ERROR("Wrong parameters: tx_ctl %p, mp %p", tx_ctl, mp);
-		return;
+		return ERR_PARAM;
 	}
 
 	DEBUG_TRACE();
 
+	/* pcap frames live in their own mempool */
+	if (tx_ctl->tx_pattern == TX_PATTERN_PCAP)
+		return __tx_pcap_load(tx_ctl, mp->socket_id);
+	/* streamed frames are built by the reader lcore */
+	if (tx_ctl->tx_pattern == TX_PATTERN_PCAP_STREAM)
+		return 0;
+	/* flows are shared by all TX queues of the socket */
+	if (tx_ctl->tx_pattern == TX_PATTERN_FLOW) {
+		tx_ctl->u.tx_flow.table = flow_table_get(mp->socket_id);
+		if (tx_ctl->u.tx_flow.table == NULL)
+			return ERR_MEMORY;
+		/* fewer flows than queues: keep both below the table size, so
+		 * that a single wrap is enough on the TX path */
+		tx_ctl->u.tx_flow.next %= tx_ctl->u.tx_flow.table->nb_flows;
+		tx_ctl->u.tx_flow.stride %= tx_ctl->u.tx_flow.table->nb_flows;
+	}
+
+	if (__tx_payload_setup(tx_ctl, mp->socket_id) < 0)
+		return ERR_MEMORY;
+
 #if RTE_VERSION >= RTE_VERSION_NUM(16, 7, 0, 0)
 	rte_mempool_obj_iter(mp, __pktmbuf_setup_cb, tx_ctl);
 #else
@@ -115,6 +1608,89 @@ tx_ctl_setup_mempool(struct tx_ctl *tx_ctl, struct rte_mempool *mp)
 #endif
 	LOG_DEBUG("Setup all mbufs in the mempool for queue %u",
 					tx_ctl->queueid);
+
+	if (tx_ctl->tx_pattern == TX_PATTERN_SINGLE && pktsender.tx_pinned)
+		return __tx_pinned_setup(tx_ctl, mp);
+	return 0;
+}
+
+/* get the txq_flags matching how a tx_ctl owns its mbufs */
+uint32_t
+tx_ctl_get_txq_flags(const struct tx_ctl *tx_ctl)
+{
+	uint32_t flags = 0;
+
+#ifdef ETH_TXQ_FLAGS_NOREFCOUNT
+	/* payload segments come from another mempool and are refcounted */
+	if (tx_ctl->tx_pattern != TX_PATTERN_PCAP &&
+			tx_ctl->tx_pattern != TX_PATTERN_PCAP_STREAM &&
+			__tx_payload_needed(tx_ctl))
+		return 0;
+
+	/* in-band probes come from the probe mempool */
+	if (pktsender.probe_inband && tx_ctl->queueid == PROBE_INBAND_QUEUE)
+		return 0;
+
+	switch (tx_ctl->tx_pattern) {
+	case TX_PATTERN_SINGLE:
+		flags = ETH_TXQ_FLAGS_NOMULTMEMP;
+		if (!pktsender.tx_pinned)
+			flags |= ETH_TXQ_FLAGS_NOREFCOUNT;
+		break;
+	case TX_PATTERN_RANDOM:
+	case TX_PATTERN_FLOW:
+	case TX_PATTERN_TEMPLATE:
+		flags = ETH_TXQ_FLAGS_NOMULTMEMP | ETH_TXQ_FLAGS_NOREFCOUNT;
+		break;
+	case TX_PATTERN_PCAP:
+		flags = ETH_TXQ_FLAGS_NOMULTMEMP;
+		break;
+	default:
+		break;
+	}
+#else
+	RTE_SET_USED(tx_ctl);
+#endif
+	return flags;
+}
+
+/* free all memory areas owned by a tx_ctl */
+void
+tx_ctl_free(struct tx_ctl *tx_ctl)
+{
+	struct tx_pcap *pcap = &tx_ctl->u.tx_pcap;
+	struct tx_payload *payload = &tx_ctl->payload;
+
+	/* payload segments still chained in the TX ring are released with
+	 * their pool */
+	if (payload->mp != NULL) {
+		rte_mempool_free(payload->mp);
+		memset(payload, 0, sizeof(struct tx_payload));
+	}
+
+	/* pinned mbufs are released with the TX mempool */
+	if (tx_ctl->tx_pattern == TX_PATTERN_SINGLE) {
+		tx_ctl->u.tx_single.nb_pinned = 0;
+		return;
+	}
+
+	if (tx_ctl->tx_pattern != TX_PATTERN_PCAP)
+		return;
+
+	/* frames still referenced by the driver are released with the pool */
+	if (pcap->mp != NULL) {
+		rte_mempool_free(pcap->mp);
+		pcap->mp = NULL;
+	}
+	if (pcap->pkts != NULL) {
+		rte_free(pcap->pkts);
+		pcap->pkts = NULL;
+	}
+	if (pcap->offsets != NULL) {
+		rte_free(pcap->offsets);
+		pcap->offsets = NULL;
+	}
+	pcap->nb_pkts = 0;
 }
 
 static inline void
@@ -143,6 +1719,9 @@ __pktmbuf_reset(struct rte_mbuf *m)
  * Allocate a bulk of mbufs, initialize refcnt and reset the fields to default
  * values.
  *
+ * TX queues using ETH_TXQ_FLAGS_NOREFCOUNT put mbufs back to the pool
+ * without touching the refcnt, so it is set rather than verified here.
+ *
  *  @param pool
  *    The mempool from which mbufs are allocated.
  *  @param mbufs
@@ -172,41 +1751,21 @@ __pktmbuf_alloc_bulk(struct rte_mempool *pool,
 	switch (count % 4) {
 	case 0:
 		while (idx != count) {
-#ifdef RTE_ASSERT
-			RTE_ASSERT(rte_mbuf_refcnt_read(mbufs[idx]) == 0);
-#else
-			RTE_VERIFY(rte_mbuf_refcnt_read(mbufs[idx]) == 0);
-#endif
 			rte_mbuf_refcnt_set(mbufs[idx], 1);
 			__pktmbuf_reset(mbufs[idx]);
 			idx++;
 			/* fall-through */
 		case 3:
-#ifdef RTE_ASSERT
-			RTE_ASSERT(rte_mbuf_refcnt_read(mbufs[idx]) == 0);
-#else
-			RTE_VERIFY(rte_mbuf_refcnt_read(mbufs[idx]) == 0);
-#endif
 			rte_mbuf_refcnt_set(mbufs[idx], 1);
 			__pktmbuf_reset(mbufs[idx]);
 			idx++;
 			/* fall-through */
 		case 2:
-#ifdef RTE_ASSERT
-			RTE_ASSERT(rte_mbuf_refcnt_read(mbufs[idx]) == 0);
-#else
-			RTE_VERIFY(rte_mbuf_refcnt_read(mbufs[idx]) == 0);
-#endif
 			rte_mbuf_refcnt_set(mbufs[idx], 1);
 			__pktmbuf_reset(mbufs[idx]);
 			idx++;
 			/* fall-through */
 		case 1:
-#ifdef RTE_ASSERT
-			RTE_ASSERT(rte_mbuf_refcnt_read(mbufs[idx]) == 0);
-#else
-			RTE_VERIFY(rte_mbuf_refcnt_read(mbufs[idx]) == 0);
-#endif
 			rte_mbuf_refcnt_set(mbufs[idx], 1);
 			__pktmbuf_reset(mbufs[idx]);
 			idx++;
@@ -234,55 +1793,157 @@ __send_burst(uint8_t portid, uint8_t queueid,
 	}
 }
 
-#define pkt_wire_size(len) (len + FRAME_EXTRA_BYTES)
+/** fetch a burst of pre-init packets from the mempool */
+static inline uint16_t
+__tx_alloc_fill(struct tx_ctl *ctl, struct rte_mempool *mp, uint16_t max)
+{
+	struct mbuf_table *buffer = &ctl->tx_buffer;
+	uint16_t i = 0;
 
-/** send a set of packet buffers to a given port */
-int
-tx_ctl_tx_burst(uint8_t portid, struct tx_ctl *ctl,
-				struct rte_mempool *mp)
+	if (unlikely(__pktmbuf_alloc_bulk(mp, buffer->m_table, max) < 0))
+		return 0;
+
+	if (ctl->size_mix.nb_sizes > 0) {
+		__tx_size_apply(&ctl->size_mix, &ctl->payload, buffer->m_table, max);
+	} else if (unlikely(ctl->payload.tails[0] != NULL)) {
+		for (i = 0; i < max; i++)
+			__tx_len_set(ctl, buffer->m_table[i]);
+	}
+
+	if (ctl->tx_pattern == TX_PATTERN_RANDOM)
+		__tx_random_apply(&ctl->u.tx_random, buffer->m_table, max);
+	else if (ctl->tx_pattern == TX_PATTERN_FLOW)
+		__tx_flow_apply(&ctl->u.tx_flow, buffer->m_table, max,
+						ctl->size_mix.nb_sizes > 0);
+	else if (ctl->tx_pattern == TX_PATTERN_TEMPLATE)
+		__tx_tmpl_apply(&ctl->u.tx_tmpl, buffer->m_table, max);
+
+	for (i = 0; i < max; i++)
+		buffer->total_size += pkt_wire_size(buffer->m_table[i]->pkt_len);
+	return max;
+}
+
+/**
+ * Send a set of packet buffers to a given port
+ *
+ * Sent mbufs belong to the driver, which frees them once transmitted.
+ * Pinned and pre-loaded mbufs get one more reference per TX instead, so
+ * the driver never returns them to their mempool.
+ *
+ * @param burst
+ *	Burst size, a constant in the specialized variants below
+ */
+static inline __attribute__((always_inline)) int
+__tx_ctl_tx_burst(uint8_t portid, struct tx_ctl *ctl,
+				struct rte_mempool *mp, const uint16_t burst)
 {
-	int rc = 0;
 	uint64_t cycles = rte_get_tsc_cycles();
-	struct rte_mbuf *pkt = NULL;
-	uint8_t i = 0;
+	struct mbuf_table *buffer = &ctl->tx_buffer;
+	uint16_t max = burst, nb_data = 0;
+	uint8_t is_paced = 1;
 
-	if (ctl->rate_next_cycles >= cycles)
+	/* pcap frames keeping their original gaps are not rate limited */
+	if (ctl->tx_pattern == TX_PATTERN_PCAP && ctl->u.tx_pcap.offsets != NULL)
+		is_paced = 0;
+	else if (__tx_rate_follow(ctl, cycles) == 0)
 		return 0;
+	else
+		max = __tx_rate_refill(ctl, cycles, burst);
 
-	/* Fetch a set of pre-init packets */
-//	rc = rte_mempool_get_bulk(mp, (void**)ctl->tx_buffer.m_table,
-//						MAX_PKT_BURST);
-	rc = __pktmbuf_alloc_bulk(mp, ctl->tx_buffer.m_table, MAX_PKT_BURST);
+	if (max == 0)
+		return 0;
+	/* a full burst would leave no room for a waiting in-band probe */
+	if (unlikely(ctl->probe != NULL) && max == MAX_PKT_BURST)
+		max--;
 
-	if (rc < 0) {
-		LOG_ERROR("No enough %u mbufs in the port %u tx_mp",
-						MAX_PKT_BURST, portid);
-		return -1;
-	}
+	switch (ctl->tx_pattern) {
+	case TX_PATTERN_PCAP:
+		buffer->len = __tx_pcap_fill(&ctl->u.tx_pcap, buffer, cycles, max);
+		break;
+	case TX_PATTERN_PCAP_STREAM:
+		buffer->len = __tx_stream_fill(&ctl->u.tx_stream, buffer,
+						cycles, max);
+		break;
+	default:
+		if (ctl->tx_pattern == TX_PATTERN_SINGLE &&
+				ctl->u.tx_single.nb_pinned > 0) {
+			buffer->len = __tx_pinned_fill(&ctl->u.tx_single, buffer, max);
+			break;
+		}
 
-	for (i = 0; i < MAX_PKT_BURST; i++) {
-		pkt = ctl->tx_buffer.m_table[i];
-		ctl->tx_buffer.total_size += pkt_wire_size(pkt->pkt_len);
+		buffer->len = __tx_alloc_fill(ctl, mp, max);
+		if (buffer->len == 0) {
+			LOG_ERROR("No enough %u mbufs in the port %u tx_mp",
+							max, portid);
+			return -1;
+		}
+		if (ctl->seqnum.off != 0)
+			__tx_seqnum_apply(&ctl->seqnum, buffer->m_table, buffer->len,
+							rte_rdtsc(), ctl->tx_pattern == TX_PATTERN_FLOW &&
+							ctl->size_mix.nb_sizes == 0);
+		break;
 	}
 
-	ctl->tx_buffer.len = MAX_PKT_BURST;
-//	LOG_DEBUG("Port %u: fetch %u packets, total size %u",
-//					portid, MAX_PKT_BURST, ctl->tx_buffer.total_size);
+	if (buffer->len == 0)
+		return 0;
+
+	/* an in-band probe waits in the TX ring behind the data, it is not
+	 * charged to the rate */
+	nb_data = buffer->len;
+	if (unlikely(ctl->probe != NULL) && nb_data < MAX_PKT_BURST)
+		buffer->m_table[buffer->len++] = ctl->probe;
 
-	__send_burst(portid, ctl->queueid, &ctl->tx_buffer);
+	__send_burst(portid, ctl->queueid, buffer);
 
-	/* set next tx cycles */
-	ctl->rate_next_cycles = cycles +
-				(uint64_t)(ctl->tx_buffer.total_size * ctl->rate_cycles);
+	if (unlikely(buffer->len > nb_data))
+		ctl->probe = NULL;
+	if (is_paced)
+		__tx_rate_charge(ctl, nb_data, buffer->total_size);
 
-	rte_pktmbuf_free_bulk(ctl->tx_buffer.m_table, MAX_PKT_BURST);
-	ctl->tx_buffer.len = 0;
-	ctl->tx_buffer.total_size = 0;
-//		LOG_DEBUG("%u, %u, %lu, %lu, %lu",
-//						lcore,
-//						ctl->tx_buffer.total_size,
-//						ctl->rate_cycles,
-//						cycles,
-//						ctl->rate_next_cycles);
+	buffer->len = 0;
+	buffer->total_size = 0;
 	return 0;
 }
+
+/* variants of __tx_ctl_tx_burst() for common burst sizes, so the hot
+ * loops are bounded by constants */
+#define TX_BURST_FN(n) \
+static int \
+__tx_ctl_tx_burst_##n(uint8_t portid, struct tx_ctl *ctl, \
+				struct rte_mempool *mp) \
+{ \
+	return __tx_ctl_tx_burst(portid, ctl, mp, n); \
+}
+
+TX_BURST_FN(8)
+TX_BURST_FN(16)
+TX_BURST_FN(32)
+TX_BURST_FN(64)
+
+#undef TX_BURST_FN
+
+/* any other burst size */
+static int
+__tx_ctl_tx_burst_any(uint8_t portid, struct tx_ctl *ctl,
+				struct rte_mempool *mp)
+{
+	return __tx_ctl_tx_burst(portid, ctl, mp, ctl->burst);
+}
+
+/* pick the variant of a burst size */
+static tx_burst_fn_t
+__tx_get_burst_fn(uint16_t burst)
+{
+	switch (burst) {
+	case 8:
+		return __tx_ctl_tx_burst_8;
+	case 16:
+		return __tx_ctl_tx_burst_16;
+	case 32:
+		return __tx_ctl_tx_burst_32;
+	case 64:
+		return __tx_ctl_tx_burst_64;
+	default:
+		return __tx_ctl_tx_burst_any;
+	}
+}
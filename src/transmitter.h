@@ -2,6 +2,72 @@
 #define _PKTSENDER_TRANSMITTER_H_
 
 #include "pktsender.h"
+#include "rand.h"
+#include "profile.h"
+#include "pkt_tmpl.h"
+
+/** Max number of entries of a packet size schedule */
+#define TX_SIZE_SCHED_MAX	256
+/** Max length of the headers of a size template, the pkt_hdr of tx_seq or
+ * the header stack of a packet template */
+#define TX_HDR_LEN_MAX	PKT_TMPL_HDR_MAX
+
+/**
+ * Packet sizes of a size mix, used by the patterns building packets
+ *
+ * Every size has its own header template. Sizes are picked per packet by
+ * walking a schedule where each size appears in proportion to its weight,
+ * shuffled once at init so bursts interleave the sizes.
+ */
+struct tx_size_mix {
+	/** Number of sizes, 0 if all packets have the tx_seq length */
+	uint8_t nb_sizes;
+	/** Length of each size (excluding FCS) */
+	uint16_t len[PKT_SEQ_SIZE_MAX];
+	/** Length of the header templates */
+	uint16_t hdr_len;
+	/** Header template of each size */
+	uint8_t hdr[PKT_SEQ_SIZE_MAX][TX_HDR_LEN_MAX];
+	/** Number of entries in the schedule */
+	uint16_t sched_len;
+	/** Next entry of the schedule */
+	uint16_t sched_next;
+	/** Schedule of size indexes */
+	uint8_t sched[TX_SIZE_SCHED_MAX];
+};
+
+/** The NIC computes the IPv4 header checksum, IPv6 has none */
+#define TX_CKSUM_OFFLOAD_L3	0x1
+/** The NIC computes the L4 checksum, the packet holds the pseudo header
+ * sum in its place */
+#define TX_CKSUM_OFFLOAD_L4	0x2
+
+/** Length of the private part of a packet with a shared payload, covers
+ * all headers rewritten per packet */
+#define TX_SPLIT_HEAD_LEN	128
+
+/**
+ * Shared payload segments
+ *
+ * A packet longer than head_len keeps its first head_len bytes in its own
+ * mbuf, chained to a zero payload segment shared by all packets of the
+ * same size. The segment gets one more reference per packet and keeps its
+ * own reference, so it never goes back to its mempool.
+ *
+ * head_len is MAX_PKT_LEN so that only jumbo packets are chained, or
+ * TX_SPLIT_HEAD_LEN with --tx-split so that per-packet writes and the TX
+ * mempool only cover the headers.
+ */
+struct tx_payload {
+	/** Length of the private head of each packet */
+	uint16_t head_len;
+	/** Private mempool of the payload segments, NULL if all packets fit
+	 * in their head */
+	struct rte_mempool *mp;
+	/** Payload segment of each size of the mix, or of tx_seq without a
+	 * mix in [0]. NULL if the size fits in its head. */
+	struct rte_mbuf *tails[PKT_SEQ_SIZE_MAX];
+};
 
 /** Controller of single-pkt-pattern transmittion */
 struct tx_single {
@@ -11,12 +77,141 @@ struct tx_single {
 	struct pkt_hdr hdr;
 	/** padding for full mbuf */
 	uint8_t pad[MAX_PKT_LEN - sizeof(struct pkt_hdr)];
+	/** Number of pinned mbufs, 0 if each burst is allocated */
+	uint16_t nb_pinned;
+	/** Next pinned mbuf to send */
+	uint16_t pinned_next;
+	/** Pre-built mbufs re-sent in turn, each one pinned by refcnt. With a
+	 * size mix, mbuf i has the size of schedule entry i. */
+	struct rte_mbuf *pinned[TX_SIZE_SCHED_MAX];
+};
+
+/** Max number of randomized fields */
+#define TX_RANDOM_FIELD_MAX	6
+
+/** The field is covered by the IPv4 header checksum */
+#define TX_RANDOM_CKSUM_L3	0x1
+/** The field is covered by the L4 checksum (incl. pseudo header) */
+#define TX_RANDOM_CKSUM_L4	0x2
+/** The field is covered by the pseudo header sum of an offloaded L4
+ * checksum */
+#define TX_RANDOM_CKSUM_PHDR	0x4
+
+/** A randomized packet field */
+struct tx_random_field {
+	/** Offset from the start of the packet */
+	uint16_t offset;
+	/** Width in bytes: 2 or 4 */
+	uint8_t width;
+	/** Checksums covering this field, TX_RANDOM_CKSUM_* */
+	uint8_t cksum_flags;
+	/** Lower bound (host byte order) */
+	uint32_t min;
+	/** Number of values in the range */
+	uint64_t span;
+};
+
+/** Controller of random-pattern transmittion */
+struct tx_random {
+	/** Packet template, shared with the single pattern */
+	struct tx_single base;
+	/** Random generator */
+	struct rand_state rng;
+	/** Offset of the IPv4 header checksum */
+	uint16_t l3_cksum_off;
+	/** Offset of the L4 checksum */
+	uint16_t l4_cksum_off;
+	/** L4 protocol */
+	uint8_t l4_proto;
+	/** Number of randomized fields */
+	uint8_t nb_fields;
+	/** Randomized fields */
+	struct tx_random_field fields[TX_RANDOM_FIELD_MAX];
+};
+
+struct flow_table;
+
+/** Controller of flow-pattern transmittion */
+struct tx_flow {
+	/** Packet template, shared with the single pattern */
+	struct tx_single base;
+	/** Flow table of the socket */
+	const struct flow_table *table;
+	/** Random generator */
+	struct rand_state rng;
+	/** Next flow of the round-robin selection */
+	uint32_t next;
+	/** Number of flows to skip, so that queues take interleaved flows */
+	uint32_t stride;
+	/** Offset of the source address, of its low 32 bits with IPv6 */
+	uint16_t src_ip_off;
+	/** Offset of the destination address, of its low 32 bits with IPv6 */
+	uint16_t dst_ip_off;
+	/** Offset of the L4 header */
+	uint16_t l4_off;
+	/** Offset of the IPv4 header checksum, 0 if none or offloaded */
+	uint16_t l3_cksum_off;
+	/** Offset of the L4 checksum, 0 if none */
+	uint16_t l4_cksum_off;
+	/** IPv4 header checksum of the template */
+	uint16_t l3_cksum;
+	/** L4 checksum of the template */
+	uint16_t l4_cksum;
+	/** L4 protocol */
+	uint8_t l4_proto;
+	/** Checksums computed by the NIC, TX_CKSUM_OFFLOAD_* */
+	uint8_t cksum_offload;
+};
+
+/** Controller of template-pattern transmittion */
+struct tx_tmpl {
+	/** Packet template, shared with the single pattern */
+	struct tx_single base;
+	/** Compiled template */
+	struct pkt_tmpl tmpl;
+	/** Random generator */
+	struct rand_state rng;
+	/** Position of each inc/dec field in its range */
+	uint64_t pos[PKT_TMPL_FIELD_MAX];
+	/** Distance between two values of an inc/dec field, so that queues
+	 * take interleaved values */
+	uint64_t stride[PKT_TMPL_FIELD_MAX];
 };
 
 /** Controller of pcap-pattern transmittion */
 struct tx_pcap {
-	/** Pcap file */
-	FILE *file;
+	/** Private mempool holding all frames of this queue */
+	struct rte_mempool *mp;
+	/** Pre-loaded frames in capture order, each one pinned by refcnt */
+	struct rte_mbuf **pkts;
+	/** TX offset of each frame since the start of a loop, in cycles.
+	 * NULL if frames are paced by the TX rate. */
+	uint64_t *offsets;
+	/** Number of frames */
+	uint32_t nb_pkts;
+	/** Next frame to send */
+	uint32_t next;
+	/** Duration of one replay loop in cycles */
+	uint64_t loop_cycles;
+	/** Start cycle of the current loop */
+	uint64_t loop_start;
+	/** Number of TX queues sharing the capture, frame i goes to queue
+	 * (i % nb_txq) */
+	uint8_t nb_txq;
+};
+
+/** Controller of streaming-pcap-pattern transmittion */
+struct tx_stream {
+	/** Ring filled by the pcap reader lcore */
+	struct rte_ring *ring;
+	/** Whether the ring was empty when the last burst was due */
+	uint8_t is_starved;
+	/** Cycle when the ring ran empty */
+	uint64_t starve_start;
+	/** Number of times the ring ran empty when a burst was due */
+	uint64_t nb_underruns;
+	/** Total cycles spent waiting for the reader */
+	uint64_t starved_cycles;
 };
 
 /** TX buffer */
@@ -29,29 +224,142 @@ struct mbuf_table {
 	struct rte_mbuf *m_table[MAX_PKT_BURST];
 };
 
+/** Any size of the size mix */
+#define TX_SIZE_ANY	UINT8_MAX
+
+/** Sequence number stamping of the packets built, see seqnum.h */
+struct tx_seqnum {
+	/** Offset of the stamp, 0 if packets are not stamped */
+	uint16_t off;
+	/** Offset of the L4 checksum covering the stamp, 0 if none or
+	 * offloaded */
+	uint16_t cksum_off;
+	/** L4 protocol of that checksum */
+	uint8_t l4_proto;
+	/** Stream of the queue, SEQNUM_STREAM() of its port and queue */
+	uint32_t stream;
+	/** Sequence number of the next packet */
+	uint64_t next;
+	/** One packet every tsc_every carries its TX TSC, 0 if none */
+	uint32_t tsc_every;
+	/** Packets left before the next timestamped one */
+	uint32_t tsc_left;
+};
+
+/** Rate and packet size requested by another lcore */
+struct tx_rate_req {
+	/** Bumped once the request is written */
+	volatile uint32_t gen;
+	/** Per-queue rate in the unit of the tx_ctl, 0 to stop sending */
+	uint64_t rate;
+	/** Index in the size mix of the only size to send, or TX_SIZE_ANY */
+	uint8_t size_idx;
+};
+
+struct tx_ctl;
+
+/** Send a burst of a tx_ctl, specialized for its burst size */
+typedef int (*tx_burst_fn_t)(uint8_t portid, struct tx_ctl *ctl,
+				struct rte_mempool *mp);
+
 /** Controller of transmittion */
 struct tx_ctl {
 	/** TX queue id */
 	uint8_t queueid;
+	/** Number of TX data queues sharing the port rate */
+	uint8_t nb_txq;
 	/** tx pattern */
 	uint8_t tx_pattern;
+	/** Burst size */
+	uint16_t burst;
+	/** TX function specialized for the burst size */
+	tx_burst_fn_t tx_burst_fn;
 	/** default packet sequence */
 	struct pkt_seq tx_seq;
 	/** controller of specific pattern */
 	union {
 		struct tx_single tx_single;
+		struct tx_random tx_random;
+		struct tx_flow tx_flow;
+		struct tx_tmpl tx_tmpl;
 		struct tx_pcap tx_pcap;
+		struct tx_stream tx_stream;
 	} u;
+	/** Packet sizes of the patterns building packets */
+	struct tx_size_mix size_mix;
+	/** Shared payload segments */
+	struct tx_payload payload;
+	/** Checksums computed by the NIC, TX_CKSUM_OFFLOAD_* */
+	uint8_t cksum_offload;
+	/** Offload flags of every packet */
+	uint64_t ol_flags;
+	/** Length of the headers before the IP one, for the offloads */
+	uint16_t l2_len;
+	/** Length of the IP header, for the offloads */
+	uint16_t l3_len;
+	/** Sequence number stamping */
+	struct tx_seqnum seqnum;
 	/** TX buffer */
 	struct mbuf_table tx_buffer;
-	/** Rate control: TX rate in unit of bps */
-	uint64_t rate_bps;
-	/** Rate control: cycles per byte */
-	double rate_cycles;
-	/** Rate control: next cycle to send a burst of traffic */
-	uint64_t rate_next_cycles;
+	/** Rate control: TX rate in unit of bps, or pps if rate_pps is set */
+	uint64_t rate;
+	/** Rate control: whether the rate counts packets instead of bits */
+	uint8_t rate_pps;
+	/** Rate control: credit cost of one packet, cpu_hz in pps mode */
+	uint64_t rate_pkt_cost;
+	/** Rate control: credit cost of one wire byte, 8 * cpu_hz in bps mode */
+	uint64_t rate_byte_cost;
+	/** Rate control: average credit cost of a packet in the last burst */
+	uint64_t rate_avg_cost;
+	/** Rate control: credit earned so far, negative when in debt.
+	 * One cycle earns 'rate' units, so a packet sent at exactly the rate
+	 * costs as much as the cycles between two packets earn. */
+	int64_t rate_credit;
+	/** Rate control: max credit, bounds the catch-up after a late wakeup */
+	int64_t rate_depth;
+	/** Rate control: max cycles credited at once, keeps credit from
+	 * overflowing */
+	uint64_t rate_max_elapsed;
+	/** Rate control: last cycle the credit was updated */
+	uint64_t rate_last_cycles;
+	/** Rate control: whether the queue is silent */
+	uint8_t rate_off;
+	/** Rate request written by another lcore, see tx_ctl_request() */
+	struct tx_rate_req req;
+	/** Generation of the last rate request applied */
+	uint32_t req_gen;
+	/** In-band latency probe handed by the statistics lcore, sent behind
+	 * the data of the next burst, NULL if none. See probe.h */
+	struct rte_mbuf *volatile probe;
+	/** Rate profile: NULL if the rate is static */
+	const struct profile *profile;
+	/** Rate profile: segment of the last evaluation */
+	uint16_t profile_seg;
+	/** Rate profile: cycle the profile started at */
+	uint64_t profile_start;
+	/** Rate profile: cycle of the next evaluation */
+	uint64_t profile_next;
 };
 
+/**
+ * Parse a TX rate
+ *
+ * Format: <value>[k|m|g][bps|pps], s.t. "1G", "20Mbps", "1.5mpps".
+ * Bit rates use binary units (k = 1024), packet rates use decimal units
+ * (k = 1000), the same units stat reports them with.
+ *
+ * @param str
+ *	The string to parse
+ * @param rate
+ *	Output: the rate
+ * @param is_pps
+ *	Output: 1 if the rate is in pps, 0 if it is in bps
+ * @return
+ *	- 0 on success
+ *	- ERR_PARAM on failure
+ */
+int tx_parse_rate(const char *str, uint64_t *rate, uint8_t *is_pps);
+
 /**
  * Initialize a tx_ctl structure
  *
@@ -59,19 +367,111 @@ struct tx_ctl {
  *	Pointer to the tx_ctl structure need to initialize
  * @param port_mac
  *	The MAC address of the port who has this tx_ctl
+ * @param queueid
+ *	The TX queue driven by this tx_ctl
+ * @param nb_txq
+ *	Number of TX data queues of the port. The per-port TX rate is
+ *	split evenly across them.
+ * @param burst
+ *	Max number of packets sent at once, at most MAX_PKT_BURST
+ * @param tx_offload_capa
+ *	DEV_TX_OFFLOAD_* capabilities of the port. With --tx-cksum-offload,
+ *	the checksums the port supports are left to it.
  */
 void tx_ctl_init(struct tx_ctl *ctl, struct ether_addr *port_mac,
-				uint8_t queueid);
+				uint8_t queueid, uint8_t nb_txq, uint16_t burst,
+				uint64_t tx_offload_capa);
+
+/**
+ * Request a new rate and packet size, applied by the TX lcore before its
+ * next burst
+ *
+ * Requests come from one lcore at a time, e.g. the statistics lcore.
+ *
+ * @param ctl
+ *	Pointer to the tx_ctl structure
+ * @param port_rate
+ *	Per-port rate, in the unit the tx_ctl was initialized with. The queue
+ *	takes its share. 0 stops sending.
+ * @param size_idx
+ *	Index in the size mix of the only size to send, TX_SIZE_ANY keeps
+ *	the current sizes
+ */
+void tx_ctl_request(struct tx_ctl *ctl, uint64_t port_rate,
+				uint8_t size_idx);
+
+/**
+ * Hand an in-band probe to the TX lcore, sent behind the data of its next
+ * burst
+ *
+ * Probes come from one lcore at a time, e.g. the statistics lcore. The
+ * driver frees the probe once sent.
+ *
+ * @param ctl
+ *	Pointer to the tx_ctl structure
+ * @param pkt
+ *	The probe
+ * @return
+ *	- True if the probe was handed
+ *	- False if the previous one is not sent yet
+ */
+bool tx_ctl_inject_probe(struct tx_ctl *ctl, struct rte_mbuf *pkt);
+
+/**
+ * Check whether the last in-band probe handed is not sent yet
+ *
+ * @param ctl
+ *	Pointer to the tx_ctl structure
+ */
+bool tx_ctl_probe_pending(const struct tx_ctl *ctl);
+
+/**
+ * Take back the in-band probe not sent yet, once the TX lcore is stopped
+ *
+ * @param ctl
+ *	Pointer to the tx_ctl structure
+ * @return
+ *	The probe, NULL if none
+ */
+struct rte_mbuf *tx_ctl_take_probe(struct tx_ctl *ctl);
 
 /**
  * Setup the default packets to be sent in the mempool
  *
+ * For the pcap pattern, all frames of the capture are loaded into a
+ * private mempool on the same socket as mp.
+ *
  * @param tx_ctl
  *	Pointer to the tx_ctl structure
  * @param mp
  *	Pointer to the mempool need to be setup
+ * @return
+ *	- 0 on success
+ *	- Negative value on failure
+ */
+int tx_ctl_setup_mempool(struct tx_ctl *tx_ctl, struct rte_mempool *mp);
+
+/**
+ * Get the txq_flags matching how a tx_ctl owns its mbufs
+ *
+ * Mbufs allocated for every burst come from a single mempool with one
+ * reference, so the driver may free them with a plain mempool put.
+ * Pinned or pre-loaded mbufs rely on the refcnt and must not skip it.
+ *
+ * @param tx_ctl
+ *	Pointer to the tx_ctl structure
+ * @return
+ *	The ETH_TXQ_FLAGS_* to setup the TX queue with
+ */
+uint32_t tx_ctl_get_txq_flags(const struct tx_ctl *tx_ctl);
+
+/**
+ * Free all memory areas owned by a tx_ctl
+ *
+ * @param tx_ctl
+ *	Pointer to the tx_ctl structure
  */
-void tx_ctl_setup_mempool(struct tx_ctl *tx_ctl, struct rte_mempool *mp);
+void tx_ctl_free(struct tx_ctl *tx_ctl);
 
 /**
  * Send a set of packet buffers to a given port
@@ -83,7 +483,11 @@ void tx_ctl_setup_mempool(struct tx_ctl *tx_ctl, struct rte_mempool *mp);
  * @param mp
  *	Pointer to the tx mempool of this port
  */
-int tx_ctl_tx_burst(uint8_t portid, struct tx_ctl *ctl,
-				struct rte_mempool *mp);
+static inline int
+tx_ctl_tx_burst(uint8_t portid, struct tx_ctl *ctl,
+				struct rte_mempool *mp)
+{
+	return ctl->tx_burst_fn(portid, ctl, mp);
+}
 
 #endif /* _PKTSENDER_TRANSMITTER_H_ */